@@ -0,0 +1,78 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <blockstore.h>
+#include <chainparams.h>
+#include <clientversion.h>
+#include <net.h>
+#include <netmessagemaker.h>
+#include <random.h>
+#include <streams.h>
+#include <util.h>
+#include <validation.h>
+
+namespace block_bench {
+#include <bench/data/block413567.raw.h>
+} // namespace block_bench
+
+// Serving a witness block to a peer, by deserializing it and serializing it
+// again, or by sending the bytes the block store holds as they are.
+
+/** Write the test block to the first block file of a fresh data directory. */
+static fs::path WriteBlockFile(CDiskBlockPos& pos)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    const fs::path datadir = fs::temp_directory_path() / strprintf("bench_quebecoin_%lu", (unsigned long)GetRand(1ULL << 32));
+    fs::create_directories(datadir);
+    gArgs.ForceSetArg("-datadir", datadir.string());
+    ClearDatadirCache();
+
+    CAutoFile fileout(OpenBlockFile(CDiskBlockPos(0, 0)), SER_DISK, CLIENT_VERSION);
+    assert(!fileout.IsNull());
+    fileout << FLATDATA(Params().MessageStart()) << (unsigned int)sizeof(block_bench::block413567);
+    fileout.write((const char*)block_bench::block413567, sizeof(block_bench::block413567));
+    pos = CDiskBlockPos(0, CMessageHeader::MESSAGE_START_SIZE + sizeof(unsigned int));
+    return datadir;
+}
+
+static void ServeBlock(benchmark::State& state, bool send_stored)
+{
+    CDiskBlockPos pos;
+    const fs::path datadir = WriteBlockFile(pos);
+    BlockStore store;
+    const CNetMsgMaker msg_maker(PROTOCOL_VERSION);
+
+    while (state.KeepRunning()) {
+        RawBlock raw_block;
+        assert(store.Read(pos, Params().MessageStart(), true, raw_block));
+        CSerializedNetMsg msg;
+        if (send_stored) {
+            msg.command = NetMsgType::BLOCK;
+            msg.data.assign(raw_block.begin(), raw_block.end());
+        } else {
+            CBlock block;
+            SpanReader(SER_DISK, CLIENT_VERSION, raw_block.data(), raw_block.size()) >> block;
+            msg = msg_maker.Make(NetMsgType::BLOCK, block);
+        }
+        assert(msg.data.size() == sizeof(block_bench::block413567));
+    }
+
+    store.Clear();
+    fs::remove_all(datadir);
+}
+
+static void ServeBlockReserialized(benchmark::State& state)
+{
+    ServeBlock(state, false);
+}
+
+static void ServeBlockStored(benchmark::State& state)
+{
+    ServeBlock(state, true);
+}
+
+BENCHMARK(ServeBlockReserialized, 130);
+BENCHMARK(ServeBlockStored, 5000);
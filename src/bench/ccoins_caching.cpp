@@ -5,8 +5,12 @@
 #include <bench/bench.h>
 #include <coins.h>
 #include <policy/policy.h>
+#include <random.h>
 #include <wallet/crypter.h>
 
+#include <iostream>
+#include <set>
+#include <unordered_map>
 #include <vector>
 
 // FIXME: Dedup with SetupDummyInputs in test/transaction_tests.cpp.
@@ -85,3 +89,83 @@ static void CCoinsCaching(benchmark::State& state)
 }
 
 BENCHMARK(CCoinsCaching, 170 * 1000);
+
+// Compare the coins cache map with the std::unordered_map it replaced, using
+// entries the size of a typical P2PKH coin.
+typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsUnorderedMap;
+
+static const size_t COINS_MAP_ENTRIES = 200000;
+
+static std::vector<COutPoint> RandomOutpoints(size_t count)
+{
+    FastRandomContext rng(true);
+    std::vector<COutPoint> outpoints;
+    outpoints.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        outpoints.emplace_back(rng.rand256(), rng.randrange(4));
+    }
+    return outpoints;
+}
+
+template <typename Map>
+static void FillCoinsMap(Map& map, const std::vector<COutPoint>& outpoints)
+{
+    CScript script = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG;
+    for (const COutPoint& outpoint : outpoints) {
+        CCoinsCacheEntry entry(Coin(CTxOut(COIN, script), 1, false));
+        entry.flags = CCoinsCacheEntry::DIRTY;
+        map.emplace(outpoint, std::move(entry));
+    }
+}
+
+template <typename Map>
+static void CoinsMapInsert(benchmark::State& state, const char* name)
+{
+    const std::vector<COutPoint> outpoints = RandomOutpoints(COINS_MAP_ENTRIES);
+    static std::set<std::string> reported;
+    while (state.KeepRunning()) {
+        Map map;
+        FillCoinsMap(map, outpoints);
+        if (reported.insert(name).second) {
+            // Memory as accounted against -dbcache (see CCoinsViewCache::DynamicMemoryUsage).
+            size_t usage = memusage::DynamicUsage(map);
+            for (const auto& entry : map) {
+                usage += entry.second.coin.DynamicMemoryUsage();
+            }
+            std::cerr << name << ": " << (uint64_t)(map.size() * (double)(1 << 30) / usage) << " entries per GiB" << std::endl;
+        }
+    }
+}
+
+template <typename Map>
+static void CoinsMapLookup(benchmark::State& state)
+{
+    const std::vector<COutPoint> outpoints = RandomOutpoints(COINS_MAP_ENTRIES);
+    std::vector<COutPoint> missing(outpoints.begin(), outpoints.begin() + 1024);
+    for (COutPoint& outpoint : missing) {
+        outpoint.n += 4;
+    }
+    Map map;
+    FillCoinsMap(map, outpoints);
+    size_t i = 0;
+    uint64_t found = 0;
+    while (state.KeepRunning()) {
+        // Three hits for every miss, as when validating blocks against a warm cache.
+        found += map.find(outpoints[i % outpoints.size()]) != map.end();
+        found += map.find(outpoints[(i * 7919) % outpoints.size()]) != map.end();
+        found += map.find(outpoints[(i * 104729) % outpoints.size()]) != map.end();
+        found += map.find(missing[i % missing.size()]) != map.end();
+        i++;
+    }
+    assert(found == 3 * i);
+}
+
+static void CCoinsMapInsert(benchmark::State& state) { CoinsMapInsert<CCoinsMap>(state, "CCoinsMap"); }
+static void CCoinsUnorderedMapInsert(benchmark::State& state) { CoinsMapInsert<CCoinsUnorderedMap>(state, "std::unordered_map"); }
+static void CCoinsMapLookup(benchmark::State& state) { CoinsMapLookup<CCoinsMap>(state); }
+static void CCoinsUnorderedMapLookup(benchmark::State& state) { CoinsMapLookup<CCoinsUnorderedMap>(state); }
+
+BENCHMARK(CCoinsMapInsert, 5);
+BENCHMARK(CCoinsUnorderedMapInsert, 5);
+BENCHMARK(CCoinsMapLookup, 1000 * 1000);
+BENCHMARK(CCoinsUnorderedMapLookup, 1000 * 1000);
@@ -10,6 +10,8 @@
 #include <vector>
 #include <boost/thread/thread.hpp>
 #include <random.h>
+#include <crypto/sha256.h>
+#include <uint256.h>
 
 
 static const int MIN_CORES = 2;
@@ -60,3 +62,47 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State& state)
     tg.join_all();
 }
 BENCHMARK(CCheckQueueSpeedPrevectorJob, 1400);
+
+// This Benchmark reports how the CheckQueue scales from 1 to 32 threads (the
+// master included) with many cheap checks, as in a block full of small
+// transactions, where contention on the queue matters most.
+static void CCheckQueueScaling(benchmark::State& state, int nThreads)
+{
+    struct HashJob {
+        uint256 data;
+        bool operator()()
+        {
+            CSHA256().Write(data.begin(), 32).Finalize(data.begin());
+            return true;
+        }
+        void swap(HashJob& x){std::swap(data, x.data);};
+    };
+    CCheckQueue<HashJob> queue {QUEUE_BATCH_SIZE};
+    boost::thread_group tg;
+    for (auto x = 0; x < nThreads - 1; ++x) {
+       tg.create_thread([&]{queue.Thread();});
+    }
+    while (state.KeepRunning()) {
+        CCheckQueueControl<HashJob> control(&queue);
+        std::vector<std::vector<HashJob>> vBatches(BATCHES);
+        for (auto& vChecks : vBatches) {
+            vChecks.resize(BATCH_SIZE);
+            control.Add(vChecks);
+        }
+        control.Wait();
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+static void CCheckQueueScaling1(benchmark::State& state) { CCheckQueueScaling(state, 1); }
+static void CCheckQueueScaling2(benchmark::State& state) { CCheckQueueScaling(state, 2); }
+static void CCheckQueueScaling4(benchmark::State& state) { CCheckQueueScaling(state, 4); }
+static void CCheckQueueScaling8(benchmark::State& state) { CCheckQueueScaling(state, 8); }
+static void CCheckQueueScaling16(benchmark::State& state) { CCheckQueueScaling(state, 16); }
+static void CCheckQueueScaling32(benchmark::State& state) { CCheckQueueScaling(state, 32); }
+BENCHMARK(CCheckQueueScaling1, 500);
+BENCHMARK(CCheckQueueScaling2, 500);
+BENCHMARK(CCheckQueueScaling4, 500);
+BENCHMARK(CCheckQueueScaling8, 500);
+BENCHMARK(CCheckQueueScaling16, 500);
+BENCHMARK(CCheckQueueScaling32, 500);
@@ -0,0 +1,159 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <coins.h>
+#include <crypto/common.h>
+#include <dbwrapper.h>
+#include <primitives/transaction.h>
+#include <random.h>
+#include <script/script.h>
+#include <util.h>
+
+#include <vector>
+
+// A chainstate access trace, replayed against each database profile.
+//
+// The trace is recorded once from a deterministic model of connecting
+// blocks: each block reads the coins it spends, many of them recently
+// created, looks up some outputs that do not exist, as mempool acceptance
+// does, and then writes its new coins and erases the spent ones in one
+// batch, as a cache flush would.
+
+static const char DB_COIN = 'C';
+static const size_t TRACE_DB_CACHE = 8 << 20;
+static const int TRACE_INITIAL_TXS = 100000;
+static const int TRACE_BLOCKS = 200;
+static const int TRACE_SPENDS_PER_BLOCK = 1000;
+static const int TRACE_MISSES_PER_BLOCK = 200;
+static const int TRACE_TXS_PER_BLOCK = 600;
+
+struct TraceBlock
+{
+    std::vector<COutPoint> reads;
+    std::vector<COutPoint> writes;
+    std::vector<COutPoint> erases;
+};
+
+struct ChainstateTrace
+{
+    std::vector<COutPoint> initial_coins;
+    std::vector<TraceBlock> blocks;
+};
+
+/** The coin stored for an outpoint: a pay-to-pubkey-hash output derived from it. */
+static Coin MakeCoin(const COutPoint& outpoint, int height)
+{
+    const unsigned char* txid = outpoint.hash.begin();
+    CScript script = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(txid, txid + 20) << OP_EQUALVERIFY << OP_CHECKSIG;
+    const CAmount value = (ReadLE64(txid + 20) + outpoint.n) % (50 * COIN);
+    return Coin(CTxOut(value, script), height, false);
+}
+
+static void AddTxOutputs(FastRandomContext& rng, std::vector<COutPoint>& outputs)
+{
+    const uint256 txid = rng.rand256();
+    outputs.emplace_back(txid, 0);
+    outputs.emplace_back(txid, 1);
+}
+
+static const ChainstateTrace& GetTrace()
+{
+    static ChainstateTrace trace;
+    if (!trace.blocks.empty()) {
+        return trace;
+    }
+
+    FastRandomContext rng(true);
+    for (int i = 0; i < TRACE_INITIAL_TXS; ++i) {
+        AddTxOutputs(rng, trace.initial_coins);
+    }
+    std::vector<COutPoint> unspent = trace.initial_coins;
+    for (int i = 0; i < TRACE_BLOCKS; ++i) {
+        TraceBlock block;
+        for (int j = 0; j < TRACE_SPENDS_PER_BLOCK; ++j) {
+            // Half of the spends are of the most recent tenth of the coins.
+            const size_t recent = unspent.size() / 10;
+            const size_t index = rng.randbool() ? unspent.size() - 1 - rng.randrange(recent) : rng.randrange(unspent.size());
+            block.reads.push_back(unspent[index]);
+            block.erases.push_back(unspent[index]);
+            unspent[index] = unspent.back();
+            unspent.pop_back();
+        }
+        for (int j = 0; j < TRACE_MISSES_PER_BLOCK; ++j) {
+            block.reads.emplace_back(rng.rand256(), 0);
+        }
+        for (int j = 0; j < TRACE_TXS_PER_BLOCK; ++j) {
+            AddTxOutputs(rng, block.writes);
+        }
+        unspent.insert(unspent.end(), block.writes.begin(), block.writes.end());
+        trace.blocks.push_back(std::move(block));
+    }
+    return trace;
+}
+
+static void ReplayChainstateTrace(benchmark::State& state, DBProfile profile)
+{
+    const ChainstateTrace& trace = GetTrace();
+    const fs::path path = fs::temp_directory_path() / strprintf("bench_quebecoin_db_%lu", (unsigned long)GetRand(1ULL << 32));
+    {
+        CDBWrapper db(path, TRACE_DB_CACHE, false, true, true, profile);
+        CDBBatch batch(db);
+        for (const COutPoint& outpoint : trace.initial_coins) {
+            batch.Write(std::make_pair(DB_COIN, outpoint), MakeCoin(outpoint, 0));
+            if (batch.SizeEstimate() > (1 << 20)) {
+                db.WriteBatch(batch);
+                batch.Clear();
+            }
+        }
+        db.WriteBatch(batch);
+
+        // Once the trace runs out it starts over, reading coins that are
+        // gone and writing ones that exist already, which is close enough.
+        size_t height = 0;
+        while (state.KeepRunning()) {
+            const TraceBlock& block = trace.blocks[height % trace.blocks.size()];
+            ++height;
+            Coin coin;
+            for (const COutPoint& outpoint : block.reads) {
+                db.Read(std::make_pair(DB_COIN, outpoint), coin);
+            }
+            CDBBatch block_batch(db);
+            for (const COutPoint& outpoint : block.erases) {
+                block_batch.Erase(std::make_pair(DB_COIN, outpoint));
+            }
+            for (const COutPoint& outpoint : block.writes) {
+                block_batch.Write(std::make_pair(DB_COIN, outpoint), MakeCoin(outpoint, height));
+            }
+            db.WriteBatch(block_batch);
+        }
+    }
+    fs::remove_all(path);
+}
+
+static void ChainstateTraceDefault(benchmark::State& state)
+{
+    ReplayChainstateTrace(state, DBProfile::DEFAULT);
+}
+
+static void ChainstateTraceChainstate(benchmark::State& state)
+{
+    ReplayChainstateTrace(state, DBProfile::CHAINSTATE);
+}
+
+static void ChainstateTraceBlockIndex(benchmark::State& state)
+{
+    ReplayChainstateTrace(state, DBProfile::BLOCK_INDEX);
+}
+
+static void ChainstateTraceIndex(benchmark::State& state)
+{
+    ReplayChainstateTrace(state, DBProfile::INDEX);
+}
+
+BENCHMARK(ChainstateTraceDefault, 40);
+BENCHMARK(ChainstateTraceChainstate, 40);
+BENCHMARK(ChainstateTraceBlockIndex, 40);
+BENCHMARK(ChainstateTraceIndex, 40);
@@ -0,0 +1,94 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <arith_uint256.h>
+#include <policy/policy.h>
+#include <txmempool.h>
+
+#include <vector>
+
+// Connecting a block that confirms the first part of each family of
+// transactions in the mempool, then disconnecting it again and adding its
+// transactions back, as UpdateMempoolForReorg does.
+
+static CTransactionRef MakeTx(const std::vector<COutPoint>& vPrevouts, size_t nOutputs)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(vPrevouts.size());
+    for (size_t i = 0; i < vPrevouts.size(); ++i) {
+        tx.vin[i].prevout = vPrevouts[i];
+        tx.vin[i].scriptSig = CScript() << OP_1;
+    }
+    tx.vout.resize(nOutputs);
+    for (CTxOut& out : tx.vout) {
+        out.scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        out.nValue = COIN;
+    }
+    return MakeTransactionRef(tx);
+}
+
+static void AddTx(const CTransactionRef& tx, CTxMemPool& pool)
+{
+    LockPoints lp;
+    pool.addUnchecked(tx->GetHash(), CTxMemPoolEntry(tx, 1000 + tx->vin[0].prevout.hash.GetUint64(0) % 10000, 0, 1, false, 4, lp));
+}
+
+static void ReorgBlock(benchmark::State& state, const std::vector<CTransactionRef>& vBlock, const std::vector<CTransactionRef>& vRest)
+{
+    CTxMemPool pool;
+    for (const CTransactionRef& tx : vBlock) AddTx(tx, pool);
+    for (const CTransactionRef& tx : vRest) AddTx(tx, pool);
+    std::vector<uint256> vHashes;
+    for (const CTransactionRef& tx : vBlock) vHashes.push_back(tx->GetHash());
+
+    while (state.KeepRunning()) {
+        pool.removeForBlock(vBlock, 1);
+        for (const CTransactionRef& tx : vBlock) AddTx(tx, pool);
+        pool.UpdateTransactionsFromBlock(vHashes);
+    }
+    assert(pool.size() == vBlock.size() + vRest.size());
+}
+
+// 40 chains of 25 transactions, the first 12 of each in the block.
+static void MempoolReorgChain25(benchmark::State& state)
+{
+    std::vector<CTransactionRef> vBlock, vRest;
+    for (uint32_t nChain = 0; nChain < 40; ++nChain) {
+        COutPoint prevout(ArithToUint256(arith_uint256(nChain + 1)), 0);
+        for (int i = 0; i < 25; ++i) {
+            CTransactionRef tx = MakeTx({prevout}, 1);
+            (i < 12 ? vBlock : vRest).push_back(tx);
+            prevout = COutPoint(tx->GetHash(), 0);
+        }
+    }
+    ReorgBlock(state, vBlock, vRest);
+}
+
+// 20 transactions in the block, each paying to 50 transactions that are
+// spent together by 5 more in the mempool.
+static void MempoolReorgFanout(benchmark::State& state)
+{
+    std::vector<CTransactionRef> vBlock, vRest;
+    for (uint32_t nRoot = 0; nRoot < 20; ++nRoot) {
+        CTransactionRef root = MakeTx({COutPoint(ArithToUint256(arith_uint256(nRoot + 1)), 0)}, 50);
+        vBlock.push_back(root);
+        std::vector<COutPoint> vChildOutputs;
+        for (uint32_t i = 0; i < 50; ++i) {
+            CTransactionRef child = MakeTx({COutPoint(root->GetHash(), i)}, 5);
+            vRest.push_back(child);
+            for (uint32_t j = 0; j < 5; ++j) vChildOutputs.emplace_back(child->GetHash(), j);
+        }
+        for (uint32_t j = 0; j < 5; ++j) {
+            std::vector<COutPoint> vPrevouts;
+            for (uint32_t i = 0; i < 50; ++i) vPrevouts.push_back(vChildOutputs[i * 5 + j]);
+            vRest.push_back(MakeTx(vPrevouts, 1));
+        }
+    }
+    ReorgBlock(state, vBlock, vRest);
+}
+
+BENCHMARK(MempoolReorgChain25, 50);
+BENCHMARK(MempoolReorgFanout, 50);
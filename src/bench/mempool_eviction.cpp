@@ -2,10 +2,13 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <arith_uint256.h>
 #include <bench/bench.h>
 #include <policy/policy.h>
+#include <reverse_iterator.h>
 #include <txmempool.h>
 
+#include <iostream>
 #include <list>
 #include <vector>
 
@@ -111,4 +114,65 @@ static void MempoolEviction(benchmark::State& state)
     }
 }
 
+// Chains of up to three transactions, as in a mempool where most
+// transactions have no unconfirmed parents but some spend each other.
+static std::vector<CTransactionRef> MakeChains(uint32_t nCount)
+{
+    std::vector<CTransactionRef> vtx;
+    for (uint32_t i = 0; i < nCount; ++i) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        if (i % 3 == 0) {
+            tx.vin[0].prevout = COutPoint(ArithToUint256(arith_uint256(i + 1)), 0);
+        } else {
+            tx.vin[0].prevout = COutPoint(vtx.back()->GetHash(), 0);
+        }
+        tx.vin[0].scriptSig = CScript() << OP_1;
+        tx.vout.resize(2);
+        tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        tx.vout[0].nValue = 10 * COIN;
+        tx.vout[1].scriptPubKey = CScript() << OP_2 << OP_EQUAL;
+        tx.vout[1].nValue = 10 * COIN;
+        vtx.push_back(MakeTransactionRef(tx));
+    }
+    return vtx;
+}
+
+// Adding 3000 transactions and removing them again, both one at a time.
+static void MempoolInsertRemove(benchmark::State& state)
+{
+    const std::vector<CTransactionRef> vtx = MakeChains(3000);
+    CTxMemPool pool;
+
+    while (state.KeepRunning()) {
+        for (const CTransactionRef& tx : vtx) {
+            AddTx(*tx, 1000 + tx->vin[0].prevout.hash.GetUint64(0) % 10000, pool);
+        }
+        for (const CTransactionRef& tx : reverse_iterate(vtx)) {
+            pool.removeRecursive(*tx);
+        }
+    }
+}
+
+// Filling a mempool with 1 MiB of transactions. The number of entries that
+// fit is printed along with the time taken.
+static void MempoolEntriesPerMiB(benchmark::State& state)
+{
+    const std::vector<CTransactionRef> vtx = MakeChains(10000);
+    CTxMemPool pool;
+    size_t nEntries = 0;
+
+    while (state.KeepRunning()) {
+        pool.clear();
+        nEntries = 0;
+        while (pool.DynamicMemoryUsage() < (1 << 20)) {
+            const CTransactionRef& tx = vtx[nEntries++];
+            AddTx(*tx, 1000, pool);
+        }
+    }
+    std::cerr << "# MempoolEntriesPerMiB: " << nEntries << " entries" << std::endl;
+}
+
 BENCHMARK(MempoolEviction, 41000);
+BENCHMARK(MempoolInsertRemove, 5);
+BENCHMARK(MempoolEntriesPerMiB, 50);
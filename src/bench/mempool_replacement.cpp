@@ -0,0 +1,102 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <arith_uint256.h>
+#include <policy/rbf.h>
+#include <txmempool.h>
+
+#include <vector>
+
+// Evaluating what replacing the roots of families of mempool transactions
+// would evict, as AcceptToMemoryPoolWorker does for every fee bump.
+
+static CTransactionRef MakeTx(const std::vector<COutPoint>& vPrevouts, size_t nOutputs)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(vPrevouts.size());
+    for (size_t i = 0; i < vPrevouts.size(); ++i) {
+        tx.vin[i].prevout = vPrevouts[i];
+        tx.vin[i].scriptSig = CScript() << OP_1;
+        tx.vin[i].nSequence = MAX_BIP125_RBF_SEQUENCE;
+    }
+    tx.vout.resize(nOutputs);
+    for (CTxOut& out : tx.vout) {
+        out.scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        out.nValue = COIN;
+    }
+    return MakeTransactionRef(tx);
+}
+
+static CTxMemPool::txiter AddTx(const CTransactionRef& tx, CTxMemPool& pool)
+{
+    LockPoints lp;
+    pool.addUnchecked(tx->GetHash(), CTxMemPoolEntry(tx, 1000 + tx->vin[0].prevout.hash.GetUint64(0) % 10000, 0, 1, false, 4, lp));
+    return pool.mapTx.find(tx->GetHash());
+}
+
+/** Add nFamilies families to pool, each a root paying to nChildren chains of
+ *  nDepth transactions, and return their roots */
+static std::vector<CTxMemPool::txiter> AddFamilies(CTxMemPool& pool, uint32_t nFamilies, uint32_t nChildren, uint32_t nDepth)
+{
+    std::vector<CTxMemPool::txiter> vRoots;
+    for (uint32_t nFamily = 0; nFamily < nFamilies; ++nFamily) {
+        CTransactionRef root = MakeTx({COutPoint(ArithToUint256(arith_uint256(nFamily + 1)), 0)}, nChildren);
+        vRoots.push_back(AddTx(root, pool));
+        for (uint32_t i = 0; i < nChildren; ++i) {
+            COutPoint prevout(root->GetHash(), i);
+            for (uint32_t j = 0; j < nDepth; ++j) {
+                CTransactionRef tx = MakeTx({prevout}, 1);
+                AddTx(tx, pool);
+                prevout = COutPoint(tx->GetHash(), 0);
+            }
+        }
+    }
+    return vRoots;
+}
+
+static void EvaluateReplacements(benchmark::State& state, CTxMemPool& pool, const std::vector<CTxMemPool::txiter>& vRoots,
+                                 size_t nConflicts, bool fExpectAccepted)
+{
+    LOCK(pool.cs);
+    while (state.KeepRunning()) {
+        // Every window of nConflicts roots is one replacement
+        for (size_t i = 0; i + nConflicts <= vRoots.size(); i += nConflicts) {
+            CTxMemPool::setEntries setConflicting(vRoots.begin() + i, vRoots.begin() + i + nConflicts);
+            CTxMemPool::ReplacementSummary summary;
+            bool fAccepted = pool.CalculateReplacementSummary(setConflicting, MAX_BIP125_REPLACEMENT_CANDIDATES, summary);
+            assert(fAccepted == fExpectAccepted);
+        }
+    }
+}
+
+// 100 replacements of a single transaction with 24 descendants in 4 chains.
+static void MempoolReplaceOne(benchmark::State& state)
+{
+    CTxMemPool pool;
+    std::vector<CTxMemPool::txiter> vRoots = AddFamilies(pool, 100, 4, 6);
+    EvaluateReplacements(state, pool, vRoots, 1, true);
+}
+
+// 25 replacements of 4 transactions at once, evicting 100 in all.
+static void MempoolReplaceMany(benchmark::State& state)
+{
+    CTxMemPool pool;
+    std::vector<CTxMemPool::txiter> vRoots = AddFamilies(pool, 100, 4, 6);
+    EvaluateReplacements(state, pool, vRoots, 4, true);
+}
+
+// 100 replacements of a transaction with 500 descendants, all turned away
+// before any of them is visited.
+static void MempoolReplaceTooMany(benchmark::State& state)
+{
+    CTxMemPool pool;
+    std::vector<CTxMemPool::txiter> vRoots = AddFamilies(pool, 100, 20, 25);
+    EvaluateReplacements(state, pool, vRoots, 1, false);
+}
+
+BENCHMARK(MempoolReplaceOne, 500);
+BENCHMARK(MempoolReplaceMany, 500);
+BENCHMARK(MempoolReplaceTooMany, 500);
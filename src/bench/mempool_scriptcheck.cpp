@@ -0,0 +1,122 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <checkqueue.h>
+#include <key.h>
+#include <policy/policy.h>
+#include <script/sigcache.h>
+#include <script/standard.h>
+#include <util.h>
+#include <validation.h>
+
+#include <array>
+#include <vector>
+
+#include <boost/thread/thread.hpp>
+
+static const int MIN_CORES = 2;
+static const unsigned int QUEUE_BATCH_SIZE = 128;
+
+// Build a transaction spending nInputs P2WPKH outputs of txCredit, signed.
+static CMutableTransaction BuildSignedSpend(size_t nInputs, CMutableTransaction& txCredit)
+{
+    CKey key;
+    static const std::array<unsigned char, 32> vchKey = {
+        {
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1
+        }
+    };
+    key.Set(vchKey.begin(), vchKey.end(), true);
+    CPubKey pubkey = key.GetPubKey();
+    uint160 pubkeyHash;
+    CHash160().Write(pubkey.begin(), pubkey.size()).Finalize(pubkeyHash.begin());
+    CScript witScriptPubkey = CScript() << OP_DUP << OP_HASH160 << ToByteVector(pubkeyHash) << OP_EQUALVERIFY << OP_CHECKSIG;
+
+    txCredit.vin.resize(1);
+    txCredit.vin[0].prevout.SetNull();
+    txCredit.vout.resize(nInputs);
+    for (CTxOut& out : txCredit.vout) {
+        out.scriptPubKey = CScript() << OP_0 << ToByteVector(pubkeyHash);
+        out.nValue = 1000;
+    }
+
+    CMutableTransaction txSpend;
+    txSpend.vin.resize(nInputs);
+    txSpend.vout.resize(1);
+    txSpend.vout[0].nValue = 1000 * nInputs;
+    for (size_t i = 0; i < nInputs; ++i) {
+        txSpend.vin[i].prevout = COutPoint(txCredit.GetHash(), i);
+    }
+    for (size_t i = 0; i < nInputs; ++i) {
+        CScriptWitness& witness = txSpend.vin[i].scriptWitness;
+        witness.stack.emplace_back();
+        key.Sign(SignatureHash(witScriptPubkey, txSpend, i, SIGHASH_ALL, txCredit.vout[i].nValue, SIGVERSION_WITNESS_V0), witness.stack.back(), 0);
+        witness.stack.back().push_back(static_cast<unsigned char>(SIGHASH_ALL));
+        witness.stack.push_back(ToByteVector(pubkey));
+    }
+    return txSpend;
+}
+
+// Script checks of a transaction with nInputs inputs, as done when it is
+// accepted to the mempool: either all on the calling thread, or spread over
+// a CCheckQueue the way transactions with at least
+// MEMPOOL_PARALLEL_SCRIPT_CHECK_INPUTS inputs are. Nothing is stored in the
+// signature cache, so every iteration verifies each signature.
+static void MempoolScriptChecks(benchmark::State& state, size_t nInputs, bool fParallel)
+{
+    static bool fSigCacheReady = false;
+    if (!fSigCacheReady) {
+        InitSignatureCache();
+        fSigCacheReady = true;
+    }
+
+    CMutableTransaction txCredit;
+    const CTransaction tx(BuildSignedSpend(nInputs, txCredit));
+    PrecomputedTransactionData txdata(tx);
+    const unsigned int flags = STANDARD_SCRIPT_VERIFY_FLAGS;
+
+    CCheckQueue<CScriptCheck> queue {QUEUE_BATCH_SIZE};
+    boost::thread_group tg;
+    if (fParallel) {
+        for (auto x = 0; x < std::max(MIN_CORES, GetNumCores()) - 1; ++x) {
+            tg.create_thread([&]{queue.Thread();});
+        }
+    }
+
+    while (state.KeepRunning()) {
+        std::vector<CScriptCheck> vChecks;
+        vChecks.reserve(nInputs);
+        for (size_t i = 0; i < nInputs; ++i) {
+            vChecks.emplace_back(txCredit.vout[i], tx, i, flags, false, &txdata);
+        }
+        if (fParallel) {
+            CCheckQueueControl<CScriptCheck> control(&queue);
+            control.Add(vChecks);
+            bool fOk = control.Wait();
+            assert(fOk);
+        } else {
+            for (CScriptCheck& check : vChecks) {
+                bool fOk = check();
+                assert(fOk);
+            }
+        }
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+static void MempoolScriptChecks1Serial(benchmark::State& state) { MempoolScriptChecks(state, 1, false); }
+static void MempoolScriptChecks1Parallel(benchmark::State& state) { MempoolScriptChecks(state, 1, true); }
+static void MempoolScriptChecks50Serial(benchmark::State& state) { MempoolScriptChecks(state, 50, false); }
+static void MempoolScriptChecks50Parallel(benchmark::State& state) { MempoolScriptChecks(state, 50, true); }
+static void MempoolScriptChecks500Serial(benchmark::State& state) { MempoolScriptChecks(state, 500, false); }
+static void MempoolScriptChecks500Parallel(benchmark::State& state) { MempoolScriptChecks(state, 500, true); }
+
+BENCHMARK(MempoolScriptChecks1Serial, 6000);
+BENCHMARK(MempoolScriptChecks1Parallel, 6000);
+BENCHMARK(MempoolScriptChecks50Serial, 120);
+BENCHMARK(MempoolScriptChecks50Parallel, 120);
+BENCHMARK(MempoolScriptChecks500Serial, 12);
+BENCHMARK(MempoolScriptChecks500Parallel, 12);
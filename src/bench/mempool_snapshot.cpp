@@ -0,0 +1,106 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <arith_uint256.h>
+#include <core_io.h>
+#include <policy/policy.h>
+#include <rpc/blockchain.h>
+#include <txmempool.h>
+#include <univalue.h>
+#include <validation.h>
+
+#include <atomic>
+#include <thread>
+
+// Adding transactions to a mempool of 20000 while another thread keeps
+// listing it in full, as getrawmempool true does. The time measured is that
+// of the part of AcceptToMemoryPool that holds mempool.cs.
+
+static const int DUMP_MEMPOOL_SIZE = 20000;
+
+static CTransactionRef MakeTx(uint32_t n)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(ArithToUint256(arith_uint256(n + 1)), 0);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vout.resize(2);
+    tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx.vout[0].nValue = 10 * COIN;
+    tx.vout[1].scriptPubKey = CScript() << OP_2 << OP_EQUAL;
+    tx.vout[1].nValue = 10 * COIN;
+    return MakeTransactionRef(tx);
+}
+
+static void AddTx(const CTransactionRef& tx, CTxMemPool& pool)
+{
+    LockPoints lp;
+    pool.addUnchecked(tx->GetHash(), CTxMemPoolEntry(tx, 1000 + tx->vin[0].prevout.hash.GetUint64(0) % 10000, 0, 1, false, 4, lp));
+}
+
+/** A full listing formatted while holding mempool.cs, as before snapshots */
+static UniValue LockedMempoolToJSON()
+{
+    LOCK(mempool.cs);
+    UniValue o(UniValue::VOBJ);
+    for (const CTxMemPoolEntry& e : mempool.mapTx) {
+        UniValue info(UniValue::VOBJ);
+        info.push_back(Pair("size", (int)e.GetTxSize()));
+        info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
+        info.push_back(Pair("modifiedfee", ValueFromAmount(e.GetModifiedFee())));
+        info.push_back(Pair("time", e.GetTime()));
+        info.push_back(Pair("height", (int)e.GetHeight()));
+        info.push_back(Pair("descendantcount", e.GetCountWithDescendants()));
+        info.push_back(Pair("descendantsize", e.GetSizeWithDescendants()));
+        info.push_back(Pair("descendantfees", e.GetModFeesWithDescendants()));
+        info.push_back(Pair("ancestorcount", e.GetCountWithAncestors()));
+        info.push_back(Pair("ancestorsize", e.GetSizeWithAncestors()));
+        info.push_back(Pair("ancestorfees", e.GetModFeesWithAncestors()));
+        info.push_back(Pair("wtxid", e.GetTx().GetWitnessHash().ToString()));
+        info.push_back(Pair("depends", UniValue(UniValue::VARR)));
+        o.push_back(Pair(e.GetTx().GetHash().ToString(), info));
+    }
+    return o;
+}
+
+static void MempoolAddDuringDump(benchmark::State& state, bool fSnapshot)
+{
+    mempool.clear();
+    for (int i = 0; i < DUMP_MEMPOOL_SIZE; ++i) {
+        AddTx(MakeTx(i), mempool);
+    }
+    const CTransactionRef tx = MakeTx(DUMP_MEMPOOL_SIZE);
+
+    std::atomic<bool> fStop(false);
+    std::thread dumper([&] {
+        while (!fStop) {
+            UniValue o = fSnapshot ? mempoolToJSON(true) : LockedMempoolToJSON();
+            assert(o.size() >= DUMP_MEMPOOL_SIZE);
+        }
+    });
+
+    while (state.KeepRunning()) {
+        AddTx(tx, mempool);
+        mempool.removeRecursive(*tx);
+    }
+
+    fStop = true;
+    dumper.join();
+    mempool.clear();
+}
+
+static void MempoolAddDuringLockedDump(benchmark::State& state)
+{
+    MempoolAddDuringDump(state, false);
+}
+
+static void MempoolAddDuringSnapshotDump(benchmark::State& state)
+{
+    MempoolAddDuringDump(state, true);
+}
+
+BENCHMARK(MempoolAddDuringLockedDump, 200);
+BENCHMARK(MempoolAddDuringSnapshotDump, 200);
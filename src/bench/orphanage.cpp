@@ -0,0 +1,63 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <arith_uint256.h>
+#include <net_processing.h>
+#include <txorphanage.h>
+
+#include <vector>
+
+// 100 peers flood the orphan pool in turn, each orphan followed by the
+// limit check the node runs after adding one. Then the parents of the
+// orphans still held arrive and their children are looked up.
+
+static const int FLOOD_PEERS = 100;
+static const int FLOOD_ORPHANS_PER_PEER = 50;
+
+static void OrphanageFlood(benchmark::State& state)
+{
+    std::vector<CTransactionRef> vParents;
+    std::vector<std::vector<CTransactionRef>> vOrphans(FLOOD_PEERS);
+    for (int nPeer = 0; nPeer < FLOOD_PEERS; ++nPeer) {
+        CMutableTransaction parent;
+        parent.vin.resize(1);
+        parent.vin[0].prevout = COutPoint(ArithToUint256(arith_uint256(nPeer + 1)), 0);
+        parent.vout.resize(FLOOD_ORPHANS_PER_PEER);
+        for (CTxOut& out : parent.vout) {
+            out.scriptPubKey = CScript() << OP_1;
+            out.nValue = COIN;
+        }
+        vParents.push_back(MakeTransactionRef(parent));
+        for (int i = 0; i < FLOOD_ORPHANS_PER_PEER; ++i) {
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = COutPoint(parent.GetHash(), i);
+            tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(100 * (nPeer % 5), 0x01);
+            tx.vout.resize(1);
+            tx.vout[0].scriptPubKey = CScript() << OP_1;
+            tx.vout[0].nValue = COIN;
+            vOrphans[nPeer].push_back(MakeTransactionRef(tx));
+        }
+    }
+
+    while (state.KeepRunning()) {
+        TxOrphanage orphanage;
+        for (int i = 0; i < FLOOD_ORPHANS_PER_PEER; ++i) {
+            for (int nPeer = 0; nPeer < FLOOD_PEERS; ++nPeer) {
+                orphanage.AddTx(vOrphans[nPeer][i], nPeer);
+                orphanage.LimitOrphans(DEFAULT_MAX_ORPHAN_TRANSACTIONS * 10);
+            }
+        }
+        for (const CTransactionRef& parent : vParents) {
+            for (const auto& child : orphanage.GetChildren(*parent)) {
+                orphanage.EraseTx(child.first->GetHash());
+            }
+        }
+        assert(orphanage.Size() == 0);
+    }
+}
+
+BENCHMARK(OrphanageFlood, 5);
@@ -0,0 +1,131 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <clientversion.h>
+#include <coins.h>
+#include <hash.h>
+#include <random.h>
+#include <streams.h>
+#include <undo.h>
+#include <util.h>
+#include <validation.h>
+
+// The undo data side of a reorganization by 10 blocks: reading the undo
+// data of each block and restoring the coins it spent, with the undo data
+// stored in the original and in the compact format.
+
+static const int REORG_DEPTH = 10;
+static const int REORG_TIP_HEIGHT = 500000;
+static const int REORG_INPUTS_PER_TX = 2;
+static const int REORG_TXS_PER_BLOCK = 1000;
+
+/** Undo data with a mix of output types and ages, and some address reuse. */
+static CBlockUndo MakeBlockUndo(FastRandomContext& rng, int nHeight)
+{
+    CBlockUndo blockundo;
+    std::vector<CScript> scripts;
+    blockundo.vtxundo.resize(REORG_TXS_PER_BLOCK);
+    for (CTxUndo& txundo : blockundo.vtxundo) {
+        for (int i = 0; i < REORG_INPUTS_PER_TX; ++i) {
+            CScript script;
+            const uint256 hash = rng.rand256();
+            const int kind = rng.randrange(100);
+            if (!scripts.empty() && kind < 15) {
+                script = scripts[rng.randrange(scripts.size())];
+            } else if (kind < 55) {
+                script << OP_DUP << OP_HASH160 << std::vector<unsigned char>(hash.begin(), hash.begin() + 20) << OP_EQUALVERIFY << OP_CHECKSIG;
+            } else if (kind < 70) {
+                script << OP_HASH160 << std::vector<unsigned char>(hash.begin(), hash.begin() + 20) << OP_EQUAL;
+            } else if (kind < 92) {
+                script << OP_0 << std::vector<unsigned char>(hash.begin(), hash.begin() + 20);
+            } else if (kind < 97) {
+                script << OP_0 << std::vector<unsigned char>(hash.begin(), hash.end());
+            } else {
+                script << OP_RETURN << std::vector<unsigned char>(hash.begin(), hash.end());
+            }
+            scripts.push_back(script);
+            // Most spent outputs are young
+            const int nAge = rng.randbool() ? rng.randrange(100) : rng.randrange(nHeight);
+            txundo.vprevout.emplace_back(CTxOut(rng.randrange(50 * COIN), script), nHeight - nAge, rng.randrange(100) == 0);
+        }
+    }
+    return blockundo;
+}
+
+static void ReorgUndo(benchmark::State& state, bool fCompact)
+{
+    SelectParams(CBaseChainParams::REGTEST);
+    const fs::path datadir = fs::temp_directory_path() / strprintf("bench_quebecoin_%lu", (unsigned long)GetRand(1ULL << 32));
+    gArgs.ForceSetArg("-datadir", datadir.string());
+    ClearDatadirCache();
+    fs::create_directories(GetDataDir() / "blocks");
+
+    // Write the undo data of the blocks to disconnect, as UndoWriteToDisk does
+    FastRandomContext rng(true);
+    std::vector<uint256> hashes(REORG_DEPTH + 1);
+    std::vector<CBlockIndex> vIndex(REORG_DEPTH + 1);
+    {
+        CAutoFile fileout(fsbridge::fopen(GetDataDir() / "blocks" / "rev00000.dat", "wb"), SER_DISK, CLIENT_VERSION);
+        for (int i = 0; i <= REORG_DEPTH; ++i) {
+            hashes[i] = rng.rand256();
+            vIndex[i].phashBlock = &hashes[i];
+            vIndex[i].nHeight = REORG_TIP_HEIGHT - REORG_DEPTH + i;
+            if (i == 0) continue;
+            vIndex[i].pprev = &vIndex[i - 1];
+
+            CBlockUndo blockundo = MakeBlockUndo(rng, vIndex[i].nHeight);
+            CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+            hasher << hashes[i - 1];
+            fileout << FLATDATA(Params().MessageStart());
+            if (fCompact) {
+                const CompactBlockUndo compact(blockundo, vIndex[i].nHeight);
+                fileout << (unsigned int)GetSerializeSize(compact, SER_DISK, CLIENT_VERSION);
+                vIndex[i].nUndoPos = ftell(fileout.Get());
+                fileout << compact;
+                hasher << compact;
+            } else {
+                fileout << (unsigned int)GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION);
+                vIndex[i].nUndoPos = ftell(fileout.Get());
+                fileout << blockundo;
+                hasher << blockundo;
+            }
+            fileout << hasher.GetHash();
+            vIndex[i].nStatus = BLOCK_HAVE_UNDO | (fCompact ? (uint32_t)BLOCK_UNDO_COMPACT : (uint32_t)0);
+        }
+    }
+
+    while (state.KeepRunning()) {
+        CCoinsView view_dummy;
+        CCoinsViewCache view(&view_dummy);
+        for (int i = REORG_DEPTH; i > 0; --i) {
+            CBlockUndo blockundo;
+            assert(UndoReadFromDisk(blockundo, &vIndex[i]));
+            for (size_t j = 0; j < blockundo.vtxundo.size(); ++j) {
+                const uint256 txid = ArithToUint256(arith_uint256(i * REORG_TXS_PER_BLOCK + j));
+                for (size_t k = 0; k < blockundo.vtxundo[j].vprevout.size(); ++k) {
+                    view.AddCoin(COutPoint(txid, k), std::move(blockundo.vtxundo[j].vprevout[k]), true);
+                }
+            }
+        }
+    }
+
+    fs::remove_all(datadir);
+}
+
+static void ReorgUndoLegacy(benchmark::State& state)
+{
+    ReorgUndo(state, false);
+}
+
+static void ReorgUndoCompact(benchmark::State& state)
+{
+    ReorgUndo(state, true);
+}
+
+BENCHMARK(ReorgUndoLegacy, 50);
+BENCHMARK(ReorgUndoCompact, 50);
@@ -0,0 +1,260 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockstore.h>
+
+#include <clientversion.h>
+#include <crypto/common.h>
+#include <serialize.h>
+#include <streams.h>
+#include <util.h>
+#include <validation.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+BlockStore g_blockstore;
+
+//! Size of the message start and block size preceding each block in a file
+static const unsigned int BLOCK_RECORD_HEADER_SIZE = CMessageHeader::MESSAGE_START_SIZE + sizeof(uint32_t);
+
+/** A block file mapped read-only into memory, unmapped when the last reference goes. */
+class BlockStore::MappedFile
+{
+private:
+    void* m_addr;
+    size_t m_size;
+
+public:
+    MappedFile(void* addr, size_t size) : m_addr(addr), m_size(size) {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+#ifndef WIN32
+        munmap(m_addr, m_size);
+#endif
+    }
+
+    const unsigned char* data() const { return static_cast<const unsigned char*>(m_addr); }
+    size_t size() const { return m_size; }
+
+    /** Tell the kernel a range is about to be read, so it is read ahead in one go. */
+    void WillNeed(size_t offset, size_t length) const
+    {
+#if !defined(WIN32) && defined(MADV_WILLNEED)
+        static const size_t page_size = sysconf(_SC_PAGESIZE);
+        size_t start = offset - offset % page_size;
+        madvise(static_cast<char*>(m_addr) + start, offset + length - start, MADV_WILLNEED);
+#endif
+    }
+};
+
+/** Check the message start and size that precede the block at pos. */
+static bool CheckRecordHeader(const unsigned char* header, const CDiskBlockPos& pos,
+                              const CMessageHeader::MessageStartChars& message_start, uint32_t& size)
+{
+    if (memcmp(header, message_start, CMessageHeader::MESSAGE_START_SIZE) != 0) {
+        return error("%s: Block magic mismatch at %s", __func__, pos.ToString());
+    }
+    size = ReadLE32(header + CMessageHeader::MESSAGE_START_SIZE);
+    if (size == 0 || size > MAX_SIZE) {
+        return error("%s: Invalid block size %u at %s", __func__, size, pos.ToString());
+    }
+    return true;
+}
+
+BlockStore::BlockStore(size_t max_cache_usage) : m_max_cache_usage(max_cache_usage) {}
+
+BlockStore::~BlockStore() {}
+
+std::shared_ptr<const BlockStore::MappedFile> BlockStore::GetMappedFile(int file)
+{
+    auto it = m_mapped.find(file);
+    if (it != m_mapped.end()) {
+        m_mapped_order.remove(file);
+        m_mapped_order.push_front(file);
+        return it->second;
+    }
+
+#ifdef WIN32
+    return nullptr;
+#else
+    // Block files would exhaust a 32-bit address space quickly.
+    if (sizeof(void*) < 8) return nullptr;
+
+    fs::path path = GetBlockPosFilename(CDiskBlockPos(file, 0), "blk");
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1) {
+        return nullptr;
+    }
+    struct stat st;
+    void* addr = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (addr == MAP_FAILED) {
+        LogPrintf("Unable to map %s, reading it instead\n", path.string());
+        return nullptr;
+    }
+#ifdef MADV_RANDOM
+    // Peers and RPC clients ask for scattered blocks; reading ahead of them
+    // only evicts pages that are still wanted.
+    madvise(addr, st.st_size, MADV_RANDOM);
+#endif
+
+    std::shared_ptr<const MappedFile> mapped = std::make_shared<const MappedFile>(addr, st.st_size);
+    m_mapped.emplace(file, mapped);
+    m_mapped_order.push_front(file);
+    if (m_mapped_order.size() > MAX_MAPPED_BLOCK_FILES) {
+        // Blocks still referenced keep their mapping alive.
+        m_mapped.erase(m_mapped_order.back());
+        m_mapped_order.pop_back();
+    }
+    return mapped;
+#endif
+}
+
+bool BlockStore::ReadMapped(const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start,
+                            RawBlock& block)
+{
+    std::shared_ptr<const MappedFile> mapped = GetMappedFile(pos.nFile);
+    if (!mapped) {
+        return false;
+    }
+    if (pos.nPos < BLOCK_RECORD_HEADER_SIZE || pos.nPos > mapped->size()) {
+        return error("%s: Position %s is outside of the block file", __func__, pos.ToString());
+    }
+    uint32_t size;
+    if (!CheckRecordHeader(mapped->data() + pos.nPos - BLOCK_RECORD_HEADER_SIZE, pos, message_start, size)) {
+        return false;
+    }
+    if (size > mapped->size() - pos.nPos) {
+        return error("%s: Block at %s extends past the end of the file", __func__, pos.ToString());
+    }
+    mapped->WillNeed(pos.nPos, size);
+    block = RawBlock(mapped, mapped->data() + pos.nPos, size);
+    return true;
+}
+
+bool BlockStore::ReadFromFile(const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start,
+                              RawBlock& block) const
+{
+    if (pos.nPos < BLOCK_RECORD_HEADER_SIZE) {
+        return error("%s: Invalid position %s", __func__, pos.ToString());
+    }
+    CAutoFile filein(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - BLOCK_RECORD_HEADER_SIZE), true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        return error("%s: OpenBlockFile failed for %s", __func__, pos.ToString());
+    }
+
+    unsigned char header[BLOCK_RECORD_HEADER_SIZE];
+    uint32_t size;
+    std::shared_ptr<std::vector<unsigned char>> data;
+    try {
+        filein.read(reinterpret_cast<char*>(header), sizeof(header));
+        if (!CheckRecordHeader(header, pos, message_start, size)) {
+            return false;
+        }
+        data = std::make_shared<std::vector<unsigned char>>(size);
+        filein.read(reinterpret_cast<char*>(data->data()), size);
+    } catch (const std::exception& e) {
+        return error("%s: I/O error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+    block = RawBlock(data, data->data(), data->size());
+    return true;
+}
+
+void BlockStore::AddToCache(const CDiskBlockPos& pos, const RawBlock& block)
+{
+    // A block larger than the whole cache would only flush it.
+    if (block.size() > m_max_cache_usage) return;
+
+    const CacheKey key(pos.nFile, pos.nPos);
+    if (m_cache_index.count(key)) return;
+    m_cache.emplace_front(key, block);
+    m_cache_index.emplace(key, m_cache.begin());
+    m_cache_usage += block.size();
+    TrimCache();
+}
+
+void BlockStore::TrimCache()
+{
+    while (m_cache_usage > m_max_cache_usage && !m_cache.empty()) {
+        m_cache_usage -= m_cache.back().second.size();
+        m_cache_index.erase(m_cache.back().first);
+        m_cache.pop_back();
+    }
+}
+
+bool BlockStore::Read(const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start,
+                      bool finalized, RawBlock& block)
+{
+    {
+        LOCK(m_cs);
+        auto it = m_cache_index.find(CacheKey(pos.nFile, pos.nPos));
+        if (it != m_cache_index.end()) {
+            m_cache.splice(m_cache.begin(), m_cache, it->second);
+            block = it->second->second;
+            return true;
+        }
+        if (finalized && ReadMapped(pos, message_start, block)) {
+            AddToCache(pos, block);
+            return true;
+        }
+    }
+
+    // The file is still being written, or could not be mapped.
+    if (!ReadFromFile(pos, message_start, block)) {
+        return false;
+    }
+    LOCK(m_cs);
+    AddToCache(pos, block);
+    return true;
+}
+
+void BlockStore::ForgetFile(int file)
+{
+    LOCK(m_cs);
+    for (auto it = m_cache.begin(); it != m_cache.end();) {
+        if (it->first.first == file) {
+            m_cache_usage -= it->second.size();
+            m_cache_index.erase(it->first);
+            it = m_cache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    m_mapped.erase(file);
+    m_mapped_order.remove(file);
+}
+
+void BlockStore::Clear()
+{
+    LOCK(m_cs);
+    m_cache.clear();
+    m_cache_index.clear();
+    m_cache_usage = 0;
+    m_mapped.clear();
+    m_mapped_order.clear();
+}
+
+void BlockStore::SetMaxCacheUsage(size_t max_cache_usage)
+{
+    LOCK(m_cs);
+    m_max_cache_usage = max_cache_usage;
+    TrimCache();
+}
+
+size_t BlockStore::CacheUsage() const
+{
+    LOCK(m_cs);
+    return m_cache_usage;
+}
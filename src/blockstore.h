@@ -0,0 +1,108 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKSTORE_H
+#define BITCOIN_BLOCKSTORE_H
+
+#include <chain.h>
+#include <protocol.h>
+#include <sync.h>
+
+#include <list>
+#include <map>
+#include <memory>
+
+//! Default for -blockreadcache, the size in MiB of the cache of recently read blocks
+static const int64_t DEFAULT_BLOCK_READ_CACHE = 16;
+//! Number of finalized block files kept memory-mapped at once
+static const size_t MAX_MAPPED_BLOCK_FILES = 64;
+
+/**
+ * A serialized block as stored in a blk?????.dat file, without the message
+ * start and size that precede it. The bytes are shared, not copied, and stay
+ * valid for as long as any RawBlock referring to them exists, even if the
+ * block store drops them or the file is pruned.
+ */
+class RawBlock
+{
+private:
+    std::shared_ptr<const void> m_owner;
+    const unsigned char* m_data;
+    size_t m_size;
+
+public:
+    RawBlock() : m_data(nullptr), m_size(0) {}
+    RawBlock(std::shared_ptr<const void> owner, const unsigned char* data, size_t size)
+        : m_owner(std::move(owner)), m_data(data), m_size(size) {}
+
+    const unsigned char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    const unsigned char* begin() const { return m_data; }
+    const unsigned char* end() const { return m_data + m_size; }
+};
+
+/**
+ * Read path for the block files.
+ *
+ * Files that are no longer appended to are memory-mapped read-only, so a
+ * block read from them costs no system call and no copy. The file being
+ * written is read with stdio into a buffer of its own. Either way, recently
+ * read blocks are kept in an LRU cache, so blocks requested by many peers or
+ * RPC clients at once are located only once.
+ */
+class BlockStore
+{
+private:
+    class MappedFile;
+
+    typedef std::pair<int, unsigned int> CacheKey;
+    typedef std::list<std::pair<CacheKey, RawBlock>> CacheList;
+
+    mutable CCriticalSection m_cs;
+
+    //! Recently read blocks, most recent first
+    CacheList m_cache;
+    std::map<CacheKey, CacheList::iterator> m_cache_index;
+    size_t m_cache_usage = 0;
+    size_t m_max_cache_usage;
+
+    //! Mapped files, by file number, and their use order, most recent first
+    std::map<int, std::shared_ptr<const MappedFile>> m_mapped;
+    std::list<int> m_mapped_order;
+
+    std::shared_ptr<const MappedFile> GetMappedFile(int file);
+    bool ReadMapped(const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start,
+                    RawBlock& block);
+    bool ReadFromFile(const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start,
+                      RawBlock& block) const;
+    void AddToCache(const CDiskBlockPos& pos, const RawBlock& block);
+    void TrimCache();
+
+public:
+    explicit BlockStore(size_t max_cache_usage = DEFAULT_BLOCK_READ_CACHE << 20);
+    ~BlockStore();
+
+    /**
+     * Read the block at pos. Finalized files, which will not be appended to
+     * again, may be memory-mapped.
+     */
+    bool Read(const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start,
+              bool finalized, RawBlock& block);
+
+    /** Drop the cached blocks and the mapping of a file, before it is deleted. */
+    void ForgetFile(int file);
+
+    /** Drop all cached blocks and mappings. */
+    void Clear();
+
+    void SetMaxCacheUsage(size_t max_cache_usage);
+
+    size_t CacheUsage() const;
+};
+
+/** The block store used by ReadBlockFromDisk. */
+extern BlockStore g_blockstore;
+
+#endif // BITCOIN_BLOCKSTORE_H
@@ -8,6 +8,10 @@
 #include <sync.h>
 
 #include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <thread>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
@@ -25,12 +29,42 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every worker, and the master, has a deque of its own which the master
+  * spreads added checks over. A worker takes batches from the back of its
+  * own deque and, once that is empty, steals half of another one (up to a
+  * batch) from its front, so threads only contend for a lock when they
+  * touch the same deque. A worker which finds nothing spins for a little
+  * while before it parks on a condition variable.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    //! Maximum number of deques; further workers share one.
+    static const unsigned int MAX_QUEUES = 64;
+
+    //! Number of times an idle thread looks for work before parking.
+    static const unsigned int SPIN_ROUNDS = 64;
+
+    struct WorkerQueue {
+        //! Mutex to protect checks
+        boost::mutex mutex;
+        std::deque<T> checks;
+        //! Size of checks, read without the mutex to skip empty deques
+        std::atomic<size_t> size{0};
+    };
+
+    //! The deques of the master (0) and the workers.
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+
+    //! Number of workers which called Thread(), not including the master.
+    std::atomic<unsigned int> nWorkers;
+
+    //! Deque the next batch added is put into. Only used by the master.
+    unsigned int nNextQueue;
+
+    //! Mutex for parking idle threads
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -39,87 +73,129 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
-
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
-
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! The number of workers parked on condWorker.
+    std::atomic<int> nParked;
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk;
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo;
+
+    //! Number of verifications waiting in any deque. May briefly go negative.
+    std::atomic<int64_t> nQueued;
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
+    unsigned int ActiveQueues() const
+    {
+        return std::min<unsigned int>(nWorkers.load() + 1, queues.size());
+    }
+
+    /** Move up to a batch of checks from deque n into vChecks. */
+    bool Take(unsigned int n, bool fOwner, std::vector<T>& vChecks)
+    {
+        WorkerQueue& q = *queues[n];
+        if (q.size.load(std::memory_order_relaxed) == 0)
+            return false;
+        boost::unique_lock<boost::mutex> lock(q.mutex);
+        if (q.checks.empty())
+            return false;
+        // Leave half of a deque to whoever comes next, so that all workers
+        // finish approximately simultaneously.
+        unsigned int nNow = std::max(1U, std::min(nBatchSize, (unsigned int)q.checks.size() / 2));
+        vChecks.resize(nNow);
+        for (unsigned int i = 0; i < nNow; i++) {
+            // Swap jobs out of the deque instead of copying, as in Add.
+            if (fOwner) {
+                vChecks[i].swap(q.checks.back());
+                q.checks.pop_back();
+            } else {
+                vChecks[i].swap(q.checks.front());
+                q.checks.pop_front();
+            }
+        }
+        q.size.store(q.checks.size(), std::memory_order_relaxed);
+        nQueued -= nNow;
+        return true;
+    }
+
+    /** Take a batch from our own deque, or else steal one. */
+    bool TakeOrSteal(unsigned int nSelf, std::vector<T>& vChecks)
+    {
+        if (Take(nSelf, true, vChecks))
+            return true;
+        unsigned int nActive = ActiveQueues();
+        for (unsigned int i = 1; i < nActive; i++) {
+            if (Take((nSelf + i) % nActive, false, vChecks))
+                return true;
+        }
+        return false;
+    }
+
+    /** Block until there may be something to do. */
+    void Park(bool fMaster)
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (fMaster) {
+            while (nTodo != 0 && nQueued <= 0)
+                condMaster.wait(lock);
+            return;
+        }
+        nParked++;
+        try {
+            while (nQueued <= 0)
+                condWorker.wait(lock); // wait, or get interrupted
+        } catch (...) {
+            nParked--;
+            throw;
+        }
+        nParked--;
+    }
+
     /** Internal function that does bulk of the verification work. */
     bool Loop(bool fMaster = false)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
+        unsigned int nSelf = fMaster ? 0 : 1 + nWorkers++ % (MAX_QUEUES - 1);
         std::vector<T> vChecks;
         vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
+        unsigned int nSpins = 0;
         do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
-                }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if (fMaster && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
-                }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
+            if (TakeOrSteal(nSelf, vChecks)) {
+                nSpins = 0;
                 // Check whether we need to do work at all
-                fOk = fAllOk;
+                bool fOk = fAllOk;
+                // execute work
+                for (T& check : vChecks)
+                    if (fOk)
+                        fOk = check();
+                if (!fOk)
+                    fAllOk = false;
+                // Checks must be destroyed before they are accounted done.
+                unsigned int nNow = vChecks.size();
+                vChecks.clear();
+                if (nTodo.fetch_sub(nNow) == nNow && !fMaster) {
+                    // We processed the last element; inform the master it can exit and return the result
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    condMaster.notify_one();
+                }
+                continue;
+            }
+            if (fMaster && nTodo == 0) {
+                // reset the status for new work later, and return the current status
+                return fAllOk.exchange(true);
+            }
+            if (++nSpins < SPIN_ROUNDS) {
+                std::this_thread::yield();
+                continue;
             }
-            // execute work
-            for (T& check : vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
+            nSpins = 0;
+            Park(fMaster);
         } while (true);
     }
 
@@ -128,7 +204,11 @@ public:
     boost::mutex ControlMutex;
 
     //! Create a new check queue
-    explicit CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn) {}
+    explicit CCheckQueue(unsigned int nBatchSizeIn) : nWorkers(0), nNextQueue(0), nParked(0), fAllOk(true), nTodo(0), nQueued(0), nBatchSize(nBatchSizeIn)
+    {
+        for (unsigned int i = 0; i < MAX_QUEUES; i++)
+            queues.emplace_back(new WorkerQueue());
+    }
 
     //! Worker thread
     void Thread()
@@ -145,16 +225,31 @@ public:
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        for (T& check : vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
-        }
+        if (vChecks.empty())
+            return;
         nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
+        // Spread the batch in contiguous runs over the deques.
+        unsigned int nActive = ActiveQueues();
+        size_t nPer = (vChecks.size() + nActive - 1) / nActive;
+        for (size_t i = 0; i < vChecks.size(); ) {
+            WorkerQueue& q = *queues[nNextQueue % nActive];
+            nNextQueue = (nNextQueue + 1) % nActive;
+            size_t nEnd = std::min(vChecks.size(), i + nPer);
+            boost::unique_lock<boost::mutex> lock(q.mutex);
+            for (; i < nEnd; i++) {
+                q.checks.emplace_back();
+                vChecks[i].swap(q.checks.back());
+            }
+            q.size.store(q.checks.size(), std::memory_order_relaxed);
+        }
+        nQueued += vChecks.size();
+        if (nParked > 0) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (vChecks.size() == 1)
+                condWorker.notify_one();
+            else
+                condWorker.notify_all();
+        }
     }
 
     ~CCheckQueue()
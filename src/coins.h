@@ -11,14 +11,13 @@
 #include <core_memusage.h>
 #include <hash.h>
 #include <memusage.h>
+#include <openhashmap.h>
 #include <serialize.h>
 #include <uint256.h>
 
 #include <assert.h>
 #include <stdint.h>
 
-#include <unordered_map>
-
 /**
  * A UTXO entry.
  *
@@ -119,7 +118,13 @@ struct CCoinsCacheEntry
     explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+/**
+ * Map of cached coins. Entries are pool-allocated and indexed by an
+ * open-addressed table (see openhashmap.h), which roughly halves the
+ * per-entry overhead compared to std::unordered_map and so lets more
+ * coins fit in -dbcache before a flush is needed.
+ */
+typedef openhashmap<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -167,6 +172,13 @@ public:
     //! The passed mapCoins can be modified.
     virtual bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
 
+    //! Like BatchWrite, but the view may return before the changes reach
+    //! persistent storage, as long as it keeps serving them to readers.
+    //! nCoinsUsage is the memory the coins in mapCoins hold outside of the
+    //! map itself, for views that account for what they keep in memory.
+    //! Defaults to a synchronous BatchWrite.
+    virtual bool BatchWriteBackground(CCoinsMap &mapCoins, const uint256 &hashBlock, size_t nCoinsUsage);
+
     //! Get a cursor to iterate over the whole state
     virtual CCoinsViewCursor *Cursor() const;
 
@@ -192,6 +204,7 @@ public:
     std::vector<uint256> GetHeadBlocks() const override;
     void SetBackend(CCoinsView &viewIn);
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWriteBackground(CCoinsMap &mapCoins, const uint256 &hashBlock, size_t nCoinsUsage) override;
     CCoinsViewCursor *Cursor() const override;
     size_t EstimateSize() const override;
 };
@@ -265,8 +278,10 @@ public:
      * Push the modifications applied to this cache to its base.
      * Failure to call this method before destruction will cause the changes to be forgotten.
      * If false is returned, the state of this cache (and its backing view) will be undefined.
+     * With fBackground set, the base may complete the write asynchronously
+     * (see CCoinsView::BatchWriteBackground).
      */
-    bool Flush();
+    bool Flush(bool fBackground = false);
 
     /**
      * Removes the UTXO with the given outpoint from the cache, if it is
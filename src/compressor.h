@@ -28,6 +28,8 @@ class CScriptID;
 class CScriptCompressor
 {
 private:
+    CScript &script;
+protected:
     /**
      * make this static for now (there are only 6 special scripts defined)
      * this can potentially be extended together with a new nVersion for
@@ -36,8 +38,6 @@ private:
      */
     static const unsigned int nSpecialScripts = 6;
 
-    CScript &script;
-protected:
     /**
      * These check for scripts for which a special case with a shorter encoding is defined.
      * They are implemented separately from the CScript test, as these test for exact byte
@@ -475,6 +475,25 @@ public:
             }
         return false;
     }
+
+    /** live_elements returns a copy of every element which is not marked
+     * for erasure, those of the older epoch first. Inserting them in that
+     * order into a freshly setup cache restores them with roughly the same
+     * priority for eviction.
+     *
+     * Not threadsafe with any concurrent insert or contains(e, true).
+     *
+     * @returns the elements currently held by the cache
+     */
+    std::vector<Element> live_elements() const
+    {
+        std::vector<Element> out;
+        for (bool recent : {false, true})
+            for (uint32_t i = 0; i < size; ++i)
+                if (!collection_flags.bit_is_set(i) && epoch_flags[i] == recent)
+                    out.push_back(table[i]);
+        return out;
+    }
 };
 } // namespace CuckooCache
 
@@ -2,6 +2,10 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#if defined(HAVE_CONFIG_H)
+#include <config/bitcoin-config.h>
+#endif
+
 #include <dbwrapper.h>
 
 #include <memory>
@@ -72,14 +76,138 @@ public:
     }
 };
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+//! Table files the chainstate keeps open. On 64-bit POSIX systems LevelDB maps
+//! table files into memory and closes their descriptors, so it can keep many.
+#ifdef WIN32
+static const int CHAINSTATE_MAX_OPEN_FILES = 64;
+#else
+static const int CHAINSTATE_MAX_OPEN_FILES = sizeof(void*) >= 8 ? 1000 : 64;
+#endif
+
+std::string DBProfileName(DBProfile profile)
+{
+    switch (profile) {
+    case DBProfile::DEFAULT: return "default";
+    case DBProfile::CHAINSTATE: return "chainstate";
+    case DBProfile::BLOCK_INDEX: return "blockindex";
+    case DBProfile::INDEX: return "index";
+    }
+    assert(false);
+}
+
+static DBOptions GetProfileDefaults(DBProfile profile)
+{
+    DBOptions options;
+    switch (profile) {
+    case DBProfile::DEFAULT:
+        break;
+    case DBProfile::CHAINSTATE:
+        // Coins are stored compressed and obfuscated, so compressing table
+        // blocks gains little, and lookups are spread over the whole set.
+        options.max_open_files = CHAINSTATE_MAX_OPEN_FILES;
+        break;
+    case DBProfile::BLOCK_INDEX:
+        // Read with a cursor at startup and hardly ever by key after that.
+        options.bloom_bits = 0;
+        options.block_size = 16 * 1024;
+        options.block_cache_percent = 25;
+        break;
+    case DBProfile::INDEX:
+        // Compression stays off unless asked for, as builds without Snappy
+        // cannot open a compressed database.
+        options.block_size = 8 * 1024;
+        break;
+    }
+    return options;
+}
+
+/** Set one setting named by -dboption, returning false if it is unknown or out of range. */
+static bool SetDBOption(DBOptions& options, const std::string& setting, int64_t value)
+{
+    if (setting == "compression" && (value == 0 || value == 1)) {
+        options.compression = value;
+    } else if (setting == "bloombits" && value >= 0 && value <= 64) {
+        options.bloom_bits = value;
+    } else if (setting == "blocksize" && value >= 1024 && value <= 4 * 1024 * 1024) {
+        options.block_size = value;
+    } else if (setting == "maxopenfiles" && value >= 64 && value <= 50000) {
+        options.max_open_files = value;
+    } else if (setting == "blockcachepercent" && value >= 10 && value <= 90) {
+        options.block_cache_percent = value;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/** Split a -dboption argument into the profile name, setting and value. */
+static bool ParseDBOptionArg(const std::string& arg, std::string& profile, std::string& setting, int64_t& value)
+{
+    const size_t first = arg.find(':');
+    const size_t second = first == std::string::npos ? std::string::npos : arg.find(':', first + 1);
+    if (second == std::string::npos) {
+        return false;
+    }
+    profile = arg.substr(0, first);
+    setting = arg.substr(first + 1, second - first - 1);
+    return ParseInt64(arg.substr(second + 1), &value);
+}
+
+DBOptions GetDBOptions(DBProfile profile)
+{
+    DBOptions options = GetProfileDefaults(profile);
+    for (const std::string& arg : gArgs.GetArgs("-dboption")) {
+        std::string name, setting;
+        int64_t value;
+        if (ParseDBOptionArg(arg, name, setting, value) && name == DBProfileName(profile)) {
+            SetDBOption(options, setting, value);
+        }
+    }
+    return options;
+}
+
+bool CheckDBOptionArgs(std::string& error)
+{
+    for (const std::string& arg : gArgs.GetArgs("-dboption")) {
+        std::string name, setting;
+        int64_t value;
+        if (!ParseDBOptionArg(arg, name, setting, value)) {
+            error = strprintf("Invalid -dboption=%s, expecting database:setting:value", arg);
+            return false;
+        }
+        bool known = false;
+        for (DBProfile profile : {DBProfile::DEFAULT, DBProfile::CHAINSTATE, DBProfile::BLOCK_INDEX, DBProfile::INDEX}) {
+            known |= name == DBProfileName(profile);
+        }
+        if (!known) {
+            error = strprintf("Unknown database %s in -dboption=%s", name, arg);
+            return false;
+        }
+        DBOptions options;
+        if (!SetDBOption(options, setting, value)) {
+            error = strprintf("Unknown setting or value out of range in -dboption=%s", arg);
+            return false;
+        }
+#ifndef USE_SNAPPY
+        if (options.compression) {
+            error = strprintf("-dboption=%s needs a build with Snappy", arg);
+            return false;
+        }
+#endif
+    }
+    return true;
+}
+
+static leveldb::Options GetOptions(size_t nCacheSize, const DBOptions& db_options)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    const size_t block_cache_size = nCacheSize * db_options.block_cache_percent / 100;
+    options.block_cache = leveldb::NewLRUCache(block_cache_size);
+    options.write_buffer_size = (nCacheSize - block_cache_size) / 2; // up to two write buffers may be held in memory simultaneously
+    options.filter_policy = db_options.bloom_bits > 0 ? leveldb::NewBloomFilterPolicy(db_options.bloom_bits) : nullptr;
+    options.compression = db_options.compression ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    options.block_size = db_options.block_size;
+    options.max_open_files = db_options.max_open_files;
     options.info_log = new CBitcoinLevelDBLogger();
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
@@ -89,14 +217,14 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
+CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate, DBProfile profile)
 {
     penv = nullptr;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(nCacheSize, GetDBOptions(profile));
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -108,7 +236,7 @@ CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bo
             dbwrapper_private::HandleError(result);
         }
         TryCreateDirectories(path);
-        LogPrintf("Opening LevelDB in %s\n", path.string());
+        LogPrintf("Opening LevelDB in %s (%s profile)\n", path.string(), DBProfileName(profile));
     }
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     dbwrapper_private::HandleError(status);
@@ -25,6 +25,44 @@ public:
     explicit dbwrapper_error(const std::string& msg) : std::runtime_error(msg) {}
 };
 
+/** How a database is accessed, which decides how LevelDB is tuned for it. */
+enum class DBProfile {
+    //! Settings suitable for any database
+    DEFAULT,
+    //! The UTXO set: random point reads, some of them for coins that do not exist
+    CHAINSTATE,
+    //! The block index: read in full at startup, written in small batches
+    BLOCK_INDEX,
+    //! Optional indexes: written once per block, and can be rebuilt from the blocks
+    INDEX,
+};
+
+/** LevelDB settings of a database profile. */
+struct DBOptions
+{
+    //! Compress table blocks with Snappy. Needs a build with Snappy, and a
+    //! build without it cannot open a database written this way, so no
+    //! profile turns it on by itself.
+    bool compression = false;
+    //! Bits per key of the bloom filter that spares reads of absent keys, 0 for none
+    int bloom_bits = 10;
+    //! Approximate size of the uncompressed data in a table block
+    size_t block_size = 4 * 1024;
+    //! Number of table files kept open, which is the size of LevelDB's table cache
+    int max_open_files = 64;
+    //! Percentage of the cache used for table blocks, the rest buffers writes
+    int block_cache_percent = 50;
+};
+
+/** Name of a profile, as used by -dboption. */
+std::string DBProfileName(DBProfile profile);
+
+/** The settings of a profile, with the -dboption arguments for it applied. */
+DBOptions GetDBOptions(DBProfile profile);
+
+/** Check that the -dboption arguments are well-formed. */
+bool CheckDBOptionArgs(std::string& error);
+
 class CDBWrapper;
 
 /** These should be considered an implementation detail of the specific database.
@@ -217,8 +255,10 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If false, XOR
      *                        with a zero'd byte array.
+     * @param[in] profile     How the database is accessed, which decides how leveldb is tuned.
      */
-    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
+    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false,
+               DBProfile profile = DBProfile::DEFAULT);
     ~CDBWrapper();
 
     template <typename K, typename V>
@@ -0,0 +1,408 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coins.h>
+#include <crypto/sha256.h>
+#include <index/addressindex.h>
+#include <undo.h>
+#include <util.h>
+#include <validation.h>
+
+#include <map>
+
+constexpr char DB_ADDRESS_HISTORY = 'h';
+constexpr char DB_ADDRESS_UNSPENT = 'u';
+constexpr char DB_ADDRESS_BALANCE = 'b';
+
+std::unique_ptr<AddressIndex> g_addressindex;
+
+namespace {
+
+/**
+ * History entries are keyed by script hash, then height, then position in
+ * the block, so a script's entries are contiguous and in chain order.
+ * Heights, positions and indexes are stored big-endian so LevelDB's bytewise
+ * ordering matches numeric ordering.
+ */
+struct HistoryKey
+{
+    uint256 script_hash;
+    int height;
+    uint32_t tx_pos;
+    uint256 txid;
+    uint32_t index;
+    bool spending;
+
+    HistoryKey() : height(0), tx_pos(0), index(0), spending(false) {}
+    HistoryKey(const uint256& script_hash_in, int height_in, uint32_t tx_pos_in, const uint256& txid_in, uint32_t index_in, bool spending_in) :
+        script_hash(script_hash_in), height(height_in), tx_pos(tx_pos_in), txid(txid_in), index(index_in), spending(spending_in) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata8(s, DB_ADDRESS_HISTORY);
+        s << script_hash;
+        ser_writedata32be(s, height);
+        ser_writedata32be(s, tx_pos);
+        s << txid;
+        ser_writedata32be(s, index);
+        s << spending;
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        if (ser_readdata8(s) != DB_ADDRESS_HISTORY) {
+            throw std::ios_base::failure("Invalid format for address history key");
+        }
+        s >> script_hash;
+        height = ser_readdata32be(s);
+        tx_pos = ser_readdata32be(s);
+        s >> txid;
+        index = ser_readdata32be(s);
+        s >> spending;
+    }
+};
+
+struct HistoryValue
+{
+    CAmount amount;
+    COutPoint linked;
+    int linked_height;
+    //! Position in its block of the transaction linked to.
+    uint32_t linked_pos;
+
+    HistoryValue() : amount(0), linked_height(-1), linked_pos(0) {}
+    HistoryValue(CAmount amount_in, const COutPoint& linked_in, int linked_height_in, uint32_t linked_pos_in) :
+        amount(amount_in), linked(linked_in), linked_height(linked_height_in), linked_pos(linked_pos_in) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(amount);
+        READWRITE(linked);
+        READWRITE(linked_height);
+        READWRITE(linked_pos);
+    }
+};
+
+struct UnspentKey
+{
+    uint256 script_hash;
+    int height;
+    COutPoint outpoint;
+
+    UnspentKey() : height(0) {}
+    UnspentKey(const uint256& script_hash_in, int height_in, const COutPoint& outpoint_in) :
+        script_hash(script_hash_in), height(height_in), outpoint(outpoint_in) {}
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata8(s, DB_ADDRESS_UNSPENT);
+        s << script_hash;
+        ser_writedata32be(s, height);
+        s << outpoint.hash;
+        ser_writedata32be(s, outpoint.n);
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream& s)
+    {
+        if (ser_readdata8(s) != DB_ADDRESS_UNSPENT) {
+            throw std::ios_base::failure("Invalid format for address unspent key");
+        }
+        s >> script_hash;
+        height = ser_readdata32be(s);
+        s >> outpoint.hash;
+        outpoint.n = ser_readdata32be(s);
+    }
+};
+
+/**
+ * Unspent entries are keyed by outpoint rather than position, so spending
+ * one can find it; the position of its transaction is kept in the value.
+ */
+struct UnspentValue
+{
+    CAmount amount;
+    uint32_t tx_pos;
+
+    UnspentValue() : amount(0), tx_pos(0) {}
+    UnspentValue(CAmount amount_in, uint32_t tx_pos_in) : amount(amount_in), tx_pos(tx_pos_in) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(amount);
+        READWRITE(tx_pos);
+    }
+};
+
+} // namespace
+
+/**
+ * Access to the address index database (indexes/addressindex/)
+ *
+ * Besides the best block locator, the database holds one history entry per
+ * output paying to a script and per input spending such an output, one entry
+ * per unspent output and one running balance per script.
+ */
+class AddressIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    /// Add the balance changes of a block to the batch, which must not be
+    /// written before this returns.
+    bool UpdateBalances(CDBBatch& batch, const std::map<uint256, AddressBalance>& deltas) const;
+
+    bool ReadDeltas(const uint256& script_hash, int start_height, int end_height,
+                    std::vector<AddressDelta>& deltas);
+
+    bool ReadUnspent(const uint256& script_hash, int start_height, int end_height,
+                     std::vector<AddressUnspent>& unspent);
+
+    bool ReadBalance(const uint256& script_hash, AddressBalance& balance) const;
+
+    /// Find the position in its block of the transaction of an unspent output.
+    bool ReadUnspentPos(const uint256& script_hash, int height, const COutPoint& outpoint, uint32_t& tx_pos) const;
+};
+
+AddressIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe) :
+    BaseIndex::DB(GetDataDir() / "indexes" / "addressindex", n_cache_size, f_memory, f_wipe)
+{}
+
+bool AddressIndex::DB::UpdateBalances(CDBBatch& batch, const std::map<uint256, AddressBalance>& deltas) const
+{
+    for (const auto& entry : deltas) {
+        AddressBalance balance;
+        if (!ReadBalance(entry.first, balance)) {
+            return false;
+        }
+        balance.balance += entry.second.balance;
+        balance.received += entry.second.received;
+        if (balance.balance == 0 && balance.received == 0) {
+            batch.Erase(std::make_pair(DB_ADDRESS_BALANCE, entry.first));
+        } else {
+            batch.Write(std::make_pair(DB_ADDRESS_BALANCE, entry.first), balance);
+        }
+    }
+    return true;
+}
+
+bool AddressIndex::DB::ReadDeltas(const uint256& script_hash, int start_height, int end_height,
+                                  std::vector<AddressDelta>& deltas)
+{
+    std::unique_ptr<CDBIterator> cursor(NewIterator());
+    for (cursor->Seek(HistoryKey(script_hash, start_height, 0, uint256(), 0, false)); cursor->Valid(); cursor->Next()) {
+        HistoryKey key;
+        if (!cursor->GetKey(key) || key.script_hash != script_hash || key.height > end_height) {
+            break;
+        }
+        HistoryValue value;
+        if (!cursor->GetValue(value)) {
+            return error("%s: cannot parse address history record", __func__);
+        }
+        deltas.push_back(AddressDelta{key.height, key.tx_pos, key.txid, key.index, key.spending,
+                                      value.amount, value.linked, value.linked_height});
+    }
+    return true;
+}
+
+bool AddressIndex::DB::ReadUnspent(const uint256& script_hash, int start_height, int end_height,
+                                   std::vector<AddressUnspent>& unspent)
+{
+    std::unique_ptr<CDBIterator> cursor(NewIterator());
+    for (cursor->Seek(UnspentKey(script_hash, start_height, COutPoint(uint256(), 0))); cursor->Valid(); cursor->Next()) {
+        UnspentKey key;
+        if (!cursor->GetKey(key) || key.script_hash != script_hash || key.height > end_height) {
+            break;
+        }
+        UnspentValue value;
+        if (!cursor->GetValue(value)) {
+            return error("%s: cannot parse address unspent record", __func__);
+        }
+        unspent.push_back(AddressUnspent{key.height, value.tx_pos, key.outpoint, value.amount});
+    }
+    return true;
+}
+
+bool AddressIndex::DB::ReadBalance(const uint256& script_hash, AddressBalance& balance) const
+{
+    balance = AddressBalance();
+    const auto key = std::make_pair(DB_ADDRESS_BALANCE, script_hash);
+    if (!Exists(key)) {
+        return true;
+    }
+    if (!Read(key, balance)) {
+        return error("%s: cannot parse address balance record", __func__);
+    }
+    return true;
+}
+
+bool AddressIndex::DB::ReadUnspentPos(const uint256& script_hash, int height, const COutPoint& outpoint, uint32_t& tx_pos) const
+{
+    UnspentValue value;
+    if (!Read(UnspentKey(script_hash, height, outpoint), value)) {
+        return error("%s: unspent output %s:%u is missing from the address index", __func__, outpoint.hash.ToString(), outpoint.n);
+    }
+    tx_pos = value.tx_pos;
+    return true;
+}
+
+AddressIndex::AddressIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(MakeUnique<AddressIndex::DB>(n_cache_size, f_memory, f_wipe))
+{}
+
+AddressIndex::~AddressIndex() {}
+
+uint256 AddressIndex::GetScriptHash(const CScript& script)
+{
+    uint256 hash;
+    CSHA256().Write(script.data(), script.size()).Finalize(hash.begin());
+    return hash;
+}
+
+static bool ReadUndoForIndex(const CBlock& block, const CBlockIndex* pindex, CBlockUndo& block_undo)
+{
+    if (!UndoReadFromDisk(block_undo, pindex)) {
+        return error("%s: Failed to read undo data for block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+    if (block_undo.vtxundo.size() + 1 != block.vtx.size()) {
+        return error("%s: Undo data does not match block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+    return true;
+}
+
+bool AddressIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // Exclude genesis block transaction because outputs are not spendable.
+    if (pindex->nHeight == 0) return true;
+
+    CBlockUndo block_undo;
+    if (!ReadUndoForIndex(block, pindex, block_undo)) {
+        return false;
+    }
+
+    const int height = pindex->nHeight;
+    CDBBatch batch(*m_db);
+    std::map<uint256, AddressBalance> deltas;
+    std::map<uint256, uint32_t> block_positions;
+    for (uint32_t i = 0; i < block.vtx.size(); ++i) {
+        const CTransaction& tx = *block.vtx[i];
+        const uint256& txid = tx.GetHash();
+        for (uint32_t n = 0; n < tx.vout.size(); ++n) {
+            const CTxOut& out = tx.vout[n];
+            if (out.scriptPubKey.IsUnspendable()) continue;
+            const uint256 script_hash = GetScriptHash(out.scriptPubKey);
+            batch.Write(HistoryKey(script_hash, height, i, txid, n, false), HistoryValue(out.nValue, COutPoint(), -1, 0));
+            batch.Write(UnspentKey(script_hash, height, COutPoint(txid, n)), UnspentValue(out.nValue, i));
+            deltas[script_hash].balance += out.nValue;
+            deltas[script_hash].received += out.nValue;
+        }
+        block_positions.emplace(txid, i);
+        if (tx.IsCoinBase()) continue;
+
+        // Outputs created earlier in this block are spent after they were
+        // added to the batch, so the erase below takes effect.
+        const CTxUndo& tx_undo = block_undo.vtxundo[i - 1];
+        for (uint32_t n = 0; n < tx.vin.size(); ++n) {
+            const COutPoint& prevout = tx.vin[n].prevout;
+            const Coin& coin = tx_undo.vprevout[n];
+            const uint256 script_hash = GetScriptHash(coin.out.scriptPubKey);
+            uint32_t prev_pos;
+            if ((int)coin.nHeight == height) {
+                prev_pos = block_positions.at(prevout.hash);
+            } else if (!m_db->ReadUnspentPos(script_hash, coin.nHeight, prevout, prev_pos)) {
+                return false;
+            }
+            batch.Write(HistoryKey(script_hash, height, i, txid, n, true),
+                        HistoryValue(-coin.out.nValue, prevout, coin.nHeight, prev_pos));
+            batch.Write(HistoryKey(script_hash, coin.nHeight, prev_pos, prevout.hash, prevout.n, false),
+                        HistoryValue(coin.out.nValue, COutPoint(txid, n), height, i));
+            batch.Erase(UnspentKey(script_hash, coin.nHeight, prevout));
+            deltas[script_hash].balance -= coin.out.nValue;
+        }
+    }
+
+    if (!m_db->UpdateBalances(batch, deltas)) {
+        return false;
+    }
+    return m_db->WriteBatch(batch);
+}
+
+bool AddressIndex::RewindBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    if (pindex->nHeight == 0) return true;
+
+    CBlockUndo block_undo;
+    if (!ReadUndoForIndex(block, pindex, block_undo)) {
+        return false;
+    }
+
+    // Undo transactions last to first, so that an output spent later in the
+    // same block is restored before it is removed.
+    const int height = pindex->nHeight;
+    CDBBatch batch(*m_db);
+    std::map<uint256, AddressBalance> deltas;
+    for (uint32_t i = block.vtx.size(); i-- > 0;) {
+        const CTransaction& tx = *block.vtx[i];
+        const uint256& txid = tx.GetHash();
+        if (!tx.IsCoinBase()) {
+            const CTxUndo& tx_undo = block_undo.vtxundo[i - 1];
+            for (uint32_t n = 0; n < tx.vin.size(); ++n) {
+                const COutPoint& prevout = tx.vin[n].prevout;
+                const Coin& coin = tx_undo.vprevout[n];
+                const uint256 script_hash = GetScriptHash(coin.out.scriptPubKey);
+                // The spend records where the output it restores was created.
+                const HistoryKey spend_key(script_hash, height, i, txid, n, true);
+                HistoryValue spend;
+                if (!m_db->Read(spend_key, spend)) {
+                    return error("%s: spend of %s:%u is missing from the address index", __func__, prevout.hash.ToString(), prevout.n);
+                }
+                batch.Erase(spend_key);
+                batch.Write(HistoryKey(script_hash, coin.nHeight, spend.linked_pos, prevout.hash, prevout.n, false),
+                            HistoryValue(coin.out.nValue, COutPoint(), -1, 0));
+                batch.Write(UnspentKey(script_hash, coin.nHeight, prevout), UnspentValue(coin.out.nValue, spend.linked_pos));
+                deltas[script_hash].balance += coin.out.nValue;
+            }
+        }
+        for (uint32_t n = 0; n < tx.vout.size(); ++n) {
+            const CTxOut& out = tx.vout[n];
+            if (out.scriptPubKey.IsUnspendable()) continue;
+            const uint256 script_hash = GetScriptHash(out.scriptPubKey);
+            batch.Erase(HistoryKey(script_hash, height, i, txid, n, false));
+            batch.Erase(UnspentKey(script_hash, height, COutPoint(txid, n)));
+            deltas[script_hash].balance -= out.nValue;
+            deltas[script_hash].received -= out.nValue;
+        }
+    }
+
+    if (!m_db->UpdateBalances(batch, deltas)) {
+        return false;
+    }
+    return m_db->WriteBatch(batch);
+}
+
+BaseIndex::DB& AddressIndex::GetDB() const { return *m_db; }
+
+bool AddressIndex::FindDeltas(const uint256& script_hash, int start_height, int end_height,
+                              std::vector<AddressDelta>& deltas) const
+{
+    return m_db->ReadDeltas(script_hash, std::max(start_height, 0), end_height, deltas);
+}
+
+bool AddressIndex::FindUnspent(const uint256& script_hash, int start_height, int end_height,
+                               std::vector<AddressUnspent>& unspent) const
+{
+    return m_db->ReadUnspent(script_hash, std::max(start_height, 0), end_height, unspent);
+}
+
+bool AddressIndex::FindBalance(const uint256& script_hash, AddressBalance& balance) const
+{
+    return m_db->ReadBalance(script_hash, balance);
+}
@@ -0,0 +1,115 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_ADDRESSINDEX_H
+#define BITCOIN_INDEX_ADDRESSINDEX_H
+
+#include <amount.h>
+#include <chain.h>
+#include <index/base.h>
+#include <primitives/transaction.h>
+#include <script/script.h>
+#include <uint256.h>
+
+#include <vector>
+
+/** A change to the funds held by a script in one transaction. */
+struct AddressDelta
+{
+    int height;
+    //! Position of the transaction in its block.
+    uint32_t tx_pos;
+    uint256 txid;
+    //! Output index, or input index for a spend.
+    uint32_t index;
+    bool spending;
+    //! Positive for an output, negative for a spend.
+    CAmount amount;
+    //! For an output, the input that spent it (txid and input index) and the
+    //! height it was spent at, or null and -1 while it is unspent. For a
+    //! spend, the output it spent and the height that output was created at.
+    COutPoint linked;
+    int linked_height;
+};
+
+/** An unspent output paying to an indexed script. */
+struct AddressUnspent
+{
+    int height;
+    //! Position of the transaction in its block.
+    uint32_t tx_pos;
+    COutPoint outpoint;
+    CAmount value;
+};
+
+/** Running totals of the funds held by a script. */
+struct AddressBalance
+{
+    CAmount balance{0};
+    CAmount received{0};
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(balance);
+        READWRITE(received);
+    }
+};
+
+/**
+ * AddressIndex records, for every script that has been paid to, the outputs
+ * paying to it and the inputs spending them, the outputs still unspent and
+ * its balance. Entries are keyed by the SHA256 of the scriptPubKey and
+ * ordered by height, so history and unspent outputs can be read a height
+ * range at a time. History is further ordered by the position of the
+ * transaction in its block. Spent outputs are found through the block undo
+ * data.
+ */
+class AddressIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+protected:
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool RewindBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "addressindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit AddressIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~AddressIndex() override;
+
+    /// Key under which entries for a script are stored.
+    static uint256 GetScriptHash(const CScript& script);
+
+    /// Append the history of a script between two heights (inclusive) in
+    /// the order it was confirmed.
+    bool FindDeltas(const uint256& script_hash, int start_height, int end_height,
+                    std::vector<AddressDelta>& deltas) const;
+
+    /// Append the unspent outputs paying to a script created between two
+    /// heights (inclusive) in height order.
+    bool FindUnspent(const uint256& script_hash, int start_height, int end_height,
+                     std::vector<AddressUnspent>& unspent) const;
+
+    /// Look up the balance of a script. Scripts never paid to have a zero
+    /// balance.
+    bool FindBalance(const uint256& script_hash, AddressBalance& balance) const;
+};
+
+/// The global address index. May be null.
+extern std::unique_ptr<AddressIndex> g_addressindex;
+
+#endif // BITCOIN_INDEX_ADDRESSINDEX_H
@@ -0,0 +1,85 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <coins.h>
+#include <index/spentindex.h>
+#include <undo.h>
+#include <util.h>
+#include <validation.h>
+
+constexpr char DB_SPENT = 's';
+
+std::unique_ptr<SpentIndex> g_spentindex;
+
+/**
+ * Access to the spent index database (indexes/spentindex/)
+ *
+ * Besides the best block locator, the database holds one entry per spent
+ * output, keyed by the outpoint.
+ */
+class SpentIndex::DB : public BaseIndex::DB
+{
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    bool ReadSpend(const COutPoint& outpoint, SpentInfo& info) const;
+};
+
+SpentIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe) :
+    BaseIndex::DB(GetDataDir() / "indexes" / "spentindex", n_cache_size, f_memory, f_wipe)
+{}
+
+bool SpentIndex::DB::ReadSpend(const COutPoint& outpoint, SpentInfo& info) const
+{
+    return Read(std::make_pair(DB_SPENT, outpoint), info);
+}
+
+SpentIndex::SpentIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(MakeUnique<SpentIndex::DB>(n_cache_size, f_memory, f_wipe))
+{}
+
+SpentIndex::~SpentIndex() {}
+
+bool SpentIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    // The genesis block spends nothing and has no undo data.
+    if (pindex->nHeight == 0) return true;
+
+    CBlockUndo block_undo;
+    if (!UndoReadFromDisk(block_undo, pindex)) {
+        return error("%s: Failed to read undo data for block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+    if (block_undo.vtxundo.size() + 1 != block.vtx.size()) {
+        return error("%s: Undo data does not match block %s", __func__, pindex->GetBlockHash().ToString());
+    }
+
+    CDBBatch batch(*m_db);
+    for (size_t i = 1; i < block.vtx.size(); ++i) {
+        const CTransaction& tx = *block.vtx[i];
+        const CTxUndo& tx_undo = block_undo.vtxundo[i - 1];
+        for (uint32_t n = 0; n < tx.vin.size(); ++n) {
+            batch.Write(std::make_pair(DB_SPENT, tx.vin[n].prevout),
+                        SpentInfo(tx.GetHash(), n, pindex->nHeight, tx_undo.vprevout[n].out.nValue));
+        }
+    }
+    return m_db->WriteBatch(batch);
+}
+
+bool SpentIndex::RewindBlock(const CBlock& block, const CBlockIndex* pindex)
+{
+    CDBBatch batch(*m_db);
+    for (size_t i = 1; i < block.vtx.size(); ++i) {
+        for (const CTxIn& txin : block.vtx[i]->vin) {
+            batch.Erase(std::make_pair(DB_SPENT, txin.prevout));
+        }
+    }
+    return m_db->WriteBatch(batch);
+}
+
+BaseIndex::DB& SpentIndex::GetDB() const { return *m_db; }
+
+bool SpentIndex::FindSpend(const COutPoint& outpoint, SpentInfo& info) const
+{
+    return m_db->ReadSpend(outpoint, info);
+}
@@ -0,0 +1,79 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_SPENTINDEX_H
+#define BITCOIN_INDEX_SPENTINDEX_H
+
+#include <amount.h>
+#include <chain.h>
+#include <index/base.h>
+#include <primitives/transaction.h>
+#include <serialize.h>
+#include <uint256.h>
+
+/** The input that spent an output, and the output's value. */
+struct SpentInfo
+{
+    uint256 txid;
+    uint32_t input_index;
+    int height;
+    CAmount value;
+
+    SpentInfo() : input_index(0), height(-1), value(0) {}
+    SpentInfo(const uint256& txid_in, uint32_t input_index_in, int height_in, CAmount value_in) :
+        txid(txid_in), input_index(input_index_in), height(height_in), value(value_in) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(txid);
+        READWRITE(VARINT(input_index));
+        READWRITE(VARINT(height));
+        READWRITE(VARINT(value));
+    }
+};
+
+/**
+ * SpentIndex maps every spent output on the active chain to the transaction
+ * input that spent it, so the spender of an outpoint can be found without
+ * scanning the blocks that follow it. The spent values come from the block
+ * undo data.
+ */
+class SpentIndex final : public BaseIndex
+{
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+protected:
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    bool RewindBlock(const CBlock& block, const CBlockIndex* pindex) override;
+
+    BaseIndex::DB& GetDB() const override;
+
+    const char* GetName() const override { return "spentindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit SpentIndex(size_t n_cache_size, bool f_memory = false, bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an incomplete type.
+    virtual ~SpentIndex() override;
+
+    /// Look up the input that spent an output.
+    ///
+    /// @param[in]   outpoint  The spent output.
+    /// @param[out]  info  The spending input, its height and the spent value.
+    /// @return  true if the output was spent on the active chain, false otherwise
+    bool FindSpend(const COutPoint& outpoint, SpentInfo& info) const;
+};
+
+/// The global spent index. May be null.
+extern std::unique_ptr<SpentIndex> g_spentindex;
+
+#endif // BITCOIN_INDEX_SPENTINDEX_H
@@ -6,6 +6,8 @@
 #define BITCOIN_MEMUSAGE_H
 
 #include <indirectmap.h>
+#include <openhashmap.h>
+#include <prevector.h>
 
 #include <stdlib.h>
 
@@ -165,6 +167,15 @@ static inline size_t DynamicUsage(const std::unordered_map<X, Y, Z>& m)
     return MallocUsage(sizeof(unordered_node<std::pair<const X, Y> >)) * m.size() + MallocUsage(sizeof(void*) * m.bucket_count());
 }
 
+template<typename X, typename Y, typename Z, typename W>
+static inline size_t DynamicUsage(const openhashmap<X, Y, Z, W>& m)
+{
+    // The node pool allocates whole slabs; count them rather than the live entries.
+    typedef typename openhashmap<X, Y, Z, W>::value_type value_type;
+    const node_pool<value_type>& nodes = m.nodes();
+    return MallocUsage(m.bucket_bytes()) + MallocUsage(node_pool<value_type>::SLAB_BYTES) * nodes.slab_count() + MallocUsage(sizeof(void*) * nodes.slab_index_capacity());
+}
+
 }
 
 #endif // BITCOIN_MEMUSAGE_H
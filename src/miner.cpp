@@ -31,6 +31,8 @@
 #include <queue>
 #include <utility>
 
+#include <boost/bind.hpp>
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // BitcoinMiner
@@ -107,16 +109,14 @@ void BlockAssembler::resetBlock()
     nFees = 0;
 }
 
-std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, int algo, bool fMineWitnessTx)
+bool BlockAssembler::StartBlock(CBlockIndex* pindexPrev, int algo, bool fMineWitnessTx)
 {
-    int64_t nTimeStart = GetTimeMicros();
-
     resetBlock();
 
     pblocktemplate.reset(new CBlockTemplate());
 
     if(!pblocktemplate.get())
-        return nullptr;
+        return false;
     pblock = &pblocktemplate->block; // pointer for convenience
 
     // Add dummy coinbase tx as first transaction
@@ -124,9 +124,6 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     pblocktemplate->vTxFees.push_back(-1); // updated at end
     pblocktemplate->vTxSigOpsCost.push_back(-1); // updated at end
 
-    LOCK2(cs_main, mempool.cs);
-    CBlockIndex* pindexPrev = chainActive.Tip();
-    assert(pindexPrev != nullptr);
     nHeight = pindexPrev->nHeight + 1;
 
     const int32_t nChainId = chainparams.GetConsensus ().nAuxpowChainId;
@@ -156,13 +153,11 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     // TODO: replace this with a call to main to assess validity of a mempool
     // transaction (which in most cases can be a no-op).
     fIncludeWitness = IsWitnessEnabled(pindexPrev, chainparams.GetConsensus()) && fMineWitnessTx;
+    return true;
+}
 
-    int nPackagesSelected = 0;
-    int nDescendantsUpdated = 0;
-    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
-
-    int64_t nTime1 = GetTimeMicros();
-
+void BlockAssembler::FinishBlock(const CScript& scriptPubKeyIn, CBlockIndex* pindexPrev, int algo)
+{
     nLastBlockTx = nBlockTx;
     nLastBlockWeight = nBlockWeight;
 
@@ -192,6 +187,26 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     pblock->nBits          = GetNextWorkRequired(pindexPrev, pblock, algo, chainparams.GetConsensus());
     pblock->nNonce         = 0;
     pblocktemplate->vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*pblock->vtx[0]);
+}
+
+std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, int algo, bool fMineWitnessTx)
+{
+    int64_t nTimeStart = GetTimeMicros();
+
+    LOCK2(cs_main, mempool.cs);
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    assert(pindexPrev != nullptr);
+
+    if (!StartBlock(pindexPrev, algo, fMineWitnessTx))
+        return nullptr;
+
+    int nPackagesSelected = 0;
+    int nDescendantsUpdated = 0;
+    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+
+    int64_t nTime1 = GetTimeMicros();
+
+    FinishBlock(scriptPubKeyIn, pindexPrev, algo);
 
     CValidationState state;
     if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
@@ -204,6 +219,55 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     return std::move(pblocktemplate);
 }
 
+std::unique_ptr<CBlockTemplate> BlockAssembler::UpdateBlock(const CScript& scriptPubKeyIn, int algo, bool fMineWitnessTx, std::vector<CTxMemPool::txiter>& vSelected, const std::vector<CTxMemPool::txiter>& vCandidates, bool& fStale)
+{
+    int64_t nTimeStart = GetTimeMicros();
+
+    LOCK2(cs_main, mempool.cs);
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    assert(pindexPrev != nullptr);
+
+    if (!StartBlock(pindexPrev, algo, fMineWitnessTx))
+        return nullptr;
+
+    for (CTxMemPool::txiter it : vSelected) {
+        AddToBlock(it);
+    }
+
+    int nAppended = 0;
+    for (CTxMemPool::txiter it : vCandidates) {
+        if (inBlock.count(it))
+            continue;
+
+        // Everything a full selection would leave out on fee alone
+        if (it->GetModifiedFee() < blockMinFeeRate.GetFee(it->GetTxSize()))
+            continue;
+
+        // A transaction can only go at the end of the block if its
+        // unconfirmed parents are in it already. Ones that are left out
+        // here may still make it into a full selection.
+        bool fParentsInBlock = true;
+        for (const CTxMemPoolEntry* parent : mempool.GetMemPoolParents(it)) {
+            fParentsInBlock = fParentsInBlock && inBlock.count(mempool.GetIter(parent));
+        }
+        CTxMemPool::setEntries package{it};
+        if (!fParentsInBlock || !TestPackage(it->GetTxSize(), it->GetSigOpCost()) || !TestPackageTransactions(package)) {
+            fStale = true;
+            continue;
+        }
+
+        AddToBlock(it);
+        vSelected.push_back(it);
+        ++nAppended;
+    }
+
+    FinishBlock(scriptPubKeyIn, pindexPrev, algo);
+
+    LogPrint(BCLog::BENCH, "CreateNewBlock() updated: %d txs appended (total %.2fms)\n", nAppended, 0.001 * (GetTimeMicros() - nTimeStart));
+
+    return std::move(pblocktemplate);
+}
+
 void BlockAssembler::onlyUnconfirmed(CTxMemPool::setEntries& testSet)
 {
     for (CTxMemPool::setEntries::iterator iit = testSet.begin(); iit != testSet.end(); ) {
@@ -472,3 +536,104 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
     pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
 }
+
+BlockTemplateCache g_block_template_cache;
+
+void BlockTemplateCache::Connect(CTxMemPool& pool)
+{
+    pool.NotifyEntryAdded.connect(boost::bind(&BlockTemplateCache::TransactionAdded, this, _1));
+    pool.NotifyEntryPrioritised.connect(boost::bind(&BlockTemplateCache::TransactionPrioritised, this, _1));
+}
+
+void BlockTemplateCache::Disconnect(CTxMemPool& pool)
+{
+    pool.NotifyEntryAdded.disconnect(boost::bind(&BlockTemplateCache::TransactionAdded, this, _1));
+    pool.NotifyEntryPrioritised.disconnect(boost::bind(&BlockTemplateCache::TransactionPrioritised, this, _1));
+}
+
+void BlockTemplateCache::TransactionAdded(CTransactionRef tx)
+{
+    LOCK(cs);
+    // Nothing to keep up to date until the first template is made
+    if (pindexPrev == nullptr)
+        return;
+    if (vAdded.size() >= MAX_BLOCK_TEMPLATE_PENDING) {
+        // Too far behind to catch up; select from scratch next time
+        pindexPrev = nullptr;
+        vAdded.clear();
+        return;
+    }
+    vAdded.push_back(tx->GetHash());
+}
+
+void BlockTemplateCache::TransactionPrioritised(const uint256& hash)
+{
+    LOCK(cs);
+    // A changed fee can move the transaction and its relatives in or out of
+    // the selection, which only a full selection takes into account
+    pindexPrev = nullptr;
+    vAdded.clear();
+}
+
+std::unique_ptr<CBlockTemplate> BlockTemplateCache::CreateNewBlock(const CChainParams& params, const CScript& scriptPubKeyIn, int algo, bool fMineWitnessTxIn)
+{
+    BlockAssembler assembler(params);
+
+    LOCK2(cs_main, mempool.cs);
+    LOCK(cs);
+    const int64_t nNow = GetTime();
+    if (pindexPrev != chainActive.Tip() || fMineWitnessTx != fMineWitnessTxIn ||
+            (fStale && nNow - nTimeSelected > BLOCK_TEMPLATE_REFRESH_INTERVAL)) {
+        // Clear pindexPrev so that a failure below does not leave a selection behind
+        pindexPrev = nullptr;
+        vSelected.clear();
+        vAdded.clear();
+
+        std::unique_ptr<CBlockTemplate> pblocktemplate = assembler.CreateNewBlock(scriptPubKeyIn, algo, fMineWitnessTxIn);
+        if (!pblocktemplate)
+            return nullptr;
+
+        for (size_t i = 1; i < pblocktemplate->block.vtx.size(); ++i) {
+            vSelected.push_back(pblocktemplate->block.vtx[i]->GetHash());
+        }
+        pindexPrev = chainActive.Tip();
+        fMineWitnessTx = fMineWitnessTxIn;
+        fStale = false;
+        nTimeSelected = nNow;
+        return pblocktemplate;
+    }
+
+    // Bring the selection up to date. Transactions that left the mempool
+    // took their descendants with them, so what remains is still in a
+    // valid order.
+    std::vector<CTxMemPool::txiter> vSelectedIters;
+    vSelectedIters.reserve(vSelected.size());
+    for (const uint256& hash : vSelected) {
+        CTxMemPool::txiter it = mempool.mapTx.find(hash);
+        if (it != mempool.mapTx.end()) {
+            vSelectedIters.push_back(it);
+        } else {
+            // The space it leaves could go to a transaction that was left out
+            fStale = true;
+        }
+    }
+    std::vector<CTxMemPool::txiter> vCandidates;
+    vCandidates.reserve(vAdded.size());
+    for (const uint256& hash : vAdded) {
+        CTxMemPool::txiter it = mempool.mapTx.find(hash);
+        if (it != mempool.mapTx.end()) {
+            vCandidates.push_back(it);
+        }
+    }
+    vAdded.clear();
+
+    std::unique_ptr<CBlockTemplate> pblocktemplate = assembler.UpdateBlock(scriptPubKeyIn, algo, fMineWitnessTx, vSelectedIters, vCandidates, fStale);
+    if (!pblocktemplate)
+        return nullptr;
+
+    vSelected.clear();
+    for (CTxMemPool::txiter it : vSelectedIters) {
+        vSelected.push_back(it->GetTx().GetHash());
+    }
+    return pblocktemplate;
+}
@@ -21,6 +21,10 @@ class CScript;
 namespace Consensus { struct Params; };
 
 static const bool DEFAULT_PRINTPRIORITY = false;
+/** Seconds after which a block template selection that could not follow the mempool is made again */
+static const int64_t BLOCK_TEMPLATE_REFRESH_INTERVAL = 10;
+/** Maximum number of mempool additions kept for the block template selection between templates */
+static const size_t MAX_BLOCK_TEMPLATE_PENDING = 20000;
 
 struct CBlockTemplate
 {
@@ -158,10 +162,22 @@ public:
     /** Construct a new block template with coinbase to scriptPubKeyIn */
     std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, int algo, bool fMineWitnessTx=true);
 
+    /** Construct a new block template with coinbase to scriptPubKeyIn from the
+      * transactions in vSelected, which an earlier template for the same tip
+      * selected, followed by the candidates that fit after their unconfirmed
+      * parents. These are appended to vSelected. Sets fStale if a candidate
+      * was left out that a new selection might include. The transactions are
+      * not validated again. */
+    std::unique_ptr<CBlockTemplate> UpdateBlock(const CScript& scriptPubKeyIn, int algo, bool fMineWitnessTx, std::vector<CTxMemPool::txiter>& vSelected, const std::vector<CTxMemPool::txiter>& vCandidates, bool& fStale);
+
 private:
     // utility functions
     /** Clear the block's state and prepare for assembling a new block */
     void resetBlock();
+    /** Start a new block template on top of pindexPrev */
+    bool StartBlock(CBlockIndex* pindexPrev, int algo, bool fMineWitnessTx);
+    /** Add the coinbase to scriptPubKeyIn and fill in the header */
+    void FinishBlock(const CScript& scriptPubKeyIn, CBlockIndex* pindexPrev, int algo);
     /** Add a tx to the block */
     void AddToBlock(CTxMemPool::txiter iter);
 
@@ -192,6 +208,44 @@ private:
     int UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set &mapModifiedTx);
 };
 
+/**
+ * Keeps the transactions selected for the last block template up to date as
+ * transactions enter the mempool, so that a template for the same tip only
+ * takes the selection as it stands, with the coinbase and the header of the
+ * requested algo filled in, instead of a selection over the whole mempool
+ * and a TestBlockValidity each time. A full selection is made when the tip
+ * changes, and at most every BLOCK_TEMPLATE_REFRESH_INTERVAL seconds while
+ * the selection could not follow the mempool exactly.
+ */
+class BlockTemplateCache
+{
+private:
+    CCriticalSection cs;
+    //! Tip the selection was made on top of, or nullptr if there is none
+    const CBlockIndex* pindexPrev = nullptr;
+    bool fMineWitnessTx = true;
+    //! Hashes of the selected transactions, in block order
+    std::vector<uint256> vSelected;
+    //! Hashes of transactions added to the mempool since the last template
+    std::vector<uint256> vAdded;
+    //! Whether a full selection could differ from this one
+    bool fStale = false;
+    int64_t nTimeSelected = 0;
+
+    void TransactionAdded(CTransactionRef tx);
+    void TransactionPrioritised(const uint256& hash);
+
+public:
+    /** Follow the transactions added to and prioritised in pool, which must be the global mempool */
+    void Connect(CTxMemPool& pool);
+    void Disconnect(CTxMemPool& pool);
+
+    /** Construct a new block template with coinbase to scriptPubKeyIn, as BlockAssembler does with default options */
+    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CChainParams& params, const CScript& scriptPubKeyIn, int algo, bool fMineWitnessTx=true);
+};
+
+extern BlockTemplateCache g_block_template_cache;
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
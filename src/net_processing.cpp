@@ -8,9 +8,11 @@
 #include <addrman.h>
 #include <arith_uint256.h>
 #include <blockencodings.h>
+#include <blockstore.h>
 #include <chainparams.h>
 #include <consensus/validation.h>
 #include <hash.h>
+#include <index/blockfilterindex.h>
 #include <init.h>
 #include <validation.h>
 #include <merkleblock.h>
@@ -25,6 +27,8 @@
 #include <scheduler.h>
 #include <tinyformat.h>
 #include <txmempool.h>
+#include <txorphanage.h>
+#include <txreconciliation.h>
 #include <ui_interface.h>
 #include <util.h>
 #include <utilmoneystr.h>
@@ -38,25 +42,10 @@
 
 std::atomic<int64_t> nTimeBestReceived(0); // Used only to inform the wallet of when we last received a block
 
-struct IteratorComparator
-{
-    template<typename I>
-    bool operator()(const I& a, const I& b) const
-    {
-        return &(*a) < &(*b);
-    }
-};
-
-struct COrphanTx {
-    // When modifying, adapt the copy of this definition in tests/DoS_tests.
-    CTransactionRef tx;
-    NodeId fromPeer;
-    int64_t nTimeExpire;
-};
 static CCriticalSection g_cs_orphans;
-std::map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(g_cs_orphans);
-std::map<COutPoint, std::set<std::map<uint256, COrphanTx>::iterator, IteratorComparator>> mapOrphanTransactionsByPrev GUARDED_BY(g_cs_orphans);
-void EraseOrphansFor(NodeId peer);
+static TxOrphanage g_orphanage GUARDED_BY(g_cs_orphans);
+
+static TxReconciliationTracker g_txreconciliation GUARDED_BY(cs_main);
 
 static size_t vExtraTxnForCompactIt GUARDED_BY(g_cs_orphans) = 0;
 static std::vector<std::pair<uint256, CTransactionRef>> vExtraTxnForCompact GUARDED_BY(g_cs_orphans);
@@ -71,6 +60,17 @@ static const int STALE_RELAY_AGE_LIMIT = 30 * 24 * 60 * 60;
 /// limiting block relay. Set to one week, denominated in seconds.
 static const int HISTORICAL_BLOCK_AGE = 7 * 24 * 60 * 60;
 
+/** Maximum number of compact filters that may be requested with one getcfilters. See BIP 157. */
+static constexpr uint32_t MAX_GETCFILTERS_SIZE = 1000;
+/** Maximum number of cf hashes that may be requested with one getcfheaders. See BIP 157. */
+static constexpr uint32_t MAX_GETCFHEADERS_SIZE = 2000;
+/** Interval between compact filter checkpoints. See BIP 157. */
+static constexpr int CFCHECKPT_INTERVAL = 1000;
+/** Maximum number of getpkgtxns requests to a peer that may await an answer */
+static constexpr size_t MAX_PACKAGE_REQUESTS_IN_FLIGHT = 16;
+/** Seconds after which an unanswered getpkgtxns request is given up on */
+static constexpr int64_t PACKAGE_REQUEST_TIMEOUT = 60;
+
 // Internal stuff
 namespace {
     /** Number of nodes with fSyncStarted. */
@@ -108,6 +108,17 @@ namespace {
     std::unique_ptr<CRollingBloomFilter> recentRejects;
     uint256 hashRecentRejectsChainTip;
 
+    /**
+     * Filter for transactions with rejected parents that we asked a peer for
+     * the package of. They count as known, so that announcements of them,
+     * from the same peer or others, do not lead to further downloads and
+     * getpkgtxns requests while one is outstanding. Failed packages put the
+     * transaction into recentRejects.
+     *
+     * Memory used: 110 kB
+     */
+    std::unique_ptr<CRollingBloomFilter> recentPackageRequests;
+
     /** Blocks that are in flight, and that are in the queue to be downloaded. Protected by cs_main. */
     struct QueuedBlock {
         uint256 hash;
@@ -239,6 +250,9 @@ struct CNodeState {
     //! Time of last new block announcement
     int64_t m_last_block_announcement;
 
+    //! Transactions we asked the peer for with their ancestors, and when
+    std::map<uint256, int64_t> mapPackagesRequested;
+
     CNodeState(CAddress addrIn, std::string addrNameIn) : address(addrIn), name(addrNameIn) {
         fCurrentlyConnected = false;
         nMisbehavior = 0;
@@ -595,7 +609,11 @@ void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTim
     for (const QueuedBlock& entry : state->vBlocksInFlight) {
         mapBlocksInFlight.erase(entry.hash);
     }
-    EraseOrphansFor(nodeid);
+    {
+        LOCK(g_cs_orphans);
+        g_orphanage.EraseForPeer(nodeid);
+    }
+    g_txreconciliation.ForgetPeer(nodeid);
     nPreferredDownload -= state->fPreferredDownload;
     nPeersWithValidatedDownloads -= (state->nBlocksInFlightValidHeaders != 0);
     assert(nPeersWithValidatedDownloads >= 0);
@@ -631,7 +649,7 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
 
 //////////////////////////////////////////////////////////////////////////////
 //
-// mapOrphanTransactions
+// Orphan transactions
 //
 
 void AddToCompactExtraTransactions(const CTransactionRef& tx) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans)
@@ -645,112 +663,6 @@ void AddToCompactExtraTransactions(const CTransactionRef& tx) EXCLUSIVE_LOCKS_RE
     vExtraTxnForCompactIt = (vExtraTxnForCompactIt + 1) % max_extra_txn;
 }
 
-bool AddOrphanTx(const CTransactionRef& tx, NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans)
-{
-    const uint256& hash = tx->GetHash();
-    if (mapOrphanTransactions.count(hash))
-        return false;
-
-    // Ignore big transactions, to avoid a
-    // send-big-orphans memory exhaustion attack. If a peer has a legitimate
-    // large transaction with a missing parent then we assume
-    // it will rebroadcast it later, after the parent transaction(s)
-    // have been mined or received.
-    // 100 orphans, each of which is at most 99,999 bytes big is
-    // at most 10 megabytes of orphans and somewhat more byprev index (in the worst case):
-    unsigned int sz = GetTransactionWeight(*tx);
-    if (sz >= MAX_STANDARD_TX_WEIGHT)
-    {
-        LogPrint(BCLog::MEMPOOL, "ignoring large orphan tx (size: %u, hash: %s)\n", sz, hash.ToString());
-        return false;
-    }
-
-    auto ret = mapOrphanTransactions.emplace(hash, COrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME});
-    assert(ret.second);
-    for (const CTxIn& txin : tx->vin) {
-        mapOrphanTransactionsByPrev[txin.prevout].insert(ret.first);
-    }
-
-    AddToCompactExtraTransactions(tx);
-
-    LogPrint(BCLog::MEMPOOL, "stored orphan tx %s (mapsz %u outsz %u)\n", hash.ToString(),
-             mapOrphanTransactions.size(), mapOrphanTransactionsByPrev.size());
-    return true;
-}
-
-int static EraseOrphanTx(uint256 hash) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans)
-{
-    std::map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(hash);
-    if (it == mapOrphanTransactions.end())
-        return 0;
-    for (const CTxIn& txin : it->second.tx->vin)
-    {
-        auto itPrev = mapOrphanTransactionsByPrev.find(txin.prevout);
-        if (itPrev == mapOrphanTransactionsByPrev.end())
-            continue;
-        itPrev->second.erase(it);
-        if (itPrev->second.empty())
-            mapOrphanTransactionsByPrev.erase(itPrev);
-    }
-    mapOrphanTransactions.erase(it);
-    return 1;
-}
-
-void EraseOrphansFor(NodeId peer)
-{
-    LOCK(g_cs_orphans);
-    int nErased = 0;
-    std::map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
-    while (iter != mapOrphanTransactions.end())
-    {
-        std::map<uint256, COrphanTx>::iterator maybeErase = iter++; // increment to avoid iterator becoming invalid
-        if (maybeErase->second.fromPeer == peer)
-        {
-            nErased += EraseOrphanTx(maybeErase->second.tx->GetHash());
-        }
-    }
-    if (nErased > 0) LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx from peer=%d\n", nErased, peer);
-}
-
-
-unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans)
-{
-    LOCK(g_cs_orphans);
-
-    unsigned int nEvicted = 0;
-    static int64_t nNextSweep;
-    int64_t nNow = GetTime();
-    if (nNextSweep <= nNow) {
-        // Sweep out expired orphan pool entries:
-        int nErased = 0;
-        int64_t nMinExpTime = nNow + ORPHAN_TX_EXPIRE_TIME - ORPHAN_TX_EXPIRE_INTERVAL;
-        std::map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
-        while (iter != mapOrphanTransactions.end())
-        {
-            std::map<uint256, COrphanTx>::iterator maybeErase = iter++;
-            if (maybeErase->second.nTimeExpire <= nNow) {
-                nErased += EraseOrphanTx(maybeErase->second.tx->GetHash());
-            } else {
-                nMinExpTime = std::min(maybeErase->second.nTimeExpire, nMinExpTime);
-            }
-        }
-        // Sweep again 5 minutes after the next entry that expires in order to batch the linear scan.
-        nNextSweep = nMinExpTime + ORPHAN_TX_EXPIRE_INTERVAL;
-        if (nErased > 0) LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx due to expiration\n", nErased);
-    }
-    while (mapOrphanTransactions.size() > nMaxOrphans)
-    {
-        // Evict a random orphan:
-        uint256 randomhash = GetRandHash();
-        std::map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.lower_bound(randomhash);
-        if (it == mapOrphanTransactions.end())
-            it = mapOrphanTransactions.begin();
-        EraseOrphanTx(it->first);
-        ++nEvicted;
-    }
-    return nEvicted;
-}
-
 // Requires cs_main.
 void Misbehaving(NodeId pnode, int howmuch)
 {
@@ -799,6 +711,7 @@ static bool BlockRequestAllowed(const CBlockIndex* pindex, const Consensus::Para
 PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn, CScheduler &scheduler) : connman(connmanIn), m_stale_tip_check_time(0) {
     // Initialize global variables that cannot be constructed at startup.
     recentRejects.reset(new CRollingBloomFilter(120000, 0.000001));
+    recentPackageRequests.reset(new CRollingBloomFilter(10000, 0.000001));
 
     const Consensus::Params& consensusParams = Params().GetConsensus();
     // Stale tip checking and peer eviction are on two different timers, but we
@@ -810,32 +723,9 @@ PeerLogicValidation::PeerLogicValidation(CConnman* connmanIn, CScheduler &schedu
 }
 
 void PeerLogicValidation::BlockConnected(const std::shared_ptr<const CBlock>& pblock, const CBlockIndex* pindex, const std::vector<CTransactionRef>& vtxConflicted) {
-    LOCK(g_cs_orphans);
-
-    std::vector<uint256> vOrphanErase;
-
-    for (const CTransactionRef& ptx : pblock->vtx) {
-        const CTransaction& tx = *ptx;
-
-        // Which orphan pool entries must we evict?
-        for (const auto& txin : tx.vin) {
-            auto itByPrev = mapOrphanTransactionsByPrev.find(txin.prevout);
-            if (itByPrev == mapOrphanTransactionsByPrev.end()) continue;
-            for (auto mi = itByPrev->second.begin(); mi != itByPrev->second.end(); ++mi) {
-                const CTransaction& orphanTx = *(*mi)->second.tx;
-                const uint256& orphanHash = orphanTx.GetHash();
-                vOrphanErase.push_back(orphanHash);
-            }
-        }
-    }
-
-    // Erase orphan transactions include or precluded by this block
-    if (vOrphanErase.size()) {
-        int nErased = 0;
-        for (uint256 &orphanHash : vOrphanErase) {
-            nErased += EraseOrphanTx(orphanHash);
-        }
-        LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx included or conflicted by block\n", nErased);
+    {
+        LOCK(g_cs_orphans);
+        g_orphanage.EraseForBlock(*pblock);
     }
 
     g_last_tip_update = GetTime();
@@ -979,10 +869,11 @@ bool static AlreadyHave(const CInv& inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 
             {
                 LOCK(g_cs_orphans);
-                if (mapOrphanTransactions.count(inv.hash)) return true;
+                if (g_orphanage.HaveTx(inv.hash)) return true;
             }
 
             return recentRejects->contains(inv.hash) ||
+                   recentPackageRequests->contains(inv.hash) ||
                    mempool.exists(inv.hash) ||
                    pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 0)) || // Best effort: only try output 0 and 1
                    pcoinsTip->HaveCoinInCache(COutPoint(inv.hash, 1));
@@ -1111,7 +1002,7 @@ void static ProcessGetBlockData(CNode* pfrom, const Consensus::Params& consensus
         std::shared_ptr<const CBlock> pblock;
         if (a_recent_block && a_recent_block->GetHash() == (*mi).second->GetBlockHash()) {
             pblock = a_recent_block;
-        } else {
+        } else if (inv.type != MSG_WITNESS_BLOCK) {
             // Send block from disk
             std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
             if (!ReadBlockFromDisk(*pblockRead, (*mi).second, consensusParams))
@@ -1121,7 +1012,21 @@ void static ProcessGetBlockData(CNode* pfrom, const Consensus::Params& consensus
         if (inv.type == MSG_BLOCK)
             connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *pblock));
         else if (inv.type == MSG_WITNESS_BLOCK)
-            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
+        {
+            if (pblock) {
+                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
+            } else {
+                // Blocks are stored in witness serialization, so the stored
+                // bytes are the message payload as they are.
+                RawBlock raw_block;
+                if (!ReadRawBlockFromDisk(raw_block, (*mi).second, Params().MessageStart()))
+                    assert(!"cannot load block from disk");
+                CSerializedNetMsg msg;
+                msg.command = NetMsgType::BLOCK;
+                msg.data.assign(raw_block.begin(), raw_block.end());
+                connman->PushMessage(pfrom, std::move(msg));
+            }
+        }
         else if (inv.type == MSG_FILTERED_BLOCK)
         {
             bool sendMerkleBlock = false;
@@ -1490,6 +1395,515 @@ bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman, const std::ve
     return true;
 }
 
+/**
+ * Validation logic for compact filters request handling.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   chain_params    Chain parameters
+ * @param[in]   filter_type     The filter type the request is for. Must be basic filters.
+ * @param[in]   start_height    The start height for the request
+ * @param[in]   stop_hash       The stop_hash for the request
+ * @param[in]   max_height_diff The maximum number of items permitted to request, as specified in BIP 157
+ * @param[out]  stop_index      The CBlockIndex for the stop_hash block, if the request can be serviced.
+ * @param[out]  filter_index    The filter index, if the request can be serviced.
+ * @return                      True if the request can be serviced.
+ */
+static bool PrepareBlockFilterRequest(CNode* pfrom, const CChainParams& chain_params,
+                                      BlockFilterType filter_type, uint32_t start_height,
+                                      const uint256& stop_hash, uint32_t max_height_diff,
+                                      const CBlockIndex*& stop_index,
+                                      BlockFilterIndex*& filter_index)
+{
+    const bool supported_filter_type =
+        (filter_type == BlockFilterType::BASIC &&
+         (pfrom->GetLocalServices() & NODE_COMPACT_FILTERS));
+    if (!supported_filter_type) {
+        LogPrint(BCLog::NET, "peer %d requested unsupported block filter type: %d\n",
+                 pfrom->GetId(), static_cast<uint8_t>(filter_type));
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator mi = mapBlockIndex.find(stop_hash);
+        stop_index = mi != mapBlockIndex.end() ? mi->second : nullptr;
+
+        // Check that the stop block exists and the peer would be allowed to fetch it.
+        if (!stop_index || !BlockRequestAllowed(stop_index, chain_params.GetConsensus())) {
+            LogPrint(BCLog::NET, "peer %d requested invalid block hash: %s\n",
+                     pfrom->GetId(), stop_hash.ToString());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+    }
+
+    uint32_t stop_height = stop_index->nHeight;
+    if (start_height > stop_height) {
+        LogPrint(BCLog::NET, "peer %d sent invalid getcfilters/getcfheaders with " /* Continued */
+                 "start height %d and stop height %d\n",
+                 pfrom->GetId(), start_height, stop_height);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+    if (stop_height - start_height >= max_height_diff) {
+        LogPrint(BCLog::NET, "peer %d requested too many cfilters/cfheaders: %d / %d\n",
+                 pfrom->GetId(), stop_height - start_height + 1, max_height_diff);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    filter_index = GetBlockFilterIndex(filter_type);
+    if (!filter_index) {
+        LogPrint(BCLog::NET, "Filter index for supported type %s not found\n", BlockFilterTypeName(filter_type));
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Handle a cfilters request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   chain_params    Chain parameters
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessGetCFilters(CNode* pfrom, CDataStream& vRecv, const CChainParams& chain_params,
+                               CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint32_t start_height;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> start_height >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    BlockFilterIndex* filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, chain_params, filter_type, start_height, stop_hash,
+                                   MAX_GETCFILTERS_SIZE, stop_index, filter_index)) {
+        return;
+    }
+
+    std::vector<BlockFilter> filters;
+
+    if (!filter_index->LookupFilterRange(start_height, stop_index, filters)) {
+        LogPrint(BCLog::NET, "Failed to find block filter in index: filter_type=%s, start_height=%d, stop_hash=%s\n",
+                     BlockFilterTypeName(filter_type), start_height, stop_hash.ToString());
+        return;
+    }
+
+    for (const auto& filter : filters) {
+        CSerializedNetMsg msg = CNetMsgMaker(pfrom->GetSendVersion())
+            .Make(NetMsgType::CFILTER, filter);
+        connman->PushMessage(pfrom, std::move(msg));
+    }
+}
+
+/**
+ * Handle a cfheaders request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   chain_params    Chain parameters
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessGetCFHeaders(CNode* pfrom, CDataStream& vRecv, const CChainParams& chain_params,
+                                CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint32_t start_height;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> start_height >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    BlockFilterIndex* filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, chain_params, filter_type, start_height, stop_hash,
+                                   MAX_GETCFHEADERS_SIZE, stop_index, filter_index)) {
+        return;
+    }
+
+    uint256 prev_header;
+    if (start_height > 0) {
+        const CBlockIndex* const prev_block =
+            stop_index->GetAncestor(static_cast<int>(start_height - 1));
+        if (!filter_index->LookupFilterHeader(prev_block, prev_header)) {
+            LogPrint(BCLog::NET, "Failed to find block filter header in index: filter_type=%s, block_hash=%s\n",
+                         BlockFilterTypeName(filter_type), prev_block->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    std::vector<uint256> filter_hashes;
+    if (!filter_index->LookupFilterHashRange(start_height, stop_index, filter_hashes)) {
+        LogPrint(BCLog::NET, "Failed to find block filter hashes in index: filter_type=%s, start_height=%d, stop_hash=%s\n",
+                     BlockFilterTypeName(filter_type), start_height, stop_hash.ToString());
+        return;
+    }
+
+    CSerializedNetMsg msg = CNetMsgMaker(pfrom->GetSendVersion())
+        .Make(NetMsgType::CFHEADERS,
+              filter_type_ser,
+              stop_index->GetBlockHash(),
+              prev_header,
+              filter_hashes);
+    connman->PushMessage(pfrom, std::move(msg));
+}
+
+/**
+ * Handle a getcfcheckpt request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   chain_params    Chain parameters
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessGetCFCheckPt(CNode* pfrom, CDataStream& vRecv, const CChainParams& chain_params,
+                                CConnman* connman)
+{
+    uint8_t filter_type_ser;
+    uint256 stop_hash;
+
+    vRecv >> filter_type_ser >> stop_hash;
+
+    const BlockFilterType filter_type = static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex* stop_index;
+    BlockFilterIndex* filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, chain_params, filter_type, /*start_height=*/0, stop_hash,
+                                   /*max_height_diff=*/std::numeric_limits<uint32_t>::max(),
+                                   stop_index, filter_index)) {
+        return;
+    }
+
+    std::vector<uint256> headers(stop_index->nHeight / CFCHECKPT_INTERVAL);
+
+    // Populate headers.
+    const CBlockIndex* block_index = stop_index;
+    for (int i = headers.size() - 1; i >= 0; i--) {
+        int height = (i + 1) * CFCHECKPT_INTERVAL;
+        block_index = block_index->GetAncestor(height);
+
+        if (!filter_index->LookupFilterHeader(block_index, headers[i])) {
+            LogPrint(BCLog::NET, "Failed to find block filter header in index: filter_type=%s, block_hash=%s\n",
+                         BlockFilterTypeName(filter_type), block_index->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    CSerializedNetMsg msg = CNetMsgMaker(pfrom->GetSendVersion())
+        .Make(NetMsgType::CFCHECKPT,
+              filter_type_ser,
+              stop_index->GetBlockHash(),
+              headers);
+    connman->PushMessage(pfrom, std::move(msg));
+}
+
+/** Keep tx for peers to fetch for 15 minutes after we announced it. Requires cs_main. */
+static void AddToRelayMap(const uint256& hash, CTransactionRef tx, int64_t nNow)
+{
+    // Expire old relay messages
+    while (!vRelayExpiration.empty() && vRelayExpiration.front().first < nNow)
+    {
+        mapRelay.erase(vRelayExpiration.front().second);
+        vRelayExpiration.pop_front();
+    }
+
+    auto ret = mapRelay.insert(std::make_pair(hash, std::move(tx)));
+    if (ret.second) {
+        vRelayExpiration.push_back(std::make_pair(nNow + 15 * 60 * 1000000, ret.first));
+    }
+}
+
+/** Announce the transactions a reconciliation found the peer to lack, as far
+ *  as they are still in the mempool. Requires cs_main. */
+static void AnnounceReconciledTxs(CNode* pto, const std::vector<uint256>& vHashes, CConnman* connman)
+{
+    const CNetMsgMaker msgMaker(pto->GetSendVersion());
+    const int64_t nNow = GetTimeMicros();
+    std::vector<CInv> vInv;
+    LOCK(pto->cs_inventory);
+    for (const uint256& hash : vHashes) {
+        if (pto->filterInventoryKnown.contains(hash)) {
+            continue;
+        }
+        auto txinfo = mempool.info(hash);
+        if (!txinfo.tx) {
+            continue;
+        }
+        vInv.push_back(CInv(MSG_TX, hash));
+        AddToRelayMap(hash, std::move(txinfo.tx), nNow);
+        pto->filterInventoryKnown.insert(hash);
+        if (vInv.size() == MAX_INV_SZ) {
+            connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
+            vInv.clear();
+        }
+    }
+    if (!vInv.empty())
+        connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
+}
+
+/**
+ * Handle a reqrecon message: answer with the sketch of the transactions we
+ * have to announce to the peer.
+ *
+ * Disconnects from the peer if it did not negotiate reconciliation with us
+ * or asks again before finishing the last reconciliation.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessReqRecon(CNode* pfrom, CDataStream& vRecv, CConnman* connman)
+{
+    uint16_t nSetSize, nQ;
+    vRecv >> nSetSize >> nQ;
+
+    std::vector<unsigned char> sketch;
+    {
+        LOCK(cs_main);
+        if (!g_txreconciliation.RespondToReconciliationRequest(pfrom->GetId(), nSetSize, nQ, sketch)) {
+            LogPrint(BCLog::NET, "unexpected reqrecon, disconnect peer=%d\n", pfrom->GetId());
+            pfrom->fDisconnect = true;
+            return;
+        }
+    }
+    connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::SKETCH, sketch));
+}
+
+/**
+ * Handle a sketch message: reconcile it with our set, announce what the peer
+ * lacks and ask for what we lack.
+ *
+ * Disconnects from the peer if we did not ask for the sketch or it is
+ * malformed.
+ *
+ * @param[in]   pfrom           The peer that we received the sketch from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessSketch(CNode* pfrom, CDataStream& vRecv, CConnman* connman)
+{
+    std::vector<unsigned char> sketch;
+    vRecv >> sketch;
+
+    LOCK(cs_main);
+    bool fSuccess;
+    std::vector<uint256> vAnnounce;
+    std::vector<uint32_t> vAskFor;
+    if (!g_txreconciliation.HandleSketch(pfrom->GetId(), sketch, fSuccess, vAnnounce, vAskFor)) {
+        LogPrint(BCLog::NET, "unexpected sketch, disconnect peer=%d\n", pfrom->GetId());
+        pfrom->fDisconnect = true;
+        return;
+    }
+    LogPrint(BCLog::NET, "reconciliation with peer=%d %s: announcing %u, asking for %u\n", pfrom->GetId(),
+             fSuccess ? "succeeded" : "failed", vAnnounce.size(), vAskFor.size());
+    connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::RECONCILDIFF, fSuccess, vAskFor));
+    AnnounceReconciledTxs(pfrom, vAnnounce, connman);
+}
+
+/**
+ * Handle a reconcildiff message: announce the transactions the peer found
+ * itself to lack, or all of the set we reconciled if it found nothing.
+ *
+ * Disconnects from the peer if no reconciliation was outstanding.
+ *
+ * @param[in]   pfrom           The peer that we received the message from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessReconcilDiff(CNode* pfrom, CDataStream& vRecv, CConnman* connman)
+{
+    bool fSuccess;
+    std::vector<uint32_t> vAskFor;
+    vRecv >> fSuccess >> vAskFor;
+
+    LOCK(cs_main);
+    std::vector<uint256> vAnnounce;
+    if (vAskFor.size() > MAX_SKETCH_CAPACITY ||
+        !g_txreconciliation.HandleReconciliationDifference(pfrom->GetId(), fSuccess, vAskFor, vAnnounce)) {
+        LogPrint(BCLog::NET, "unexpected reconcildiff, disconnect peer=%d\n", pfrom->GetId());
+        pfrom->fDisconnect = true;
+        return;
+    }
+    AnnounceReconciledTxs(pfrom, vAnnounce, connman);
+}
+
+/** Whether we and the peer both offer NODE_PACKAGE_RELAY */
+static bool CanRelayPackages(const CNode* pfrom)
+{
+    return (pfrom->GetLocalServices() & NODE_PACKAGE_RELAY) && (pfrom->nServices & NODE_PACKAGE_RELAY);
+}
+
+/** Ask the peer for a transaction together with its ancestors, unless we
+ *  did already or too many of our requests to it are unanswered. Only the
+ *  packages asked for here are accepted from the peer. */
+static void RequestPackage(CNode* pfrom, const uint256& hash, CConnman* connman) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    std::map<uint256, int64_t>& mapRequested = State(pfrom->GetId())->mapPackagesRequested;
+    const int64_t nNow = GetTime();
+    for (auto it = mapRequested.begin(); it != mapRequested.end();) {
+        if (it->second + PACKAGE_REQUEST_TIMEOUT < nNow) {
+            it = mapRequested.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    if (mapRequested.size() >= MAX_PACKAGE_REQUESTS_IN_FLIGHT || !mapRequested.emplace(hash, nNow).second)
+        return;
+
+    LogPrint(BCLog::MEMPOOL, "requesting package ending in %s from peer=%d\n", hash.ToString(), pfrom->GetId());
+    connman->PushMessage(pfrom, CNetMsgMaker(pfrom->GetSendVersion()).Make(NetMsgType::GETPKGTXNS, hash));
+}
+
+/**
+ * Handle a getpkgtxns request: send a mempool transaction together with its
+ * unconfirmed ancestors, parents first.
+ *
+ * Only transactions the peer already knows about are served, so that the
+ * request cannot be used to probe our mempool. Anything else is answered
+ * with notfound. May disconnect from the peer if we do not offer package
+ * relay.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessGetPkgTxns(CNode* pfrom, CDataStream& vRecv, CConnman* connman)
+{
+    uint256 hash;
+    vRecv >> hash;
+
+    if (!(pfrom->GetLocalServices() & NODE_PACKAGE_RELAY)) {
+        LogPrint(BCLog::NET, "getpkgtxns received despite not offering package relay, disconnect peer=%d\n", pfrom->GetId());
+        pfrom->fDisconnect = true;
+        return;
+    }
+
+    bool fKnown;
+    {
+        LOCK(pfrom->cs_inventory);
+        fKnown = pfrom->filterInventoryKnown.contains(hash);
+    }
+
+    std::vector<CTransactionRef> vPackage;
+    if (fKnown) {
+        LOCK(mempool.cs);
+        CTxMemPool::txiter it = mempool.mapTx.find(hash);
+        if (it != mempool.mapTx.end()) {
+            CTxMemPool::setEntries setAncestors;
+            uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+            std::string dummy;
+            mempool.CalculateMemPoolAncestors(*it, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+            if (setAncestors.size() < MAX_PACKAGE_COUNT) {
+                // An ancestor always has fewer ancestors than its descendants
+                std::vector<CTxMemPool::txiter> vSorted(setAncestors.begin(), setAncestors.end());
+                std::sort(vSorted.begin(), vSorted.end(), [](CTxMemPool::txiter a, CTxMemPool::txiter b) {
+                    return a->GetCountWithAncestors() < b->GetCountWithAncestors();
+                });
+                for (CTxMemPool::txiter ancestor : vSorted) {
+                    vPackage.push_back(ancestor->GetSharedTx());
+                }
+                vPackage.push_back(it->GetSharedTx());
+            }
+        }
+    }
+
+    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    if (vPackage.empty()) {
+        std::vector<CInv> vNotFound{CInv(MSG_TX, hash)};
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::NOTFOUND, vNotFound));
+        return;
+    }
+
+    int nSendFlags;
+    {
+        LOCK(cs_main);
+        nSendFlags = State(pfrom->GetId())->fHaveWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
+    }
+    connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::PKGTXNS, vPackage));
+}
+
+/**
+ * Handle a pkgtxns message: try to accept the transactions as a package, so
+ * that a child can pay for parents we would not take on their own. Packages
+ * we did not ask the peer for are dropped.
+ *
+ * @param[in]   pfrom           The peer that we received the package from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessPkgTxns(CNode* pfrom, CDataStream& vRecv, CConnman* connman)
+{
+    std::vector<CTransactionRef> vPackage;
+    vRecv >> vPackage;
+
+    if (!(pfrom->GetLocalServices() & NODE_PACKAGE_RELAY) || vPackage.empty()) {
+        return;
+    }
+
+    LOCK2(cs_main, g_cs_orphans);
+
+    const uint256& hash = vPackage.back()->GetHash();
+    if (!State(pfrom->GetId())->mapPackagesRequested.erase(hash)) {
+        LogPrint(BCLog::NET, "ignoring unrequested package ending in %s from peer=%d\n", hash.ToString(), pfrom->GetId());
+        return;
+    }
+
+    for (const CTransactionRef& ptx : vPackage) {
+        CInv inv(MSG_TX, ptx->GetHash());
+        pfrom->AddInventoryKnown(inv);
+        pfrom->setAskFor.erase(inv.hash);
+        mapAlreadyAskedFor.erase(inv.hash);
+    }
+
+    CValidationState state;
+    bool fMissingInputs = false;
+    if (AcceptPackageToMemoryPool(mempool, state, vPackage, &fMissingInputs, 0 /* nAbsurdFee */)) {
+        mempool.check(pcoinsTip.get());
+        for (const CTransactionRef& ptx : vPackage) {
+            RelayTransaction(*ptx, connman);
+            g_orphanage.EraseTx(ptx->GetHash());
+        }
+        pfrom->nLastTXTime = GetTime();
+
+        LogPrint(BCLog::MEMPOOL, "AcceptPackageToMemoryPool: peer=%d: accepted package of %u txs ending in %s (poolsz %u txn, %u kB)\n",
+            pfrom->GetId(), vPackage.size(), hash.ToString(),
+            mempool.size(), mempool.DynamicMemoryUsage() / 1000);
+        return;
+    }
+
+    int nDoS = 0;
+    if (state.IsInvalid(nDoS)) {
+        LogPrint(BCLog::MEMPOOLREJ, "package ending in %s from peer=%d was not accepted: %s\n", hash.ToString(),
+            pfrom->GetId(),
+            FormatStateMessage(state));
+        if (nDoS > 0) {
+            Misbehaving(pfrom->GetId(), nDoS);
+        }
+        if (!vPackage.back()->HasWitness() && !state.CorruptionPossible()) {
+            // Do not ask for this package again. Witness transactions are
+            // left out for the same reason as in the tx handler.
+            assert(recentRejects);
+            recentRejects->insert(hash);
+        }
+    }
+}
+
 bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived, const CChainParams& chainparams, CConnman* connman, const std::atomic<bool>& interruptMsgProc)
 {
     LogPrint(BCLog::NET, "received: %s (%u bytes) peer=%d\n", SanitizeString(strCommand), vRecv.size(), pfrom->GetId());
@@ -1760,6 +2174,16 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             nCMPCTBLOCKVersion = 1;
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDCMPCT, fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion));
         }
+        if ((pfrom->GetLocalServices() & NODE_TXRECONCILIATION) && (pfrom->nServices & NODE_TXRECONCILIATION)) {
+            // Offer to announce transactions through set reconciliation. The
+            // peer's offer comes after its verack, so it finds ours set up.
+            uint64_t nSalt;
+            {
+                LOCK(cs_main);
+                nSalt = g_txreconciliation.PreRegisterPeer(pfrom->GetId());
+            }
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDTXRCNCL, TXRECONCILIATION_VERSION, nSalt));
+        }
         pfrom->fSuccessfullyConnected = true;
     }
 
@@ -1827,6 +2251,18 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         State(pfrom->GetId())->fPreferHeaders = true;
     }
 
+    else if (strCommand == NetMsgType::SENDTXRCNCL)
+    {
+        uint32_t nVersion;
+        uint64_t nSalt;
+        vRecv >> nVersion >> nSalt;
+        LOCK(cs_main);
+        if (g_txreconciliation.RegisterPeer(pfrom->GetId(), pfrom->fInbound, nVersion, nSalt)) {
+            LogPrint(BCLog::NET, "reconciling transactions with peer=%d%s\n", pfrom->GetId(),
+                     g_txreconciliation.ShouldFloodTo(pfrom->GetId()) ? ", flooding too" : "");
+        }
+    }
+
     else if (strCommand == NetMsgType::SENDCMPCT)
     {
         bool fAnnounceUsingCMPCTBLOCK = false;
@@ -2114,7 +2550,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             return true;
         }
 
-        std::deque<COutPoint> vWorkQueue;
+        std::deque<CTransactionRef> vWorkQueue;
         std::vector<uint256> vEraseQueue;
         CTransactionRef ptx;
         vRecv >> ptx;
@@ -2137,9 +2573,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             AcceptToMemoryPool(mempool, state, ptx, &fMissingInputs, &lRemovedTxn, false /* bypass_limits */, 0 /* nAbsurdFee */)) {
             mempool.check(pcoinsTip.get());
             RelayTransaction(tx, connman);
-            for (unsigned int i = 0; i < tx.vout.size(); i++) {
-                vWorkQueue.emplace_back(inv.hash, i);
-            }
+            vWorkQueue.push_back(ptx);
 
             pfrom->nLastTXTime = GetTime();
 
@@ -2148,21 +2582,21 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 tx.GetHash().ToString(),
                 mempool.size(), mempool.DynamicMemoryUsage() / 1000);
 
-            // Recursively process any orphan transactions that depended on this one
+            // Process the orphans that depended on this one, and in turn those
+            // that depended on them. Each accepted transaction has its orphan
+            // children looked up at once, and orphans that are settled are
+            // only erased after the whole batch.
             std::set<NodeId> setMisbehaving;
+            std::set<uint256> setSettled;
             while (!vWorkQueue.empty()) {
-                auto itByPrev = mapOrphanTransactionsByPrev.find(vWorkQueue.front());
+                CTransactionRef pparent = vWorkQueue.front();
                 vWorkQueue.pop_front();
-                if (itByPrev == mapOrphanTransactionsByPrev.end())
-                    continue;
-                for (auto mi = itByPrev->second.begin();
-                     mi != itByPrev->second.end();
-                     ++mi)
+                for (const auto& child : g_orphanage.GetChildren(*pparent))
                 {
-                    const CTransactionRef& porphanTx = (*mi)->second.tx;
+                    const CTransactionRef& porphanTx = child.first;
                     const CTransaction& orphanTx = *porphanTx;
                     const uint256& orphanHash = orphanTx.GetHash();
-                    NodeId fromPeer = (*mi)->second.fromPeer;
+                    NodeId fromPeer = child.second;
                     bool fMissingInputs2 = false;
                     // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan
                     // resolution (that is, feeding people an invalid transaction based on LegitTxX in order to get
@@ -2170,15 +2604,14 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                     CValidationState stateDummy;
 
 
-                    if (setMisbehaving.count(fromPeer))
+                    if (setMisbehaving.count(fromPeer) || setSettled.count(orphanHash))
                         continue;
                     if (AcceptToMemoryPool(mempool, stateDummy, porphanTx, &fMissingInputs2, &lRemovedTxn, false /* bypass_limits */, 0 /* nAbsurdFee */)) {
                         LogPrint(BCLog::MEMPOOL, "   accepted orphan tx %s\n", orphanHash.ToString());
                         RelayTransaction(orphanTx, connman);
-                        for (unsigned int i = 0; i < orphanTx.vout.size(); i++) {
-                            vWorkQueue.emplace_back(orphanHash, i);
-                        }
+                        vWorkQueue.push_back(porphanTx);
                         vEraseQueue.push_back(orphanHash);
+                        setSettled.insert(orphanHash);
                     }
                     else if (!fMissingInputs2)
                     {
@@ -2194,6 +2627,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                         // Probably non-standard or insufficient fee
                         LogPrint(BCLog::MEMPOOL, "   removed orphan tx %s\n", orphanHash.ToString());
                         vEraseQueue.push_back(orphanHash);
+                        setSettled.insert(orphanHash);
                         if (!orphanTx.HasWitness() && !stateDummy.CorruptionPossible()) {
                             // Do not use rejection cache for witness transactions or
                             // witness-stripped transactions, as they can have been malleated.
@@ -2206,8 +2640,8 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 }
             }
 
-            for (uint256 hash : vEraseQueue)
-                EraseOrphanTx(hash);
+            for (const uint256& hash : vEraseQueue)
+                g_orphanage.EraseTx(hash);
         }
         else if (fMissingInputs)
         {
@@ -2225,14 +2659,22 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                     pfrom->AddInventoryKnown(_inv);
                     if (!AlreadyHave(_inv)) pfrom->AskFor(_inv);
                 }
-                AddOrphanTx(ptx, pfrom->GetId());
+                if (g_orphanage.AddTx(ptx, pfrom->GetId())) {
+                    AddToCompactExtraTransactions(ptx);
+                }
 
-                // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
+                // DoS prevention: do not allow the orphan pool to grow unbounded
                 unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, gArgs.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-                unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
+                unsigned int nEvicted = g_orphanage.LimitOrphans(nMaxOrphanTx);
                 if (nEvicted > 0) {
-                    LogPrint(BCLog::MEMPOOL, "mapOrphan overflow, removed %u tx\n", nEvicted);
+                    LogPrint(BCLog::MEMPOOL, "orphan pool overflow, removed %u tx\n", nEvicted);
                 }
+            } else if (CanRelayPackages(pfrom)) {
+                // A parent may only have been rejected for its fee, which
+                // this transaction could make up for: ask for them together,
+                // once
+                recentPackageRequests->insert(tx.GetHash());
+                RequestPackage(pfrom, tx.GetHash(), connman);
             } else {
                 LogPrint(BCLog::MEMPOOL, "not keeping orphan with rejected parents %s\n",tx.GetHash().ToString());
                 // We will continue to reject this tx since it has rejected
@@ -2240,6 +2682,15 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 recentRejects->insert(tx.GetHash());
             }
         } else {
+            if (state.GetRejectCode() == REJECT_INSUFFICIENTFEE && CanRelayPackages(pfrom)) {
+                // Orphans from this peer may pay for the transaction: ask
+                // for each of them with its ancestors
+                for (const auto& child : g_orphanage.GetChildren(tx)) {
+                    if (child.second == pfrom->GetId()) {
+                        RequestPackage(pfrom, child.first->GetHash(), connman);
+                    }
+                }
+            }
             if (!tx.HasWitness() && !state.CorruptionPossible()) {
                 // Do not use rejection cache for witness transactions or
                 // witness-stripped transactions, as they can have been malleated.
@@ -2839,9 +3290,53 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         }
     }
 
+    else if (strCommand == NetMsgType::GETCFILTERS) {
+        ProcessGetCFilters(pfrom, vRecv, chainparams, connman);
+    }
+
+    else if (strCommand == NetMsgType::GETCFHEADERS) {
+        ProcessGetCFHeaders(pfrom, vRecv, chainparams, connman);
+    }
+
+    else if (strCommand == NetMsgType::GETCFCHECKPT) {
+        ProcessGetCFCheckPt(pfrom, vRecv, chainparams, connman);
+    }
+
+    else if (strCommand == NetMsgType::GETPKGTXNS) {
+        ProcessGetPkgTxns(pfrom, vRecv, connman);
+    }
+
+    else if (strCommand == NetMsgType::PKGTXNS) {
+        ProcessPkgTxns(pfrom, vRecv, connman);
+    }
+
+    else if (strCommand == NetMsgType::REQRECON) {
+        ProcessReqRecon(pfrom, vRecv, connman);
+    }
+
+    else if (strCommand == NetMsgType::SKETCH) {
+        ProcessSketch(pfrom, vRecv, connman);
+    }
+
+    else if (strCommand == NetMsgType::RECONCILDIFF) {
+        ProcessReconcilDiff(pfrom, vRecv, connman);
+    }
+
     else if (strCommand == NetMsgType::NOTFOUND) {
         // We do not care about the NOTFOUND message, but logging an Unknown Command
-        // message would be undesirable as we transmit it ourselves.
+        // message would be undesirable as we transmit it ourselves. It does
+        // answer the getpkgtxns requests the peer cannot serve, though.
+        std::vector<CInv> vInv;
+        vRecv >> vInv;
+        if (vInv.size() <= MAX_INV_SZ) {
+            LOCK(cs_main);
+            CNodeState* nodestate = State(pfrom->GetId());
+            for (const CInv& inv : vInv) {
+                if (inv.type == MSG_TX) {
+                    nodestate->mapPackagesRequested.erase(inv.hash);
+                }
+            }
+        }
     }
 
     else {
@@ -3516,22 +4011,14 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                         continue;
                     }
                     if (pto->pfilter && !pto->pfilter->IsRelevantAndUpdate(*txinfo.tx)) continue;
+                    // Leave it to the next reconciliation, unless we flood to the peer
+                    if (!g_txreconciliation.ShouldFloodTo(pto->GetId()) && g_txreconciliation.AddToSet(pto->GetId(), hash)) {
+                        continue;
+                    }
                     // Send
                     vInv.push_back(CInv(MSG_TX, hash));
                     nRelayedTransactions++;
-                    {
-                        // Expire old relay messages
-                        while (!vRelayExpiration.empty() && vRelayExpiration.front().first < nNow)
-                        {
-                            mapRelay.erase(vRelayExpiration.front().second);
-                            vRelayExpiration.pop_front();
-                        }
-
-                        auto ret = mapRelay.insert(std::make_pair(hash, std::move(txinfo.tx)));
-                        if (ret.second) {
-                            vRelayExpiration.push_back(std::make_pair(nNow + 15 * 60 * 1000000, ret.first));
-                        }
-                    }
+                    AddToRelayMap(hash, std::move(txinfo.tx), nNow);
                     if (vInv.size() == MAX_INV_SZ) {
                         connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
                         vInv.clear();
@@ -3543,6 +4030,14 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
         if (!vInv.empty())
             connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
 
+        //
+        // Message: reconciliation request
+        //
+        uint16_t nReconSetSize, nReconQ;
+        if (g_txreconciliation.InitiateReconciliation(pto->GetId(), nNow, nReconSetSize, nReconQ)) {
+            connman->PushMessage(pto, msgMaker.Make(NetMsgType::REQRECON, nReconSetSize, nReconQ));
+        }
+
         // Detect whether we're stalling
         nNow = GetTimeMicros();
         if (state.nStallingSince && state.nStallingSince < nNow - 1000000 * BLOCK_STALLING_TIMEOUT) {
@@ -3688,7 +4183,6 @@ public:
     CNetProcessingCleanup() {}
     ~CNetProcessingCleanup() {
         // orphan transactions
-        mapOrphanTransactions.clear();
-        mapOrphanTransactionsByPrev.clear();
+        g_orphanage.Clear();
     }
 } instance_of_cnetprocessingcleanup;
@@ -16,6 +16,10 @@ static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
 static const int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
 /** Minimum time between orphan transactions expire time checks in seconds */
 static const int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
+/** Default for -packagerelay, serving and accepting packages of transactions */
+static const bool DEFAULT_PACKAGE_RELAY = false;
+/** Default for -txreconciliation, announcing transactions through set reconciliation */
+static const bool DEFAULT_TXRECONCILIATION = false;
 /** Default number of orphan+recently-replaced txn to keep around for block reconstruction */
 static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
 /** Headers download timeout expressed in microseconds
@@ -0,0 +1,364 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_OPENHASHMAP_H
+#define BITCOIN_OPENHASHMAP_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <iterator>
+#include <new>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+/** Object pool handing out fixed-size slots addressed by 32-bit index.
+ *
+ * Slots are carved out of slabs of 2^SLAB_BITS objects, and released slots
+ * are kept on an intrusive free list, so objects do not pay for a malloc
+ * header each. Memory is only returned to the system by clear().
+ */
+template <typename T, unsigned int SLAB_BITS = 6>
+class node_pool
+{
+    union slot {
+        uint32_t next;
+        alignas(T) unsigned char data[sizeof(T)];
+    };
+
+    static const uint32_t SLAB_MASK = (1U << SLAB_BITS) - 1;
+    static const uint32_t NONE = 0xffffffff;
+
+    std::vector<slot*> slabs;
+    uint32_t free_head;
+    uint32_t used;
+
+    slot& at(uint32_t index) const { return slabs[index >> SLAB_BITS][index & SLAB_MASK]; }
+
+public:
+    static const size_t SLAB_BYTES = sizeof(slot) << SLAB_BITS;
+
+    node_pool() : free_head(NONE), used(0) {}
+    node_pool(node_pool&& other) noexcept : slabs(std::move(other.slabs)), free_head(other.free_head), used(other.used)
+    {
+        other.slabs.clear();
+        other.free_head = NONE;
+        other.used = 0;
+    }
+    node_pool(const node_pool&) = delete;
+    node_pool& operator=(const node_pool&) = delete;
+    ~node_pool() { clear(); }
+
+    /** Return the index of an unused slot. */
+    uint32_t allocate()
+    {
+        if (free_head != NONE) {
+            uint32_t index = free_head;
+            free_head = at(index).next;
+            return index;
+        }
+        if ((used & SLAB_MASK) == 0 && (used >> SLAB_BITS) == slabs.size()) {
+            slabs.push_back(static_cast<slot*>(::operator new(SLAB_BYTES)));
+        }
+        assert(used != NONE);
+        return used++;
+    }
+
+    /** Return a slot to the pool. Its object must have been destroyed. */
+    void deallocate(uint32_t index)
+    {
+        at(index).next = free_head;
+        free_head = index;
+    }
+
+    T* get(uint32_t index) const { return reinterpret_cast<T*>(at(index).data); }
+
+    /** Release all slabs. Objects in use must have been destroyed. */
+    void clear()
+    {
+        for (slot* s : slabs) {
+            ::operator delete(s);
+        }
+        slabs.clear();
+        slabs.shrink_to_fit();
+        free_head = NONE;
+        used = 0;
+    }
+
+    size_t slab_count() const { return slabs.size(); }
+    size_t slab_index_capacity() const { return slabs.capacity(); }
+};
+
+/** Hash map with open addressing, for large maps of small values.
+ *
+ * Buckets are a contiguous array of 8 bytes each (32 bits of the key's hash
+ * and a pool index), probed linearly; values live in a node_pool. This
+ * avoids the per-entry allocation, list pointers and cached hash of
+ * std::unordered_map, while keeping the guarantees callers rely on:
+ *  - References to values stay valid until the value is erased or the map
+ *    is cleared, as values never move.
+ *  - Iterators are invalidated by insertions that cause a rehash and by
+ *    clear(); erase only invalidates iterators to the erased element, so
+ *    "it = map.erase(it)" loops work as with std::unordered_map.
+ *
+ * Erasure leaves a tombstone that is dropped on the next rehash.
+ */
+template <typename K, typename V, typename Hash = std::hash<K>, typename Eq = std::equal_to<K>>
+class openhashmap
+{
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<const K, V> value_type;
+    typedef size_t size_type;
+
+private:
+    struct bucket {
+        //! 0 for an empty bucket, 1 for an erased one, otherwise hash bits of the key.
+        uint32_t tag;
+        uint32_t index;
+    };
+
+    static const uint32_t EMPTY = 0;
+    static const uint32_t DELETED = 1;
+    static const size_t MIN_BUCKETS = 8;
+
+    std::vector<bucket> table;
+    node_pool<value_type> pool;
+    size_t num_elements;
+    size_t num_deleted;
+    Hash hasher;
+    Eq key_eq;
+
+    static uint32_t tag_for(size_t hash)
+    {
+        uint32_t tag = (uint32_t)(hash >> (sizeof(size_t) * 4));
+        return tag < 2 ? tag + 2 : tag;
+    }
+
+    template <typename Ptr, typename Ref>
+    class iter_base
+    {
+        friend class openhashmap;
+        template <typename, typename> friend class iter_base;
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef typename openhashmap::value_type value_type;
+        typedef ptrdiff_t difference_type;
+        typedef Ptr pointer;
+        typedef Ref reference;
+
+    protected:
+        const bucket* pos;
+        const bucket* end;
+        const node_pool<value_type>* nodes;
+
+        void skip()
+        {
+            while (pos != end && pos->tag < 2)
+                ++pos;
+        }
+
+    public:
+        iter_base() : pos(nullptr), end(nullptr), nodes(nullptr) {}
+        iter_base(const bucket* pos_in, const bucket* end_in, const node_pool<value_type>* nodes_in) : pos(pos_in), end(end_in), nodes(nodes_in) {}
+        template <typename P, typename R>
+        iter_base(const iter_base<P, R>& x) : pos(x.pos), end(x.end), nodes(x.nodes) {}
+
+        Ref operator*() const { return *nodes->get(pos->index); }
+        Ptr operator->() const { return nodes->get(pos->index); }
+        bool operator==(const iter_base& x) const { return pos == x.pos; }
+        bool operator!=(const iter_base& x) const { return pos != x.pos; }
+    };
+
+public:
+    class iterator : public iter_base<value_type*, value_type&>
+    {
+        typedef iter_base<value_type*, value_type&> base;
+
+    public:
+        using base::base;
+        iterator& operator++() { ++this->pos; this->skip(); return *this; }
+        iterator operator++(int) { iterator copy(*this); ++(*this); return copy; }
+    };
+
+    class const_iterator : public iter_base<const value_type*, const value_type&>
+    {
+        typedef iter_base<const value_type*, const value_type&> base;
+
+    public:
+        using base::base;
+        const_iterator(const iterator& x) : base(x) {}
+        const_iterator& operator++() { ++this->pos; this->skip(); return *this; }
+        const_iterator operator++(int) { const_iterator copy(*this); ++(*this); return copy; }
+    };
+
+private:
+    iterator make_iterator(const bucket* pos) const
+    {
+        iterator it(pos, table.data() + table.size(), &pool);
+        it.skip();
+        return it;
+    }
+
+    /** Find the bucket holding key, or the end of the table. */
+    const bucket* lookup(const K& key) const
+    {
+        if (num_elements == 0) return table.data() + table.size();
+        size_t hash = hasher(key);
+        uint32_t tag = tag_for(hash);
+        size_t mask = table.size() - 1;
+        for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+            const bucket& b = table[i];
+            if (b.tag == EMPTY) return table.data() + table.size();
+            if (b.tag == tag && key_eq(pool.get(b.index)->first, key)) return &b;
+        }
+    }
+
+    /** Place a pool index into the first free bucket of its probe sequence. */
+    bucket* place(size_t hash, uint32_t index)
+    {
+        size_t mask = table.size() - 1;
+        for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+            bucket& b = table[i];
+            if (b.tag < 2) {
+                if (b.tag == DELETED) num_deleted--;
+                b.tag = tag_for(hash);
+                b.index = index;
+                return &b;
+            }
+        }
+    }
+
+    void rehash(size_t new_size)
+    {
+        std::vector<bucket> old;
+        old.swap(table);
+        table.assign(new_size, bucket{EMPTY, 0});
+        num_deleted = 0;
+        for (const bucket& b : old) {
+            if (b.tag >= 2) {
+                place(hasher(pool.get(b.index)->first), b.index);
+            }
+        }
+    }
+
+public:
+    openhashmap() : num_elements(0), num_deleted(0) {}
+    openhashmap(openhashmap&& other) noexcept : table(std::move(other.table)), pool(std::move(other.pool)), num_elements(other.num_elements), num_deleted(other.num_deleted), hasher(other.hasher), key_eq(other.key_eq)
+    {
+        other.table.clear();
+        other.num_elements = 0;
+        other.num_deleted = 0;
+    }
+    openhashmap(const openhashmap&) = delete;
+    openhashmap& operator=(const openhashmap&) = delete;
+    ~openhashmap() { clear(); }
+
+    iterator begin() { return make_iterator(table.data()); }
+    iterator end() { return iterator(table.data() + table.size(), table.data() + table.size(), &pool); }
+    const_iterator begin() const { return make_iterator(table.data()); }
+    const_iterator end() const { return const_iterator(table.data() + table.size(), table.data() + table.size(), &pool); }
+
+    size_type size() const { return num_elements; }
+    bool empty() const { return num_elements == 0; }
+    size_type bucket_count() const { return table.size(); }
+    size_t bucket_bytes() const { return table.capacity() * sizeof(bucket); }
+    const node_pool<value_type>& nodes() const { return pool; }
+
+    iterator find(const K& key) { return iterator(lookup(key), table.data() + table.size(), &pool); }
+    const_iterator find(const K& key) const { return const_iterator(lookup(key), table.data() + table.size(), &pool); }
+    size_type count(const K& key) const { return lookup(key) != table.data() + table.size(); }
+
+    template <typename... Args>
+    std::pair<iterator, bool> emplace(Args&&... args)
+    {
+        uint32_t index = pool.allocate();
+        value_type* node;
+        try {
+            node = new (pool.get(index)) value_type(std::forward<Args>(args)...);
+        } catch (...) {
+            pool.deallocate(index);
+            throw;
+        }
+        const bucket* existing = lookup(node->first);
+        if (existing != table.data() + table.size()) {
+            node->~value_type();
+            pool.deallocate(index);
+            return std::make_pair(make_iterator(existing), false);
+        }
+        // Keep the load, counting tombstones, at or below 3/4.
+        if ((num_elements + num_deleted + 1) * 4 > table.size() * 3) {
+            size_t new_size = MIN_BUCKETS;
+            while (new_size < (num_elements + 1) * 2) new_size <<= 1;
+            try {
+                rehash(new_size);
+            } catch (...) {
+                node->~value_type();
+                pool.deallocate(index);
+                throw;
+            }
+        }
+        bucket* b = place(hasher(node->first), index);
+        num_elements++;
+        return std::make_pair(make_iterator(b), true);
+    }
+
+    V& operator[](const K& key)
+    {
+        iterator it = find(key);
+        if (it != end()) return it->second;
+        return emplace(std::piecewise_construct, std::forward_as_tuple(key), std::tuple<>()).first->second;
+    }
+
+    iterator erase(const_iterator it)
+    {
+        bucket* b = const_cast<bucket*>(it.pos);
+        value_type* node = pool.get(b->index);
+        node->~value_type();
+        pool.deallocate(b->index);
+        num_elements--;
+        // A tombstone is only needed if a probe sequence may continue past it.
+        const bucket* next = (b + 1 == table.data() + table.size()) ? table.data() : b + 1;
+        if (next->tag == EMPTY) {
+            b->tag = EMPTY;
+        } else {
+            b->tag = DELETED;
+            num_deleted++;
+        }
+        return make_iterator(b + 1);
+    }
+
+    iterator erase(const_iterator first, const_iterator last)
+    {
+        while (first != last) first = erase(first);
+        return iterator(last.pos, table.data() + table.size(), &pool);
+    }
+
+    size_type erase(const K& key)
+    {
+        const_iterator it = find(key);
+        if (it == end()) return 0;
+        erase(it);
+        return 1;
+    }
+
+    void clear()
+    {
+        for (const bucket& b : table) {
+            if (b.tag >= 2) pool.get(b.index)->~value_type();
+        }
+        table.clear();
+        table.shrink_to_fit();
+        pool.clear();
+        num_elements = 0;
+        num_deleted = 0;
+    }
+};
+
+#endif // BITCOIN_OPENHASHMAP_H
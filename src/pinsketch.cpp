@@ -0,0 +1,265 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <pinsketch.h>
+
+#include <crypto/common.h>
+
+#include <assert.h>
+
+namespace {
+
+/** Multiply in GF(2^32) = GF(2)[x] / (x^32 + x^7 + x^3 + x^2 + 1) */
+uint32_t GFMul(uint32_t a, uint32_t b)
+{
+    uint64_t r = 0;
+    for (int i = 0; i < 32; i++) {
+        r ^= ((uint64_t)a << i) & (0 - (uint64_t)((b >> i) & 1));
+    }
+    uint64_t hi = r >> 32;
+    r = (r & 0xffffffff) ^ hi ^ (hi << 2) ^ (hi << 3) ^ (hi << 7);
+    hi = r >> 32;
+    r = (r & 0xffffffff) ^ hi ^ (hi << 2) ^ (hi << 3) ^ (hi << 7);
+    return (uint32_t)r;
+}
+
+uint32_t GFInv(uint32_t a)
+{
+    // a^(2^32 - 2)
+    assert(a != 0);
+    uint32_t r = 1;
+    uint32_t p = a;
+    for (int i = 1; i < 32; i++) {
+        p = GFMul(p, p);
+        r = GFMul(r, p);
+    }
+    return r;
+}
+
+/** Polynomials over GF(2^32), lowest coefficient first, without leading zeros */
+typedef std::vector<uint32_t> Poly;
+
+void Trim(Poly& p)
+{
+    while (!p.empty() && p.back() == 0) p.pop_back();
+}
+
+void MakeMonic(Poly& p)
+{
+    uint32_t inv = GFInv(p.back());
+    for (uint32_t& c : p) c = GFMul(c, inv);
+}
+
+/** a mod m, m monic */
+void Mod(Poly& a, const Poly& m)
+{
+    if (a.size() < m.size()) return;
+    const size_t deg = m.size() - 1;
+    for (size_t i = a.size() - 1; i >= deg; i--) {
+        uint32_t c = a[i];
+        if (c != 0) {
+            for (size_t j = 0; j < deg; j++) {
+                a[i - deg + j] ^= GFMul(c, m[j]);
+            }
+        }
+        a[i] = 0;
+        if (i == deg) break;
+    }
+    a.resize(deg);
+    Trim(a);
+}
+
+/** a / b for b monic, where b divides a */
+Poly DivExact(Poly a, const Poly& b)
+{
+    const size_t deg = b.size() - 1;
+    Poly q(a.size() - deg, 0);
+    for (size_t i = a.size() - 1; i >= deg; i--) {
+        uint32_t c = a[i];
+        q[i - deg] = c;
+        if (c != 0) {
+            for (size_t j = 0; j < deg; j++) {
+                a[i - deg + j] ^= GFMul(c, b[j]);
+            }
+        }
+        if (i == deg) break;
+    }
+    return q;
+}
+
+/** The monic greatest common divisor of a and b */
+Poly Gcd(Poly a, Poly b)
+{
+    Trim(a);
+    Trim(b);
+    while (!b.empty()) {
+        MakeMonic(b);
+        Mod(a, b);
+        a.swap(b);
+    }
+    if (!a.empty()) MakeMonic(a);
+    return a;
+}
+
+/** p^2 mod m. Squaring is linear in characteristic 2, so each coefficient
+ *  only needs squaring. */
+Poly SqrMod(const Poly& p, const Poly& m)
+{
+    Poly r(p.empty() ? 0 : 2 * p.size() - 1, 0);
+    for (size_t i = 0; i < p.size(); i++) {
+        r[2 * i] = GFMul(p[i], p[i]);
+    }
+    Mod(r, m);
+    return r;
+}
+
+/**
+ * Find the roots of f, monic and known to be a product of distinct linear
+ * factors, by splitting it along the trace of beta * x for beta running
+ * through a basis of the field: the trace is 0 or 1 on every root, and for
+ * any two roots one of those betas tells them apart.
+ */
+bool FindRoots(const Poly& f, std::vector<uint32_t>& roots)
+{
+    if (f.size() <= 1) return true;
+    if (f.size() == 2) {
+        roots.push_back(f[0]);
+        return true;
+    }
+    for (int k = 0; k < 32; k++) {
+        Poly t{0, (uint32_t)1 << k};
+        Poly trace = t;
+        for (int i = 1; i < 32; i++) {
+            t = SqrMod(t, f);
+            if (trace.size() < t.size()) trace.resize(t.size(), 0);
+            for (size_t j = 0; j < t.size(); j++) trace[j] ^= t[j];
+        }
+        Trim(trace);
+        Poly g = Gcd(f, trace);
+        if (g.size() > 1 && g.size() < f.size()) {
+            return FindRoots(g, roots) && FindRoots(DivExact(f, g), roots);
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+void PinSketch::Add(uint32_t element)
+{
+    if (element == 0) return;
+    const uint32_t square = GFMul(element, element);
+    uint32_t power = element;
+    for (uint32_t& syndrome : m_syndromes) {
+        syndrome ^= power;
+        power = GFMul(power, square);
+    }
+}
+
+void PinSketch::Merge(const PinSketch& other)
+{
+    assert(other.m_syndromes.size() == m_syndromes.size());
+    for (size_t i = 0; i < m_syndromes.size(); i++) {
+        m_syndromes[i] ^= other.m_syndromes[i];
+    }
+}
+
+bool PinSketch::Decode(std::vector<uint32_t>& elements) const
+{
+    elements.clear();
+    const size_t capacity = m_syndromes.size();
+
+    // The even power sums follow from the odd ones: s_2k = s_k^2
+    std::vector<uint32_t> sums(2 * capacity);
+    for (size_t j = 1; j <= 2 * capacity; j++) {
+        sums[j - 1] = (j & 1) ? m_syndromes[j / 2] : GFMul(sums[j / 2 - 1], sums[j / 2 - 1]);
+    }
+
+    // Berlekamp-Massey: the shortest recurrence the power sums satisfy has
+    // as connection polynomial prod(1 - e * x) over the elements e
+    Poly c{1}, b{1};
+    size_t len = 0;
+    size_t shift = 1;
+    uint32_t b_disc = 1;
+    for (size_t n = 0; n < sums.size(); n++) {
+        uint32_t disc = sums[n];
+        for (size_t i = 1; i <= len && i < c.size(); i++) {
+            disc ^= GFMul(c[i], sums[n - i]);
+        }
+        if (disc == 0) {
+            shift++;
+            continue;
+        }
+        const uint32_t factor = GFMul(disc, GFInv(b_disc));
+        Poly prev = c;
+        if (c.size() < b.size() + shift) c.resize(b.size() + shift, 0);
+        for (size_t i = 0; i < b.size(); i++) {
+            c[i + shift] ^= GFMul(factor, b[i]);
+        }
+        if (2 * len <= n) {
+            len = n + 1 - len;
+            b.swap(prev);
+            b_disc = disc;
+            shift = 1;
+        } else {
+            shift++;
+        }
+    }
+    if (len > capacity) return false;
+    if (len == 0) return true;
+
+    // The elements are the roots of the reversed connection polynomial
+    c.resize(len + 1, 0);
+    Poly f(len + 1);
+    for (size_t i = 0; i <= len; i++) {
+        f[i] = c[len - i];
+    }
+    if (f[0] == 0) return false;
+
+    // Only a product of distinct linear factors divides x^(2^32) - x
+    if (len > 1) {
+        Poly x{0, 1};
+        Poly p = x;
+        for (int i = 0; i < 32; i++) {
+            p = SqrMod(p, f);
+        }
+        if (p != x) return false;
+    }
+
+    if (!FindRoots(f, elements) || elements.size() != len) {
+        elements.clear();
+        return false;
+    }
+
+    // Catch sets larger than the capacity that happened to decode into
+    // something, as far as the sketch allows
+    PinSketch check(capacity);
+    for (uint32_t element : elements) {
+        check.Add(element);
+    }
+    if (check.m_syndromes != m_syndromes) {
+        elements.clear();
+        return false;
+    }
+    return true;
+}
+
+std::vector<unsigned char> PinSketch::Serialize() const
+{
+    std::vector<unsigned char> data(4 * m_syndromes.size());
+    for (size_t i = 0; i < m_syndromes.size(); i++) {
+        WriteLE32(data.data() + 4 * i, m_syndromes[i]);
+    }
+    return data;
+}
+
+bool PinSketch::Deserialize(const std::vector<unsigned char>& data, PinSketch& sketch)
+{
+    if (data.size() % 4 != 0) return false;
+    sketch.m_syndromes.resize(data.size() / 4);
+    for (size_t i = 0; i < sketch.m_syndromes.size(); i++) {
+        sketch.m_syndromes[i] = ReadLE32(data.data() + 4 * i);
+    }
+    return true;
+}
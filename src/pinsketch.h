@@ -0,0 +1,54 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_PINSKETCH_H
+#define BITCOIN_PINSKETCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/**
+ * A PinSketch over GF(2^32): a sketch of a set of non-zero 32-bit elements
+ * that takes 4 bytes per unit of capacity, whatever the size of the set.
+ *
+ * The sketch holds the odd power sums of the elements, which are the
+ * syndromes of a BCH code. Adding an element twice removes it again, so
+ * merging the sketches of two sets gives the sketch of their symmetric
+ * difference, and that difference can be recovered when it has at most
+ * capacity elements.
+ */
+class PinSketch
+{
+public:
+    explicit PinSketch(size_t capacity) : m_syndromes(capacity, 0) {}
+
+    size_t GetCapacity() const { return m_syndromes.size(); }
+
+    /** Add element to the set, or remove it if it is in it already. Zero is
+     *  not a valid element and is ignored. */
+    void Add(uint32_t element);
+
+    /** Combine with the sketch of another set, of the same capacity, into the
+     *  sketch of the symmetric difference of both sets. */
+    void Merge(const PinSketch& other);
+
+    /** Recover the elements of the set. Returns false if the set has more
+     *  elements than the capacity of the sketch, which is not always
+     *  detected: a set that large may also come back as a wrong result. */
+    bool Decode(std::vector<uint32_t>& elements) const;
+
+    /** The sketch as 4 bytes per unit of capacity, little endian */
+    std::vector<unsigned char> Serialize() const;
+
+    /** Read a sketch from Serialize(). Returns false if the size of data is
+     *  not a multiple of 4. */
+    static bool Deserialize(const std::vector<unsigned char>& data, PinSketch& sketch);
+
+private:
+    //! Power sums of the elements, to the odd powers 1, 3, ..., 2 * capacity - 1
+    std::vector<uint32_t> m_syndromes;
+};
+
+#endif // BITCOIN_PINSKETCH_H
@@ -14,6 +14,10 @@
 
 static constexpr double INF_FEERATE = 1e99;
 
+/** Targets kept in the smart fee table: those offered by the GUI, which
+ *  include the wallet default, and 3 */
+static const unsigned int SMART_FEE_TABLE_TARGETS[] = {2, 3, 4, 6, 12, 24, 48, 144, 504, 1008};
+
 std::string StringForFeeEstimateHorizon(FeeEstimateHorizon horizon) {
     static const std::map<FeeEstimateHorizon, std::string> horizon_strings = {
         {FeeEstimateHorizon::SHORT_HALFLIFE, "short"},
@@ -105,6 +109,8 @@ private:
     // For each bucket X, track the number of transactions in the mempool
     // that are unconfirmed for each possible confirmation value Y
     std::vector<std::vector<int> > unconfTxs;  //unconfTxs[Y][X]
+    // For each bucket X, the sum of unconfTxs over all Y
+    std::vector<int> unconfTotal;
     // transactions still unconfirmed after GetMaxConfirms for each bucket
     std::vector<int> oldUnconfTxs;
 
@@ -202,6 +208,7 @@ void TxConfirmStats::resizeInMemoryCounters(size_t newbuckets) {
         unconfTxs[i].resize(newbuckets);
     }
     oldUnconfTxs.resize(newbuckets);
+    unconfTotal.resize(newbuckets);
 }
 
 // Roll the unconfirmed txs circular buffer
@@ -209,6 +216,7 @@ void TxConfirmStats::ClearCurrent(unsigned int nBlockHeight)
 {
     for (unsigned int j = 0; j < buckets.size(); j++) {
         oldUnconfTxs[j] += unconfTxs[nBlockHeight%unconfTxs.size()][j];
+        unconfTotal[j] -= unconfTxs[nBlockHeight%unconfTxs.size()][j];
         unconfTxs[nBlockHeight%unconfTxs.size()][j] = 0;
     }
 }
@@ -288,8 +296,16 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
         nConf += confAvg[periodTarget - 1][bucket];
         totalNum += txCtAvg[bucket];
         failNum += failAvg[periodTarget - 1][bucket];
-        for (unsigned int confct = confTarget; confct < GetMaxConfirms(); confct++)
-            extraNum += unconfTxs[(nBlockHeight - confct)%bins][bucket];
+        // Count the txs unconfirmed for confTarget blocks or more directly, or
+        // as all of them less the more recent ones, whichever is fewer bins
+        if ((unsigned int)confTarget < bins / 2) {
+            extraNum += unconfTotal[bucket];
+            for (unsigned int confct = 0; confct < (unsigned int)confTarget; confct++)
+                extraNum -= unconfTxs[(nBlockHeight - confct)%bins][bucket];
+        } else {
+            for (unsigned int confct = confTarget; confct < GetMaxConfirms(); confct++)
+                extraNum += unconfTxs[(nBlockHeight - confct)%bins][bucket];
+        }
         extraNum += oldUnconfTxs[bucket];
         // If we have enough transaction data points in this range of buckets,
         // we can test for success
@@ -464,6 +480,7 @@ unsigned int TxConfirmStats::NewTx(unsigned int nBlockHeight, double val)
     unsigned int bucketindex = bucketMap.lower_bound(val)->second;
     unsigned int blockIndex = nBlockHeight % unconfTxs.size();
     unconfTxs[blockIndex][bucketindex]++;
+    unconfTotal[bucketindex]++;
     return bucketindex;
 }
 
@@ -490,6 +507,7 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
         unsigned int blockIndex = entryHeight % unconfTxs.size();
         if (unconfTxs[blockIndex][bucketindex] > 0) {
             unconfTxs[blockIndex][bucketindex]--;
+            unconfTotal[bucketindex]--;
         } else {
             LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy error, mempool tx removed from blockIndex=%u,bucketIndex=%u already\n",
                      blockIndex, bucketindex);
@@ -659,6 +677,8 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
 
     trackedTxs = 0;
     untrackedTxs = 0;
+
+    UpdateSmartFeeTable();
 }
 
 CFeeRate CBlockPolicyEstimator::estimateFee(int confTarget) const
@@ -819,8 +839,43 @@ double CBlockPolicyEstimator::estimateConservativeFee(unsigned int doubleTarget,
  */
 CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const
 {
+    std::shared_ptr<const SmartFeeTable> table = std::atomic_load(&smartFeeTable);
+    if (table && confTarget > 0 && (unsigned int)confTarget <= table->nMaxTarget) {
+        unsigned int target = std::min(std::max((unsigned int)confTarget, 2U), table->nMaxUsable);
+        const auto& estimates = conservative ? table->conservative : table->economical;
+        auto it = estimates.find(target);
+        if (it != estimates.end()) {
+            if (feeCalc) {
+                *feeCalc = it->second.second;
+                feeCalc->desiredTarget = confTarget;
+            }
+            return it->second.first;
+        }
+    }
+
     LOCK(cs_feeEstimator);
+    return calculateSmartFee(confTarget, feeCalc, conservative);
+}
+
+void CBlockPolicyEstimator::UpdateSmartFeeTable()
+{
+    std::shared_ptr<SmartFeeTable> table = std::make_shared<SmartFeeTable>();
+    table->nMaxTarget = longStats->GetMaxConfirms();
+    table->nMaxUsable = MaxUsableEstimate();
+    for (unsigned int target : SMART_FEE_TABLE_TARGETS) {
+        target = std::min(target, table->nMaxUsable);
+        if (target <= 1 || table->economical.count(target)) continue;
+        FeeCalculation feeCalc;
+        CFeeRate feeRate = calculateSmartFee(target, &feeCalc, false);
+        table->economical.emplace(target, std::make_pair(feeRate, feeCalc));
+        feeRate = calculateSmartFee(target, &feeCalc, true);
+        table->conservative.emplace(target, std::make_pair(feeRate, feeCalc));
+    }
+    std::atomic_store(&smartFeeTable, std::shared_ptr<const SmartFeeTable>(std::move(table)));
+}
 
+CFeeRate CBlockPolicyEstimator::calculateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const
+{
     if (feeCalc) {
         feeCalc->desiredTarget = confTarget;
         feeCalc->returnedTarget = confTarget;
@@ -972,6 +1027,8 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
             nBestSeenHeight = nFileBestSeenHeight;
             historicalFirst = nFileHistoricalFirst;
             historicalBest = nFileHistoricalBest;
+
+            UpdateSmartFeeTable();
         }
     }
     catch (const std::exception& e) {
@@ -208,6 +208,8 @@ public:
      *  blocks. If no answer can be given at confTarget, return an estimate at
      *  the closest target where one can be given.  'conservative' estimates are
      *  valid over longer time horizons also.
+     *  Common targets are answered from a table taken after the last block,
+     *  without taking cs_feeEstimator.
      */
     CFeeRate estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const;
 
@@ -258,6 +260,22 @@ private:
 
     mutable CCriticalSection cs_feeEstimator;
 
+    /** Smart fee estimates for the common targets, taken after each block.
+     *  Replaced as a whole and read with std::atomic_load. */
+    struct SmartFeeTable
+    {
+        unsigned int nMaxTarget;        //!< Highest target tracked
+        unsigned int nMaxUsable;        //!< Targets above this are answered at it
+        std::map<unsigned int, std::pair<CFeeRate, FeeCalculation>> economical;
+        std::map<unsigned int, std::pair<CFeeRate, FeeCalculation>> conservative;
+    };
+    std::shared_ptr<const SmartFeeTable> smartFeeTable;
+
+    /** Recompute and publish smartFeeTable. Requires cs_feeEstimator. */
+    void UpdateSmartFeeTable();
+    /** estimateSmartFee without the table. Requires cs_feeEstimator. */
+    CFeeRate calculateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const;
+
     /** Process a transaction confirmed in a block*/
     bool processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry);
 
@@ -24,6 +24,10 @@ static const unsigned int DEFAULT_BLOCK_MAX_WEIGHT = 800000 - 4000;
 static const unsigned int DEFAULT_BLOCK_MIN_TX_FEE = 1000;
 /** The maximum weight for transactions we're willing to relay/mine */
 static const unsigned int MAX_STANDARD_TX_WEIGHT = 400000;
+/** The maximum number of transactions in a package we're willing to relay */
+static const unsigned int MAX_PACKAGE_COUNT = 25;
+/** The maximum total weight of a package we're willing to relay */
+static const unsigned int MAX_PACKAGE_WEIGHT = 404000;
 /** The minimum non-witness size for transactions we're willing to relay/mine (1 segwit input + 1 P2WPKH output = 82 bytes) */
 static const unsigned int MIN_STANDARD_TX_NONWITNESS_SIZE = 82;
 /** Maximum number of signature check operations in an IsStandard() P2SH script */
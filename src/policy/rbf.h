@@ -9,6 +9,10 @@
 
 static const uint32_t MAX_BIP125_RBF_SEQUENCE = 0xfffffffd;
 
+/** Maximum number of transactions a replacement may evict, counting the
+ *  cached descendant counts of the transactions it conflicts with */
+static const uint64_t MAX_BIP125_REPLACEMENT_CANDIDATES = 100;
+
 enum RBFTransactionState {
     RBF_TRANSACTIONSTATE_UNKNOWN,
     RBF_TRANSACTIONSTATE_REPLACEABLE_BIP125,
@@ -237,6 +237,75 @@ extern const char *GETBLOCKTXN;
  * @since protocol version 70014 as described by BIP 152
  */
 extern const char *BLOCKTXN;
+/**
+ * getcfilters requests compact filters for a range of blocks.
+ * Only available with service bit NODE_COMPACT_FILTERS as described by
+ * BIP 157 & 158.
+ */
+extern const char *GETCFILTERS;
+/**
+ * cfilter is a response to a getcfilters request containing a single compact
+ * filter.
+ */
+extern const char *CFILTER;
+/**
+ * getcfheaders requests a compact filter header and the filter hashes for a
+ * range of blocks, which can then be used to reconstruct the filter headers
+ * for those blocks.
+ * Only available with service bit NODE_COMPACT_FILTERS as described by
+ * BIP 157 & 158.
+ */
+extern const char *GETCFHEADERS;
+/**
+ * cfheaders is a response to a getcfheaders request containing a filter header
+ * and a vector of filter hashes for each subsequent block in the requested range.
+ */
+extern const char *CFHEADERS;
+/**
+ * getcfcheckpt requests evenly spaced compact filter headers, enabling
+ * parallelized download and validation of the headers between them.
+ * Only available with service bit NODE_COMPACT_FILTERS as described by
+ * BIP 157 & 158.
+ */
+extern const char *GETCFCHECKPT;
+/**
+ * cfcheckpt is a response to a getcfcheckpt request containing a vector of
+ * evenly spaced filter headers for blocks on the requested chain.
+ */
+extern const char *CFCHECKPT;
+/**
+ * getpkgtxns requests a transaction from the mempool together with its
+ * unconfirmed ancestors, so that they can be accepted as a package.
+ * Only available with service bit NODE_PACKAGE_RELAY.
+ */
+extern const char *GETPKGTXNS;
+/**
+ * pkgtxns is a response to a getpkgtxns request containing the package,
+ * sorted with parents before children.
+ */
+extern const char *PKGTXNS;
+/**
+ * sendtxrcncl offers to announce transactions through set reconciliation,
+ * giving the protocol version and our half of the salt for short ids.
+ * Only available with service bit NODE_TXRECONCILIATION.
+ */
+extern const char *SENDTXRCNCL;
+/**
+ * reqrecon asks the peer for a sketch of the transactions it has to announce
+ * to us, giving the size of our own set and the share of it expected to
+ * differ.
+ */
+extern const char *REQRECON;
+/**
+ * sketch is a response to a reqrecon message containing the PinSketch of the
+ * short ids of the transactions the peer has to announce to us.
+ */
+extern const char *SKETCH;
+/**
+ * reconcildiff finishes a reconciliation, telling whether the difference
+ * could be decoded and if so the short ids of the transactions we lack.
+ */
+extern const char *RECONCILDIFF;
 };
 
 /* Get a vector of all valid message types (see above) */
@@ -263,10 +332,21 @@ enum ServiceFlags : uint64_t {
     // NODE_XTHIN means the node supports Xtreme Thinblocks
     // If this is turned off then the node will not service nor make xthin requests
     NODE_XTHIN = (1 << 4),
+    // NODE_COMPACT_FILTERS means the node will service basic block filter requests.
+    // See BIP157 and BIP158 for details on how this is implemented.
+    NODE_COMPACT_FILTERS = (1 << 6),
     // NODE_NETWORK_LIMITED means the same as NODE_NETWORK with the limitation of only
     // serving the last 288 (2 day) blocks
     // See BIP159 for details on how this is implemented.
     NODE_NETWORK_LIMITED = (1 << 10),
+    // NODE_PACKAGE_RELAY means the node serves getpkgtxns requests and accepts
+    // the packages it receives in pkgtxns, where a child may pay for its parents.
+    // This is an experimental bit until it is allocated.
+    NODE_PACKAGE_RELAY = (1 << 24),
+    // NODE_TXRECONCILIATION means the node can announce transactions through
+    // set reconciliation instead of inv messages.
+    // This is an experimental bit until it is allocated.
+    NODE_TXRECONCILIATION = (1 << 25),
 
     // Bits 24-31 are reserved for temporary experiments. Just pick a bit that
     // isn't getting used, or one not being used much, and notify the
@@ -924,6 +924,15 @@ QString formatServicesStr(quint64 mask)
             case NODE_XTHIN:
                 strList.append("XTHIN");
                 break;
+            case NODE_COMPACT_FILTERS:
+                strList.append("COMPACT_FILTERS");
+                break;
+            case NODE_PACKAGE_RELAY:
+                strList.append("PACKAGE_RELAY");
+                break;
+            case NODE_TXRECONCILIATION:
+                strList.append("TXRECONCILIATION");
+                break;
             default:
                 strList.append(QString("%1[%2]").arg("UNKNOWN").arg(check));
             }
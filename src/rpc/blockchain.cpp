@@ -6,6 +6,8 @@
 #include <rpc/blockchain.h>
 
 #include <amount.h>
+#include <blockfilter.h>
+#include <base58.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
@@ -13,10 +15,14 @@
 #include <consensus/validation.h>
 #include <validation.h>
 #include <core_io.h>
+#include <index/addressindex.h>
+#include <index/blockfilterindex.h>
+#include <index/spentindex.h>
 #include <policy/feerate.h>
 #include <policy/policy.h>
 #include <primitives/transaction.h>
 #include <rpc/server.h>
+#include <script/standard.h>
 #include <streams.h>
 #include <sync.h>
 #include <txdb.h>
@@ -34,6 +40,7 @@
 #include <boost/thread/thread.hpp> // boost::thread::interrupt
 
 #include <memory>
+#include <tuple>
 #include <mutex>
 #include <condition_variable>
 
@@ -445,28 +452,24 @@ std::string EntryDescriptionString()
            "       ... ]\n";
 }
 
-void entryToJSON(UniValue &info, const CTxMemPoolEntry &e)
+void entryToJSON(UniValue &info, const TxMempoolSnapshotEntry &e)
 {
-    AssertLockHeld(mempool.cs);
-
-    info.push_back(Pair("size", (int)e.GetTxSize()));
-    info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
-    info.push_back(Pair("modifiedfee", ValueFromAmount(e.GetModifiedFee())));
-    info.push_back(Pair("time", e.GetTime()));
-    info.push_back(Pair("height", (int)e.GetHeight()));
-    info.push_back(Pair("descendantcount", e.GetCountWithDescendants()));
-    info.push_back(Pair("descendantsize", e.GetSizeWithDescendants()));
-    info.push_back(Pair("descendantfees", e.GetModFeesWithDescendants()));
-    info.push_back(Pair("ancestorcount", e.GetCountWithAncestors()));
-    info.push_back(Pair("ancestorsize", e.GetSizeWithAncestors()));
-    info.push_back(Pair("ancestorfees", e.GetModFeesWithAncestors()));
-    info.push_back(Pair("wtxid", mempool.vTxHashes[e.vTxHashesIdx].first.ToString()));
-    const CTransaction& tx = e.GetTx();
+    info.push_back(Pair("size", (int)e.nTxSize));
+    info.push_back(Pair("fee", ValueFromAmount(e.nFee)));
+    info.push_back(Pair("modifiedfee", ValueFromAmount(e.nModifiedFee)));
+    info.push_back(Pair("time", e.nTime));
+    info.push_back(Pair("height", (int)e.entryHeight));
+    info.push_back(Pair("descendantcount", e.nCountWithDescendants));
+    info.push_back(Pair("descendantsize", e.nSizeWithDescendants));
+    info.push_back(Pair("descendantfees", e.nModFeesWithDescendants));
+    info.push_back(Pair("ancestorcount", e.nCountWithAncestors));
+    info.push_back(Pair("ancestorsize", e.nSizeWithAncestors));
+    info.push_back(Pair("ancestorfees", e.nModFeesWithAncestors));
+    info.push_back(Pair("wtxid", e.tx->GetWitnessHash().ToString()));
     std::set<std::string> setDepends;
-    for (const CTxIn& txin : tx.vin)
+    for (const uint256& parent : e.vParents)
     {
-        if (mempool.exists(txin.prevout.hash))
-            setDepends.insert(txin.prevout.hash.ToString());
+        setDepends.insert(parent.ToString());
     }
 
     UniValue depends(UniValue::VARR);
@@ -480,13 +483,15 @@ void entryToJSON(UniValue &info, const CTxMemPoolEntry &e)
 
 UniValue mempoolToJSON(bool fVerbose)
 {
+    // Work from a snapshot, so that mempool.cs is only held to copy the
+    // entries and not while they are formatted
+    std::shared_ptr<const CTxMemPoolSnapshot> snapshot = mempool.GetSnapshot();
     if (fVerbose)
     {
-        LOCK(mempool.cs);
         UniValue o(UniValue::VOBJ);
-        for (const CTxMemPoolEntry& e : mempool.mapTx)
+        for (const TxMempoolSnapshotEntry& e : snapshot->entries)
         {
-            const uint256& hash = e.GetTx().GetHash();
+            const uint256& hash = e.tx->GetHash();
             UniValue info(UniValue::VOBJ);
             entryToJSON(info, e);
             o.push_back(Pair(hash.ToString(), info));
@@ -495,12 +500,9 @@ UniValue mempoolToJSON(bool fVerbose)
     }
     else
     {
-        std::vector<uint256> vtxid;
-        mempool.queryHashes(vtxid);
-
         UniValue a(UniValue::VARR);
-        for (const uint256& hash : vtxid)
-            a.push_back(hash.ToString());
+        for (const TxMempoolSnapshotEntry& e : snapshot->entries)
+            a.push_back(e.tx->GetHash().ToString());
 
         return a;
     }
@@ -570,32 +572,26 @@ UniValue getmempoolancestors(const JSONRPCRequest& request)
 
     uint256 hash = ParseHashV(request.params[0], "parameter 1");
 
-    LOCK(mempool.cs);
-
-    CTxMemPool::txiter it = mempool.mapTx.find(hash);
-    if (it == mempool.mapTx.end()) {
+    std::shared_ptr<const CTxMemPoolSnapshot> snapshot = mempool.GetSnapshot();
+    if (!snapshot->Find(hash)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
     }
 
-    CTxMemPool::setEntries setAncestors;
-    uint64_t noLimit = std::numeric_limits<uint64_t>::max();
-    std::string dummy;
-    mempool.CalculateMemPoolAncestors(*it, setAncestors, noLimit, noLimit, noLimit, noLimit, dummy, false);
+    std::vector<const TxMempoolSnapshotEntry*> vAncestors = snapshot->CalculateRelatives(hash, true);
 
     if (!fVerbose) {
         UniValue o(UniValue::VARR);
-        for (CTxMemPool::txiter ancestorIt : setAncestors) {
-            o.push_back(ancestorIt->GetTx().GetHash().ToString());
+        for (const TxMempoolSnapshotEntry* e : vAncestors) {
+            o.push_back(e->tx->GetHash().ToString());
         }
 
         return o;
     } else {
         UniValue o(UniValue::VOBJ);
-        for (CTxMemPool::txiter ancestorIt : setAncestors) {
-            const CTxMemPoolEntry &e = *ancestorIt;
-            const uint256& _hash = e.GetTx().GetHash();
+        for (const TxMempoolSnapshotEntry* e : vAncestors) {
+            const uint256& _hash = e->tx->GetHash();
             UniValue info(UniValue::VOBJ);
-            entryToJSON(info, e);
+            entryToJSON(info, *e);
             o.push_back(Pair(_hash.ToString(), info));
         }
         return o;
@@ -634,32 +630,26 @@ UniValue getmempooldescendants(const JSONRPCRequest& request)
 
     uint256 hash = ParseHashV(request.params[0], "parameter 1");
 
-    LOCK(mempool.cs);
-
-    CTxMemPool::txiter it = mempool.mapTx.find(hash);
-    if (it == mempool.mapTx.end()) {
+    std::shared_ptr<const CTxMemPoolSnapshot> snapshot = mempool.GetSnapshot();
+    if (!snapshot->Find(hash)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
     }
 
-    CTxMemPool::setEntries setDescendants;
-    mempool.CalculateDescendants(it, setDescendants);
-    // CTxMemPool::CalculateDescendants will include the given tx
-    setDescendants.erase(it);
+    std::vector<const TxMempoolSnapshotEntry*> vDescendants = snapshot->CalculateRelatives(hash, false);
 
     if (!fVerbose) {
         UniValue o(UniValue::VARR);
-        for (CTxMemPool::txiter descendantIt : setDescendants) {
-            o.push_back(descendantIt->GetTx().GetHash().ToString());
+        for (const TxMempoolSnapshotEntry* e : vDescendants) {
+            o.push_back(e->tx->GetHash().ToString());
         }
 
         return o;
     } else {
         UniValue o(UniValue::VOBJ);
-        for (CTxMemPool::txiter descendantIt : setDescendants) {
-            const CTxMemPoolEntry &e = *descendantIt;
-            const uint256& _hash = e.GetTx().GetHash();
+        for (const TxMempoolSnapshotEntry* e : vDescendants) {
+            const uint256& _hash = e->tx->GetHash();
             UniValue info(UniValue::VOBJ);
-            entryToJSON(info, e);
+            entryToJSON(info, *e);
             o.push_back(Pair(_hash.ToString(), info));
         }
         return o;
@@ -686,14 +676,11 @@ UniValue getmempoolentry(const JSONRPCRequest& request)
 
     uint256 hash = ParseHashV(request.params[0], "parameter 1");
 
-    LOCK(mempool.cs);
-
-    CTxMemPool::txiter it = mempool.mapTx.find(hash);
-    if (it == mempool.mapTx.end()) {
+    TxMempoolSnapshotEntry e;
+    if (!mempool.CopyEntry(hash, e)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Transaction not in mempool");
     }
 
-    const CTxMemPoolEntry &e = *it;
     UniValue info(UniValue::VOBJ);
     entryToJSON(info, e);
     return info;
@@ -962,7 +949,7 @@ UniValue pruneblockchain(const JSONRPCRequest& request)
             "1. \"height\"       (numeric, required) The block height to prune up to. May be set to a discrete height, or a unix timestamp\n"
             "                  to prune blocks whose block time is at least 2 hours older than the provided timestamp.\n"
             "\nResult:\n"
-            "n    (numeric) Height of the last block pruned.\n"
+            "n    (numeric) Height of the last block pruned. The files are deleted by the time this returns.\n"
             "\nExamples:\n"
             + HelpExampleCli("pruneblockchain", "1000")
             + HelpExampleRpc("pruneblockchain", "1000"));
@@ -970,35 +957,41 @@ UniValue pruneblockchain(const JSONRPCRequest& request)
     if (!fPruneMode)
         throw JSONRPCError(RPC_MISC_ERROR, "Cannot prune blocks because node is not in prune mode.");
 
-    LOCK(cs_main);
+    unsigned int height;
+    {
+        LOCK(cs_main);
 
-    int heightParam = request.params[0].get_int();
-    if (heightParam < 0)
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative block height.");
-
-    // Height value more than a billion is too high to be a block height, and
-    // too low to be a block time (corresponds to timestamp from Sep 2001).
-    if (heightParam > 1000000000) {
-        // Add a 2 hour buffer to include blocks which might have had old timestamps
-        CBlockIndex* pindex = chainActive.FindEarliestAtLeast(heightParam - TIMESTAMP_WINDOW);
-        if (!pindex) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, "Could not find block with at least the specified timestamp.");
+        int heightParam = request.params[0].get_int();
+        if (heightParam < 0)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Negative block height.");
+
+        // Height value more than a billion is too high to be a block height, and
+        // too low to be a block time (corresponds to timestamp from Sep 2001).
+        if (heightParam > 1000000000) {
+            // Add a 2 hour buffer to include blocks which might have had old timestamps
+            CBlockIndex* pindex = chainActive.FindEarliestAtLeast(heightParam - TIMESTAMP_WINDOW);
+            if (!pindex) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Could not find block with at least the specified timestamp.");
+            }
+            heightParam = pindex->nHeight;
         }
-        heightParam = pindex->nHeight;
-    }
 
-    unsigned int height = (unsigned int) heightParam;
-    unsigned int chainHeight = (unsigned int) chainActive.Height();
-    if (chainHeight < Params().PruneAfterHeight())
-        throw JSONRPCError(RPC_MISC_ERROR, "Blockchain is too short for pruning.");
-    else if (height > chainHeight)
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "Blockchain is shorter than the attempted prune height.");
-    else if (height > chainHeight - MIN_BLOCKS_TO_KEEP) {
-        LogPrint(BCLog::RPC, "Attempt to prune blocks close to the tip.  Retaining the minimum number of blocks.");
-        height = chainHeight - MIN_BLOCKS_TO_KEEP;
-    }
+        height = (unsigned int) heightParam;
+        unsigned int chainHeight = (unsigned int) chainActive.Height();
+        if (chainHeight < Params().PruneAfterHeight())
+            throw JSONRPCError(RPC_MISC_ERROR, "Blockchain is too short for pruning.");
+        else if (height > chainHeight)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Blockchain is shorter than the attempted prune height.");
+        else if (height > chainHeight - MIN_BLOCKS_TO_KEEP) {
+            LogPrint(BCLog::RPC, "Attempt to prune blocks close to the tip.  Retaining the minimum number of blocks.");
+            height = chainHeight - MIN_BLOCKS_TO_KEEP;
+        }
 
-    PruneBlockFilesManual(height);
+        PruneBlockFilesManual(height);
+    }
+    // The files are deleted on the background pruning thread; return once
+    // they are gone, without holding cs_main meanwhile
+    WaitForPrunedFileRemoval();
     return uint64_t(height);
 }
 
@@ -1044,6 +1037,55 @@ UniValue gettxoutsetinfo(const JSONRPCRequest& request)
     return ret;
 }
 
+UniValue getchainstateinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getchainstateinfo\n"
+            "\nReturns information about the coins cache and its most recent write to disk.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"bestblock\": \"hex\",      (string) The block the coins cache is consistent with\n"
+            "  \"cache_txouts\": n,         (numeric) The number of transaction outputs in the coins cache\n"
+            "  \"cache_usage\": n,          (numeric) The memory usage of the coins cache in bytes\n"
+            "  \"flushing\": true|false,    (boolean) Whether a background write of the cache is in progress\n"
+            "  \"pending_usage\": n,        (numeric) The memory usage of the entries the background write has yet to write, in bytes\n"
+            "  \"last_flush\": {            (json object) The last completed write of the cache to disk\n"
+            "     \"time\": n,              (numeric) The time the write started in seconds since epoch (Jan 1 1970 GMT)\n"
+            "     \"background\": true|false, (boolean) Whether the write ran in the background\n"
+            "     \"duration\": x.xxx,      (numeric) The time spent writing in seconds\n"
+            "     \"bytes\": n,             (numeric) The estimated number of bytes written\n"
+            "     \"txouts\": n,            (numeric) The number of changed transaction outputs written\n"
+            "     \"batches\": n            (numeric) The number of database batches used\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getchainstateinfo", "")
+            + HelpExampleRpc("getchainstateinfo", "")
+        );
+
+    UniValue ret(UniValue::VOBJ);
+    {
+        LOCK(cs_main);
+        ret.push_back(Pair("bestblock", pcoinsTip->GetBestBlock().GetHex()));
+        ret.push_back(Pair("cache_txouts", (int64_t)pcoinsTip->GetCacheSize()));
+        ret.push_back(Pair("cache_usage", (int64_t)pcoinsTip->DynamicMemoryUsage()));
+    }
+    ret.push_back(Pair("flushing", pcoinsdbview->IsFlushing()));
+    ret.push_back(Pair("pending_usage", (int64_t)pcoinsdbview->PendingMemoryUsage()));
+
+    CCoinsFlushStats stats = pcoinsdbview->GetLastFlushStats();
+    UniValue flush(UniValue::VOBJ);
+    flush.push_back(Pair("time", stats.nTime));
+    flush.push_back(Pair("background", stats.fBackground));
+    flush.push_back(Pair("duration", stats.nDuration * 0.000001));
+    flush.push_back(Pair("bytes", (uint64_t)stats.nBytes));
+    flush.push_back(Pair("txouts", (uint64_t)stats.nChanged));
+    flush.push_back(Pair("batches", (uint64_t)stats.nBatches));
+    ret.push_back(Pair("last_flush", flush));
+    return ret;
+}
+
 UniValue gettxout(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 2 || request.params.size() > 3)
@@ -1253,6 +1295,14 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
             "  \"pruneheight\": xxxxxx,        (numeric) lowest-height complete block stored (only present if pruning is enabled)\n"
             "  \"automatic_pruning\": xx,      (boolean) whether automatic pruning is enabled (only present if pruning is enabled)\n"
             "  \"prune_target_size\": xxxxxx,  (numeric) the target size used by pruning (only present if automatic pruning is enabled)\n"
+            "  \"undo_pruneheight\": xxxxxx,   (numeric) lowest height from which undo data is stored for every block (only present if pruning is enabled)\n"
+            "  \"prune_undo_target_size\": xxxxxx, (numeric) the target size used for undo data (only present if automatic pruning and -pruneundo are enabled)\n"
+            "  \"prune_keep_days\": xx,       (numeric) days of blocks before the tip that are never pruned automatically (only present if automatic pruning and -prunekeepdays are enabled)\n"
+            "  \"prune_progress\": {          (object) removal of pruned files, which runs in the background (only present if pruning is enabled)\n"
+            "     \"pending_files\": xx,      (numeric) files waiting to be removed\n"
+            "     \"removed_files\": xx,      (numeric) files removed since startup\n"
+            "     \"removed_bytes\": xx,      (numeric) bytes freed since startup\n"
+            "  },\n"
             "  \"softforks\": [                (array) status of softforks in progress\n"
             "     {\n"
             "        \"id\": \"xxxx\",           (string) name of softfork\n"
@@ -1321,6 +1371,25 @@ UniValue getblockchaininfo(const JSONRPCRequest& request)
         if (automatic_pruning) {
             obj.push_back(Pair("prune_target_size",  nPruneTarget));
         }
+
+        CBlockIndex* undo_block = chainActive.Tip();
+        while (undo_block->pprev && (undo_block->pprev->nStatus & BLOCK_HAVE_UNDO)) {
+            undo_block = undo_block->pprev;
+        }
+        obj.push_back(Pair("undo_pruneheight",   undo_block->nHeight));
+        if (automatic_pruning && nPruneUndoTarget) {
+            obj.push_back(Pair("prune_undo_target_size", nPruneUndoTarget));
+        }
+        if (automatic_pruning && nPruneKeepTime) {
+            obj.push_back(Pair("prune_keep_days",    nPruneKeepTime / (24 * 60 * 60)));
+        }
+
+        const PruneProgress progress = GetPruneProgress();
+        UniValue prune_progress(UniValue::VOBJ);
+        prune_progress.push_back(Pair("pending_files", progress.nPendingFiles));
+        prune_progress.push_back(Pair("removed_files", progress.nRemovedFiles));
+        prune_progress.push_back(Pair("removed_bytes", progress.nRemovedBytes));
+        obj.push_back(Pair("prune_progress",     prune_progress));
     }
 
     const Consensus::Params& consensusParams = Params().GetConsensus();
@@ -1706,21 +1775,416 @@ UniValue savemempool(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+static void EnsureAddressIndexReady()
+{
+    if (!g_addressindex) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index not enabled. Use -addressindex to enable it");
+    }
+    if (!g_addressindex->BlockUntilSyncedToCurrentChain()) {
+        throw JSONRPCError(RPC_MISC_ERROR, strprintf("Address index is still being built (indexed up to height %d)",
+                                                     g_addressindex->GetBestHeight()));
+    }
+}
+
+/** Parse the addresses argument, a single address or an array of them, into their scriptPubKeys. */
+static std::vector<std::pair<std::string, CScript>> ParseAddressesParam(const UniValue& param)
+{
+    std::vector<std::string> addresses;
+    if (param.isStr()) {
+        addresses.push_back(param.get_str());
+    } else {
+        const UniValue& array = param.get_array();
+        for (size_t i = 0; i < array.size(); ++i) {
+            addresses.push_back(array[i].get_str());
+        }
+    }
+
+    std::vector<std::pair<std::string, CScript>> scripts;
+    std::set<std::string> seen;
+    for (const std::string& address : addresses) {
+        CTxDestination dest = DecodeDestination(address);
+        if (!IsValidDestination(dest)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, std::string("Invalid address: ") + address);
+        }
+        if (seen.insert(address).second) {
+            scripts.emplace_back(address, GetScriptForDestination(dest));
+        }
+    }
+    return scripts;
+}
+
+/** Parse the optional start and end heights of an address index query. */
+static void ParseHeightRange(const UniValue& start_param, const UniValue& end_param, int& start_height, int& end_height)
+{
+    start_height = start_param.isNull() ? 0 : start_param.get_int();
+    end_height = end_param.isNull() ? std::numeric_limits<int>::max() : end_param.get_int();
+    if (start_height < 0 || end_height < start_height) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid height range: start must be at least 0 and end at least start");
+    }
+}
+
+UniValue getaddressutxos(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
+        throw std::runtime_error(
+            "getaddressutxos [\"address\",...] ( start end )\n"
+            "\nReturns the unspent outputs paying to the given addresses, in the order they were confirmed.\n"
+            "Requires -addressindex. Mempool transactions are not taken into account.\n"
+            "\nArguments:\n"
+            "1. \"addresses\"   (json array, required) The addresses to look up\n"
+            "    [\n"
+            "      \"address\"  (string) An address\n"
+            "      ,...\n"
+            "    ]\n"
+            "2. start         (numeric, optional, default=0) Only return outputs confirmed at or after this height\n"
+            "3. end           (numeric, optional) Only return outputs confirmed at or before this height\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\" : \"address\",   (string) The address the output pays to\n"
+            "    \"txid\" : \"hash\",         (string) The transaction id\n"
+            "    \"vout\" : n,              (numeric) The output index\n"
+            "    \"scriptPubKey\" : \"hex\",  (string) The output script\n"
+            "    \"amount\" : x.xxx,        (numeric) The output value in " + CURRENCY_UNIT + "\n"
+            "    \"height\" : n             (numeric) The height of the block the output was confirmed in\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressutxos", "'[\"myaddress\"]'")
+            + HelpExampleCli("getaddressutxos", "'[\"myaddress\"]' 1000 2000")
+            + HelpExampleRpc("getaddressutxos", "[\"myaddress\"], 1000, 2000")
+        );
+
+    std::vector<std::pair<std::string, CScript>> scripts = ParseAddressesParam(request.params[0]);
+    int start_height, end_height;
+    ParseHeightRange(request.params[1], request.params[2], start_height, end_height);
+
+    EnsureAddressIndexReady();
+
+    std::vector<std::pair<size_t, AddressUnspent>> unspent;
+    for (size_t i = 0; i < scripts.size(); ++i) {
+        std::vector<AddressUnspent> script_unspent;
+        if (!g_addressindex->FindUnspent(AddressIndex::GetScriptHash(scripts[i].second), start_height, end_height, script_unspent)) {
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read address index");
+        }
+        for (const AddressUnspent& entry : script_unspent) {
+            unspent.emplace_back(i, entry);
+        }
+    }
+    std::stable_sort(unspent.begin(), unspent.end(),
+        [](const std::pair<size_t, AddressUnspent>& a, const std::pair<size_t, AddressUnspent>& b) {
+            return std::tie(a.second.height, a.second.tx_pos, a.second.outpoint.n) <
+                   std::tie(b.second.height, b.second.tx_pos, b.second.outpoint.n);
+        });
+
+    UniValue result(UniValue::VARR);
+    for (const auto& entry : unspent) {
+        const CScript& script = scripts[entry.first].second;
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("address", scripts[entry.first].first));
+        obj.push_back(Pair("txid", entry.second.outpoint.hash.GetHex()));
+        obj.push_back(Pair("vout", (int64_t)entry.second.outpoint.n));
+        obj.push_back(Pair("scriptPubKey", HexStr(script.begin(), script.end())));
+        obj.push_back(Pair("amount", ValueFromAmount(entry.second.value)));
+        obj.push_back(Pair("height", entry.second.height));
+        result.push_back(obj);
+    }
+    return result;
+}
+
+UniValue getaddressbalance(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "getaddressbalance [\"address\",...]\n"
+            "\nReturns the confirmed balance of the given addresses, and the total they have ever received.\n"
+            "Requires -addressindex. Mempool transactions are not taken into account.\n"
+            "\nArguments:\n"
+            "1. \"addresses\"   (json array, required) The addresses to look up\n"
+            "    [\n"
+            "      \"address\"  (string) An address\n"
+            "      ,...\n"
+            "    ]\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"balance\" : x.xxx,   (numeric) The value of the unspent outputs in " + CURRENCY_UNIT + "\n"
+            "  \"received\" : x.xxx   (numeric) The value of all outputs ever received in " + CURRENCY_UNIT + "\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressbalance", "'[\"myaddress\"]'")
+            + HelpExampleRpc("getaddressbalance", "[\"myaddress\"]")
+        );
+
+    std::vector<std::pair<std::string, CScript>> scripts = ParseAddressesParam(request.params[0]);
+
+    EnsureAddressIndexReady();
+
+    CAmount balance = 0;
+    CAmount received = 0;
+    for (const auto& script : scripts) {
+        AddressBalance script_balance;
+        if (!g_addressindex->FindBalance(AddressIndex::GetScriptHash(script.second), script_balance)) {
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read address index");
+        }
+        balance += script_balance.balance;
+        received += script_balance.received;
+    }
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("balance", ValueFromAmount(balance)));
+    result.push_back(Pair("received", ValueFromAmount(received)));
+    return result;
+}
+
+UniValue getaddresstxids(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
+        throw std::runtime_error(
+            "getaddresstxids [\"address\",...] ( start end )\n"
+            "\nReturns the ids of the confirmed transactions paying to or spending from the given addresses,\n"
+            "in the order they were confirmed. Requires -addressindex.\n"
+            "\nArguments:\n"
+            "1. \"addresses\"   (json array, required) The addresses to look up\n"
+            "    [\n"
+            "      \"address\"  (string) An address\n"
+            "      ,...\n"
+            "    ]\n"
+            "2. start         (numeric, optional, default=0) Only return transactions confirmed at or after this height\n"
+            "3. end           (numeric, optional) Only return transactions confirmed at or before this height\n"
+            "\nResult:\n"
+            "[\n"
+            "  \"txid\"         (string) The transaction id\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddresstxids", "'[\"myaddress\"]'")
+            + HelpExampleCli("getaddresstxids", "'[\"myaddress\"]' 1000 2000")
+            + HelpExampleRpc("getaddresstxids", "[\"myaddress\"], 1000, 2000")
+        );
+
+    std::vector<std::pair<std::string, CScript>> scripts = ParseAddressesParam(request.params[0]);
+    int start_height, end_height;
+    ParseHeightRange(request.params[1], request.params[2], start_height, end_height);
+
+    EnsureAddressIndexReady();
+
+    std::vector<AddressDelta> deltas;
+    for (const auto& script : scripts) {
+        if (!g_addressindex->FindDeltas(AddressIndex::GetScriptHash(script.second), start_height, end_height, deltas)) {
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read address index");
+        }
+    }
+    std::stable_sort(deltas.begin(), deltas.end(),
+        [](const AddressDelta& a, const AddressDelta& b) { return std::tie(a.height, a.tx_pos) < std::tie(b.height, b.tx_pos); });
+
+    UniValue result(UniValue::VARR);
+    std::set<uint256> seen;
+    for (const AddressDelta& delta : deltas) {
+        if (seen.insert(delta.txid).second) {
+            result.push_back(delta.txid.GetHex());
+        }
+    }
+    return result;
+}
+
+UniValue getblockfilter(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
+        throw std::runtime_error(
+            "getblockfilter \"blockhash\" ( \"filtertype\" )\n"
+            "\nRetrieve a BIP 157 content filter for a particular block. Requires -blockfilterindex.\n"
+            "\nArguments:\n"
+            "1. \"blockhash\"    (string, required) The hash of the block\n"
+            "2. \"filtertype\"   (string, optional, default=basic) The type name of the filter\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"filter\" : \"hex\",  (string) the hex-encoded filter data\n"
+            "  \"header\" : \"hex\"   (string) the hex-encoded filter header\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\" \"basic\"")
+            + HelpExampleRpc("getblockfilter", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\", \"basic\"")
+        );
+
+    uint256 block_hash = ParseHashV(request.params[0], "blockhash");
+    std::string filtertype_name = "basic";
+    if (!request.params[1].isNull()) {
+        filtertype_name = request.params[1].get_str();
+    }
+
+    BlockFilterType filtertype;
+    if (!BlockFilterTypeByName(filtertype_name, filtertype)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown filtertype");
+    }
+
+    BlockFilterIndex* index = GetBlockFilterIndex(filtertype);
+    if (!index) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Index is not enabled for filtertype " + filtertype_name);
+    }
+
+    const CBlockIndex* block_index;
+    bool block_was_connected;
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator mi = mapBlockIndex.find(block_hash);
+        if (mi == mapBlockIndex.end()) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        }
+        block_index = mi->second;
+        block_was_connected = block_index->IsValid(BLOCK_VALID_SCRIPTS);
+    }
+
+    bool index_ready = index->BlockUntilSyncedToCurrentChain();
+
+    BlockFilter filter;
+    uint256 filter_header;
+    if (!index->LookupFilter(block_index, filter) ||
+        !index->LookupFilterHeader(block_index, filter_header)) {
+        int err_code;
+        std::string errmsg = "Filter not found.";
+
+        if (!block_was_connected) {
+            err_code = RPC_INVALID_ADDRESS_OR_KEY;
+            errmsg += " Block was not connected to active chain.";
+        } else if (!index_ready) {
+            err_code = RPC_MISC_ERROR;
+            errmsg += " Block filters are still in the process of being indexed.";
+        } else {
+            err_code = RPC_INTERNAL_ERROR;
+            errmsg += " This error is unexpected and indicates index corruption.";
+        }
+
+        throw JSONRPCError(err_code, errmsg);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("filter", HexStr(filter.GetEncodedFilter())));
+    ret.push_back(Pair("header", filter_header.GetHex()));
+    return ret;
+}
+
+UniValue gettxspendingprevout(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1)
+        throw std::runtime_error(
+            "gettxspendingprevout [{\"txid\":\"id\",\"vout\":n},...]\n"
+            "\nReturns the transactions spending the given outputs, looking in the mempool and,\n"
+            "with -spentindex, in the active chain.\n"
+            "\nArguments:\n"
+            "1. \"outputs\"         (json array, required) The outputs to look up\n"
+            "    [\n"
+            "      {\n"
+            "        \"txid\":\"id\",  (string, required) The transaction id\n"
+            "        \"vout\":n       (numeric, required) The output number\n"
+            "      }\n"
+            "      ,...\n"
+            "    ]\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"txid\" : \"id\",          (string) The transaction id of the output\n"
+            "    \"vout\" : n,             (numeric) The output number\n"
+            "    \"spendingtxid\" : \"id\",  (string, optional) The transaction id of the spender, if any\n"
+            "    \"spendingvin\" : n,      (numeric, optional) The input number of the spender\n"
+            "    \"blockheight\" : n,      (numeric, optional) The height of the block containing the spender,\n"
+            "                                       absent while the spender is in the mempool\n"
+            "    \"value\" : x.xxx         (numeric, optional) The value of the output in " + CURRENCY_UNIT + ", for confirmed spends\n"
+            "  }\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("gettxspendingprevout", "'[{\"txid\":\"mytxid\",\"vout\":0}]'")
+            + HelpExampleRpc("gettxspendingprevout", "[{\"txid\":\"mytxid\",\"vout\":0}]")
+        );
+
+    const UniValue& outputs = request.params[0].get_array();
+    if (outputs.empty()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, outputs are missing");
+    }
+
+    std::vector<COutPoint> prevouts;
+    prevouts.reserve(outputs.size());
+    for (size_t i = 0; i < outputs.size(); ++i) {
+        const UniValue& output = outputs[i];
+        if (!output.isObject()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, expected object with {\"txid\",\"vout\"}");
+        }
+        RPCTypeCheckObj(output,
+            {
+                {"txid", UniValueType(UniValue::VSTR)},
+                {"vout", UniValueType(UniValue::VNUM)},
+            });
+
+        const uint256 txid = ParseHashO(output, "txid");
+        const int nOutput = find_value(output, "vout").get_int();
+        if (nOutput < 0) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid parameter, vout must be positive");
+        }
+        prevouts.emplace_back(txid, nOutput);
+    }
+
+    if (g_spentindex && !g_spentindex->BlockUntilSyncedToCurrentChain()) {
+        throw JSONRPCError(RPC_MISC_ERROR, strprintf("Spent index is still being built (indexed up to height %d)",
+                                                     g_spentindex->GetBestHeight()));
+    }
+
+    UniValue result(UniValue::VARR);
+    for (const COutPoint& prevout : prevouts) {
+        UniValue o(UniValue::VOBJ);
+        o.push_back(Pair("txid", prevout.hash.GetHex()));
+        o.push_back(Pair("vout", (uint64_t)prevout.n));
+
+        bool found = false;
+        {
+            LOCK(mempool.cs);
+            auto it = mempool.mapNextTx.find(prevout);
+            if (it != mempool.mapNextTx.end()) {
+                const CTransaction& spender = *it->second;
+                for (uint32_t n = 0; n < spender.vin.size(); ++n) {
+                    if (spender.vin[n].prevout == prevout) {
+                        o.push_back(Pair("spendingtxid", spender.GetHash().GetHex()));
+                        o.push_back(Pair("spendingvin", (uint64_t)n));
+                        break;
+                    }
+                }
+                found = true;
+            }
+        }
+
+        SpentInfo info;
+        if (!found && g_spentindex && g_spentindex->FindSpend(prevout, info)) {
+            o.push_back(Pair("spendingtxid", info.txid.GetHex()));
+            o.push_back(Pair("spendingvin", (uint64_t)info.input_index));
+            o.push_back(Pair("blockheight", info.height));
+            o.push_back(Pair("value", ValueFromAmount(info.value)));
+        }
+        result.push_back(o);
+    }
+    return result;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         argNames
   //  --------------------- ------------------------  -----------------------  ----------
     { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      {} },
+    { "blockchain",         "getaddressbalance",      &getaddressbalance,      {"addresses"} },
+    { "blockchain",         "getaddresstxids",        &getaddresstxids,        {"addresses","start","end"} },
+    { "blockchain",         "getaddressutxos",        &getaddressutxos,        {"addresses","start","end"} },
     { "blockchain",         "getchaintxstats",        &getchaintxstats,        {"nblocks", "blockhash"} },
     { "blockchain",         "getbestblockhash",       &getbestblockhash,       {} },
     { "blockchain",         "getblockcount",          &getblockcount,          {} },
+    { "blockchain",         "getblockfilter",         &getblockfilter,         {"blockhash", "filtertype"} },
     { "blockchain",         "getblock",               &getblock,               {"blockhash","verbosity|verbose"} },
     { "blockchain",         "getblockhash",           &getblockhash,           {"height"} },
     { "blockchain",         "getblockheader",         &getblockheader,         {"blockhash","verbose"} },
     { "blockchain",         "getchaintips",           &getchaintips,           {} },
+    { "blockchain",         "getchainstateinfo",      &getchainstateinfo,      {} },
     { "blockchain",         "getdifficulty",          &getdifficulty,          {} },
     { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    {"txid","verbose"} },
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  {"txid","verbose"} },
     { "blockchain",         "getmempoolentry",        &getmempoolentry,        {"txid"} },
+    { "blockchain",         "gettxspendingprevout",   &gettxspendingprevout,   {"outputs"} },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          {"verbose"} },
     { "blockchain",         "gettxout",               &gettxout,               {"txid","n","include_mempool"} },
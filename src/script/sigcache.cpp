@@ -57,6 +57,27 @@ public:
     {
         return setValid.setup_bytes(n);
     }
+
+    void Dump(uint256& nonce_out, std::vector<uint256>& entries)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        nonce_out = nonce;
+        entries = setValid.live_elements();
+    }
+
+    bool Load(const uint256& nonce_in, const std::vector<uint256>& entries)
+    {
+        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+        // Entries already held were computed under the current nonce.
+        if (nonce_in != nonce && !setValid.live_elements().empty()) {
+            return false;
+        }
+        nonce = nonce_in;
+        for (const uint256& entry : entries) {
+            setValid.insert(entry);
+        }
+        return true;
+    }
 };
 
 /* In previous versions of this code, signatureCache was a local static variable
@@ -80,6 +101,16 @@ void InitSignatureCache()
             (nElems*sizeof(uint256)) >>20, (nMaxCacheSize*2)>>20, nElems);
 }
 
+void DumpSignatureCache(uint256& nonce, std::vector<uint256>& entries)
+{
+    signatureCache.Dump(nonce, entries);
+}
+
+bool LoadSignatureCache(const uint256& nonce, const std::vector<uint256>& entries)
+{
+    return signatureCache.Load(nonce, entries);
+}
+
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
     uint256 entry;
@@ -53,4 +53,12 @@ public:
 
 void InitSignatureCache();
 
+/** Copy out the signature cache nonce and the entries it currently holds. */
+void DumpSignatureCache(uint256& nonce, std::vector<uint256>& entries);
+
+/** Adopt a nonce and entries previously returned by DumpSignatureCache.
+ *  Entries are only meaningful under the nonce they were computed with, so
+ *  this fails if the cache already holds entries under a different nonce. */
+bool LoadSignatureCache(const uint256& nonce, const std::vector<uint256>& entries);
+
 #endif // BITCOIN_SCRIPT_SIGCACHE_H
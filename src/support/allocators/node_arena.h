@@ -0,0 +1,204 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_NODE_ARENA_H
+#define BITCOIN_SUPPORT_ALLOCATORS_NODE_ARENA_H
+
+#include <memusage.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+/**
+ * Memory for the nodes of node-based containers. Single nodes are carved
+ * from large chunks, one pool per node size, and freed nodes are kept on a
+ * free list for reuse. This saves the malloc overhead of every node and
+ * keeps the memory in use known exactly. Larger allocations, such as the
+ * bucket array of a hash table, are passed on to the heap but counted.
+ *
+ * Not thread safe: the containers using an arena must be guarded by one lock.
+ */
+class NodeArena
+{
+private:
+    static const size_t CHUNK_SIZE = 64 * 1024;
+
+    struct Pool {
+        size_t nBlockSize;
+        std::vector<char*> vChunks;
+        char* pFree = nullptr;      //!< Free list, linked through the blocks
+        size_t nChunkUsed = 0;      //!< Bytes handed out of the last chunk
+        size_t nBlocksInUse = 0;
+
+        explicit Pool(size_t nBlockSizeIn) : nBlockSize(nBlockSizeIn) {}
+    };
+
+    std::vector<Pool> vPools;
+    size_t nLargeUsage = 0;
+
+    static size_t BlockSize(size_t nSize)
+    {
+        const size_t align = alignof(std::max_align_t);
+        return (std::max(nSize, sizeof(void*)) + align - 1) / align * align;
+    }
+
+    Pool& GetPool(size_t nBlockSize)
+    {
+        for (Pool& pool : vPools) {
+            if (pool.nBlockSize == nBlockSize) return pool;
+        }
+        vPools.emplace_back(nBlockSize);
+        return vPools.back();
+    }
+
+    static size_t ChunkSize(const Pool& pool)
+    {
+        return std::max(CHUNK_SIZE / pool.nBlockSize, (size_t)1) * pool.nBlockSize;
+    }
+
+    static void Release(Pool& pool)
+    {
+        for (char* chunk : pool.vChunks) {
+            ::operator delete(chunk);
+        }
+        pool.vChunks.clear();
+        pool.pFree = nullptr;
+        pool.nChunkUsed = 0;
+    }
+
+public:
+    NodeArena() {}
+    NodeArena(const NodeArena&) = delete;
+    NodeArena& operator=(const NodeArena&) = delete;
+
+    ~NodeArena()
+    {
+        for (Pool& pool : vPools) {
+            Release(pool);
+        }
+    }
+
+    void* Allocate(size_t nSize)
+    {
+        Pool& pool = GetPool(BlockSize(nSize));
+        ++pool.nBlocksInUse;
+        if (pool.pFree) {
+            char* p = pool.pFree;
+            pool.pFree = *reinterpret_cast<char**>(p);
+            return p;
+        }
+        if (pool.vChunks.empty() || pool.nChunkUsed == ChunkSize(pool)) {
+            pool.vChunks.push_back(static_cast<char*>(::operator new(ChunkSize(pool))));
+            pool.nChunkUsed = 0;
+        }
+        char* p = pool.vChunks.back() + pool.nChunkUsed;
+        pool.nChunkUsed += pool.nBlockSize;
+        return p;
+    }
+
+    void Deallocate(void* p, size_t nSize)
+    {
+        Pool& pool = GetPool(BlockSize(nSize));
+        *reinterpret_cast<char**>(p) = pool.pFree;
+        pool.pFree = static_cast<char*>(p);
+        // Give the chunks back once a pool is empty
+        if (--pool.nBlocksInUse == 0) Release(pool);
+    }
+
+    void* AllocateLarge(size_t nSize)
+    {
+        void* p = ::operator new(nSize);
+        nLargeUsage += memusage::MallocUsage(nSize);
+        return p;
+    }
+
+    void DeallocateLarge(void* p, size_t nSize)
+    {
+        nLargeUsage -= memusage::MallocUsage(nSize);
+        ::operator delete(p);
+    }
+
+    /** Memory in use by the containers, in bytes */
+    size_t DynamicMemoryUsage() const
+    {
+        size_t nUsage = nLargeUsage;
+        for (const Pool& pool : vPools) {
+            nUsage += pool.nBlocksInUse * pool.nBlockSize;
+        }
+        return nUsage;
+    }
+
+    /** Memory taken from the heap, including free blocks not yet reused */
+    size_t AllocatedMemory() const
+    {
+        size_t nUsage = nLargeUsage;
+        for (const Pool& pool : vPools) {
+            nUsage += pool.vChunks.size() * memusage::MallocUsage(ChunkSize(pool)) + memusage::DynamicUsage(pool.vChunks);
+        }
+        return nUsage + memusage::DynamicUsage(vPools);
+    }
+};
+
+/** Allocator for containers that take their nodes from a NodeArena */
+template <typename T>
+class node_arena_allocator
+{
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+
+    template <typename U>
+    struct rebind {
+        typedef node_arena_allocator<U> other;
+    };
+
+    explicit node_arena_allocator(NodeArena* arenaIn) noexcept : arena(arenaIn) {}
+    template <typename U>
+    node_arena_allocator(const node_arena_allocator<U>& a) noexcept : arena(a.arena) {}
+
+    size_type max_size() const noexcept { return std::numeric_limits<size_type>::max() / sizeof(T); }
+
+    T* allocate(std::size_t n)
+    {
+        // n * sizeof(T) would wrap around
+        if (n > max_size()) throw std::bad_array_new_length();
+        if (n == 1) return static_cast<T*>(arena->Allocate(sizeof(T)));
+        return static_cast<T*>(arena->AllocateLarge(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        if (n == 1) {
+            arena->Deallocate(p, sizeof(T));
+        } else {
+            arena->DeallocateLarge(p, n * sizeof(T));
+        }
+    }
+
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args) { ::new ((void*)p) U(std::forward<Args>(args)...); }
+    template <typename U>
+    void destroy(U* p) { p->~U(); }
+
+    template <typename U>
+    bool operator==(const node_arena_allocator<U>& a) const { return arena == a.arena; }
+    template <typename U>
+    bool operator!=(const node_arena_allocator<U>& a) const { return arena != a.arena; }
+
+private:
+    template <typename U> friend class node_arena_allocator;
+    NodeArena* arena;
+};
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_NODE_ARENA_H
@@ -11,6 +11,7 @@
 #include <pow.h>
 #include <script/sign.h>
 #include <serialize.h>
+#include <txorphanage.h>
 #include <util.h>
 #include <validation.h>
 
@@ -20,17 +21,6 @@
 
 #include <boost/test/unit_test.hpp>
 
-// Tests these internal-to-net_processing.cpp methods:
-extern bool AddOrphanTx(const CTransactionRef& tx, NodeId peer);
-extern void EraseOrphansFor(NodeId peer);
-extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans);
-struct COrphanTx {
-    CTransactionRef tx;
-    NodeId fromPeer;
-    int64_t nTimeExpire;
-};
-extern std::map<uint256, COrphanTx> mapOrphanTransactions;
-
 CService ip(uint32_t i)
 {
     struct in_addr s;
@@ -293,14 +283,9 @@ BOOST_AUTO_TEST_CASE(DoS_bantime)
     peerLogic->FinalizeNode(dummyNode.GetId(), dummy);
 }
 
-CTransactionRef RandomOrphan()
+static CTransactionRef RandomOrphan(const std::vector<CTransactionRef>& vOrphans)
 {
-    std::map<uint256, COrphanTx>::iterator it;
-    LOCK(cs_main);
-    it = mapOrphanTransactions.lower_bound(InsecureRand256());
-    if (it == mapOrphanTransactions.end())
-        it = mapOrphanTransactions.begin();
-    return it->second.tx;
+    return vOrphans[InsecureRandRange(vOrphans.size())];
 }
 
 BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
@@ -310,6 +295,9 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
     CBasicKeyStore keystore;
     keystore.AddKey(key);
 
+    TxOrphanage orphanage;
+    std::vector<CTransactionRef> vOrphans;
+
     // 50 orphan transactions:
     for (int i = 0; i < 50; i++)
     {
@@ -322,13 +310,14 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
         tx.vout[0].nValue = 1*CENT;
         tx.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
 
-        AddOrphanTx(MakeTransactionRef(tx), i);
+        vOrphans.push_back(MakeTransactionRef(tx));
+        orphanage.AddTx(vOrphans.back(), i);
     }
 
     // ... and 50 that depend on other orphans:
     for (int i = 0; i < 50; i++)
     {
-        CTransactionRef txPrev = RandomOrphan();
+        CTransactionRef txPrev = RandomOrphan(vOrphans);
 
         CMutableTransaction tx;
         tx.vin.resize(1);
@@ -339,13 +328,14 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
         tx.vout[0].scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
         SignSignature(keystore, *txPrev, tx, 0, SIGHASH_ALL);
 
-        AddOrphanTx(MakeTransactionRef(tx), i);
+        vOrphans.push_back(MakeTransactionRef(tx));
+        orphanage.AddTx(vOrphans.back(), i);
     }
 
     // This really-big orphan should be ignored:
     for (int i = 0; i < 10; i++)
     {
-        CTransactionRef txPrev = RandomOrphan();
+        CTransactionRef txPrev = RandomOrphan(vOrphans);
 
         CMutableTransaction tx;
         tx.vout.resize(1);
@@ -363,25 +353,118 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
         for (unsigned int j = 1; j < tx.vin.size(); j++)
             tx.vin[j].scriptSig = tx.vin[0].scriptSig;
 
-        BOOST_CHECK(!AddOrphanTx(MakeTransactionRef(tx), i));
+        BOOST_CHECK(!orphanage.AddTx(MakeTransactionRef(tx), i));
     }
 
-    LOCK(cs_main);
-    // Test EraseOrphansFor:
+    // Test EraseForPeer:
     for (NodeId i = 0; i < 3; i++)
     {
-        size_t sizeBefore = mapOrphanTransactions.size();
-        EraseOrphansFor(i);
-        BOOST_CHECK(mapOrphanTransactions.size() < sizeBefore);
+        size_t sizeBefore = orphanage.Size();
+        orphanage.EraseForPeer(i);
+        BOOST_CHECK(orphanage.Size() < sizeBefore);
+        BOOST_CHECK_EQUAL(orphanage.PeerUsage(i), 0U);
+    }
+
+    // Test LimitOrphans() function:
+    orphanage.LimitOrphans(40);
+    BOOST_CHECK(orphanage.Size() <= 40);
+    orphanage.LimitOrphans(10);
+    BOOST_CHECK(orphanage.Size() <= 10);
+    orphanage.LimitOrphans(0);
+    BOOST_CHECK_EQUAL(orphanage.Size(), 0U);
+    for (const CTransactionRef& tx : vOrphans) {
+        BOOST_CHECK(!orphanage.HaveTx(tx->GetHash()));
+        BOOST_CHECK(orphanage.GetChildren(*tx).empty());
+    }
+}
+
+static CTransactionRef OrphanSpending(const COutPoint& prevout, size_t nPadding = 0)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = prevout;
+    tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(nPadding, 0x01);
+    tx.vout.resize(2);
+    tx.vout[0].nValue = 1*CENT;
+    tx.vout[0].scriptPubKey = CScript() << OP_1;
+    tx.vout[1].nValue = 1*CENT;
+    tx.vout[1].scriptPubKey = CScript() << OP_1;
+    return MakeTransactionRef(tx);
+}
+
+BOOST_AUTO_TEST_CASE(DoS_orphan_lru)
+{
+    TxOrphanage orphanage;
+    std::vector<CTransactionRef> vOrphans;
+    for (int i = 0; i < 10; i++) {
+        vOrphans.push_back(OrphanSpending(COutPoint(InsecureRand256(), 0)));
+        BOOST_CHECK(orphanage.AddTx(vOrphans.back(), i % 2));
+    }
+
+    // Announcing an orphan again or having its parent arrive keeps it
+    BOOST_CHECK(!orphanage.AddTx(vOrphans[0], 0));
+    CMutableTransaction parent;
+    parent.vout.resize(1);
+    parent.vout[0].nValue = 1*CENT;
+    CTransactionRef child = OrphanSpending(COutPoint(parent.GetHash(), 0));
+    BOOST_CHECK(orphanage.AddTx(child, 1));
+    CTransactionRef child2 = OrphanSpending(COutPoint(parent.GetHash(), 0), 1);
+    BOOST_CHECK(orphanage.AddTx(child2, 0));
+    orphanage.AddTx(vOrphans[1], 1);
+
+    BOOST_CHECK_EQUAL(orphanage.LimitOrphans(4), 8U);
+    BOOST_CHECK(orphanage.HaveTx(vOrphans[0]->GetHash()));
+    BOOST_CHECK(orphanage.HaveTx(vOrphans[1]->GetHash()));
+    BOOST_CHECK(orphanage.HaveTx(child->GetHash()));
+    BOOST_CHECK(orphanage.HaveTx(child2->GetHash()));
+
+    auto vChildren = orphanage.GetChildren(CTransaction(parent));
+    BOOST_CHECK_EQUAL(vChildren.size(), 2U);
+    BOOST_CHECK(vChildren[0].first == child && vChildren[0].second == 1);
+    BOOST_CHECK(vChildren[1].first == child2 && vChildren[1].second == 0);
+
+    // The children were used last, so the others go first
+    BOOST_CHECK_EQUAL(orphanage.LimitOrphans(2), 2U);
+    BOOST_CHECK(orphanage.HaveTx(child->GetHash()));
+    BOOST_CHECK(orphanage.HaveTx(child2->GetHash()));
+
+    // A block spending the parent output takes both children
+    CBlock block;
+    block.vtx.push_back(OrphanSpending(COutPoint(parent.GetHash(), 0), 2));
+    BOOST_CHECK_EQUAL(orphanage.EraseForBlock(block), 2);
+    BOOST_CHECK_EQUAL(orphanage.Size(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(DoS_orphan_peer_quota)
+{
+    TxOrphanage orphanage;
+    std::vector<CTransactionRef> vFlood, vHonest;
+    for (int i = 0; i < 50; i++) {
+        vFlood.push_back(OrphanSpending(COutPoint(InsecureRand256(), 0), 1000));
+        orphanage.AddTx(vFlood.back(), 0);
+        if (i % 10 == 0) {
+            vHonest.push_back(OrphanSpending(COutPoint(InsecureRand256(), 0)));
+            orphanage.AddTx(vHonest.back(), 1);
+        }
+    }
+    size_t nUsage = orphanage.PeerUsage(0);
+    BOOST_CHECK(nUsage > 10 * orphanage.PeerUsage(1));
+
+    // Only the flooding peer loses orphans, oldest first
+    BOOST_CHECK_EQUAL(orphanage.LimitOrphans(100, nUsage / 2), 25U);
+    BOOST_CHECK(orphanage.PeerUsage(0) <= nUsage / 2);
+    for (int i = 0; i < 50; i++) {
+        BOOST_CHECK_EQUAL(orphanage.HaveTx(vFlood[i]->GetHash()), i >= 25);
+    }
+    for (const CTransactionRef& tx : vHonest) {
+        BOOST_CHECK(orphanage.HaveTx(tx->GetHash()));
     }
 
-    // Test LimitOrphanTxSize() function:
-    LimitOrphanTxSize(40);
-    BOOST_CHECK(mapOrphanTransactions.size() <= 40);
-    LimitOrphanTxSize(10);
-    BOOST_CHECK(mapOrphanTransactions.size() <= 10);
-    LimitOrphanTxSize(0);
-    BOOST_CHECK(mapOrphanTransactions.empty());
+    // A peer always keeps its most recent orphan
+    orphanage.LimitOrphans(100, 0);
+    BOOST_CHECK_EQUAL(orphanage.Size(), 2U);
+    BOOST_CHECK(orphanage.HaveTx(vFlood.back()->GetHash()));
+    BOOST_CHECK(orphanage.HaveTx(vHonest.back()->GetHash()));
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,10 +4,13 @@
 
 #include <util.h>
 
+#include <support/allocators/node_arena.h>
 #include <support/allocators/secure.h>
 #include <test/test_bitcoin.h>
 
+#include <list>
 #include <memory>
+#include <new>
 
 #include <boost/test/unit_test.hpp>
 
@@ -206,6 +209,33 @@ BOOST_AUTO_TEST_CASE(lockedpool_tests_mock)
     BOOST_CHECK(pool.stats().used == 0);
 }
 
+BOOST_AUTO_TEST_CASE(node_arena_tests)
+{
+    NodeArena arena;
+    {
+        std::list<uint64_t, node_arena_allocator<uint64_t>> list((node_arena_allocator<uint64_t>(&arena)));
+        for (uint64_t i = 0; i < 10000; ++i) {
+            list.push_back(i);
+        }
+        BOOST_CHECK(arena.DynamicMemoryUsage() > 0);
+        BOOST_CHECK(arena.AllocatedMemory() >= arena.DynamicMemoryUsage());
+        list.clear();
+        BOOST_CHECK_EQUAL(arena.DynamicMemoryUsage(), 0U);
+
+        std::vector<uint64_t, node_arena_allocator<uint64_t>> vec((node_arena_allocator<uint64_t>(&arena)));
+        vec.resize(1000);
+        BOOST_CHECK(arena.DynamicMemoryUsage() >= 1000 * sizeof(uint64_t));
+    }
+    BOOST_CHECK_EQUAL(arena.DynamicMemoryUsage(), 0U);
+
+    // Sizes whose byte count does not fit are refused, not wrapped around
+    node_arena_allocator<uint64_t> alloc(&arena);
+    BOOST_CHECK_EQUAL(alloc.max_size(), std::numeric_limits<size_t>::max() / sizeof(uint64_t));
+    BOOST_CHECK_THROW(alloc.allocate(alloc.max_size() + 1), std::bad_array_new_length);
+    BOOST_CHECK_THROW(alloc.allocate(std::numeric_limits<size_t>::max()), std::bad_array_new_length);
+    BOOST_CHECK_EQUAL(arena.DynamicMemoryUsage(), 0U);
+}
+
 // These tests used the live LockedPoolManager object, this is also used
 // by other tests so the conditions are somewhat less controllable and thus the
 // tests are somewhat more error-prone.
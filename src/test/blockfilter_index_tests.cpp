@@ -0,0 +1,150 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockfilter.h>
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <index/blockfilterindex.h>
+#include <test/test_bitcoin.h>
+#include <utiltime.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilter_index_tests, TestChain100Setup)
+
+/** Check the filter and header the index has for a block against ones computed from the block. */
+static bool CheckFilterLookups(BlockFilterIndex& filter_index, const CBlockIndex* block_index,
+                               uint256& last_header)
+{
+    BlockFilter expected_filter;
+    {
+        CBlock block;
+        CBlockUndo block_undo;
+        if (!ReadBlockFromDisk(block, block_index, Params().GetConsensus())) return false;
+        if (block_index->nHeight > 0 && !UndoReadFromDisk(block_undo, block_index)) return false;
+        expected_filter = BlockFilter(filter_index.GetFilterType(), block, block_undo);
+    }
+
+    BlockFilter filter;
+    uint256 filter_header;
+    std::vector<BlockFilter> filters;
+    std::vector<uint256> filter_hashes;
+
+    BOOST_CHECK(filter_index.LookupFilter(block_index, filter));
+    BOOST_CHECK(filter_index.LookupFilterHeader(block_index, filter_header));
+    BOOST_CHECK(filter_index.LookupFilterRange(block_index->nHeight, block_index, filters));
+    BOOST_CHECK(filter_index.LookupFilterHashRange(block_index->nHeight, block_index, filter_hashes));
+
+    BOOST_CHECK_EQUAL(filters.size(), 1U);
+    BOOST_CHECK_EQUAL(filter_hashes.size(), 1U);
+
+    BOOST_CHECK_EQUAL(filter.GetBlockHash(), block_index->GetBlockHash());
+    BOOST_CHECK(filter.GetEncodedFilter() == expected_filter.GetEncodedFilter());
+    BOOST_CHECK_EQUAL(filter_header, expected_filter.ComputeHeader(last_header));
+    BOOST_CHECK(!filters.empty() && filters[0].GetEncodedFilter() == expected_filter.GetEncodedFilter());
+    BOOST_CHECK(!filter_hashes.empty() && filter_hashes[0] == expected_filter.GetHash());
+
+    last_header = filter_header;
+    return true;
+}
+
+static void WaitForSync(BlockFilterIndex& filter_index)
+{
+    // The index syncs in a background thread, give it up to 10 seconds.
+    int64_t time_start = GetTimeMillis();
+    while (!filter_index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + 10 * 1000 > GetTimeMillis());
+        MilliSleep(100);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(blockfilter_index_initial_sync)
+{
+    BlockFilterIndex filter_index(BlockFilterType::BASIC, 1 << 20, true);
+
+    uint256 last_header;
+
+    // Filters are not available before the index is started.
+    const CBlockIndex* tip;
+    {
+        LOCK(cs_main);
+        tip = chainActive.Tip();
+    }
+    BlockFilter filter;
+    uint256 filter_header;
+    BOOST_CHECK(!filter_index.LookupFilter(tip, filter));
+    BOOST_CHECK(!filter_index.LookupFilterHeader(tip, filter_header));
+    BOOST_CHECK(!filter_index.BlockUntilSyncedToCurrentChain());
+
+    filter_index.Start();
+    WaitForSync(filter_index);
+
+    // Every block of the chain has its filter, and the headers chain up.
+    {
+        LOCK(cs_main);
+        for (const CBlockIndex* block_index = chainActive.Genesis(); block_index; block_index = chainActive.Next(block_index)) {
+            BOOST_CHECK(CheckFilterLookups(filter_index, block_index, last_header));
+        }
+    }
+
+    std::vector<BlockFilter> filters;
+    std::vector<uint256> filter_hashes;
+    BOOST_CHECK(filter_index.LookupFilterRange(0, tip, filters));
+    BOOST_CHECK(filter_index.LookupFilterHashRange(0, tip, filter_hashes));
+    BOOST_CHECK_EQUAL(filters.size(), (size_t)tip->nHeight + 1);
+    BOOST_CHECK_EQUAL(filter_hashes.size(), (size_t)tip->nHeight + 1);
+    BOOST_CHECK(!filter_index.LookupFilterRange(tip->nHeight + 1, tip, filters));
+
+    // Blocks connected later are indexed as they come.
+    CScript script_pub_key = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    for (int i = 0; i < 2; ++i) {
+        CreateAndProcessBlock({}, script_pub_key);
+    }
+    BOOST_CHECK(filter_index.BlockUntilSyncedToCurrentChain());
+    const CBlockIndex* old_tip;
+    {
+        LOCK(cs_main);
+        last_header = uint256();
+        for (const CBlockIndex* block_index = chainActive.Genesis(); block_index; block_index = chainActive.Next(block_index)) {
+            BOOST_CHECK(CheckFilterLookups(filter_index, block_index, last_header));
+        }
+        old_tip = chainActive.Tip();
+    }
+    uint256 old_header;
+    BOOST_CHECK(filter_index.LookupFilterHeader(old_tip, old_header));
+
+    // Replace the two blocks with a longer chain paying elsewhere.
+    CValidationState state;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(InvalidateBlock(state, Params(), chainActive[old_tip->nHeight - 1]));
+    }
+    BOOST_CHECK(ActivateBestChain(state, Params()));
+    CScript other_script_pub_key = CScript() << OP_TRUE;
+    for (int i = 0; i < 3; ++i) {
+        CreateAndProcessBlock({}, other_script_pub_key);
+    }
+    BOOST_CHECK(filter_index.BlockUntilSyncedToCurrentChain());
+
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(chainActive.Height() == old_tip->nHeight + 1);
+        last_header = uint256();
+        for (const CBlockIndex* block_index = chainActive.Genesis(); block_index; block_index = chainActive.Next(block_index)) {
+            BOOST_CHECK(CheckFilterLookups(filter_index, block_index, last_header));
+        }
+    }
+
+    // The filters of the disconnected blocks are still found by block.
+    BOOST_CHECK(filter_index.LookupFilter(old_tip, filter));
+    BOOST_CHECK_EQUAL(filter.GetBlockHash(), old_tip->GetBlockHash());
+    BOOST_CHECK(filter_index.LookupFilterHeader(old_tip, filter_header));
+    BOOST_CHECK_EQUAL(filter_header, old_header);
+
+    filter_index.Interrupt();
+    filter_index.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
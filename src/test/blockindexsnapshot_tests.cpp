@@ -0,0 +1,193 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chain.h>
+#include <chainparams.h>
+#include <txdb.h>
+#include <util.h>
+#include <utilstrencodings.h>
+#include <validation.h>
+
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockindexsnapshot_tests, BasicTestingSetup)
+
+static BlockIndexSnapshotEntry MakeEntry(int height, int32_t prev)
+{
+    BlockIndexSnapshotEntry entry;
+    entry.hash = InsecureRand256();
+    entry.prev = prev;
+    entry.skip = prev;
+    entry.height = height;
+    entry.file = 0;
+    entry.data_pos = 8 + height * 100;
+    entry.undo_pos = 0;
+    entry.tx_count = 1;
+    entry.status = BLOCK_VALID_TRANSACTIONS | BLOCK_HAVE_DATA;
+    entry.version = 4;
+    entry.merkle_root = InsecureRand256();
+    entry.time = 1500000000 + height;
+    entry.bits = 0x207fffff;
+    entry.nonce = height;
+    entry.chain_work = ArithToUint256(arith_uint256(2 * (height + 1)));
+    entry.time_max = entry.time;
+    return entry;
+}
+
+/** Write an entry to the block index as an older version would, without marking it as changed since the snapshot. */
+static void WriteEntry(CBlockTreeDB& blocktree, const BlockIndexSnapshotEntry& entry)
+{
+    CBlockIndex index;
+    index.phashBlock = &entry.hash;
+    index.nHeight = entry.height;
+    BOOST_CHECK(blocktree.Write(std::make_pair('b', entry.hash), CDiskBlockIndex(&index)));
+}
+
+BOOST_AUTO_TEST_CASE(blockindexsnapshot_roundtrip)
+{
+    fs::create_directories(GetDataDir() / "blocks");
+    CBlockTreeDB blocktree(1 << 20, true);
+    std::vector<BlockIndexSnapshotEntry> entries, read;
+    std::vector<CDiskBlockIndex> changed;
+    const uint256 best_block = InsecureRand256();
+
+    // There is no snapshot until one is written.
+    BOOST_CHECK(!blocktree.ReadBlockIndexSnapshot(read, changed, best_block));
+
+    for (int height = 0; height < 10; ++height) {
+        entries.push_back(MakeEntry(height, height - 1));
+        WriteEntry(blocktree, entries.back());
+    }
+    BOOST_CHECK(blocktree.WriteBlockIndexSnapshot(entries, best_block));
+    BOOST_CHECK(blocktree.ReadBlockIndexSnapshot(read, changed, best_block));
+    BOOST_CHECK_EQUAL(read.size(), entries.size());
+    for (size_t i = 0; i < read.size(); ++i) {
+        BOOST_CHECK(read[i].hash == entries[i].hash);
+        BOOST_CHECK_EQUAL(read[i].prev, entries[i].prev);
+        BOOST_CHECK(read[i].chain_work == entries[i].chain_work);
+    }
+    BOOST_CHECK(changed.empty());
+
+    // Block index entries written afterwards are read on top of it.
+    uint256 hash = InsecureRand256();
+    CBlockIndex index;
+    index.phashBlock = &hash;
+    index.nHeight = 10;
+    CBlockFileInfo info;
+    info.nBlocks = 11;
+    BOOST_CHECK(blocktree.WriteBatchSync({{0, &info}}, 0, {&index}, best_block));
+    read.clear();
+    BOOST_CHECK(blocktree.ReadBlockIndexSnapshot(read, changed, best_block));
+    BOOST_CHECK_EQUAL(changed.size(), 1U);
+    BOOST_CHECK(changed[0].GetBlockHash() == CDiskBlockIndex(&index).GetBlockHash());
+
+    // Taking a new snapshot clears them.
+    entries.push_back(MakeEntry(10, 9));
+    entries.back().hash = hash;
+    BOOST_CHECK(blocktree.WriteBlockIndexSnapshot(entries, best_block));
+    read.clear();
+    changed.clear();
+    BOOST_CHECK(blocktree.ReadBlockIndexSnapshot(read, changed, best_block));
+    BOOST_CHECK_EQUAL(read.size(), 11U);
+    BOOST_CHECK(changed.empty());
+
+    // A damaged snapshot is not used.
+    {
+        FILE* file = fsbridge::fopen(GetDataDir() / "blocks" / "indexsnapshot.dat", "rb+");
+        BOOST_REQUIRE(file);
+        fseek(file, 100, SEEK_SET);
+        int byte = fgetc(file);
+        fseek(file, 100, SEEK_SET);
+        fputc(byte ^ 1, file);
+        fclose(file);
+    }
+    read.clear();
+    BOOST_CHECK(!blocktree.ReadBlockIndexSnapshot(read, changed, best_block));
+}
+
+BOOST_AUTO_TEST_CASE(blockindexsnapshot_stale)
+{
+    fs::create_directories(GetDataDir() / "blocks");
+    CBlockTreeDB blocktree(1 << 20, true);
+    std::vector<BlockIndexSnapshotEntry> entries, read;
+    std::vector<CDiskBlockIndex> changed;
+    const uint256 best_block = InsecureRand256();
+    for (int height = 0; height < 10; ++height) {
+        entries.push_back(MakeEntry(height, height - 1));
+        WriteEntry(blocktree, entries.back());
+    }
+    BOOST_CHECK(blocktree.WriteBlockIndexSnapshot(entries, best_block));
+    BOOST_CHECK(blocktree.ReadBlockIndexSnapshot(read, changed, best_block));
+
+    // The chainstate moved on, as it does when an older version connects or
+    // disconnects blocks.
+    read.clear();
+    BOOST_CHECK(!blocktree.ReadBlockIndexSnapshot(read, changed, InsecureRand256()));
+
+    // An older version added a header.
+    WriteEntry(blocktree, MakeEntry(10, 9));
+    read.clear();
+    BOOST_CHECK(!blocktree.ReadBlockIndexSnapshot(read, changed, best_block));
+
+    // An older version wrote blocks.
+    BOOST_CHECK(blocktree.WriteBlockIndexSnapshot(entries, best_block));
+    CBlockFileInfo info;
+    info.nBlocks = 1;
+    BOOST_CHECK(blocktree.Write(std::make_pair('f', 0), info));
+    read.clear();
+    BOOST_CHECK(!blocktree.ReadBlockIndexSnapshot(read, changed, best_block));
+}
+
+/** Describe the block index, including what is only computed when loading it from the database. */
+static std::map<uint256, std::string> DescribeBlockIndex()
+{
+    std::map<uint256, std::string> description;
+    for (const auto& entry : mapBlockIndex) {
+        const CBlockIndex* pindex = entry.second;
+        description[entry.first] = strprintf("%s %s %d %s %u %u %u %u", pindex->pprev ? pindex->pprev->GetBlockHash().ToString() : "",
+                                             pindex->pskip ? pindex->pskip->GetBlockHash().ToString() : "", pindex->nHeight,
+                                             pindex->nChainWork.GetHex(), pindex->nStatus, pindex->nTx, pindex->nChainTx, pindex->nTimeMax);
+    }
+    return description;
+}
+
+BOOST_FIXTURE_TEST_CASE(blockindexsnapshot_load, TestChain100Setup)
+{
+    LOCK(cs_main);
+    FlushStateToDisk();
+    const std::map<uint256, std::string> description = DescribeBlockIndex();
+    const uint256 tip = chainActive.Tip()->GetBlockHash();
+    const uint256 prev = chainActive.Tip()->pprev->GetBlockHash();
+
+    // A change to an entry that an older version could have made, without
+    // adding one, shows whether the snapshot or the database was loaded.
+    CBlockIndex* pindex = chainActive[50];
+    const uint256 hash = pindex->GetBlockHash();
+    pindex->nStatus |= BLOCK_OPT_WITNESS;
+    BOOST_CHECK(pblocktree->Write(std::make_pair('b', hash), CDiskBlockIndex(pindex)));
+    pindex->nStatus &= ~BLOCK_OPT_WITNESS;
+
+    // The snapshot links the entries as connecting the blocks did.
+    UnloadBlockIndex();
+    BOOST_CHECK(LoadBlockIndex(Params()));
+    BOOST_CHECK(DescribeBlockIndex() == description);
+    BOOST_CHECK(!(mapBlockIndex[hash]->nStatus & BLOCK_OPT_WITNESS));
+
+    // Once the chainstate moved on from it, the database is loaded instead.
+    CCoinsMap coins;
+    BOOST_CHECK(pcoinsdbview->BatchWrite(coins, prev));
+    UnloadBlockIndex();
+    BOOST_CHECK(LoadBlockIndex(Params()));
+    BOOST_CHECK(mapBlockIndex[hash]->nStatus & BLOCK_OPT_WITNESS);
+    mapBlockIndex[hash]->nStatus &= ~BLOCK_OPT_WITNESS;
+    BOOST_CHECK(DescribeBlockIndex() == description);
+
+    BOOST_CHECK(pcoinsdbview->BatchWrite(coins, tip));
+    BOOST_CHECK(LoadChainTip(Params()));
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == tip);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
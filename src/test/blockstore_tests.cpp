@@ -0,0 +1,139 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockstore.h>
+#include <chainparams.h>
+#include <chain.h>
+#include <clientversion.h>
+#include <primitives/block.h>
+#include <streams.h>
+#include <version.h>
+#include <validation.h>
+
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockstore_tests, TestingSetup)
+
+/** Append records in the block file format to file number n_file, returning their positions. */
+static std::vector<CDiskBlockPos> WriteRecords(int n_file, const std::vector<std::vector<unsigned char>>& records)
+{
+    std::vector<CDiskBlockPos> positions;
+    CAutoFile fileout(OpenBlockFile(CDiskBlockPos(n_file, 0)), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE(!fileout.IsNull());
+    unsigned int pos = 0;
+    for (const auto& record : records) {
+        fileout << FLATDATA(Params().MessageStart()) << (unsigned int)record.size();
+        pos += CMessageHeader::MESSAGE_START_SIZE + 4;
+        positions.emplace_back(n_file, pos);
+        fileout.write((const char*)record.data(), record.size());
+        pos += record.size();
+    }
+    return positions;
+}
+
+BOOST_AUTO_TEST_CASE(blockstore_read)
+{
+    const std::vector<std::vector<unsigned char>> records{
+        std::vector<unsigned char>(100, 0x01), std::vector<unsigned char>(5000, 0x02)};
+    const std::vector<CDiskBlockPos> positions = WriteRecords(7, records);
+
+    for (bool finalized : {false, true}) {
+        BlockStore store(1 << 20);
+        for (size_t i = 0; i < records.size(); ++i) {
+            RawBlock block;
+            BOOST_CHECK(store.Read(positions[i], Params().MessageStart(), finalized, block));
+            BOOST_CHECK(std::vector<unsigned char>(block.begin(), block.end()) == records[i]);
+
+            // A second read is served from the cache, sharing the bytes.
+            RawBlock again;
+            BOOST_CHECK(store.Read(positions[i], Params().MessageStart(), finalized, again));
+            BOOST_CHECK(again.data() == block.data());
+        }
+        BOOST_CHECK_EQUAL(store.CacheUsage(), 5100U);
+
+        // Blocks stay readable after their file is dropped and deleted.
+        RawBlock block;
+        BOOST_CHECK(store.Read(positions[1], Params().MessageStart(), finalized, block));
+        store.ForgetFile(7);
+        BOOST_CHECK_EQUAL(store.CacheUsage(), 0U);
+        BOOST_CHECK(std::vector<unsigned char>(block.begin(), block.end()) == records[1]);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(blockstore_cache_limit)
+{
+    const std::vector<std::vector<unsigned char>> records{
+        std::vector<unsigned char>(300, 0x01), std::vector<unsigned char>(300, 0x02), std::vector<unsigned char>(300, 0x03)};
+    const std::vector<CDiskBlockPos> positions = WriteRecords(8, records);
+
+    BlockStore store(700);
+    RawBlock block;
+    for (const CDiskBlockPos& pos : positions) {
+        BOOST_CHECK(store.Read(pos, Params().MessageStart(), true, block));
+    }
+    BOOST_CHECK_EQUAL(store.CacheUsage(), 600U);
+
+    store.SetMaxCacheUsage(0);
+    BOOST_CHECK_EQUAL(store.CacheUsage(), 0U);
+    BOOST_CHECK(store.Read(positions[0], Params().MessageStart(), true, block));
+    BOOST_CHECK_EQUAL(store.CacheUsage(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(blockstore_bad_record)
+{
+    const std::vector<CDiskBlockPos> positions = WriteRecords(9, {std::vector<unsigned char>(10, 0x01)});
+
+    BlockStore store;
+    RawBlock block;
+    CMessageHeader::MessageStartChars wrong_start = {0, 0, 0, 0};
+    for (bool finalized : {false, true}) {
+        BOOST_CHECK(!store.Read(positions[0], wrong_start, finalized, block));
+        BOOST_CHECK(!store.Read(CDiskBlockPos(9, 100), Params().MessageStart(), finalized, block));
+        BOOST_CHECK(!store.Read(CDiskBlockPos(10, 8), Params().MessageStart(), finalized, block));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(blockstore_raw_block)
+{
+    // A block with a witness, since the bytes are served as a witness block
+    CBlock block = Params().GenesisBlock();
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(InsecureRand256(), 0);
+    tx.vin[0].scriptWitness.stack.push_back(std::vector<unsigned char>(72, 0x30));
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 1;
+    block.vtx.push_back(MakeTransactionRef(std::move(tx)));
+
+    CDataStream served(SER_NETWORK, PROTOCOL_VERSION);
+    served << block;
+    const std::vector<CDiskBlockPos> positions = WriteRecords(11, {std::vector<unsigned char>(served.begin(), served.end())});
+
+    const uint256 hash = block.GetHash();
+    CBlockIndex index(block);
+    index.phashBlock = &hash;
+    index.nFile = positions[0].nFile;
+    index.nDataPos = positions[0].nPos;
+    index.nStatus |= BLOCK_HAVE_DATA;
+
+    // The stored bytes are those of the serialized block
+    RawBlock raw_block;
+    BOOST_REQUIRE(ReadRawBlockFromDisk(raw_block, &index, Params().MessageStart()));
+    BOOST_CHECK(std::vector<char>(raw_block.begin(), raw_block.end()) == std::vector<char>(served.begin(), served.end()));
+    CBlock read_block;
+    BOOST_REQUIRE(ReadBlockFromDisk(read_block, &index, Params().GetConsensus()));
+    CDataStream reserialized(SER_NETWORK, PROTOCOL_VERSION);
+    reserialized << read_block;
+    BOOST_CHECK(std::vector<char>(raw_block.begin(), raw_block.end()) == std::vector<char>(reserialized.begin(), reserialized.end()));
+    BOOST_CHECK(read_block.vtx[1]->GetWitnessHash() == block.vtx[1]->GetWitnessHash());
+
+    // Bytes stored for another block are not served
+    const uint256 other_hash = InsecureRand256();
+    index.phashBlock = &other_hash;
+    BOOST_CHECK(!ReadRawBlockFromDisk(raw_block, &index, Params().MessageStart()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -8,9 +8,11 @@
 #include <undo.h>
 #include <utilstrencodings.h>
 #include <test/test_bitcoin.h>
+#include <txdb.h>
 #include <validation.h>
 #include <consensus/validation.h>
 
+#include <atomic>
 #include <vector>
 #include <map>
 
@@ -855,4 +857,112 @@ BOOST_AUTO_TEST_CASE(ccoins_write)
                     CheckWriteCoins(parent_value, child_value, parent_value, parent_flags, child_flags, parent_flags);
 }
 
+
+BOOST_AUTO_TEST_CASE(ccoins_background_flush)
+{
+    // Use tiny batches so the background writer commits in many steps.
+    gArgs.ForceSetArg("-dbbatchsize", "1024");
+
+    CCoinsViewDB db(1 << 20, true, true);
+    CCoinsViewCache cache(&db);
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 500; i++) {
+        COutPoint outpoint(InsecureRand256(), 0);
+        cache.AddCoin(outpoint, Coin(CTxOut(i + 1, CScript() << OP_TRUE), 1, false), false);
+        outpoints.push_back(outpoint);
+    }
+    uint256 block1 = InsecureRand256();
+    cache.SetBestBlock(block1);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(db.GetBestBlock() == block1);
+
+    // Spend every other coin and add new ones on top of a new block.
+    for (size_t i = 0; i < outpoints.size(); i += 2) {
+        BOOST_CHECK(cache.SpendCoin(outpoints[i]));
+    }
+    for (int i = 0; i < 500; i++) {
+        COutPoint outpoint(InsecureRand256(), 0);
+        cache.AddCoin(outpoint, Coin(CTxOut(i + 1, CScript() << OP_TRUE), 2, false), false);
+        outpoints.push_back(outpoint);
+    }
+    uint256 block2 = InsecureRand256();
+    cache.SetBestBlock(block2);
+    const size_t nUsage = cache.DynamicMemoryUsage();
+    BOOST_CHECK(cache.Flush(true));
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+    // What has not been written yet still counts
+    BOOST_CHECK(db.PendingMemoryUsage() <= nUsage);
+
+    // Whether or not the write has reached disk, reads see the flushed state.
+    BOOST_CHECK(db.GetBestBlock() == block2);
+    for (size_t i = 0; i < outpoints.size(); i++) {
+        BOOST_CHECK_EQUAL(cache.HaveCoin(outpoints[i]), i >= 500 || i % 2 == 1);
+    }
+
+    BOOST_CHECK(db.WaitForFlush());
+    BOOST_CHECK(!db.IsFlushing());
+    BOOST_CHECK_EQUAL(db.PendingMemoryUsage(), 0U);
+    BOOST_CHECK(db.GetBestBlock() == block2);
+    BOOST_CHECK(db.GetHeadBlocks().empty());
+    for (size_t i = 0; i < outpoints.size(); i++) {
+        Coin coin;
+        BOOST_CHECK_EQUAL(db.GetCoin(outpoints[i], coin), i >= 500 || i % 2 == 1);
+    }
+
+    CCoinsFlushStats stats = db.GetLastFlushStats();
+    BOOST_CHECK(stats.fBackground);
+    BOOST_CHECK_EQUAL(stats.nChanged, 750U);
+    BOOST_CHECK(stats.nBatches > 1);
+    BOOST_CHECK(stats.nBytes > 0);
+
+    // A synchronous flush after a background one leaves a consistent database.
+    uint256 block3 = InsecureRand256();
+    cache.SetBestBlock(block3);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(db.GetBestBlock() == block3);
+    BOOST_CHECK(!db.GetLastFlushStats().fBackground);
+
+    gArgs.ForceSetArg("-dbbatchsize", std::to_string(nDefaultDbBatchSize));
+}
+
+BOOST_AUTO_TEST_CASE(ccoins_background_flush_failure)
+{
+    CCoinsViewDB db(1 << 20, true, true);
+    std::atomic<bool> fFailed(false);
+    db.SetFlushFailedHandler([&fFailed] { fFailed = true; });
+    CCoinsViewCache cache(&db);
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 100; i++) {
+        // Scripts too long to be stored inline are accounted for as well
+        COutPoint outpoint(InsecureRand256(), 0);
+        cache.AddCoin(outpoint, Coin(CTxOut(i + 1, CScript() << std::vector<unsigned char>(40, i)), 1, false), false);
+        outpoints.push_back(outpoint);
+    }
+    uint256 block1 = InsecureRand256();
+    cache.SetBestBlock(block1);
+
+    // A failed background write is reported without waiting for another
+    // flush, and the coins it did not write stay in memory.
+    gArgs.ForceSetArg("-dbflushfailure", "1");
+    const size_t nUsage = cache.DynamicMemoryUsage();
+    BOOST_CHECK(cache.Flush(true));
+    BOOST_CHECK(!db.WaitForFlush());
+    for (int i = 0; i < 1000 && !fFailed; i++) {
+        MilliSleep(10);
+    }
+    BOOST_CHECK(fFailed);
+    BOOST_CHECK_EQUAL(db.PendingMemoryUsage(), nUsage);
+    BOOST_CHECK(db.GetBestBlock() == block1);
+    for (const COutPoint& outpoint : outpoints) {
+        BOOST_CHECK(cache.HaveCoin(outpoint));
+    }
+
+    // No write builds on the coins that are missing from disk
+    gArgs.ClearArg("-dbflushfailure");
+    cache.SetBestBlock(InsecureRand256());
+    BOOST_CHECK(!cache.Flush());
+    BOOST_CHECK(!cache.Flush(true));
+    BOOST_CHECK(db.GetBestBlock() == block1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -377,4 +377,32 @@ BOOST_AUTO_TEST_CASE(cuckoocache_generations)
     test_cache_generations<CuckooCache::cache<uint256, SignatureCacheHasher>>();
 }
 
+/* Test that the live elements of a cache can be reinserted into a fresh one,
+ * as done when the signature cache is loaded from disk.
+ */
+BOOST_AUTO_TEST_CASE(cuckoocache_live_elements)
+{
+    local_rand_ctx = FastRandomContext(true);
+    CuckooCache::cache<uint256, SignatureCacheHasher> cc{};
+    cc.setup_bytes(1 << 20);
+    std::vector<uint256> inserted(10000);
+    for (uint256& h : inserted) {
+        insecure_GetRandHash(h);
+        cc.insert(h);
+    }
+    // Entries allowed to be erased are not live anymore.
+    for (size_t i = 0; i < inserted.size(); i += 2)
+        BOOST_CHECK(cc.contains(inserted[i], true));
+
+    std::vector<uint256> live = cc.live_elements();
+    BOOST_CHECK_EQUAL(live.size(), inserted.size() / 2);
+
+    CuckooCache::cache<uint256, SignatureCacheHasher> restored{};
+    restored.setup_bytes(1 << 20);
+    for (const uint256& h : live)
+        restored.insert(h);
+    for (size_t i = 0; i < inserted.size(); ++i)
+        BOOST_CHECK_EQUAL(restored.contains(inserted[i], false), i % 2 == 1);
+}
+
 BOOST_AUTO_TEST_SUITE_END();
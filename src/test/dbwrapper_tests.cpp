@@ -2,6 +2,10 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#if defined(HAVE_CONFIG_H)
+#include <config/bitcoin-config.h>
+#endif
+
 #include <dbwrapper.h>
 #include <uint256.h>
 #include <random.h>
@@ -317,6 +321,47 @@ BOOST_AUTO_TEST_CASE(iterator_string_ordering)
     }
 }
 
+/** Sets -dboption for as long as it lives. */
+class DBOptionArg
+{
+public:
+    explicit DBOptionArg(const std::string& value) { Set(value); }
+    ~DBOptionArg() { gArgs.ClearArg("-dboption"); }
+    void Set(const std::string& value) { gArgs.ForceSetArg("-dboption", value); }
+};
 
+BOOST_AUTO_TEST_CASE(dbwrapper_profiles)
+{
+    // The default profile keeps the settings every database used to share.
+    DBOptions options = GetDBOptions(DBProfile::DEFAULT);
+    BOOST_CHECK(!options.compression);
+    BOOST_CHECK_EQUAL(options.bloom_bits, 10);
+    BOOST_CHECK_EQUAL(options.block_size, 4096U);
+    BOOST_CHECK_EQUAL(options.max_open_files, 64);
+    BOOST_CHECK_EQUAL(options.block_cache_percent, 50);
+    BOOST_CHECK_EQUAL(GetDBOptions(DBProfile::BLOCK_INDEX).bloom_bits, 0);
+    // No database is compressed unless asked for.
+    BOOST_CHECK(!GetDBOptions(DBProfile::INDEX).compression);
+
+    std::string error;
+    DBOptionArg arg("blockindex:bloombits:12");
+    BOOST_CHECK(CheckDBOptionArgs(error));
+    BOOST_CHECK_EQUAL(GetDBOptions(DBProfile::BLOCK_INDEX).bloom_bits, 12);
+    BOOST_CHECK_EQUAL(GetDBOptions(DBProfile::CHAINSTATE).bloom_bits, 10);
+
+    arg.Set("index:compression:1");
+#ifdef USE_SNAPPY
+    BOOST_CHECK(CheckDBOptionArgs(error));
+    BOOST_CHECK(GetDBOptions(DBProfile::INDEX).compression);
+#else
+    BOOST_CHECK(!CheckDBOptionArgs(error));
+#endif
+
+    for (const char* value : {"blockindex:bloombits", "blocks:bloombits:12", "blockindex:bloom:12",
+                              "blockindex:blockcachepercent:100", "index:compression:yes"}) {
+        arg.Set(value);
+        BOOST_CHECK(!CheckDBOptionArgs(error));
+    }
+}
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -418,6 +418,230 @@ BOOST_AUTO_TEST_CASE(MempoolAncestorIndexingTest)
 }
 
 
+BOOST_AUTO_TEST_CASE(MempoolSnapshotTest)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(2);
+    txParent.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txParent.vout[0].nValue = 10 * COIN;
+    txParent.vout[1] = txParent.vout[0];
+    pool.addUnchecked(txParent.GetHash(), entry.Fee(10000LL).FromTx(txParent));
+
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].prevout = COutPoint(txParent.GetHash(), 0);
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 9 * COIN;
+    pool.addUnchecked(txChild.GetHash(), entry.Fee(20000LL).FromTx(txChild));
+
+    std::shared_ptr<const CTxMemPoolSnapshot> snapshot = pool.GetSnapshot();
+    BOOST_CHECK_EQUAL(snapshot->entries.size(), 2U);
+    const TxMempoolSnapshotEntry* parent = snapshot->Find(txParent.GetHash());
+    const TxMempoolSnapshotEntry* child = snapshot->Find(txChild.GetHash());
+    BOOST_REQUIRE(parent && child);
+    BOOST_CHECK_EQUAL(parent->nFee, 10000);
+    BOOST_CHECK_EQUAL(parent->nCountWithDescendants, 2U);
+    BOOST_CHECK_EQUAL(parent->nModFeesWithDescendants, 30000);
+    BOOST_CHECK_EQUAL(child->nCountWithAncestors, 2U);
+    BOOST_CHECK(child->vParents == std::vector<uint256>{txParent.GetHash()});
+    BOOST_CHECK(parent->vChildren == std::vector<uint256>{txChild.GetHash()});
+    BOOST_CHECK_EQUAL(snapshot->CalculateRelatives(txChild.GetHash(), true).size(), 1U);
+    BOOST_CHECK_EQUAL(snapshot->CalculateRelatives(txParent.GetHash(), false).size(), 1U);
+    BOOST_CHECK(snapshot->CalculateRelatives(txChild.GetHash(), false).empty());
+
+    // Readers share one snapshot until the mempool changes
+    BOOST_CHECK(pool.GetSnapshot() == snapshot);
+    pool.PrioritiseTransaction(txChild.GetHash(), 5000);
+    std::shared_ptr<const CTxMemPoolSnapshot> prioritised = pool.GetSnapshot();
+    BOOST_CHECK(prioritised != snapshot);
+    BOOST_CHECK_EQUAL(prioritised->Find(txParent.GetHash())->nModFeesWithDescendants, 35000);
+
+    // Taken snapshots stay as they were
+    pool.removeRecursive(txParent);
+    BOOST_CHECK(pool.GetSnapshot()->entries.empty());
+    BOOST_CHECK_EQUAL(snapshot->entries.size(), 2U);
+    BOOST_CHECK_EQUAL(snapshot->Find(txParent.GetHash())->nModFeesWithDescendants, 30000);
+
+    TxMempoolSnapshotEntry copy;
+    BOOST_CHECK(!pool.CopyEntry(txParent.GetHash(), copy));
+}
+
+BOOST_AUTO_TEST_CASE(MempoolMemoryUsageTest)
+{
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    const size_t nEmptyUsage = pool.DynamicMemoryUsage();
+
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(5);
+    for (int i = 0; i < 5; i++) {
+        txParent.vout[i].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txParent.vout[i].nValue = COIN;
+    }
+    pool.addUnchecked(txParent.GetHash(), entry.FromTx(txParent));
+    const size_t nParentUsage = pool.DynamicMemoryUsage();
+    BOOST_CHECK_GT(nParentUsage, nEmptyUsage);
+
+    // More children than the links hold without an allocation
+    std::vector<CTransactionRef> vChildren;
+    for (int i = 0; i < 5; i++) {
+        CMutableTransaction txChild;
+        txChild.vin.resize(1);
+        txChild.vin[0].prevout = COutPoint(txParent.GetHash(), i);
+        txChild.vout.resize(1);
+        txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txChild.vout[0].nValue = COIN;
+        vChildren.push_back(MakeTransactionRef(txChild));
+        pool.addUnchecked(txChild.GetHash(), entry.FromTx(txChild));
+    }
+    BOOST_CHECK_GT(pool.DynamicMemoryUsage(), nParentUsage);
+
+    // Removing entries gives back exactly what adding them took
+    for (const CTransactionRef& tx : vChildren) {
+        pool.removeRecursive(*tx);
+    }
+    BOOST_CHECK_EQUAL(pool.DynamicMemoryUsage(), nParentUsage);
+}
+
+static CMutableTransaction SpendOutputs(const std::vector<COutPoint>& vPrevouts, int nOutputs)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(vPrevouts.size());
+    for (size_t i = 0; i < vPrevouts.size(); i++) {
+        tx.vin[i].prevout = vPrevouts[i];
+        tx.vin[i].scriptSig = CScript() << OP_11;
+    }
+    tx.vout.resize(nOutputs);
+    for (CTxOut& out : tx.vout) {
+        out.scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        out.nValue = COIN;
+    }
+    return tx;
+}
+
+static void CheckSameState(const CTxMemPool& pool, const CTxMemPool& expected)
+{
+    LOCK2(pool.cs, expected.cs);
+    BOOST_REQUIRE_EQUAL(pool.mapTx.size(), expected.mapTx.size());
+    for (const CTxMemPoolEntry& e : expected.mapTx) {
+        CTxMemPool::txiter it = pool.mapTx.find(e.GetTx().GetHash());
+        BOOST_REQUIRE(it != pool.mapTx.end());
+        BOOST_CHECK_EQUAL(it->GetCountWithAncestors(), e.GetCountWithAncestors());
+        BOOST_CHECK_EQUAL(it->GetSizeWithAncestors(), e.GetSizeWithAncestors());
+        BOOST_CHECK_EQUAL(it->GetModFeesWithAncestors(), e.GetModFeesWithAncestors());
+        BOOST_CHECK_EQUAL(it->GetSigOpCostWithAncestors(), e.GetSigOpCostWithAncestors());
+        BOOST_CHECK_EQUAL(it->GetCountWithDescendants(), e.GetCountWithDescendants());
+        BOOST_CHECK_EQUAL(it->GetSizeWithDescendants(), e.GetSizeWithDescendants());
+        BOOST_CHECK_EQUAL(it->GetModFeesWithDescendants(), e.GetModFeesWithDescendants());
+        BOOST_CHECK_EQUAL(pool.GetMemPoolParents(it).size(), expected.GetMemPoolParents(expected.mapTx.iterator_to(e)).size());
+        BOOST_CHECK_EQUAL(pool.GetMemPoolChildren(it).size(), expected.GetMemPoolChildren(expected.mapTx.iterator_to(e)).size());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(MempoolBlockUpdateTest)
+{
+    TestMemPoolEntryHelper entry;
+
+    // A diamond in a block, with a chain hanging off it and a transaction
+    // that also spends one of the diamond's sides
+    CMutableTransaction txA = SpendOutputs({COutPoint()}, 2);
+    CMutableTransaction txB = SpendOutputs({COutPoint(txA.GetHash(), 0)}, 2);
+    CMutableTransaction txC = SpendOutputs({COutPoint(txA.GetHash(), 1)}, 1);
+    CMutableTransaction txD = SpendOutputs({COutPoint(txB.GetHash(), 0), COutPoint(txC.GetHash(), 0)}, 1);
+    CMutableTransaction txE = SpendOutputs({COutPoint(txD.GetHash(), 0)}, 1);
+    CMutableTransaction txF = SpendOutputs({COutPoint(txE.GetHash(), 0), COutPoint(txB.GetHash(), 1)}, 1);
+    const std::vector<CMutableTransaction> vBlock = {txA, txB, txC};
+    const std::vector<CMutableTransaction> vRest = {txD, txE, txF};
+
+    CTxMemPool pool, poolAll, poolRest;
+    CAmount nFee = 1000;
+    for (const CMutableTransaction& tx : vBlock) {
+        pool.addUnchecked(tx.GetHash(), entry.Fee(nFee).SigOpsCost(nFee / 250).FromTx(tx));
+        poolAll.addUnchecked(tx.GetHash(), entry.Fee(nFee).SigOpsCost(nFee / 250).FromTx(tx));
+        nFee += 1000;
+    }
+    for (const CMutableTransaction& tx : vRest) {
+        pool.addUnchecked(tx.GetHash(), entry.Fee(nFee).SigOpsCost(nFee / 250).FromTx(tx));
+        poolAll.addUnchecked(tx.GetHash(), entry.Fee(nFee).SigOpsCost(nFee / 250).FromTx(tx));
+        poolRest.addUnchecked(tx.GetHash(), entry.Fee(nFee).SigOpsCost(nFee / 250).FromTx(tx));
+        nFee += 1000;
+    }
+
+    // Connecting the block leaves the rest as if they had come in alone
+    std::vector<CTransactionRef> vtxBlock;
+    std::vector<uint256> vHashes;
+    for (const CMutableTransaction& tx : vBlock) {
+        vtxBlock.push_back(MakeTransactionRef(tx));
+        vHashes.push_back(tx.GetHash());
+    }
+    pool.removeForBlock(vtxBlock, 1);
+    CheckSameState(pool, poolRest);
+
+    // Disconnecting it again brings back the state from before
+    nFee = 1000;
+    for (const CMutableTransaction& tx : vBlock) {
+        pool.addUnchecked(tx.GetHash(), entry.Fee(nFee).SigOpsCost(nFee / 250).FromTx(tx));
+        nFee += 1000;
+    }
+    pool.UpdateTransactionsFromBlock(vHashes);
+    CheckSameState(pool, poolAll);
+
+    // A block with only the top of the diamond
+    CTxMemPool poolWithoutA;
+    nFee = 2000;
+    for (const CMutableTransaction& tx : {txB, txC, txD, txE, txF}) {
+        poolWithoutA.addUnchecked(tx.GetHash(), entry.Fee(nFee).SigOpsCost(nFee / 250).FromTx(tx));
+        nFee += 1000;
+    }
+    pool.removeForBlock({vtxBlock[0]}, 1);
+    CheckSameState(pool, poolWithoutA);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolReplacementSummaryTest)
+{
+    TestMemPoolEntryHelper entry;
+
+    // Replacing both sides of a diamond evicts what hangs off it once
+    CMutableTransaction txA = SpendOutputs({COutPoint()}, 2);
+    CMutableTransaction txB = SpendOutputs({COutPoint(txA.GetHash(), 0)}, 2);
+    CMutableTransaction txC = SpendOutputs({COutPoint(txA.GetHash(), 1)}, 1);
+    CMutableTransaction txD = SpendOutputs({COutPoint(txB.GetHash(), 0), COutPoint(txC.GetHash(), 0)}, 1);
+    CMutableTransaction txE = SpendOutputs({COutPoint(txD.GetHash(), 0)}, 1);
+    CMutableTransaction txF = SpendOutputs({COutPoint(txE.GetHash(), 0), COutPoint(txB.GetHash(), 1)}, 1);
+
+    CTxMemPool pool;
+    LOCK(pool.cs);
+    CAmount nFee = 1000;
+    for (const CMutableTransaction& tx : {txA, txB, txC, txD, txE, txF}) {
+        pool.addUnchecked(tx.GetHash(), entry.Fee(nFee).FromTx(tx));
+        nFee += 1000;
+    }
+
+    CTxMemPool::setEntries setConflicting = {pool.mapTx.find(txB.GetHash()), pool.mapTx.find(txC.GetHash())};
+    CTxMemPool::ReplacementSummary summary;
+    BOOST_CHECK(pool.CalculateReplacementSummary(setConflicting, 8, summary));
+    BOOST_CHECK_EQUAL(summary.nPotentialEvicted, 8U);
+    BOOST_CHECK_EQUAL(summary.setEvicted.size(), 5U);
+    BOOST_CHECK(!summary.setEvicted.count(pool.mapTx.find(txA.GetHash())));
+    BOOST_CHECK_EQUAL(summary.nFees, 2000 + 3000 + 4000 + 5000 + 6000);
+    size_t nSize = 0;
+    for (CTxMemPool::txiter it : summary.setEvicted) nSize += it->GetTxSize();
+    BOOST_CHECK_EQUAL(summary.nSize, nSize);
+
+    // The limit applies to the cached counts, before anything is walked
+    BOOST_CHECK(!pool.CalculateReplacementSummary(setConflicting, 7, summary));
+    BOOST_CHECK_EQUAL(summary.nPotentialEvicted, 8U);
+    BOOST_CHECK(summary.setEvicted.empty());
+}
+
 BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
 {
     CTxMemPool pool;
@@ -533,7 +757,8 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
         pool.addUnchecked(tx5.GetHash(), entry.Fee(1000LL).FromTx(tx5));
     pool.addUnchecked(tx7.GetHash(), entry.Fee(9000LL).FromTx(tx7));
 
-    pool.TrimToSize(pool.DynamicMemoryUsage() / 2); // should maximize mempool size by only removing 5/7
+    // tx4 and tx6 take a little over half, as vTxHashes keeps its capacity
+    pool.TrimToSize(pool.DynamicMemoryUsage() * 11 / 20); // should maximize mempool size by only removing 5/7
     BOOST_CHECK(pool.exists(tx4.GetHash()));
     BOOST_CHECK(!pool.exists(tx5.GetHash()));
     BOOST_CHECK(pool.exists(tx6.GetHash()));
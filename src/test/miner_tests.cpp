@@ -522,4 +522,113 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCheckpointsEnabled = true;
 }
 
+BOOST_AUTO_TEST_CASE(BlockTemplateCache_update)
+{
+    const CChainParams& chainparams = Params();
+    CScript scriptPubKey = CScript() << OP_TRUE;
+    TestMemPoolEntryHelper entry;
+    BlockTemplateCache cache;
+    cache.Connect(mempool);
+
+    // The first template selects from the (empty) mempool
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    BOOST_CHECK(pblocktemplate = cache.CreateNewBlock(chainparams, scriptPubKey, ALGO_SHA256D));
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 1);
+
+    // Transactions added afterwards are appended after their parents
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vin[0].prevout.hash = InsecureRand256();
+    tx.vin[0].prevout.n = 0;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 5000000000LL - 10000;
+    uint256 hashParentTx = tx.GetHash();
+    mempool.addUnchecked(hashParentTx, entry.Fee(10000).Time(GetTime()).FromTx(tx));
+
+    tx.vin[0].prevout.hash = hashParentTx;
+    tx.vout[0].nValue -= 20000;
+    uint256 hashChildTx = tx.GetHash();
+    mempool.addUnchecked(hashChildTx, entry.Fee(20000).Time(GetTime()).FromTx(tx));
+
+    // A free transaction stays out, as it would from a full selection
+    tx.vin[0].prevout.hash = InsecureRand256();
+    mempool.addUnchecked(tx.GetHash(), entry.Fee(0).Time(GetTime()).FromTx(tx));
+
+    BOOST_CHECK(pblocktemplate = cache.CreateNewBlock(chainparams, scriptPubKey, ALGO_SCRYPT));
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 3);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == hashParentTx);
+    BOOST_CHECK(pblocktemplate->block.vtx[2]->GetHash() == hashChildTx);
+    BOOST_CHECK_EQUAL(pblocktemplate->vTxFees[0], -30000);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.GetAlgo(), ALGO_SCRYPT);
+
+    // Transactions that leave the mempool leave the template, along with
+    // their descendants
+    mempool.removeRecursive(*pblocktemplate->block.vtx[1]);
+    BOOST_CHECK(pblocktemplate = cache.CreateNewBlock(chainparams, scriptPubKey, ALGO_SHA256D));
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 1);
+    BOOST_CHECK_EQUAL(pblocktemplate->vTxFees[0], 0);
+
+    cache.Disconnect(mempool);
+    mempool.clear();
+}
+
+BOOST_AUTO_TEST_CASE(BlockTemplateCache_prioritise)
+{
+    const CChainParams& chainparams = Params();
+    CScript scriptPubKey = CScript() << OP_TRUE;
+    TestMemPoolEntryHelper entry;
+    BlockTemplateCache cache;
+    cache.Connect(mempool);
+
+    // Spendable outputs, since a full selection checks the block is valid
+    std::vector<COutPoint> prevouts;
+    {
+        LOCK(cs_main);
+        for (int i = 0; i < 2; ++i) {
+            prevouts.emplace_back(InsecureRand256(), 0);
+            pcoinsTip->AddCoin(prevouts.back(), Coin(CTxOut(50 * COIN, scriptPubKey), chainActive.Height(), false), false);
+        }
+    }
+
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    BOOST_CHECK(pblocktemplate = cache.CreateNewBlock(chainparams, scriptPubKey, ALGO_SHA256D));
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 1);
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vin[0].prevout = prevouts[0];
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = scriptPubKey;
+    tx.vout[0].nValue = 50 * COIN - 10000;
+    uint256 hashPaidTx = tx.GetHash();
+    mempool.addUnchecked(hashPaidTx, entry.Fee(10000).Time(GetTime()).FromTx(tx));
+
+    tx.vin[0].prevout = prevouts[1];
+    tx.vout[0].nValue = 50 * COIN;
+    uint256 hashFreeTx = tx.GetHash();
+    mempool.addUnchecked(hashFreeTx, entry.Fee(0).Time(GetTime()).FromTx(tx));
+
+    BOOST_CHECK(pblocktemplate = cache.CreateNewBlock(chainparams, scriptPubKey, ALGO_SHA256D));
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 2);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == hashPaidTx);
+
+    // Lowering the fee of a selected transaction takes it out
+    mempool.PrioritiseTransaction(hashPaidTx, -10000);
+    BOOST_CHECK(pblocktemplate = cache.CreateNewBlock(chainparams, scriptPubKey, ALGO_SHA256D));
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 1);
+
+    // Raising the fee of a transaction left out brings it in
+    mempool.PrioritiseTransaction(hashFreeTx, 10000);
+    BOOST_CHECK(pblocktemplate = cache.CreateNewBlock(chainparams, scriptPubKey, ALGO_SHA256D));
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 2);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == hashFreeTx);
+
+    cache.Disconnect(mempool);
+    mempool.ClearPrioritisation(hashPaidTx);
+    mempool.ClearPrioritisation(hashFreeTx);
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,136 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <openhashmap.h>
+
+#include <test/test_bitcoin.h>
+#include <memusage.h>
+
+#include <map>
+#include <string>
+#include <unordered_map>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(openhashmap_tests, BasicTestingSetup)
+
+namespace {
+/** Poor hash function to force long probe sequences and tag collisions. */
+struct BadHash
+{
+    size_t operator()(uint32_t x) const { return x % 37; }
+};
+
+template <typename Map>
+void CheckEqual(const Map& map, const std::map<uint32_t, std::string>& reference)
+{
+    BOOST_CHECK_EQUAL(map.size(), reference.size());
+    size_t count = 0;
+    for (const auto& entry : map) {
+        auto it = reference.find(entry.first);
+        BOOST_CHECK(it != reference.end() && it->second == entry.second);
+        count++;
+    }
+    BOOST_CHECK_EQUAL(count, reference.size());
+}
+
+template <typename Map>
+void RandomOperations(Map& map, uint32_t key_range)
+{
+    std::map<uint32_t, std::string> reference;
+    for (int i = 0; i < 20000; i++) {
+        uint32_t key = InsecureRandRange(key_range);
+        switch (InsecureRandRange(5)) {
+        case 0:
+        case 1: {
+            std::string value = std::to_string(InsecureRand32());
+            auto ret = map.emplace(key, value);
+            auto ref = reference.emplace(key, value);
+            BOOST_CHECK_EQUAL(ret.second, ref.second);
+            BOOST_CHECK(ret.first->first == key && ret.first->second == ref.first->second);
+            break;
+        }
+        case 2:
+            map[key] = "x";
+            reference[key] = "x";
+            break;
+        case 3:
+            BOOST_CHECK_EQUAL(map.erase(key), reference.erase(key));
+            break;
+        case 4: {
+            auto it = map.find(key);
+            auto ref = reference.find(key);
+            BOOST_CHECK_EQUAL(it == map.end(), ref == reference.end());
+            if (it != map.end()) BOOST_CHECK(it->second == ref->second);
+            break;
+        }
+        }
+        if (i % 1000 == 0) CheckEqual(map, reference);
+    }
+    CheckEqual(map, reference);
+}
+}
+
+BOOST_AUTO_TEST_CASE(openhashmap_random)
+{
+    openhashmap<uint32_t, std::string> map;
+    RandomOperations(map, 1000);
+    openhashmap<uint32_t, std::string, BadHash> collisions;
+    RandomOperations(collisions, 300);
+}
+
+BOOST_AUTO_TEST_CASE(openhashmap_stability)
+{
+    openhashmap<uint32_t, std::string> map;
+    std::string& first = map[0];
+    first = "first";
+    // Values never move, even when the table is rehashed.
+    for (uint32_t i = 1; i < 10000; i++) {
+        map.emplace(i, std::to_string(i));
+    }
+    BOOST_CHECK(&map.find(0)->second == &first);
+    BOOST_CHECK_EQUAL(first, "first");
+
+    // Erasing while iterating visits every element exactly once.
+    size_t visited = 0;
+    for (auto it = map.begin(); it != map.end();) {
+        visited++;
+        if (it->first % 2) {
+            it = map.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    BOOST_CHECK_EQUAL(visited, 10000U);
+    BOOST_CHECK_EQUAL(map.size(), 5000U);
+    BOOST_CHECK(map.find(1) == map.end());
+    BOOST_CHECK(map.find(2) != map.end());
+
+    // Range erase and move construction.
+    map.erase(map.begin(), map.end());
+    BOOST_CHECK(map.empty());
+    map.emplace(7, "seven");
+    openhashmap<uint32_t, std::string> moved(std::move(map));
+    BOOST_CHECK(map.empty() && map.begin() == map.end());
+    BOOST_CHECK_EQUAL(moved.size(), 1U);
+    BOOST_CHECK_EQUAL(moved.find(7)->second, "seven");
+}
+
+BOOST_AUTO_TEST_CASE(openhashmap_memusage)
+{
+    // Compare per-entry overhead against std::unordered_map for a small value.
+    openhashmap<uint64_t, uint64_t> map;
+    std::unordered_map<uint64_t, uint64_t> reference;
+    for (uint64_t i = 0; i < 100000; i++) {
+        map.emplace(i, i);
+        reference.emplace(i, i);
+    }
+    BOOST_CHECK(memusage::DynamicUsage(map) < memusage::DynamicUsage(reference));
+
+    // Memory is released on clear.
+    map.clear();
+    BOOST_CHECK_EQUAL(memusage::DynamicUsage(map), 0U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
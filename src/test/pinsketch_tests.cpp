@@ -0,0 +1,95 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <pinsketch.h>
+
+#include <test/test_bitcoin.h>
+
+#include <algorithm>
+#include <set>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(pinsketch_tests, BasicTestingSetup)
+
+static uint32_t RandomElement()
+{
+    uint32_t element;
+    do {
+        element = InsecureRand32();
+    } while (element == 0);
+    return element;
+}
+
+BOOST_AUTO_TEST_CASE(pinsketch_decode)
+{
+    for (size_t capacity : {1, 2, 7, 20, 40}) {
+        for (size_t nDifference = 0; nDifference <= capacity; nDifference++) {
+            // Two sets sharing many elements, which cancel out
+            PinSketch a(capacity), b(capacity);
+            for (int i = 0; i < 100; i++) {
+                uint32_t element = RandomElement();
+                a.Add(element);
+                b.Add(element);
+            }
+            std::set<uint32_t> setDifference;
+            while (setDifference.size() < nDifference) {
+                uint32_t element = RandomElement();
+                if (setDifference.insert(element).second) {
+                    (setDifference.size() % 2 ? a : b).Add(element);
+                }
+            }
+
+            PinSketch c(0);
+            BOOST_CHECK(PinSketch::Deserialize(a.Serialize(), c));
+            BOOST_CHECK_EQUAL(c.GetCapacity(), capacity);
+            c.Merge(b);
+            std::vector<uint32_t> elements;
+            BOOST_CHECK(c.Decode(elements));
+            std::sort(elements.begin(), elements.end());
+            BOOST_CHECK(elements == std::vector<uint32_t>(setDifference.begin(), setDifference.end()));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(pinsketch_overflow)
+{
+    // Differences past the capacity mostly fail to decode, and never decode
+    // into something other than a set the sketch could hold
+    int nDecoded = 0;
+    for (int i = 0; i < 50; i++) {
+        PinSketch sketch(8);
+        std::set<uint32_t> setElements;
+        while (setElements.size() < 12) {
+            uint32_t element = RandomElement();
+            if (setElements.insert(element).second) sketch.Add(element);
+        }
+        std::vector<uint32_t> elements;
+        if (sketch.Decode(elements)) {
+            nDecoded++;
+            BOOST_CHECK(elements.size() <= 8);
+            PinSketch check(8);
+            for (uint32_t element : elements) check.Add(element);
+            BOOST_CHECK(check.Serialize() == sketch.Serialize());
+        } else {
+            BOOST_CHECK(elements.empty());
+        }
+    }
+    BOOST_CHECK(nDecoded < 5);
+
+    // Adding an element again removes it, and zero is ignored
+    PinSketch sketch(4);
+    sketch.Add(1234);
+    sketch.Add(0);
+    sketch.Add(5678);
+    sketch.Add(1234);
+    std::vector<uint32_t> elements;
+    BOOST_CHECK(sketch.Decode(elements));
+    BOOST_CHECK(elements == std::vector<uint32_t>{5678});
+
+    PinSketch malformed(0);
+    BOOST_CHECK(!PinSketch::Deserialize(std::vector<unsigned char>(7), malformed));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,7 @@
 
 #include <policy/policy.h>
 #include <policy/fees.h>
+#include <streams.h>
 #include <txmempool.h>
 #include <uint256.h>
 #include <util.h>
@@ -177,6 +178,30 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
     for (int i = 2; i < 9; i++) { // At 9, the original estimate was already at the bottom (b/c scale = 2)
         BOOST_CHECK(feeEst.estimateFee(i).GetFeePerK() < origFeeEst[i-1] - deltaFee);
     }
+
+    // Smart fee estimates for the common targets come from the table taken
+    // after the last block, the others are calculated. Both should agree,
+    // and a checkpoint should restore them.
+    CAutoFile file(std::tmpfile(), SER_DISK, CLIENT_VERSION);
+    BOOST_CHECK(feeEst.Write(file));
+    std::rewind(file.Get());
+    CBlockPolicyEstimator feeEstLoaded;
+    BOOST_CHECK(feeEstLoaded.Read(file));
+    for (bool conservative : {false, true}) {
+        CFeeRate lastFeeRate;
+        for (int i = 1; i <= 48; i++) {
+            FeeCalculation feeCalc, feeCalcLoaded;
+            CFeeRate feeRate = feeEst.estimateSmartFee(i, &feeCalc, conservative);
+            BOOST_CHECK(feeRate != CFeeRate(0));
+            BOOST_CHECK(i == 1 || feeRate <= lastFeeRate);
+            BOOST_CHECK_EQUAL(feeCalc.desiredTarget, i);
+            BOOST_CHECK_EQUAL(feeCalc.returnedTarget, std::max(i, 2));
+            BOOST_CHECK(feeRate == feeEstLoaded.estimateSmartFee(i, &feeCalcLoaded, conservative));
+            BOOST_CHECK_EQUAL(feeCalcLoaded.returnedTarget, feeCalc.returnedTarget);
+            BOOST_CHECK(feeCalcLoaded.reason == feeCalc.reason);
+            lastFeeRate = feeRate;
+        }
+    }
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,151 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chain.h>
+#include <chainparams.h>
+#include <validation.h>
+
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(prune_tests, TestChain100Setup)
+
+static const unsigned int MiB = 1024 * 1024;
+
+/** Five files of 100MiB of blocks and 10MiB of undo data, of 100 blocks each a thousand seconds apart */
+static std::vector<CBlockFileInfo> FileInfos()
+{
+    std::vector<CBlockFileInfo> vinfo(5);
+    for (unsigned int i = 0; i < vinfo.size(); ++i) {
+        vinfo[i].nBlocks = 100;
+        vinfo[i].nSize = 100 * MiB;
+        vinfo[i].nUndoSize = 10 * MiB;
+        vinfo[i].nHeightFirst = 100 * i;
+        vinfo[i].nHeightLast = 100 * i + 99;
+        vinfo[i].nTimeFirst = 1000 * i;
+        vinfo[i].nTimeLast = 1000 * i + 990;
+    }
+    return vinfo;
+}
+
+static void CheckSelected(const std::vector<CBlockFileInfo>& vinfo, unsigned int nLastBlockWeCanPrune, int64_t nKeepAfterTime, uint64_t nTarget,
+                          uint64_t nUndoTarget, const std::set<int>& setExpectedFiles, const std::set<int>& setExpectedUndoFiles)
+{
+    std::set<int> setFiles;
+    std::set<int> setUndoFiles;
+    SelectFilesToPrune(vinfo, vinfo.size() - 1, nLastBlockWeCanPrune, nKeepAfterTime, nTarget, nUndoTarget, setFiles, setUndoFiles);
+    BOOST_CHECK(setFiles == setExpectedFiles);
+    BOOST_CHECK(setUndoFiles == setExpectedUndoFiles);
+}
+
+static void CreateFile(const fs::path& path)
+{
+    FILE* file = fsbridge::fopen(path, "wb");
+    BOOST_REQUIRE(file);
+    BOOST_CHECK_EQUAL(fwrite("data", 1, 4, file), 4U);
+    fclose(file);
+}
+
+BOOST_AUTO_TEST_CASE(select_files_to_prune)
+{
+    const std::vector<CBlockFileInfo> vinfo = FileInfos();
+    const unsigned int nAnyHeight = std::numeric_limits<unsigned int>::max();
+    const int64_t nAnyTime = std::numeric_limits<int64_t>::max();
+
+    // 550MiB are in use, and a block and undo chunk are kept free below the target
+    CheckSelected(vinfo, nAnyHeight, nAnyTime, 1000 * MiB, 0, {}, {});
+    CheckSelected(vinfo, nAnyHeight, nAnyTime, 400 * MiB, 0, {0, 1}, {});
+    // The last file, which blocks are still written to, stays
+    CheckSelected(vinfo, nAnyHeight, nAnyTime, 1, 0, {0, 1, 2, 3}, {});
+    // Files that were pruned already are passed over
+    std::vector<CBlockFileInfo> vinfoPruned = vinfo;
+    vinfoPruned[0].SetNull();
+    CheckSelected(vinfoPruned, nAnyHeight, nAnyTime, 300 * MiB, 0, {1, 2}, {});
+
+    // Files with blocks too close to the tip stay
+    CheckSelected(vinfo, 150, nAnyTime, 400 * MiB, 0, {0}, {});
+    CheckSelected(vinfo, 98, nAnyTime, 400 * MiB, 0, {}, {});
+
+    // -prunekeepdays: so do files with blocks from after nKeepAfterTime
+    CheckSelected(vinfo, nAnyHeight, 1990, 400 * MiB, 0, {0}, {});
+    CheckSelected(vinfo, nAnyHeight, 990, 400 * MiB, 0, {}, {});
+
+    // -pruneundo: undo files go first, to stay below their own target, and their blocks stay
+    CheckSelected(vinfo, nAnyHeight, nAnyTime, 1000 * MiB, 25 * MiB, {}, {0, 1, 2});
+    CheckSelected(vinfo, 150, nAnyTime, 1000 * MiB, 25 * MiB, {}, {0});
+    CheckSelected(vinfo, nAnyHeight, 1990, 1000 * MiB, 25 * MiB, {}, {0});
+    // Files whose undo data went already count for their blocks alone
+    CheckSelected(vinfo, nAnyHeight, nAnyTime, 400 * MiB, 25 * MiB, {0, 1}, {2});
+}
+
+BOOST_AUTO_TEST_CASE(remove_pruned_files_in_background)
+{
+    const PruneProgress before = GetPruneProgress();
+    for (int nFile : {10, 11}) {
+        CreateFile(GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk"));
+        CreateFile(GetBlockPosFilename(CDiskBlockPos(nFile, 0), "rev"));
+    }
+
+    RemovePrunedFilesInBackground({10}, false);
+    RemovePrunedFilesInBackground({11}, true);
+    WaitForPrunedFileRemoval();
+    BOOST_CHECK(!fs::exists(GetBlockPosFilename(CDiskBlockPos(10, 0), "blk")));
+    BOOST_CHECK(!fs::exists(GetBlockPosFilename(CDiskBlockPos(10, 0), "rev")));
+    BOOST_CHECK(fs::exists(GetBlockPosFilename(CDiskBlockPos(11, 0), "blk")));
+    BOOST_CHECK(!fs::exists(GetBlockPosFilename(CDiskBlockPos(11, 0), "rev")));
+
+    const PruneProgress after = GetPruneProgress();
+    BOOST_CHECK_EQUAL(after.nPendingFiles, 0U);
+    BOOST_CHECK_EQUAL(after.nRemovedFiles - before.nRemovedFiles, 2U);
+    BOOST_CHECK_EQUAL(after.nRemovedBytes - before.nRemovedBytes, 12U);
+
+    // Stopping deletes what is left first
+    RemovePrunedFilesInBackground({11}, false);
+    StopPrunedFileRemoval();
+    BOOST_CHECK(!fs::exists(GetBlockPosFilename(CDiskBlockPos(11, 0), "blk")));
+    BOOST_CHECK_EQUAL(GetPruneProgress().nPendingFiles, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(remove_leftover_pruned_files)
+{
+    for (int nFile : {1, 2, 3}) {
+        CreateFile(GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk"));
+        CreateFile(GetBlockPosFilename(CDiskBlockPos(nFile, 0), "rev"));
+    }
+    // File 0 holds the chain, yet looks pruned; files 1 and 2 were pruned,
+    // file 2 only of its undo data; file 3 is the last one.
+    std::vector<CBlockFileInfo> vinfo(4);
+    vinfo[2].nSize = 4;
+
+    LOCK(cs_main);
+    RemoveLeftoverPrunedFiles(vinfo, 3);
+    BOOST_CHECK(fs::exists(GetBlockPosFilename(CDiskBlockPos(0, 0), "blk")));
+    BOOST_CHECK(fs::exists(GetBlockPosFilename(CDiskBlockPos(0, 0), "rev")));
+    BOOST_CHECK(!fs::exists(GetBlockPosFilename(CDiskBlockPos(1, 0), "blk")));
+    BOOST_CHECK(!fs::exists(GetBlockPosFilename(CDiskBlockPos(1, 0), "rev")));
+    BOOST_CHECK(fs::exists(GetBlockPosFilename(CDiskBlockPos(2, 0), "blk")));
+    BOOST_CHECK(!fs::exists(GetBlockPosFilename(CDiskBlockPos(2, 0), "rev")));
+    BOOST_CHECK(fs::exists(GetBlockPosFilename(CDiskBlockPos(3, 0), "blk")));
+    BOOST_CHECK(fs::exists(GetBlockPosFilename(CDiskBlockPos(3, 0), "rev")));
+}
+
+BOOST_AUTO_TEST_CASE(verifydb_pruned_undo)
+{
+    LOCK(cs_main);
+    FlushStateToDisk();
+    fPruneMode = true;
+
+    // Blocks whose undo data was pruned are read and checked, but not disconnected.
+    PruneOneUndoFile(0);
+    BOOST_CHECK(!(chainActive.Tip()->nStatus & BLOCK_HAVE_UNDO));
+    BOOST_CHECK(chainActive.Tip()->nStatus & BLOCK_HAVE_DATA);
+    for (int nCheckLevel = 0; nCheckLevel <= 4; ++nCheckLevel) {
+        BOOST_CHECK(CVerifyDB().VerifyDB(Params(), pcoinsTip.get(), nCheckLevel, 6));
+    }
+
+    fPruneMode = false;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,197 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <clientversion.h>
+#include <fs.h>
+#include <hash.h>
+#include <streams.h>
+#include <util.h>
+#include <validation.h>
+
+#include <test/test_bitcoin.h>
+
+#include <algorithm>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(scriptcache_tests, TestingSetup)
+
+/** The contents of sigcache.dat, as written by DumpScriptCaches. */
+struct ScriptCacheFile
+{
+    uint64_t nVersion = 1;
+    int nClientVersion = CLIENT_VERSION;
+    uint256 sigNonce, scriptNonce;
+    std::vector<uint256> sigEntries, scriptEntries;
+};
+
+static void WriteEntries(CDataStream& stream, const std::vector<uint256>& entries)
+{
+    stream << (uint64_t)entries.size();
+    for (const uint256& entry : entries) {
+        stream << entry;
+    }
+}
+
+static void ReadEntries(CDataStream& stream, std::vector<uint256>& entries)
+{
+    uint64_t num;
+    stream >> num;
+    entries.resize(num);
+    for (uint256& entry : entries) {
+        stream >> entry;
+    }
+}
+
+static void WriteCacheFile(const ScriptCacheFile& contents, bool fCorrupt = false, size_t nTruncate = 0)
+{
+    CDataStream stream(SER_DISK, CLIENT_VERSION);
+    stream << contents.nVersion << contents.nClientVersion;
+    stream << contents.sigNonce << contents.scriptNonce;
+    WriteEntries(stream, contents.sigEntries);
+    WriteEntries(stream, contents.scriptEntries);
+    uint256 hash = Hash(stream.begin(), stream.end());
+    if (fCorrupt) {
+        *hash.begin() ^= 1;
+    }
+    stream << hash;
+    stream.resize(stream.size() - nTruncate);
+
+    CAutoFile file(fsbridge::fopen(GetDataDir() / "sigcache.dat", "wb"), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE(!file.IsNull());
+    file << stream;
+}
+
+static ScriptCacheFile DumpAndRead()
+{
+    BOOST_REQUIRE(DumpScriptCaches());
+    CAutoFile file(fsbridge::fopen(GetDataDir() / "sigcache.dat", "rb"), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE(!file.IsNull());
+    std::vector<char> data(fs::file_size(GetDataDir() / "sigcache.dat"));
+    file.read(data.data(), data.size());
+    CDataStream stream(data, SER_DISK, CLIENT_VERSION);
+
+    ScriptCacheFile contents;
+    stream >> contents.nVersion >> contents.nClientVersion;
+    stream >> contents.sigNonce >> contents.scriptNonce;
+    ReadEntries(stream, contents.sigEntries);
+    ReadEntries(stream, contents.scriptEntries);
+    uint256 hash;
+    stream >> hash;
+    BOOST_CHECK(stream.empty());
+    BOOST_CHECK(hash == Hash(data.begin(), data.end() - hash.size()));
+    return contents;
+}
+
+static bool Contains(const std::vector<uint256>& entries, const uint256& entry)
+{
+    return std::find(entries.begin(), entries.end(), entry) != entries.end();
+}
+
+BOOST_AUTO_TEST_CASE(scriptcache_roundtrip)
+{
+    ScriptCacheFile current = DumpAndRead();
+    BOOST_CHECK_EQUAL(current.nVersion, 1U);
+    BOOST_CHECK_EQUAL(current.nClientVersion, CLIENT_VERSION);
+    BOOST_CHECK(!current.sigNonce.IsNull());
+    BOOST_CHECK(!current.scriptNonce.IsNull());
+
+    // Entries under the current salts are added to the caches
+    ScriptCacheFile added = current;
+    const uint256 sigEntry = InsecureRand256();
+    const uint256 scriptEntry = InsecureRand256();
+    added.sigEntries.push_back(sigEntry);
+    added.scriptEntries.push_back(scriptEntry);
+    WriteCacheFile(added);
+    BOOST_CHECK(LoadScriptCaches());
+    ScriptCacheFile loaded = DumpAndRead();
+    BOOST_CHECK(loaded.sigNonce == current.sigNonce);
+    BOOST_CHECK(loaded.scriptNonce == current.scriptNonce);
+    BOOST_CHECK(Contains(loaded.sigEntries, sigEntry));
+    BOOST_CHECK(Contains(loaded.scriptEntries, scriptEntry));
+    BOOST_CHECK(!Contains(loaded.sigEntries, scriptEntry));
+
+    // Loading what was dumped changes nothing
+    BOOST_CHECK(LoadScriptCaches());
+    ScriptCacheFile reloaded = DumpAndRead();
+    BOOST_CHECK(reloaded.sigNonce == loaded.sigNonce);
+    BOOST_CHECK(reloaded.scriptNonce == loaded.scriptNonce);
+    BOOST_CHECK(Contains(reloaded.sigEntries, sigEntry));
+    BOOST_CHECK(Contains(reloaded.scriptEntries, scriptEntry));
+}
+
+BOOST_AUTO_TEST_CASE(scriptcache_other_client_version)
+{
+    // Script execution entries only hold for the build that wrote them
+    ScriptCacheFile contents = DumpAndRead();
+    contents.nClientVersion = CLIENT_VERSION - 1;
+    const uint256 sigEntry = InsecureRand256();
+    const uint256 scriptEntry = InsecureRand256();
+    contents.sigEntries.push_back(sigEntry);
+    contents.scriptEntries.push_back(scriptEntry);
+    WriteCacheFile(contents);
+    BOOST_CHECK(LoadScriptCaches());
+    ScriptCacheFile loaded = DumpAndRead();
+    BOOST_CHECK(Contains(loaded.sigEntries, sigEntry));
+    BOOST_CHECK(!Contains(loaded.scriptEntries, scriptEntry));
+}
+
+BOOST_AUTO_TEST_CASE(scriptcache_rejected)
+{
+    // Make sure the caches hold entries under their current salts
+    ScriptCacheFile current = DumpAndRead();
+    current.sigEntries.push_back(InsecureRand256());
+    current.scriptEntries.push_back(InsecureRand256());
+    WriteCacheFile(current);
+    BOOST_REQUIRE(LoadScriptCaches());
+    current = DumpAndRead();
+
+    const uint256 newEntry = InsecureRand256();
+    auto check_rejected = [&](const ScriptCacheFile& contents, bool fCorrupt, size_t nTruncate) {
+        WriteCacheFile(contents, fCorrupt, nTruncate);
+        BOOST_CHECK(!LoadScriptCaches());
+        ScriptCacheFile after = DumpAndRead();
+        BOOST_CHECK(after.sigNonce == current.sigNonce);
+        BOOST_CHECK(after.scriptNonce == current.scriptNonce);
+        BOOST_CHECK(after.sigEntries == current.sigEntries);
+        BOOST_CHECK(after.scriptEntries == current.scriptEntries);
+    };
+    ScriptCacheFile contents = current;
+    contents.sigEntries.push_back(newEntry);
+    contents.scriptEntries.push_back(newEntry);
+
+    // Unknown version
+    ScriptCacheFile bad = contents;
+    bad.nVersion = 2;
+    check_rejected(bad, false, 0);
+
+    // Null salts
+    bad = contents;
+    bad.sigNonce.SetNull();
+    check_rejected(bad, false, 0);
+    bad = contents;
+    bad.scriptNonce.SetNull();
+    check_rejected(bad, false, 0);
+
+    // Salts other than those of the entries already cached
+    bad = contents;
+    bad.sigNonce = InsecureRand256();
+    check_rejected(bad, false, 0);
+    bad = contents;
+    bad.scriptNonce = InsecureRand256();
+    check_rejected(bad, false, 0);
+
+    // Bad checksum
+    check_rejected(contents, true, 0);
+
+    // Truncated file
+    check_rejected(contents, false, 1);
+    check_rejected(contents, false, 40);
+
+    // Missing file
+    fs::remove(GetDataDir() / "sigcache.dat");
+    BOOST_CHECK(!LoadScriptCaches());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
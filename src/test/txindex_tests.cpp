@@ -0,0 +1,46 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chainparams.h>
+#include <index/txindex.h>
+#include <test/test_bitcoin.h>
+#include <validation.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txindex_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(txindex_migrate_legacy_entries)
+{
+    // Entries written by nodes that kept the index in the block tree
+    // database are moved over when the index is started, before it syncs.
+    const CBlockIndex* genesis = chainActive.Genesis();
+    const uint256 genesis_txid = Params().GenesisBlock().vtx[0]->GetHash();
+    const CDiskTxPos legacy_pos(genesis->GetBlockPos(), GetSizeOfCompactSize(1));
+    BOOST_REQUIRE(pblocktree->Write(std::make_pair('t', genesis_txid), legacy_pos));
+    BOOST_REQUIRE(pblocktree->WriteFlag("txindex", true));
+
+    TxIndex txindex(1 << 20, true);
+
+    CTransactionRef tx_disk;
+    uint256 block_hash;
+    BOOST_CHECK(!txindex.FindTx(genesis_txid, block_hash, tx_disk));
+    BOOST_CHECK(!txindex.BlockUntilSyncedToCurrentChain());
+
+    txindex.Start();
+
+    BOOST_CHECK(txindex.FindTx(genesis_txid, block_hash, tx_disk));
+    BOOST_CHECK_EQUAL(block_hash, genesis->GetBlockHash());
+    BOOST_CHECK_EQUAL(tx_disk->GetHash(), genesis_txid);
+
+    bool f_legacy_flag = true;
+    BOOST_CHECK(!pblocktree->Exists(std::make_pair('t', genesis_txid)));
+    BOOST_CHECK(pblocktree->ReadFlag("txindex", f_legacy_flag));
+    BOOST_CHECK(!f_legacy_flag);
+
+    txindex.Interrupt();
+    txindex.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
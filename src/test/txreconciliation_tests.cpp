@@ -0,0 +1,145 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txreconciliation.h>
+
+#include <test/test_bitcoin.h>
+
+#include <algorithm>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txreconciliation_tests, BasicTestingSetup)
+
+namespace {
+/** Both ends of a connection, node 0 on the side that made it */
+struct Connection
+{
+    TxReconciliationTracker initiator, responder;
+
+    Connection()
+    {
+        uint64_t salt_initiator = initiator.PreRegisterPeer(0);
+        uint64_t salt_responder = responder.PreRegisterPeer(0);
+        BOOST_CHECK(initiator.RegisterPeer(0, false, TXRECONCILIATION_VERSION, salt_responder));
+        BOOST_CHECK(responder.RegisterPeer(0, true, TXRECONCILIATION_VERSION, salt_initiator));
+    }
+
+    /** Run a reconciliation, returning what each side announces */
+    bool Reconcile(std::vector<uint256>& vFromInitiator, std::vector<uint256>& vFromResponder, bool& fSuccess)
+    {
+        uint16_t nSetSize, nQ;
+        std::vector<unsigned char> sketch;
+        std::vector<uint32_t> vAskFor;
+        return initiator.InitiateReconciliation(0, GetTimeMicros(), nSetSize, nQ) &&
+            responder.RespondToReconciliationRequest(0, nSetSize, nQ, sketch) &&
+            initiator.HandleSketch(0, sketch, fSuccess, vFromInitiator, vAskFor) &&
+            responder.HandleReconciliationDifference(0, fSuccess, vAskFor, vFromResponder);
+    }
+};
+
+std::vector<uint256> Sorted(std::vector<uint256> v)
+{
+    std::sort(v.begin(), v.end());
+    return v;
+}
+} // namespace
+
+BOOST_AUTO_TEST_CASE(txreconciliation_register)
+{
+    TxReconciliationTracker tracker;
+    BOOST_CHECK(!tracker.RegisterPeer(0, false, TXRECONCILIATION_VERSION, 1));
+    for (NodeId peer = 0; peer < MAX_OUTBOUND_FLOOD_TO + 2; peer++) {
+        tracker.PreRegisterPeer(peer);
+        BOOST_CHECK(tracker.ShouldFloodTo(peer));
+        BOOST_CHECK(tracker.RegisterPeer(peer, false, TXRECONCILIATION_VERSION, 1));
+        BOOST_CHECK(!tracker.RegisterPeer(peer, false, TXRECONCILIATION_VERSION, 1));
+    }
+    // Only the first outbound peers are flooded
+    BOOST_CHECK(tracker.ShouldFloodTo(0));
+    BOOST_CHECK(!tracker.ShouldFloodTo(MAX_OUTBOUND_FLOOD_TO));
+    tracker.ForgetPeer(0);
+    BOOST_CHECK(!tracker.IsPeerRegistered(0));
+    tracker.PreRegisterPeer(100);
+    BOOST_CHECK(tracker.RegisterPeer(100, false, TXRECONCILIATION_VERSION, 1));
+    BOOST_CHECK(tracker.ShouldFloodTo(100));
+
+    // Inbound peers never are
+    tracker.PreRegisterPeer(101);
+    BOOST_CHECK(tracker.RegisterPeer(101, true, TXRECONCILIATION_VERSION, 1));
+    BOOST_CHECK(!tracker.ShouldFloodTo(101));
+}
+
+BOOST_AUTO_TEST_CASE(txreconciliation_reconcile)
+{
+    Connection conn;
+    // Both sides agree on the short ids
+    uint256 txid = InsecureRand256();
+    BOOST_CHECK_EQUAL(conn.initiator.GetShortID(0, txid), conn.responder.GetShortID(0, txid));
+
+    // Transactions both sides have cancel out; the rest is announced by the
+    // side that has it
+    std::vector<uint256> vOnlyInitiator, vOnlyResponder;
+    for (int i = 0; i < 30; i++) {
+        uint256 hash = InsecureRand256();
+        BOOST_CHECK(conn.initiator.AddToSet(0, hash));
+        BOOST_CHECK(conn.responder.AddToSet(0, hash));
+    }
+    for (int i = 0; i < 3; i++) {
+        vOnlyInitiator.push_back(InsecureRand256());
+        BOOST_CHECK(conn.initiator.AddToSet(0, vOnlyInitiator.back()));
+        vOnlyResponder.push_back(InsecureRand256());
+        BOOST_CHECK(conn.responder.AddToSet(0, vOnlyResponder.back()));
+    }
+    std::vector<uint256> vFromInitiator, vFromResponder;
+    bool fSuccess;
+    BOOST_CHECK(conn.Reconcile(vFromInitiator, vFromResponder, fSuccess));
+    BOOST_CHECK(fSuccess);
+    BOOST_CHECK(Sorted(vFromInitiator) == Sorted(vOnlyInitiator));
+    BOOST_CHECK(Sorted(vFromResponder) == Sorted(vOnlyResponder));
+
+    // The next reconciliation waits for its time, and starts from empty sets
+    uint16_t nSetSize, nQ;
+    BOOST_CHECK(!conn.initiator.InitiateReconciliation(0, GetTimeMicros(), nSetSize, nQ));
+    BOOST_CHECK(conn.initiator.InitiateReconciliation(0, GetTimeMicros() + RECON_REQUEST_INTERVAL, nSetSize, nQ));
+    BOOST_CHECK_EQUAL(nSetSize, 0U);
+
+    // Messages out of turn are refused
+    std::vector<unsigned char> sketch;
+    std::vector<uint32_t> vAskFor;
+    BOOST_CHECK(!conn.initiator.RespondToReconciliationRequest(0, 0, RECON_Q, sketch));
+    BOOST_CHECK(!conn.responder.HandleSketch(0, sketch, fSuccess, vFromResponder, vAskFor));
+    BOOST_CHECK(!conn.responder.HandleReconciliationDifference(0, true, vAskFor, vFromResponder));
+}
+
+BOOST_AUTO_TEST_CASE(txreconciliation_fallback)
+{
+    // A difference far past the capacity of the sketch: both sides fall
+    // back to announcing their whole sets
+    Connection conn;
+    std::vector<uint256> vInitiator, vResponder;
+    for (size_t i = 0; i < 2 * MAX_SKETCH_CAPACITY; i++) {
+        vInitiator.push_back(InsecureRand256());
+        conn.initiator.AddToSet(0, vInitiator.back());
+    }
+    for (size_t i = 0; i < 2 * MAX_SKETCH_CAPACITY; i++) {
+        vResponder.push_back(InsecureRand256());
+        conn.responder.AddToSet(0, vResponder.back());
+    }
+    std::vector<uint256> vFromInitiator, vFromResponder;
+    bool fSuccess;
+    BOOST_CHECK(conn.Reconcile(vFromInitiator, vFromResponder, fSuccess));
+    BOOST_CHECK(!fSuccess);
+    BOOST_CHECK(Sorted(vFromInitiator) == Sorted(vInitiator));
+    BOOST_CHECK(Sorted(vFromResponder) == Sorted(vResponder));
+
+    // A full set turns new transactions away, to be flooded
+    Connection full;
+    for (size_t i = 0; i < MAX_RECON_SET_SIZE; i++) {
+        BOOST_CHECK(full.responder.AddToSet(0, InsecureRand256()));
+    }
+    BOOST_CHECK(!full.responder.AddToSet(0, InsecureRand256()));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
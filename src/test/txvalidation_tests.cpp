@@ -5,10 +5,14 @@
 #include <validation.h>
 #include <txmempool.h>
 #include <amount.h>
+#include <clientversion.h>
 #include <consensus/validation.h>
 #include <primitives/transaction.h>
+#include <script/interpreter.h>
 #include <script/script.h>
+#include <streams.h>
 #include <test/test_bitcoin.h>
+#include <util.h>
 
 #include <boost/test/unit_test.hpp>
 
@@ -58,4 +62,168 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_reject_coinbase, TestChain100Setup)
     BOOST_CHECK_EQUAL(nDoS, 100);
 }
 
+static CMutableTransaction SpendToKey(const CTransaction& prev, const CKey& key, CAmount nFee)
+{
+    CMutableTransaction tx;
+    tx.nVersion = 1;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(prev.GetHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = prev.vout[0].nValue - nFee;
+    tx.vout[0].scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(prev.vout[0].scriptPubKey, tx, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << vchSig;
+    return tx;
+}
+
+/**
+ * Ensure that the mempool comes back from mempool.dat, in the current
+ * format and in the one without metadata.
+ */
+BOOST_FIXTURE_TEST_CASE(tx_mempool_persist, TestChain100Setup)
+{
+    // Mature a second coinbase, for a parent and child and one unrelated
+    // transaction
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CreateAndProcessBlock({}, scriptPubKey);
+    const CTransaction parent(SpendToKey(coinbaseTxns[0], coinbaseKey, 10000));
+    const CTransaction child(SpendToKey(parent, coinbaseKey, 20000));
+    const CTransaction other(SpendToKey(coinbaseTxns[1], coinbaseKey, 10000));
+    {
+        LOCK(cs_main);
+        for (const CTransaction* tx : {&parent, &child, &other}) {
+            CValidationState state;
+            BOOST_CHECK(AcceptToMemoryPool(mempool, state, MakeTransactionRef(*tx), nullptr /* pfMissingInputs */,
+                                           nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */));
+        }
+    }
+    mempool.PrioritiseTransaction(child.GetHash(), 5000);
+    const int64_t nChildTime = mempool.info(child.GetHash()).nTime;
+    BOOST_CHECK(DumpMempool());
+
+    mempool.clear();
+    mempool.ClearPrioritisation(child.GetHash());
+    BOOST_CHECK(LoadMempool());
+    BOOST_CHECK_EQUAL(mempool.size(), 3U);
+    {
+        LOCK(mempool.cs);
+        CTxMemPool::txiter it = mempool.mapTx.find(child.GetHash());
+        BOOST_REQUIRE(it != mempool.mapTx.end());
+        BOOST_CHECK_EQUAL(it->GetFee(), 20000);
+        BOOST_CHECK_EQUAL(it->GetModifiedFee(), 25000);
+        BOOST_CHECK_EQUAL(it->GetCountWithAncestors(), 2U);
+        BOOST_CHECK_EQUAL(it->GetTime(), nChildTime);
+    }
+
+    // The format without metadata still loads
+    {
+        CAutoFile file(fsbridge::fopen(GetDataDir() / "mempool.dat", "wb"), SER_DISK, CLIENT_VERSION);
+        file << (uint64_t)1 << (uint64_t)3;
+        for (const CTransaction* tx : {&parent, &child, &other}) {
+            file << *tx << nChildTime << (int64_t)0;
+        }
+        file << std::map<uint256, CAmount>();
+    }
+    mempool.clear();
+    mempool.ClearPrioritisation(child.GetHash());
+    BOOST_CHECK(LoadMempool());
+    BOOST_CHECK_EQUAL(mempool.size(), 3U);
+
+    // A transaction whose input got spent since is left out, and the rest
+    // still go in
+    BOOST_CHECK(DumpMempool());
+    mempool.clear();
+    CreateAndProcessBlock({CMutableTransaction(other)}, scriptPubKey);
+    BOOST_CHECK(LoadMempool());
+    BOOST_CHECK_EQUAL(mempool.size(), 2U);
+    BOOST_CHECK(mempool.exists(child.GetHash()));
+    BOOST_CHECK(!mempool.exists(other.GetHash()));
+
+    // Nothing below the minimum fee a full mempool sets goes in
+    BOOST_CHECK(DumpMempool());
+    mempool.TrimToSize(0);
+    BOOST_CHECK_EQUAL(mempool.size(), 0U);
+    BOOST_CHECK(LoadMempool());
+    BOOST_CHECK_EQUAL(mempool.size(), 0U);
+    mempool.clear();
+}
+
+/**
+ * Ensure that a child can pay for a parent that is too cheap to be accepted
+ * on its own, and that malformed packages are turned away.
+ */
+BOOST_FIXTURE_TEST_CASE(tx_package_accept, TestChain100Setup)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CreateAndProcessBlock({}, scriptPubKey);
+    CreateAndProcessBlock({}, scriptPubKey);
+    const CTransactionRef parent = MakeTransactionRef(SpendToKey(coinbaseTxns[0], coinbaseKey, 0));
+    const CTransactionRef child = MakeTransactionRef(SpendToKey(*parent, coinbaseKey, 10000));
+    const CTransactionRef cheap_child = MakeTransactionRef(SpendToKey(*parent, coinbaseKey, 100));
+    const CTransactionRef other = MakeTransactionRef(SpendToKey(coinbaseTxns[1], coinbaseKey, 10000));
+
+    LOCK(cs_main);
+
+    // The parent pays nothing, so it does not get in alone
+    CValidationState state;
+    BOOST_CHECK(!AcceptToMemoryPool(mempool, state, parent, nullptr /* pfMissingInputs */,
+                                    nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "min relay fee not met");
+
+    // Packages that are not sorted or whose transactions are not all
+    // ancestors of the last one
+    state = CValidationState();
+    BOOST_CHECK(!AcceptPackageToMemoryPool(mempool, state, {child, parent}, nullptr, 0));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "package-not-sorted");
+    state = CValidationState();
+    BOOST_CHECK(!AcceptPackageToMemoryPool(mempool, state, {other, parent, child}, nullptr, 0));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "package-not-connected");
+    state = CValidationState();
+    BOOST_CHECK(!AcceptPackageToMemoryPool(mempool, state, {parent, child, child}, nullptr, 0));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "package-contains-duplicates");
+
+    // A child that does not make up for its parent
+    state = CValidationState();
+    BOOST_CHECK(!AcceptPackageToMemoryPool(mempool, state, {parent, cheap_child}, nullptr, 0));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "min relay fee not met");
+    BOOST_CHECK_EQUAL(mempool.size(), 0U);
+
+    // A parent cannot pay for a child that does not pay for itself
+    const CTransactionRef rich_parent = MakeTransactionRef(SpendToKey(coinbaseTxns[2], coinbaseKey, 100000));
+    const CTransactionRef free_child = MakeTransactionRef(SpendToKey(*rich_parent, coinbaseKey, 0));
+    state = CValidationState();
+    BOOST_CHECK(!AcceptPackageToMemoryPool(mempool, state, {rich_parent, free_child}, nullptr, 0));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "min relay fee not met");
+    BOOST_CHECK_EQUAL(mempool.size(), 0U);
+
+    // A child that does
+    state = CValidationState();
+    BOOST_CHECK(AcceptPackageToMemoryPool(mempool, state, {parent, child}, nullptr, 0));
+    BOOST_CHECK_EQUAL(mempool.size(), 2U);
+    BOOST_CHECK(mempool.exists(parent->GetHash()));
+    BOOST_CHECK(mempool.exists(child->GetHash()));
+
+    // A package whose parent is in the mempool already only adds the rest,
+    // and a conflicting one is turned away
+    state = CValidationState();
+    BOOST_CHECK(!AcceptPackageToMemoryPool(mempool, state, {parent, cheap_child}, nullptr, 0));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "txn-mempool-conflict");
+    const CTransactionRef grandchild = MakeTransactionRef(SpendToKey(*child, coinbaseKey, 10000));
+    state = CValidationState();
+    BOOST_CHECK(AcceptPackageToMemoryPool(mempool, state, {parent, child, grandchild}, nullptr, 0));
+    BOOST_CHECK_EQUAL(mempool.size(), 3U);
+
+    // Inputs missing from the chain, the mempool and the package
+    const CTransactionRef orphan = MakeTransactionRef(SpendToKey(*other, coinbaseKey, 10000));
+    bool fMissingInputs = false;
+    state = CValidationState();
+    BOOST_CHECK(!AcceptPackageToMemoryPool(mempool, state, {orphan}, &fMissingInputs, 0));
+    BOOST_CHECK(fMissingInputs);
+    BOOST_CHECK(!state.IsInvalid());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
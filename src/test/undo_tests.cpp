@@ -0,0 +1,210 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <chain.h>
+#include <chainparams.h>
+#include <clientversion.h>
+#include <fs.h>
+#include <script/script.h>
+#include <streams.h>
+#include <undo.h>
+#include <validation.h>
+
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(undo_tests, BasicTestingSetup)
+
+static CScript RandomScript(int kind)
+{
+    const uint256 hash = InsecureRand256();
+    CScript script;
+    switch (kind) {
+    case 0: // pay to pubkey hash
+        return script << OP_DUP << OP_HASH160 << std::vector<unsigned char>(hash.begin(), hash.begin() + 20) << OP_EQUALVERIFY << OP_CHECKSIG;
+    case 1: // pay to script hash
+        return script << OP_HASH160 << std::vector<unsigned char>(hash.begin(), hash.begin() + 20) << OP_EQUAL;
+    case 2: // witness v0 key hash
+        return script << OP_0 << std::vector<unsigned char>(hash.begin(), hash.begin() + 20);
+    case 3: // witness v0 script hash
+        return script << OP_0 << std::vector<unsigned char>(hash.begin(), hash.end());
+    case 4: // witness v1, which has no template
+        return script << OP_1 << std::vector<unsigned char>(hash.begin(), hash.end());
+    default:
+        return script << OP_RETURN << std::vector<unsigned char>(hash.begin(), hash.begin() + InsecureRandRange(32));
+    }
+}
+
+static CBlockUndo RandomBlockUndo(int nHeight)
+{
+    CBlockUndo blockundo;
+    std::vector<CScript> scripts;
+    blockundo.vtxundo.resize(20);
+    for (CTxUndo& txundo : blockundo.vtxundo) {
+        for (int i = 0, n = 1 + InsecureRandRange(4); i < n; ++i) {
+            // Every fourth output pays to an address spent from before
+            CScript script = !scripts.empty() && InsecureRandRange(4) == 0 ? scripts[InsecureRandRange(scripts.size())] : RandomScript(InsecureRandRange(6));
+            scripts.push_back(script);
+            txundo.vprevout.emplace_back(CTxOut(InsecureRandRange(50 * COIN), script), InsecureRandRange(nHeight + 1), InsecureRandBool());
+        }
+    }
+    return blockundo;
+}
+
+static void CheckEqual(const CBlockUndo& a, const CBlockUndo& b)
+{
+    BOOST_REQUIRE_EQUAL(a.vtxundo.size(), b.vtxundo.size());
+    for (size_t i = 0; i < a.vtxundo.size(); ++i) {
+        BOOST_REQUIRE_EQUAL(a.vtxundo[i].vprevout.size(), b.vtxundo[i].vprevout.size());
+        for (size_t j = 0; j < a.vtxundo[i].vprevout.size(); ++j) {
+            const Coin& coin_a = a.vtxundo[i].vprevout[j];
+            const Coin& coin_b = b.vtxundo[i].vprevout[j];
+            BOOST_CHECK(coin_a.out == coin_b.out);
+            BOOST_CHECK_EQUAL(coin_a.nHeight, coin_b.nHeight);
+            BOOST_CHECK_EQUAL(coin_a.fCoinBase, coin_b.fCoinBase);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(undo_compact_roundtrip)
+{
+    for (int nHeight : {0, 1, 1000, 500000}) {
+        CBlockUndo blockundo = RandomBlockUndo(nHeight);
+
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << CompactBlockUndo(blockundo, nHeight);
+        CBlockUndo read;
+        ss >> REF(CompactBlockUndo(read, nHeight));
+        BOOST_CHECK(ss.empty());
+        CheckEqual(blockundo, read);
+
+        // Undo data in the original format still reads
+        CDataStream ss_legacy(SER_DISK, CLIENT_VERSION);
+        ss_legacy << blockundo;
+        CBlockUndo read_legacy;
+        ss_legacy >> read_legacy;
+        CheckEqual(blockundo, read_legacy);
+
+        BOOST_CHECK_LT(GetSerializeSize(CompactBlockUndo(blockundo, nHeight), SER_DISK, CLIENT_VERSION),
+                       GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(undo_compact_scripts)
+{
+    // Both witness templates take one byte on top of the hash, and a script
+    // spent before in the block takes a reference.
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(1);
+    const CScript witness_key_hash = RandomScript(2);
+    const CScript witness_script_hash = RandomScript(3);
+    blockundo.vtxundo[0].vprevout.emplace_back(CTxOut(0, witness_key_hash), 10, false);
+    blockundo.vtxundo[0].vprevout.emplace_back(CTxOut(0, witness_script_hash), 10, false);
+    blockundo.vtxundo[0].vprevout.emplace_back(CTxOut(0, witness_key_hash), 10, false);
+    // 2 counts, and 2 bytes of height and amount per coin
+    BOOST_CHECK_EQUAL(GetSerializeSize(CompactBlockUndo(blockundo, 10), SER_DISK, CLIENT_VERSION), 2U + 3 * 2 + 21 + 33 + 2);
+
+    // A reference to a script that was not seen yet is rejected
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << CompactBlockUndo(blockundo, 10);
+    ss[2 + 2 + 21 + 2 + 33 + 2 + 1] = 5;
+    CBlockUndo read;
+    BOOST_CHECK_THROW(ss >> REF(CompactBlockUndo(read, 10)), std::ios_base::failure);
+
+    // So is a coin that would be older than the genesis block
+    CBlockUndo genesis_spend;
+    genesis_spend.vtxundo.resize(1);
+    genesis_spend.vtxundo[0].vprevout.emplace_back(CTxOut(0, witness_key_hash), 0, false);
+    CDataStream ss_height(SER_DISK, CLIENT_VERSION);
+    ss_height << CompactBlockUndo(genesis_spend, 10);
+    BOOST_CHECK_THROW(ss_height >> REF(CompactBlockUndo(read, 9)), std::ios_base::failure);
+}
+
+/** About a megabyte of undo data, in coins with scripts of the largest size */
+static CBlockUndo LargeBlockUndo()
+{
+    CBlockUndo blockundo;
+    blockundo.vtxundo.resize(1);
+    const std::vector<unsigned char> data(MAX_SCRIPT_SIZE, OP_NOP);
+    for (int i = 0; i < 100; ++i) {
+        blockundo.vtxundo[0].vprevout.emplace_back(CTxOut(i, CScript(data.begin(), data.end())), 1, false);
+    }
+    return blockundo;
+}
+
+BOOST_FIXTURE_TEST_CASE(undo_buffer, TestingSetup)
+{
+    LOCK(cs_main);
+    // Start from an empty buffer, whatever earlier tests left in it
+    BOOST_REQUIRE(WriteUndoBuffer(true));
+
+    const uint256 hashPrev = InsecureRand256();
+    CBlockIndex prev;
+    prev.phashBlock = &hashPrev;
+    std::vector<std::unique_ptr<CBlockIndex>> vIndex;
+    auto index_at = [&](const CDiskBlockPos& pos, int nHeight, bool fCompact) {
+        vIndex.emplace_back(new CBlockIndex);
+        vIndex.back()->pprev = &prev;
+        vIndex.back()->nHeight = nHeight;
+        vIndex.back()->nFile = pos.nFile;
+        vIndex.back()->nUndoPos = pos.nPos;
+        vIndex.back()->nStatus = BLOCK_HAVE_UNDO | (fCompact ? (uint32_t)BLOCK_UNDO_COMPACT : (uint32_t)0);
+        return vIndex.back().get();
+    };
+    const unsigned int nHeaderSize = CMessageHeader::MESSAGE_START_SIZE + sizeof(unsigned int);
+    const fs::path rev30 = GetBlockPosFilename(CDiskBlockPos(30, 0), "rev");
+    const fs::path rev31 = GetBlockPosFilename(CDiskBlockPos(31, 0), "rev");
+    const fs::path rev32 = GetBlockPosFilename(CDiskBlockPos(32, 0), "rev");
+
+    // Undo data reads back before it reaches the disk, in either format
+    const CBlockUndo first = RandomBlockUndo(100);
+    CDiskBlockPos pos_first(30, 0);
+    BOOST_REQUIRE(UndoWriteToDisk(first, 100, pos_first, hashPrev, Params().MessageStart(), false));
+    BOOST_CHECK_EQUAL(pos_first.nPos, nHeaderSize);
+    const CBlockIndex* pindex_first = index_at(pos_first, 100, false);
+
+    const CBlockUndo second = RandomBlockUndo(101);
+    CDiskBlockPos pos_second(30, pos_first.nPos + GetSerializeSize(first, SER_DISK, CLIENT_VERSION) + sizeof(uint256));
+    BOOST_REQUIRE(UndoWriteToDisk(second, 101, pos_second, hashPrev, Params().MessageStart(), true));
+    const CBlockIndex* pindex_second = index_at(pos_second, 101, true);
+    const unsigned int nEnd30 = pos_second.nPos + GetSerializeSize(CompactBlockUndo(REF(second), 101), SER_DISK, CLIENT_VERSION) + sizeof(uint256);
+
+    BOOST_CHECK(!fs::exists(rev30));
+    CBlockUndo read;
+    BOOST_CHECK(UndoReadFromDisk(read, pindex_first));
+    CheckEqual(first, read);
+    BOOST_CHECK(UndoReadFromDisk(read, pindex_second));
+    CheckEqual(second, read);
+
+    // Undo data for another file writes the buffer out
+    CDiskBlockPos pos_third(31, 0);
+    BOOST_REQUIRE(UndoWriteToDisk(first, 100, pos_third, hashPrev, Params().MessageStart(), false));
+    BOOST_CHECK_EQUAL(fs::file_size(rev30), nEnd30);
+    BOOST_CHECK(!fs::exists(rev31));
+    BOOST_CHECK(UndoReadFromDisk(read, pindex_first));
+    CheckEqual(first, read);
+    BOOST_CHECK(UndoReadFromDisk(read, pindex_second));
+    CheckEqual(second, read);
+
+    // So does filling it up
+    BOOST_REQUIRE(WriteUndoBuffer(true));
+    BOOST_CHECK(fs::exists(rev31));
+    const CBlockUndo large = LargeBlockUndo();
+    const unsigned int nRecordSize = nHeaderSize + GetSerializeSize(large, SER_DISK, CLIENT_VERSION) + sizeof(uint256);
+    const CBlockIndex* pindex_last = nullptr;
+    unsigned int nEnd32 = 0;
+    while (nEnd32 < MAX_UNDO_BUFFER_SIZE) {
+        BOOST_REQUIRE(!fs::exists(rev32));
+        CDiskBlockPos pos(32, nEnd32);
+        BOOST_REQUIRE(UndoWriteToDisk(large, 100, pos, hashPrev, Params().MessageStart(), false));
+        pindex_last = index_at(pos, 100, false);
+        nEnd32 += nRecordSize;
+    }
+    BOOST_CHECK_EQUAL(fs::file_size(rev32), nEnd32);
+    BOOST_CHECK(UndoReadFromDisk(read, pindex_last));
+    CheckEqual(large, read);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
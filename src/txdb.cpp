@@ -13,6 +13,7 @@
 #include <util.h>
 #include <ui_interface.h>
 #include <init.h>
+#include <warnings.h>
 
 #include <stdint.h>
 
@@ -21,7 +22,6 @@
 static const char DB_COIN = 'C';
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
-static const char DB_TXINDEX = 't';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
@@ -29,9 +29,54 @@ static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_INDEX_SNAPSHOT = 'S';
+static const char DB_INDEX_SNAPSHOT_CHANGED = 's';
+
+//! Version of the block index snapshot file format
+static const uint32_t BLOCK_INDEX_SNAPSHOT_VERSION = 1;
 
 namespace {
 
+/** What the block database keeps about the block index snapshot. */
+struct BlockIndexSnapshotState {
+    //! Checksum of the snapshot file
+    uint256 checksum;
+    //! Hash of the last block file number and its info, as last written by a
+    //! version that keeps the snapshot up to date. Versions that do not know
+    //! about the snapshot write blocks without updating it, which shows that
+    //! the snapshot is stale.
+    uint256 block_files;
+    //! Best block of the chainstate when the block index was last written.
+    //! Versions that do not know about the snapshot connect and disconnect
+    //! blocks without updating it.
+    uint256 best_block;
+    //! Number of block index entries in the database. Versions that do not
+    //! know about the snapshot add headers without marking them as changed.
+    uint64_t entry_count = 0;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(checksum);
+        READWRITE(block_files);
+        READWRITE(best_block);
+        READWRITE(entry_count);
+    }
+};
+
+uint256 BlockFilesHash(int last_file, const CBlockFileInfo& info)
+{
+    CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+    hasher << last_file << info;
+    return hasher.GetHash();
+}
+
+fs::path GetBlockIndexSnapshotPath()
+{
+    return GetDataDir() / "blocks" / "indexsnapshot.dat";
+}
+
 struct CoinEntry {
     COutPoint* outpoint;
     char key;
@@ -54,19 +99,60 @@ struct CoinEntry {
 
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true) 
+static void AbortOnFlushFailure()
 {
+    const std::string strMessage = "Failed to write to coin database";
+    SetMiscWarning(strMessage);
+    LogPrintf("*** %s\n", strMessage);
+    uiInterface.ThreadSafeMessageBox(_("Error: A fatal internal error occurred, see debug.log for details"), "", CClientUIInterface::MSG_ERROR);
+    StartShutdown();
+}
+
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true, DBProfile::CHAINSTATE), nPendingCoinsUsage(0), fFlushing(false), fFlushFailed(false), fnFlushFailed(AbortOnFlushFailure)
+{
+}
+
+CCoinsViewDB::~CCoinsViewDB()
+{
+    WaitForFlush();
+    if (threadFlush.joinable())
+        threadFlush.join();
 }
 
 bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    {
+        WaitableLock lock(cs_pending);
+        CCoinsMap::const_iterator it;
+        if (pcoinsPending && (it = pcoinsPending->find(outpoint)) != pcoinsPending->end()) {
+            if (it->second.coin.IsSpent())
+                return false;
+            coin = it->second.coin;
+            return true;
+        }
+    }
     return db.Read(CoinEntry(&outpoint), coin);
 }
 
 bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
+    {
+        WaitableLock lock(cs_pending);
+        CCoinsMap::const_iterator it;
+        if (pcoinsPending && (it = pcoinsPending->find(outpoint)) != pcoinsPending->end())
+            return !it->second.coin.IsSpent();
+    }
     return db.Exists(CoinEntry(&outpoint));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
+    {
+        WaitableLock lock(cs_pending);
+        if (!hashPendingBlock.IsNull())
+            return hashPendingBlock;
+    }
+    return GetDiskBestBlock();
+}
+
+uint256 CCoinsViewDB::GetDiskBestBlock() const {
     uint256 hashBestChain;
     if (!db.Read(DB_BEST_BLOCK, hashBestChain))
         return uint256();
@@ -81,15 +167,10 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
     return vhashHeadBlocks;
 }
 
-bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
-    CDBBatch batch(db);
-    size_t count = 0;
-    size_t changed = 0;
-    size_t batch_size = (size_t)gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
-    int crash_simulate = gArgs.GetArg("-dbcrashratio", 0);
+void CCoinsViewDB::WriteMarkerBatch(CDBBatch& batch, const uint256& hashBlock) {
     assert(!hashBlock.IsNull());
 
-    uint256 old_tip = GetBestBlock();
+    uint256 old_tip = GetDiskBestBlock();
     if (old_tip.IsNull()) {
         // We may be in the middle of replaying.
         std::vector<uint256> old_heads = GetHeadBlocks();
@@ -105,6 +186,37 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     // interrupting after partial writes from multiple independent reorgs.
     batch.Erase(DB_BEST_BLOCK);
     batch.Write(DB_HEAD_BLOCKS, std::vector<uint256>{hashBlock, old_tip});
+}
+
+void CCoinsViewDB::WritePartialBatch(CDBBatch& batch, CCoinsFlushStats& stats) {
+    LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
+    stats.nBytes += batch.SizeEstimate();
+    stats.nBatches++;
+    db.WriteBatch(batch);
+    batch.Clear();
+    int crash_simulate = gArgs.GetArg("-dbcrashratio", 0);
+    if (crash_simulate) {
+        static FastRandomContext rng;
+        if (rng.randrange(crash_simulate) == 0) {
+            LogPrintf("Simulating a crash. Goodbye.\n");
+            _Exit(0);
+        }
+    }
+}
+
+bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    // A synchronous write must not interleave with a background one.
+    if (!WaitForFlush())
+        return false;
+
+    CCoinsFlushStats stats;
+    stats.nTime = GetTime();
+    int64_t nTimeStart = GetTimeMicros();
+    CDBBatch batch(db);
+    size_t count = 0;
+    size_t batch_size = (size_t)gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
+
+    WriteMarkerBatch(batch, hashBlock);
 
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
@@ -113,22 +225,13 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
                 batch.Erase(entry);
             else
                 batch.Write(entry, it->second.coin);
-            changed++;
+            stats.nChanged++;
         }
         count++;
         CCoinsMap::iterator itOld = it++;
         mapCoins.erase(itOld);
         if (batch.SizeEstimate() > batch_size) {
-            LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
-            db.WriteBatch(batch);
-            batch.Clear();
-            if (crash_simulate) {
-                static FastRandomContext rng;
-                if (rng.randrange(crash_simulate) == 0) {
-                    LogPrintf("Simulating a crash. Goodbye.\n");
-                    _Exit(0);
-                }
-            }
+            WritePartialBatch(batch, stats);
         }
     }
 
@@ -137,17 +240,162 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     batch.Write(DB_BEST_BLOCK, hashBlock);
 
     LogPrint(BCLog::COINDB, "Writing final batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
+    stats.nBytes += batch.SizeEstimate();
+    stats.nBatches++;
     bool ret = db.WriteBatch(batch);
-    LogPrint(BCLog::COINDB, "Committed %u changed transaction outputs (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
+    LogPrint(BCLog::COINDB, "Committed %u changed transaction outputs (out of %u) to coin database...\n", (unsigned int)stats.nChanged, (unsigned int)count);
+
+    stats.nDuration = GetTimeMicros() - nTimeStart;
+    WaitableLock lock(cs_pending);
+    lastFlush = stats;
     return ret;
 }
 
+bool CCoinsViewDB::BatchWriteBackground(CCoinsMap &mapCoins, const uint256 &hashBlock, size_t nCoinsUsage) {
+    // Only one background write can be in flight; wait for the previous one
+    // so that the head blocks marker always describes a single transition.
+    if (!WaitForFlush())
+        return false;
+    if (threadFlush.joinable())
+        threadFlush.join();
+
+    {
+        WaitableLock lock(cs_pending);
+        assert(!pcoinsPending);
+        // Taking over the caller's map is O(1); clean entries are skipped by
+        // the writer and are harmless to readers since they match the disk.
+        pcoinsPending.reset(new CCoinsMap(std::move(mapCoins)));
+        nPendingCoinsUsage = nCoinsUsage;
+        hashPendingBlock = hashBlock;
+        fFlushing = true;
+    }
+    mapCoins.clear();
+
+    threadFlush = std::thread(&TraceThread<std::function<void()> >, "coinsflush", std::function<void()>(std::bind(&CCoinsViewDB::ThreadFlush, this, GetTime())));
+    return true;
+}
+
+void CCoinsViewDB::ThreadFlush(int64_t nTime) {
+    CCoinsFlushStats stats;
+    stats.nTime = nTime;
+    stats.fBackground = true;
+    int64_t nTimeStart = GetTimeMicros();
+    size_t count = 0;
+    size_t batch_size = (size_t)gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
+    bool fOk = true;
+
+    try {
+        CDBBatch batch(db);
+        CCoinsMap::iterator it;
+        uint256 hashBlock;
+        {
+            WaitableLock lock(cs_pending);
+            it = pcoinsPending->begin();
+            hashBlock = hashPendingBlock;
+        }
+
+        WriteMarkerBatch(batch, hashBlock);
+
+        // Testing: fail as a full or broken disk would.
+        if (gArgs.GetBoolArg("-dbflushfailure", false))
+            throw dbwrapper_error("Simulated write failure");
+
+        while (true) {
+            bool fLast;
+            {
+                // Only this thread modifies pcoinsPending while a flush is in
+                // progress, so the iterator stays valid between batches.
+                WaitableLock lock(cs_pending);
+                for (; it != pcoinsPending->end() && batch.SizeEstimate() <= batch_size; ++it) {
+                    if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+                        CoinEntry entry(&it->first);
+                        if (it->second.coin.IsSpent())
+                            batch.Erase(entry);
+                        else
+                            batch.Write(entry, it->second.coin);
+                        stats.nChanged++;
+                    }
+                    count++;
+                }
+                fLast = it == pcoinsPending->end();
+            }
+            if (fLast)
+                break;
+            WritePartialBatch(batch, stats);
+            // The entries are on disk now; stop shadowing them.
+            WaitableLock lock(cs_pending);
+            for (CCoinsMap::const_iterator itDone = pcoinsPending->begin(); itDone != it; ++itDone) {
+                nPendingCoinsUsage -= itDone->second.coin.DynamicMemoryUsage();
+            }
+            pcoinsPending->erase(pcoinsPending->begin(), it);
+        }
+
+        batch.Erase(DB_HEAD_BLOCKS);
+        batch.Write(DB_BEST_BLOCK, hashBlock);
+
+        LogPrint(BCLog::COINDB, "Writing final batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
+        stats.nBytes += batch.SizeEstimate();
+        stats.nBatches++;
+        fOk = db.WriteBatch(batch);
+    } catch (const std::runtime_error& e) {
+        LogPrintf("%s: error writing to coin database: %s\n", __func__, e.what());
+        fOk = false;
+    }
+    stats.nDuration = GetTimeMicros() - nTimeStart;
+    LogPrint(BCLog::COINDB, "Committed %u changed transaction outputs (out of %u) to coin database in the background (%.2fms)\n", (unsigned int)stats.nChanged, (unsigned int)count, stats.nDuration * 0.001);
+
+    {
+        WaitableLock lock(cs_pending);
+        if (fOk) {
+            pcoinsPending.reset();
+            nPendingCoinsUsage = 0;
+            hashPendingBlock.SetNull();
+            lastFlush = stats;
+        } else {
+            // Keep the remaining entries visible, and refuse further writes
+            // that would build on the missing ones.
+            fFlushFailed = true;
+        }
+        fFlushing = false;
+        condFlushDone.notify_all();
+    }
+
+    if (!fOk) {
+        // Nothing waits on this thread, and the next flush may be a long
+        // time away, so report the failure from here.
+        fnFlushFailed();
+    }
+}
+
+bool CCoinsViewDB::WaitForFlush() const {
+    WaitableLock lock(cs_pending);
+    condFlushDone.wait(lock, [this]{ return !fFlushing; });
+    return !fFlushFailed;
+}
+
+bool CCoinsViewDB::IsFlushing() const {
+    WaitableLock lock(cs_pending);
+    return fFlushing;
+}
+
+size_t CCoinsViewDB::PendingMemoryUsage() const {
+    WaitableLock lock(cs_pending);
+    if (!pcoinsPending)
+        return 0;
+    return memusage::DynamicUsage(*pcoinsPending) + nPendingCoinsUsage;
+}
+
+CCoinsFlushStats CCoinsViewDB::GetLastFlushStats() const {
+    WaitableLock lock(cs_pending);
+    return lastFlush;
+}
+
 size_t CCoinsViewDB::EstimateSize() const
 {
     return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, false, DBProfile::BLOCK_INDEX) {
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -172,6 +420,8 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
 
 CCoinsViewCursor *CCoinsViewDB::Cursor() const
 {
+    // Iterate a database that is consistent with its best block.
+    WaitForFlush();
     CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper&>(db).NewIterator(), GetBestBlock());
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
@@ -224,29 +474,41 @@ void CCoinsViewDBCursor::Next()
     }
 }
 
-bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo) {
+bool CBlockTreeDB::WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo, const uint256& best_block) {
     CDBBatch batch(*this);
+    CBlockFileInfo last_file_info;
+    bool have_last_file_info = false;
     for (std::vector<std::pair<int, const CBlockFileInfo*> >::const_iterator it=fileInfo.begin(); it != fileInfo.end(); it++) {
         batch.Write(std::make_pair(DB_BLOCK_FILES, it->first), *it->second);
+        if (it->first == nLastFile) {
+            last_file_info = *it->second;
+            have_last_file_info = true;
+        }
     }
     batch.Write(DB_LAST_BLOCK, nLastFile);
+    // Entries written after the snapshot are read on top of it at startup.
+    BlockIndexSnapshotState snapshot;
+    const bool have_snapshot = Read(DB_INDEX_SNAPSHOT, snapshot);
     for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
+        if (have_snapshot) {
+            if (!Exists(std::make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()))) {
+                snapshot.entry_count++;
+            }
+            batch.Write(std::make_pair(DB_INDEX_SNAPSHOT_CHANGED, (*it)->GetBlockHash()), '1');
+        }
         batch.Write(std::make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
     }
+    if (have_snapshot) {
+        if (!have_last_file_info) {
+            ReadBlockFileInfo(nLastFile, last_file_info);
+        }
+        snapshot.block_files = BlockFilesHash(nLastFile, last_file_info);
+        snapshot.best_block = best_block;
+        batch.Write(DB_INDEX_SNAPSHOT, snapshot);
+    }
     return WriteBatch(batch, true);
 }
 
-bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
-    return Read(std::make_pair(DB_TXINDEX, txid), pos);
-}
-
-bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >&vect) {
-    CDBBatch batch(*this);
-    for (std::vector<std::pair<uint256,CDiskTxPos> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Write(std::make_pair(DB_TXINDEX, it->first), it->second);
-    return WriteBatch(batch);
-}
-
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -303,6 +565,157 @@ bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams,
     return true;
 }
 
+uint256 CBlockTreeDB::GetBlockFilesHash()
+{
+    int last_file = 0;
+    CBlockFileInfo info;
+    ReadLastBlockFile(last_file);
+    ReadBlockFileInfo(last_file, info);
+    return BlockFilesHash(last_file, info);
+}
+
+uint64_t CBlockTreeDB::CountBlockIndexEntries()
+{
+    uint64_t count = 0;
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    for (pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256())); pcursor->Valid(); pcursor->Next()) {
+        std::pair<char, uint256> key;
+        if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX) {
+            break;
+        }
+        count++;
+    }
+    return count;
+}
+
+bool CBlockTreeDB::ReadBlockIndexSnapshot(std::vector<BlockIndexSnapshotEntry>& entries, std::vector<CDiskBlockIndex>& changed, const uint256& best_block)
+{
+    BlockIndexSnapshotState snapshot;
+    if (!Read(DB_INDEX_SNAPSHOT, snapshot)) {
+        return false;
+    }
+    if (snapshot.block_files != GetBlockFilesHash()) {
+        LogPrintf("%s: blocks were written without updating the snapshot\n", __func__);
+        return false;
+    }
+    if (snapshot.best_block != best_block) {
+        LogPrintf("%s: the chainstate moved to %s without updating the snapshot\n", __func__, best_block.ToString());
+        return false;
+    }
+    // Only the keys are read, which costs a fraction of loading the entries.
+    if (CountBlockIndexEntries() != snapshot.entry_count) {
+        LogPrintf("%s: block index entries were added without updating the snapshot\n", __func__);
+        return false;
+    }
+
+    const fs::path path = GetBlockIndexSnapshotPath();
+    std::vector<unsigned char> data;
+    FILE* file = fsbridge::fopen(path, "rb");
+    if (!file) {
+        return error("%s: cannot open %s", __func__, path.string());
+    }
+    try {
+        data.resize(fs::file_size(path));
+    } catch (const fs::filesystem_error& e) {
+        fclose(file);
+        return error("%s: %s", __func__, e.what());
+    }
+    const size_t read = fread(data.data(), 1, data.size(), file);
+    fclose(file);
+    if (read != data.size() || data.size() < sizeof(uint256)) {
+        return error("%s: cannot read %s", __func__, path.string());
+    }
+
+    const size_t payload_size = data.size() - sizeof(uint256);
+    const uint256 checksum = Hash(data.begin(), data.begin() + payload_size);
+    if (memcmp(checksum.begin(), data.data() + payload_size, sizeof(uint256)) != 0 || checksum != snapshot.checksum) {
+        return error("%s: checksum mismatch in %s", __func__, path.string());
+    }
+
+    try {
+        SpanReader reader(SER_DISK, CLIENT_VERSION, data.data(), payload_size);
+        uint32_t version;
+        uint64_t count;
+        reader >> version >> count;
+        if (version != BLOCK_INDEX_SNAPSHOT_VERSION) {
+            return error("%s: unknown version %u", __func__, version);
+        }
+        if (count > std::numeric_limits<int32_t>::max() ||
+            reader.size() != count * GetSerializeSize(BlockIndexSnapshotEntry(), SER_DISK, CLIENT_VERSION)) {
+            return error("%s: unexpected size", __func__);
+        }
+        entries.resize(count);
+        for (size_t i = 0; i < count; ++i) {
+            BlockIndexSnapshotEntry& entry = entries[i];
+            reader >> entry;
+            if (entry.prev < -1 || entry.prev >= (int32_t)i || entry.skip < -1 || entry.skip >= (int32_t)i) {
+                return error("%s: entry %u refers forward", __func__, i);
+            }
+        }
+    } catch (const std::exception& e) {
+        return error("%s: %s", __func__, e.what());
+    }
+
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    for (pcursor->Seek(std::make_pair(DB_INDEX_SNAPSHOT_CHANGED, uint256())); pcursor->Valid(); pcursor->Next()) {
+        std::pair<char, uint256> key;
+        if (!pcursor->GetKey(key) || key.first != DB_INDEX_SNAPSHOT_CHANGED) {
+            break;
+        }
+        CDiskBlockIndex diskindex;
+        if (!Read(std::make_pair(DB_BLOCK_INDEX, key.second), diskindex)) {
+            return error("%s: changed block %s is missing", __func__, key.second.ToString());
+        }
+        changed.push_back(diskindex);
+    }
+    return true;
+}
+
+bool CBlockTreeDB::WriteBlockIndexSnapshot(const std::vector<BlockIndexSnapshotEntry>& entries, const uint256& best_block)
+{
+    const fs::path path = GetBlockIndexSnapshotPath();
+    const fs::path path_tmp = path.string() + ".new";
+    BlockIndexSnapshotState snapshot;
+    try {
+        CAutoFile file(fsbridge::fopen(path_tmp, "wb"), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull()) {
+            return error("%s: cannot open %s", __func__, path_tmp.string());
+        }
+        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+        hasher << BLOCK_INDEX_SNAPSHOT_VERSION << (uint64_t)entries.size();
+        file << BLOCK_INDEX_SNAPSHOT_VERSION << (uint64_t)entries.size();
+        for (const BlockIndexSnapshotEntry& entry : entries) {
+            hasher << entry;
+            file << entry;
+        }
+        snapshot.checksum = hasher.GetHash();
+        file << snapshot.checksum;
+        FileCommit(file.Get());
+    } catch (const std::exception& e) {
+        return error("%s: %s", __func__, e.what());
+    }
+    if (!RenameOver(path_tmp, path)) {
+        return error("%s: cannot rename %s", __func__, path_tmp.string());
+    }
+
+    // Until this batch is written, the database refers to the old checksum,
+    // so a crash in between leaves no snapshot rather than a wrong one.
+    CDBBatch batch(*this);
+    snapshot.block_files = GetBlockFilesHash();
+    snapshot.best_block = best_block;
+    snapshot.entry_count = entries.size();
+    batch.Write(DB_INDEX_SNAPSHOT, snapshot);
+    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+    for (pcursor->Seek(std::make_pair(DB_INDEX_SNAPSHOT_CHANGED, uint256())); pcursor->Valid(); pcursor->Next()) {
+        std::pair<char, uint256> key;
+        if (!pcursor->GetKey(key) || key.first != DB_INDEX_SNAPSHOT_CHANGED) {
+            break;
+        }
+        batch.Erase(key);
+    }
+    return WriteBatch(batch, true);
+}
+
 namespace {
 
 //! Legacy class to deserialize pre-pertxout database entries without reindex.
@@ -9,10 +9,13 @@
 #include <coins.h>
 #include <dbwrapper.h>
 #include <chain.h>
+#include <sync.h>
 
+#include <functional>
 #include <map>
 #include <memory>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -26,16 +29,24 @@ static constexpr int MAX_BLOCK_COINSDB_USAGE = 10;
 static const int64_t nDefaultDbCache = 450;
 //! -dbbatchsize default (bytes)
 static const int64_t nDefaultDbBatchSize = 16 << 20;
+//! -dbbackgroundflush default
+static const bool DEFAULT_DB_BACKGROUND_FLUSH = true;
 //! max. -dbcache (MiB)
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache (MiB)
 static const int64_t nMinDbCache = 4;
-//! Max memory allocated to block tree DB specific cache, if no -txindex (MiB)
+//! Max memory allocated to block tree DB specific cache (MiB)
 static const int64_t nMaxBlockDBCache = 2;
-//! Max memory allocated to block tree DB specific cache, if -txindex (MiB)
+//! Max memory allocated to tx index DB specific cache (MiB)
 // Unlike for the UTXO database, for the txindex scenario the leveldb cache make
 // a meaningful difference: https://github.com/bitcoin/bitcoin/pull/8273#issuecomment-229601991
-static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
+static const int64_t nMaxTxIndexCache = 1024;
+//! Max memory allocated to address index DB specific cache (MiB)
+static const int64_t nMaxAddressIndexCache = 1024;
+//! Max memory allocated to spent index DB specific cache (MiB)
+static const int64_t nMaxSpentIndexCache = 1024;
+//! Max memory allocated to all block filter index caches combined in MiB.
+static const int64_t nMaxBlockFilterIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
 
@@ -64,21 +75,69 @@ struct CDiskTxPos : public CDiskBlockPos
     }
 };
 
+/** Statistics about the most recent write of the coins cache to disk */
+struct CCoinsFlushStats
+{
+    int64_t nTime = 0;          //!< Time the write started (unix seconds)
+    int64_t nDuration = 0;      //!< Time spent writing to the database (microseconds)
+    uint64_t nBytes = 0;        //!< Estimated bytes handed to the database
+    uint64_t nChanged = 0;      //!< Number of changed coins written
+    unsigned int nBatches = 0;  //!< Number of database batches used
+    bool fBackground = false;   //!< Whether the write ran on the background flush thread
+};
+
 /** CCoinsView backed by the coin database (chainstate/) */
 class CCoinsViewDB final : public CCoinsView
 {
 protected:
     CDBWrapper db;
+
+    /**
+     * Entries handed to the background flush thread that have not reached
+     * disk yet. Lookups consult this map before the database, so the view
+     * stays consistent while a write is in progress. Entries are only
+     * removed after the batch containing them has been committed.
+     */
+    mutable CWaitableCriticalSection cs_pending;
+    mutable CConditionVariable condFlushDone;
+    std::unique_ptr<CCoinsMap> pcoinsPending;
+    size_t nPendingCoinsUsage;
+    uint256 hashPendingBlock;
+    bool fFlushing;
+    bool fFlushFailed;
+    CCoinsFlushStats lastFlush;
+    std::thread threadFlush;
+    std::function<void()> fnFlushFailed;
+
+    uint256 GetDiskBestBlock() const;
+    void WriteMarkerBatch(CDBBatch& batch, const uint256& hashBlock);
+    void WritePartialBatch(CDBBatch& batch, CCoinsFlushStats& stats);
+    void ThreadFlush(int64_t nTimeStart);
+
 public:
     explicit CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    ~CCoinsViewDB();
 
     bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
     bool HaveCoin(const COutPoint &outpoint) const override;
     uint256 GetBestBlock() const override;
     std::vector<uint256> GetHeadBlocks() const override;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    bool BatchWriteBackground(CCoinsMap &mapCoins, const uint256 &hashBlock, size_t nCoinsUsage) override;
     CCoinsViewCursor *Cursor() const override;
 
+    //! Wait for a running background flush to finish. Returns false if it failed.
+    bool WaitForFlush() const;
+    //! Whether a background flush is currently writing to disk.
+    bool IsFlushing() const;
+    //! Memory held by the entries a background flush has not written yet.
+    size_t PendingMemoryUsage() const;
+    //! Replace what the flush thread does when a background flush fails,
+    //! which is to shut the node down.
+    void SetFlushFailedHandler(std::function<void()> handler) { fnFlushFailed = std::move(handler); }
+    //! Statistics of the last completed write to disk.
+    CCoinsFlushStats GetLastFlushStats() const;
+
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
@@ -106,6 +165,55 @@ private:
     friend class CCoinsViewDB;
 };
 
+/**
+ * A block index entry as stored in the block index snapshot. Besides what
+ * CDiskBlockIndex holds, it keeps the chain work and maximum time that are
+ * otherwise recomputed at startup, and refers to the previous block and the
+ * skip block by their positions in the snapshot, so that entries are linked
+ * without looking up hashes. Every entry comes after the ones it refers to.
+ */
+struct BlockIndexSnapshotEntry
+{
+    uint256 hash;
+    int32_t prev;       //!< position of the previous block, -1 for none
+    int32_t skip;       //!< position of the skip block, -1 for none
+    int32_t height;
+    int32_t file;
+    uint32_t data_pos;
+    uint32_t undo_pos;
+    uint32_t tx_count;
+    uint32_t status;
+    int32_t version;
+    uint256 merkle_root;
+    uint32_t time;
+    uint32_t bits;
+    uint32_t nonce;
+    uint256 chain_work;
+    uint32_t time_max;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(hash);
+        READWRITE(prev);
+        READWRITE(skip);
+        READWRITE(height);
+        READWRITE(file);
+        READWRITE(data_pos);
+        READWRITE(undo_pos);
+        READWRITE(tx_count);
+        READWRITE(status);
+        READWRITE(version);
+        READWRITE(merkle_root);
+        READWRITE(time);
+        READWRITE(bits);
+        READWRITE(nonce);
+        READWRITE(chain_work);
+        READWRITE(time_max);
+    }
+};
+
 /** Access to the block database (blocks/index/) */
 class CBlockTreeDB : public CDBWrapper
 {
@@ -115,16 +223,31 @@ public:
     CBlockTreeDB(const CBlockTreeDB&) = delete;
     CBlockTreeDB& operator=(const CBlockTreeDB&) = delete;
 
-    bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo);
+    /** Write block file info and block index entries, the chainstate being about to be flushed to best_block. */
+    bool WriteBatchSync(const std::vector<std::pair<int, const CBlockFileInfo*> >& fileInfo, int nLastFile, const std::vector<const CBlockIndex*>& blockinfo, const uint256& best_block);
     bool ReadBlockFileInfo(int nFile, CBlockFileInfo &info);
     bool ReadLastBlockFile(int &nFile);
     bool WriteReindexing(bool fReindexing);
     bool ReadReindexing(bool &fReindexing);
-    bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
-    bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &vect);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+
+    /**
+     * Read the block index snapshot, if there is one that the database has
+     * not moved on from, and the entries written to the database since it
+     * was taken. The snapshot is stale if the block files, the number of
+     * entries in the database or the chainstate's best_block changed behind
+     * its back.
+     */
+    bool ReadBlockIndexSnapshot(std::vector<BlockIndexSnapshotEntry>& entries, std::vector<CDiskBlockIndex>& changed, const uint256& best_block);
+
+    /** Replace the block index snapshot with entries that match the database and the chainstate at best_block. */
+    bool WriteBlockIndexSnapshot(const std::vector<BlockIndexSnapshotEntry>& entries, const uint256& best_block);
+
+private:
+    uint256 GetBlockFilesHash();
+    uint64_t CountBlockIndexEntries();
 };
 
 #endif // BITCOIN_TXDB_H
@@ -21,8 +21,8 @@
 CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                                  int64_t _nTime, unsigned int _entryHeight,
                                  bool _spendsCoinbase, int64_t _sigOpsCost, LockPoints lp):
-    tx(_tx), nFee(_nFee), nTime(_nTime), entryHeight(_entryHeight),
-    spendsCoinbase(_spendsCoinbase), sigOpCost(_sigOpsCost), lockPoints(lp)
+    tx(_tx), nFee(_nFee), nTime(_nTime), sigOpCost(_sigOpsCost), lockPoints(lp),
+    entryHeight(_entryHeight), spendsCoinbase(_spendsCoinbase)
 {
     nTxWeight = GetTransactionWeight(*tx);
     nUsageSize = RecursiveDynamicUsage(tx);
@@ -59,17 +59,19 @@ size_t CTxMemPoolEntry::GetTxSize() const
 // Update the given tx for any in-mempool descendants.
 // Assumes that setMemPoolChildren is correct for the given tx and all
 // descendants.
-void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendants, const std::set<uint256> &setExclude)
+void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendants, const std::set<uint256> &setExclude, deltaMap &mapAncestorDeltas)
 {
     setEntries stageEntries, setAllDescendants;
-    stageEntries = GetMemPoolChildren(updateIt);
+    for (const CTxMemPoolEntry* child : GetMemPoolChildren(updateIt)) {
+        stageEntries.insert(GetIter(child));
+    }
 
     while (!stageEntries.empty()) {
         const txiter cit = *stageEntries.begin();
         setAllDescendants.insert(cit);
         stageEntries.erase(cit);
-        const setEntries &setChildren = GetMemPoolChildren(cit);
-        for (const txiter childEntry : setChildren) {
+        for (const CTxMemPoolEntry* child : GetMemPoolChildren(cit)) {
+            const txiter childEntry = GetIter(child);
             cacheMap::iterator cacheIt = cachedDescendants.find(childEntry);
             if (cacheIt != cachedDescendants.end()) {
                 // We've already calculated this one, just add the entries for this set
@@ -94,8 +96,13 @@ void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendan
             modifyFee += cit->GetModifiedFee();
             modifyCount++;
             cachedDescendants[updateIt].insert(cit);
-            // Update ancestor state for each descendant
-            mapTx.modify(cit, update_ancestor_state(updateIt->GetTxSize(), updateIt->GetModifiedFee(), 1, updateIt->GetSigOpCost()));
+            // Update ancestor state for each descendant, once all of the
+            // transactions are done
+            StateDelta &delta = mapAncestorDeltas[cit];
+            delta.nSize += updateIt->GetTxSize();
+            delta.nModFee += updateIt->GetModifiedFee();
+            delta.nCount++;
+            delta.nSigOpCost += updateIt->GetSigOpCost();
         }
     }
     mapTx.modify(updateIt, update_descendant_state(modifySize, modifyFee, modifyCount));
@@ -113,6 +120,8 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
     // in-vHashesToUpdate transactions, so that we don't have to recalculate
     // descendants when we come across a previously seen entry.
     cacheMap mapMemPoolDescendantsToUpdate;
+    // A descendant of several of them has its ancestor state modified once
+    deltaMap mapAncestorDeltas;
 
     // Use a set for lookups into vHashesToUpdate (these entries are already
     // accounted for in the state of their ancestors)
@@ -145,8 +154,11 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
                 UpdateParent(childIter, it, true);
             }
         }
-        UpdateForDescendants(it, mapMemPoolDescendantsToUpdate, setAlreadyIncluded);
+        UpdateForDescendants(it, mapMemPoolDescendantsToUpdate, setAlreadyIncluded, mapAncestorDeltas);
     }
+    ApplyStateDeltas(mapAncestorDeltas, deltaMap());
+    // Ancestor and descendant state changed
+    ++nTransactionsUpdated;
 }
 
 bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents /* = true */) const
@@ -174,7 +186,9 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         // If we're not searching for parents, we require this to be an
         // entry in the mempool already.
         txiter it = mapTx.iterator_to(entry);
-        parentHashes = GetMemPoolParents(it);
+        for (const CTxMemPoolEntry* parent : GetMemPoolParents(it)) {
+            parentHashes.insert(GetIter(parent));
+        }
     }
 
     size_t totalSizeWithAncestors = entry.GetTxSize();
@@ -197,8 +211,8 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
             return false;
         }
 
-        const setEntries & setMemPoolParents = GetMemPoolParents(stageit);
-        for (const txiter &phash : setMemPoolParents) {
+        for (const CTxMemPoolEntry* parent : GetMemPoolParents(stageit)) {
+            const txiter phash = GetIter(parent);
             // If this is a new ancestor, add it.
             if (setAncestors.count(phash) == 0) {
                 parentHashes.insert(phash);
@@ -215,10 +229,9 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
 
 void CTxMemPool::UpdateAncestorsOf(bool add, txiter it, setEntries &setAncestors)
 {
-    setEntries parentIters = GetMemPoolParents(it);
     // add or remove this tx as a child of each parent
-    for (txiter piter : parentIters) {
-        UpdateChild(piter, it, add);
+    for (const CTxMemPoolEntry* parent : GetMemPoolParents(it)) {
+        UpdateChild(GetIter(parent), it, add);
     }
     const int64_t updateCount = (add ? 1 : -1);
     const int64_t updateSize = updateCount * it->GetTxSize();
@@ -244,66 +257,116 @@ void CTxMemPool::UpdateEntryForAncestors(txiter it, const setEntries &setAncesto
 
 void CTxMemPool::UpdateChildrenForRemoval(txiter it)
 {
-    const setEntries &setMemPoolChildren = GetMemPoolChildren(it);
-    for (txiter updateIt : setMemPoolChildren) {
-        UpdateParent(updateIt, it, false);
+    for (const CTxMemPoolEntry* child : GetMemPoolChildren(it)) {
+        UpdateParent(GetIter(child), it, false);
+    }
+}
+
+void CTxMemPool::CalculateRelativesOutside(const setEntries &entries, bool fAncestors, cacheMap &cachedRelatives) const
+{
+    // Handle entries with fewer relatives in the walk direction first, so
+    // that those further along have their relatives collected when reached.
+    // If the state is off during a reorg this only costs some walking twice.
+    std::vector<txiter> vOrder(entries.begin(), entries.end());
+    std::sort(vOrder.begin(), vOrder.end(), [fAncestors](txiter a, txiter b) {
+        return fAncestors ? a->GetCountWithAncestors() < b->GetCountWithAncestors() : a->GetCountWithDescendants() < b->GetCountWithDescendants();
+    });
+    for (txiter entryIt : vOrder) {
+        setEntries &setRelatives = cachedRelatives[entryIt];
+        setEntries setWalked;
+        std::vector<txiter> vStage(1, entryIt);
+        while (!vStage.empty()) {
+            const txiter it = vStage.back();
+            vStage.pop_back();
+            for (const CTxMemPoolEntry* relative : fAncestors ? GetMemPoolParents(it) : GetMemPoolChildren(it)) {
+                const txiter relIt = GetIter(relative);
+                if (!entries.count(relIt)) {
+                    if (setRelatives.insert(relIt).second) {
+                        vStage.push_back(relIt);
+                    }
+                    continue;
+                }
+                cacheMap::const_iterator cacheIt = cachedRelatives.find(relIt);
+                if (cacheIt != cachedRelatives.end()) {
+                    // Already collected, including everything past it
+                    setRelatives.insert(cacheIt->second.begin(), cacheIt->second.end());
+                } else if (setWalked.insert(relIt).second) {
+                    vStage.push_back(relIt);
+                }
+            }
+        }
+    }
+}
+
+void CTxMemPool::ApplyStateDeltas(const deltaMap &mapAncestorDeltas, const deltaMap &mapDescendantDeltas)
+{
+    for (const auto& delta : mapAncestorDeltas) {
+        mapTx.modify(delta.first, update_ancestor_state(delta.second.nSize, delta.second.nModFee, delta.second.nCount, delta.second.nSigOpCost));
+    }
+    for (const auto& delta : mapDescendantDeltas) {
+        mapTx.modify(delta.first, update_descendant_state(delta.second.nSize, delta.second.nModFee, delta.second.nCount));
     }
 }
 
 void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, bool updateDescendants)
 {
     // For each entry, walk back all ancestors and decrement size associated with this
-    // transaction
-    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    // transaction. The ancestors are collected for all entries in one pass,
+    // and the entries being removed are left out of it, as their state no
+    // longer matters: when a block is connected, every in-mempool ancestor of
+    // a confirmed transaction is confirmed with it, so nothing is walked.
+    //
+    // The ancestors are found through the parent links rather than by
+    // searching the inputs. If we happen to be in the middle of processing a
+    // reorg, then the mempool can be in an inconsistent state: when we add a
+    // new transaction to the mempool in addUnchecked(), we assume it has no
+    // children, and in the case of a reorg where that assumption is false,
+    // the in-mempool children aren't linked to the in-block tx's until
+    // UpdateTransactionsFromBlock() is called. The set of ancestors reachable
+    // via the parent links is then the set of ancestors whose packages
+    // include this transaction, which is what needs updating for removal.
+    deltaMap mapAncestorDeltas, mapDescendantDeltas;
+    cacheMap mapAncestors;
+    CalculateRelativesOutside(entriesToRemove, true, mapAncestors);
+    for (txiter removeIt : entriesToRemove) {
+        for (txiter ancestorIt : mapAncestors[removeIt]) {
+            StateDelta &delta = mapDescendantDeltas[ancestorIt];
+            delta.nSize -= removeIt->GetTxSize();
+            delta.nModFee -= removeIt->GetModifiedFee();
+            delta.nCount--;
+        }
+    }
     if (updateDescendants) {
         // updateDescendants should be true whenever we're not recursively
         // removing a tx and all its descendants, eg when a transaction is
         // confirmed in a block.
-        // Here we only update statistics and not data in mapLinks (which
+        // Here we only update statistics and not the parent and child links (which
         // we need to preserve until we're finished with all operations that
         // need to traverse the mempool).
+        cacheMap mapDescendants;
+        CalculateRelativesOutside(entriesToRemove, false, mapDescendants);
         for (txiter removeIt : entriesToRemove) {
-            setEntries setDescendants;
-            CalculateDescendants(removeIt, setDescendants);
-            setDescendants.erase(removeIt); // don't update state for self
-            int64_t modifySize = -((int64_t)removeIt->GetTxSize());
-            CAmount modifyFee = -removeIt->GetModifiedFee();
-            int modifySigOps = -removeIt->GetSigOpCost();
-            for (txiter dit : setDescendants) {
-                mapTx.modify(dit, update_ancestor_state(modifySize, modifyFee, -1, modifySigOps));
+            for (txiter descendantIt : mapDescendants[removeIt]) {
+                StateDelta &delta = mapAncestorDeltas[descendantIt];
+                delta.nSize -= removeIt->GetTxSize();
+                delta.nModFee -= removeIt->GetModifiedFee();
+                delta.nCount--;
+                delta.nSigOpCost -= removeIt->GetSigOpCost();
             }
         }
     }
-    for (txiter removeIt : entriesToRemove) {
-        setEntries setAncestors;
-        const CTxMemPoolEntry &entry = *removeIt;
-        std::string dummy;
-        // Since this is a tx that is already in the mempool, we can call CMPA
-        // with fSearchForParents = false.  If the mempool is in a consistent
-        // state, then using true or false should both be correct, though false
-        // should be a bit faster.
-        // However, if we happen to be in the middle of processing a reorg, then
-        // the mempool can be in an inconsistent state.  In this case, the set
-        // of ancestors reachable via mapLinks will be the same as the set of 
-        // ancestors whose packages include this transaction, because when we
-        // add a new transaction to the mempool in addUnchecked(), we assume it
-        // has no children, and in the case of a reorg where that assumption is
-        // false, the in-mempool children aren't linked to the in-block tx's
-        // until UpdateTransactionsFromBlock() is called.
-        // So if we're being called during a reorg, ie before
-        // UpdateTransactionsFromBlock() has been called, then mapLinks[] will
-        // differ from the set of mempool parents we'd calculate by searching,
-        // and it's important that we use the mapLinks[] notion of ancestor
-        // transactions as the set of things to update for removal.
-        CalculateMemPoolAncestors(entry, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
-        // Note that UpdateAncestorsOf severs the child links that point to
-        // removeIt in the entries for the parents of removeIt.
-        UpdateAncestorsOf(false, removeIt, setAncestors);
-    }
+    ApplyStateDeltas(mapAncestorDeltas, mapDescendantDeltas);
+
     // After updating all the ancestor sizes, we can now sever the link between each
-    // transaction being removed and any mempool children (ie, update setMemPoolParents
-    // for each direct child of a transaction being removed).
+    // transaction being removed and its parents and children that stay in the
+    // mempool.
     for (txiter removeIt : entriesToRemove) {
+        for (const CTxMemPoolEntry* parent : GetMemPoolParents(removeIt)) {
+            const txiter parentIt = GetIter(parent);
+            if (!entriesToRemove.count(parentIt)) {
+                UpdateChild(parentIt, removeIt, false);
+            }
+        }
         UpdateChildrenForRemoval(removeIt);
     }
 }
@@ -329,9 +392,12 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
 }
 
 CTxMemPool::CTxMemPool(CBlockPolicyEstimator* estimator) :
-    nTransactionsUpdated(0), minerPolicyEstimator(estimator)
+    nTransactionsUpdated(0), minerPolicyEstimator(estimator),
+    mapTx(indexed_transaction_set::ctor_args_list(), node_arena_allocator<CTxMemPoolEntry>(&arena)),
+    mapNextTx(node_arena_allocator<nexttx_map::value_type>(&arena))
 {
     _clear(); //lock free clear
+    nEmptyArenaUsage = arena.DynamicMemoryUsage();
 
     // Sanity checks off by default for performance, because otherwise
     // accepting transactions becomes O(N^2) where N is the number
@@ -365,7 +431,6 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     // all the appropriate checks.
     LOCK(cs);
     indexed_transaction_set::iterator newit = mapTx.insert(entry).first;
-    mapLinks.insert(make_pair(newit, TxLinks()));
 
     // Update transaction for any feeDelta created by PrioritiseTransaction
     // TODO: refactor so that the fee delta is calculated before inserting
@@ -434,8 +499,7 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 
     totalTxSize -= it->GetTxSize();
     cachedInnerUsage -= it->DynamicMemoryUsage();
-    cachedInnerUsage -= memusage::DynamicUsage(mapLinks[it].parents) + memusage::DynamicUsage(mapLinks[it].children);
-    mapLinks.erase(it);
+    cachedInnerUsage -= memusage::DynamicUsage(it->vMemPoolParents) + memusage::DynamicUsage(it->vMemPoolChildren);
     mapTx.erase(it);
     nTransactionsUpdated++;
     if (minerPolicyEstimator) {minerPolicyEstimator->removeTx(hash, false);}
@@ -461,8 +525,8 @@ void CTxMemPool::CalculateDescendants(txiter entryit, setEntries &setDescendants
         setDescendants.insert(it);
         stage.erase(it);
 
-        const setEntries &setChildren = GetMemPoolChildren(it);
-        for (const txiter &childiter : setChildren) {
+        for (const CTxMemPoolEntry* child : GetMemPoolChildren(it)) {
+            const txiter childiter = GetIter(child);
             if (!setDescendants.count(childiter)) {
                 stage.insert(childiter);
             }
@@ -470,6 +534,32 @@ void CTxMemPool::CalculateDescendants(txiter entryit, setEntries &setDescendants
     }
 }
 
+bool CTxMemPool::CalculateReplacementSummary(const setEntries& setConflicting, uint64_t nMaxEvicted, ReplacementSummary& summary) const
+{
+    summary = ReplacementSummary();
+    for (txiter it : setConflicting) {
+        summary.nPotentialEvicted += it->GetCountWithDescendants();
+    }
+    if (summary.nPotentialEvicted > nMaxEvicted) {
+        return false;
+    }
+
+    std::vector<txiter> stage(setConflicting.begin(), setConflicting.end());
+    while (!stage.empty()) {
+        txiter it = stage.back();
+        stage.pop_back();
+        if (!summary.setEvicted.insert(it).second) {
+            continue;
+        }
+        summary.nFees += it->GetModifiedFee();
+        summary.nSize += it->GetTxSize();
+        for (const CTxMemPoolEntry* child : GetMemPoolChildren(it)) {
+            stage.push_back(GetIter(child));
+        }
+    }
+    return true;
+}
+
 void CTxMemPool::removeRecursive(const CTransaction &origTx, MemPoolRemovalReason reason)
 {
     // Remove transaction from memory pool
@@ -573,14 +663,15 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
     }
     // Before the txs in the new block have been removed from the mempool, update policy estimates
     if (minerPolicyEstimator) {minerPolicyEstimator->processBlock(nBlockHeight, entries);}
+    // Remove the confirmed transactions in one batch, so that a chain of them
+    // is not walked again for each one
+    setEntries stage;
+    for (const CTxMemPoolEntry* entry : entries) {
+        stage.insert(GetIter(entry));
+    }
+    RemoveStaged(stage, true, MemPoolRemovalReason::BLOCK);
     for (const auto& tx : vtx)
     {
-        txiter it = mapTx.find(tx->GetHash());
-        if (it != mapTx.end()) {
-            setEntries stage;
-            stage.insert(it);
-            RemoveStaged(stage, true, MemPoolRemovalReason::BLOCK);
-        }
         removeConflicts(*tx);
         ClearPrioritisation(tx->GetHash());
     }
@@ -590,9 +681,9 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
 
 void CTxMemPool::_clear()
 {
-    mapLinks.clear();
     mapTx.clear();
     mapNextTx.clear();
+    vTxHashes.clear();
     totalTxSize = 0;
     cachedInnerUsage = 0;
     lastRollingFeeUpdate = GetTime();
@@ -639,10 +730,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         checkTotal += it->GetTxSize();
         innerUsage += it->DynamicMemoryUsage();
         const CTransaction& tx = it->GetTx();
-        txlinksMap::const_iterator linksiter = mapLinks.find(it);
-        assert(linksiter != mapLinks.end());
-        const TxLinks &links = linksiter->second;
-        innerUsage += memusage::DynamicUsage(links.parents) + memusage::DynamicUsage(links.children);
+        innerUsage += memusage::DynamicUsage(it->vMemPoolParents) + memusage::DynamicUsage(it->vMemPoolChildren);
         bool fDependsWait = false;
         setEntries setParentCheck;
         int64_t parentSizes = 0;
@@ -668,7 +756,10 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
             assert(it3->second == &tx);
             i++;
         }
-        assert(setParentCheck == GetMemPoolParents(it));
+        assert(setParentCheck.size() == GetMemPoolParents(it).size());
+        for (const CTxMemPoolEntry* parent : GetMemPoolParents(it)) {
+            assert(setParentCheck.count(GetIter(parent)));
+        }
         // Verify ancestor state is correct.
         setEntries setAncestors;
         uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
@@ -701,7 +792,10 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
                 childSizes += childit->GetTxSize();
             }
         }
-        assert(setChildrenCheck == GetMemPoolChildren(it));
+        assert(setChildrenCheck.size() == GetMemPoolChildren(it).size());
+        for (const CTxMemPoolEntry* child : GetMemPoolChildren(it)) {
+            assert(setChildrenCheck.count(GetIter(child)));
+        }
         // Also check to make sure size is greater than sum with immediate children.
         // just a sanity check, not definitive that this calc is correct...
         assert(it->GetSizeWithDescendants() >= childSizes + it->GetTxSize());
@@ -797,7 +891,7 @@ void CTxMemPool::queryHashes(std::vector<uint256>& vtxid)
 }
 
 static TxMempoolInfo GetInfo(CTxMemPool::indexed_transaction_set::const_iterator it) {
-    return TxMempoolInfo{it->GetSharedTx(), it->GetTime(), CFeeRate(it->GetFee(), it->GetTxSize()), it->GetModifiedFee() - it->GetFee()};
+    return TxMempoolInfo{it->GetSharedTx(), it->GetTime(), CFeeRate(it->GetFee(), it->GetTxSize()), it->GetModifiedFee() - it->GetFee(), it->GetFee(), it->GetSigOpCost()};
 }
 
 std::vector<TxMempoolInfo> CTxMemPool::infoAll() const
@@ -832,6 +926,95 @@ TxMempoolInfo CTxMemPool::info(const uint256& hash) const
     return GetInfo(i);
 }
 
+const TxMempoolSnapshotEntry* CTxMemPoolSnapshot::Find(const uint256& hash) const
+{
+    auto it = mapIndex.find(hash);
+    if (it == mapIndex.end())
+        return nullptr;
+    return &entries[it->second];
+}
+
+std::vector<const TxMempoolSnapshotEntry*> CTxMemPoolSnapshot::CalculateRelatives(const uint256& hash, bool fAncestors) const
+{
+    std::vector<const TxMempoolSnapshotEntry*> ret;
+    std::set<uint256> setSeen{hash};
+    std::vector<uint256> vStage{hash};
+    while (!vStage.empty()) {
+        const TxMempoolSnapshotEntry* entry = Find(vStage.back());
+        vStage.pop_back();
+        if (!entry)
+            continue;
+        for (const uint256& relative : fAncestors ? entry->vParents : entry->vChildren) {
+            if (setSeen.insert(relative).second) {
+                vStage.push_back(relative);
+                ret.push_back(Find(relative));
+            }
+        }
+    }
+    return ret;
+}
+
+void CTxMemPool::CopyEntry(txiter it, TxMempoolSnapshotEntry& entry) const
+{
+    AssertLockHeld(cs);
+    entry.tx = it->GetSharedTx();
+    entry.nFee = it->GetFee();
+    entry.nModifiedFee = it->GetModifiedFee();
+    entry.nTxSize = it->GetTxSize();
+    entry.nTime = it->GetTime();
+    entry.entryHeight = it->GetHeight();
+    entry.nCountWithDescendants = it->GetCountWithDescendants();
+    entry.nSizeWithDescendants = it->GetSizeWithDescendants();
+    entry.nModFeesWithDescendants = it->GetModFeesWithDescendants();
+    entry.nCountWithAncestors = it->GetCountWithAncestors();
+    entry.nSizeWithAncestors = it->GetSizeWithAncestors();
+    entry.nModFeesWithAncestors = it->GetModFeesWithAncestors();
+    entry.vParents.reserve(it->vMemPoolParents.size());
+    for (const CTxMemPoolEntry* parent : it->vMemPoolParents) {
+        entry.vParents.push_back(parent->GetTx().GetHash());
+    }
+    entry.vChildren.reserve(it->vMemPoolChildren.size());
+    for (const CTxMemPoolEntry* child : it->vMemPoolChildren) {
+        entry.vChildren.push_back(child->GetTx().GetHash());
+    }
+}
+
+bool CTxMemPool::CopyEntry(const uint256& hash, TxMempoolSnapshotEntry& entry) const
+{
+    LOCK(cs);
+    txiter it = mapTx.find(hash);
+    if (it == mapTx.end())
+        return false;
+    CopyEntry(it, entry);
+    return true;
+}
+
+std::shared_ptr<const CTxMemPoolSnapshot> CTxMemPool::GetSnapshot() const
+{
+    // Readers arriving while a snapshot is taken wait for it and share it
+    std::lock_guard<std::mutex> lock(cs_snapshot);
+    if (snapshot && snapshot->nTransactionsUpdated == nTransactionsUpdated) {
+        return snapshot;
+    }
+
+    std::shared_ptr<CTxMemPoolSnapshot> newSnapshot = std::make_shared<CTxMemPoolSnapshot>();
+    {
+        LOCK(cs);
+        newSnapshot->nTransactionsUpdated = nTransactionsUpdated;
+        newSnapshot->entries.reserve(mapTx.size());
+        newSnapshot->mapIndex.reserve(mapTx.size());
+        for (txiter it = mapTx.begin(); it != mapTx.end(); ++it) {
+            TxMempoolSnapshotEntry entry;
+            CopyEntry(it, entry);
+            newSnapshot->mapIndex.emplace(it->GetTx().GetHash(), newSnapshot->entries.size());
+            newSnapshot->entries.push_back(std::move(entry));
+        }
+    }
+
+    snapshot = std::move(newSnapshot);
+    return snapshot;
+}
+
 void CTxMemPool::PrioritiseTransaction(const uint256& hash, const CAmount& nFeeDelta)
 {
     {
@@ -857,6 +1040,7 @@ void CTxMemPool::PrioritiseTransaction(const uint256& hash, const CAmount& nFeeD
                 mapTx.modify(descendantIt, update_ancestor_state(0, nFeeDelta, 0, 0));
             }
             ++nTransactionsUpdated;
+            NotifyEntryPrioritised(hash);
         }
     }
     LogPrintf("PrioritiseTransaction: %s feerate += %s\n", hash.ToString(), FormatMoney(nFeeDelta));
@@ -906,8 +1090,9 @@ bool CCoinsViewMemPool::GetCoin(const COutPoint &outpoint, Coin &coin) const {
 
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
-    // Estimate the overhead of mapTx to be 12 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
+    // The nodes and buckets of mapTx and mapNextTx are all taken from the arena, which counts them exactly.
+    // What an empty mempool takes there is left out, so that only memory that grows with the entries counts.
+    return arena.DynamicMemoryUsage() - nEmptyArenaUsage + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
 }
 
 void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason) {
@@ -944,40 +1129,42 @@ bool CTxMemPool::addUnchecked(const uint256&hash, const CTxMemPoolEntry &entry,
     return addUnchecked(hash, entry, setAncestors, validFeeEstimate);
 }
 
-void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add)
+// Adds or removes a link, and accounts for any change in the memory it takes.
+static void UpdateRelatives(CTxMemPoolEntry::Relatives& relatives, const CTxMemPoolEntry* relative, bool add, uint64_t& usage)
 {
-    setEntries s;
-    if (add && mapLinks[entry].children.insert(child).second) {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && mapLinks[entry].children.erase(child)) {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
+    auto pos = std::find(relatives.begin(), relatives.end(), relative);
+    if (add == (pos != relatives.end())) return;
+    usage -= memusage::DynamicUsage(relatives);
+    if (add) {
+        relatives.push_back(relative);
+    } else {
+        *pos = relatives.back();
+        relatives.pop_back();
+        if (relatives.size() <= 2) relatives.shrink_to_fit();
     }
+    usage += memusage::DynamicUsage(relatives);
+}
+
+void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add)
+{
+    UpdateRelatives(entry->vMemPoolChildren, &*child, add, cachedInnerUsage);
 }
 
 void CTxMemPool::UpdateParent(txiter entry, txiter parent, bool add)
 {
-    setEntries s;
-    if (add && mapLinks[entry].parents.insert(parent).second) {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && mapLinks[entry].parents.erase(parent)) {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
-    }
+    UpdateRelatives(entry->vMemPoolParents, &*parent, add, cachedInnerUsage);
 }
 
-const CTxMemPool::setEntries & CTxMemPool::GetMemPoolParents(txiter entry) const
+const CTxMemPoolEntry::Relatives & CTxMemPool::GetMemPoolParents(txiter entry) const
 {
     assert (entry != mapTx.end());
-    txlinksMap::const_iterator it = mapLinks.find(entry);
-    assert(it != mapLinks.end());
-    return it->second.parents;
+    return entry->vMemPoolParents;
 }
 
-const CTxMemPool::setEntries & CTxMemPool::GetMemPoolChildren(txiter entry) const
+const CTxMemPoolEntry::Relatives & CTxMemPool::GetMemPoolChildren(txiter entry) const
 {
     assert (entry != mapTx.end());
-    txlinksMap::const_iterator it = mapLinks.find(entry);
-    assert(it != mapLinks.end());
-    return it->second.children;
+    return entry->vMemPoolChildren;
 }
 
 CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const {
@@ -6,9 +6,12 @@
 #ifndef BITCOIN_TXMEMPOOL_H
 #define BITCOIN_TXMEMPOOL_H
 
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <set>
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <utility>
 #include <string>
@@ -17,9 +20,11 @@
 #include <coins.h>
 #include <indirectmap.h>
 #include <policy/feerate.h>
+#include <prevector.h>
 #include <primitives/transaction.h>
 #include <sync.h>
 #include <random.h>
+#include <support/allocators/node_arena.h>
 
 #include <boost/multi_index_container.hpp>
 #include <boost/multi_index/hashed_index.hpp>
@@ -63,14 +68,17 @@ class CTxMemPool;
 
 class CTxMemPoolEntry
 {
+public:
+    //! In-mempool parents or children of an entry. Most transactions have
+    //! no more than two of either, which then take no allocation.
+    typedef prevector<2, const CTxMemPoolEntry*> Relatives;
+
 private:
+    // The 8 byte fields come first and the narrower ones last, to leave no
+    // padding in between.
     CTransactionRef tx;
     CAmount nFee;              //!< Cached to avoid expensive parent-transaction lookups
-    size_t nTxWeight;          //!< ... and avoid recomputing tx weight (also used for GetTxSize())
-    size_t nUsageSize;         //!< ... and total memory usage
     int64_t nTime;             //!< Local time when entering the mempool
-    unsigned int entryHeight;  //!< Chain height when entering the mempool
-    bool spendsCoinbase;       //!< keep track of transactions that spend a coinbase
     int64_t sigOpCost;         //!< Total sigop cost
     int64_t feeDelta;          //!< Used for determining the priority of the transaction for mining in a block
     LockPoints lockPoints;     //!< Track the height and time at which tx was final
@@ -88,6 +96,17 @@ private:
     CAmount nModFeesWithAncestors;
     int64_t nSigOpCostWithAncestors;
 
+    // Direct in-mempool parents and children, maintained by CTxMemPool
+    mutable Relatives vMemPoolParents;
+    mutable Relatives vMemPoolChildren;
+
+    uint32_t nTxWeight;        //!< Cached to avoid recomputing tx weight (also used for GetTxSize())
+    uint32_t nUsageSize;       //!< ... and total memory usage
+    unsigned int entryHeight;  //!< Chain height when entering the mempool
+    bool spendsCoinbase;       //!< keep track of transactions that spend a coinbase
+
+    friend class CTxMemPool;
+
 public:
     CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                     int64_t _nTime, unsigned int _entryHeight,
@@ -127,7 +146,7 @@ public:
     CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
     int64_t GetSigOpCostWithAncestors() const { return nSigOpCostWithAncestors; }
 
-    mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
+    mutable uint32_t vTxHashesIdx; //!< Index in mempool's vTxHashes
 };
 
 // Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
@@ -333,6 +352,12 @@ struct TxMempoolInfo
 
     /** The fee delta. */
     int64_t nFeeDelta;
+
+    /** The fee, without the delta. */
+    CAmount nFee;
+
+    /** Total sigop cost. */
+    int64_t nSigOpCost;
 };
 
 /** Reason why a transaction was removed from the mempool,
@@ -362,6 +387,48 @@ public:
     }
 };
 
+/**
+ * A mempool transaction as of a CTxMemPoolSnapshot.
+ */
+struct TxMempoolSnapshotEntry
+{
+    CTransactionRef tx;
+    CAmount nFee;
+    CAmount nModifiedFee;
+    size_t nTxSize;                  //!< Virtual size, as CTxMemPoolEntry::GetTxSize()
+    int64_t nTime;
+    unsigned int entryHeight;
+    uint64_t nCountWithDescendants;
+    uint64_t nSizeWithDescendants;
+    CAmount nModFeesWithDescendants;
+    uint64_t nCountWithAncestors;
+    uint64_t nSizeWithAncestors;
+    CAmount nModFeesWithAncestors;
+    std::vector<uint256> vParents;   //!< Txids of the in-mempool parents
+    std::vector<uint256> vChildren;  //!< Txids of the in-mempool children
+};
+
+/**
+ * An immutable copy of the mempool at one point in time. Read-only consumers
+ * go through it without holding CTxMemPool::cs, so that listing a large
+ * mempool does not hold up transaction acceptance and block connection.
+ * Obtained through CTxMemPool::GetSnapshot(), which shares one snapshot
+ * between all readers until the mempool changes.
+ */
+class CTxMemPoolSnapshot
+{
+public:
+    //! CTxMemPool::GetTransactionsUpdated() when the snapshot was taken
+    unsigned int nTransactionsUpdated = 0;
+    std::vector<TxMempoolSnapshotEntry> entries;
+    std::unordered_map<uint256, size_t, SaltedTxidHasher> mapIndex;
+
+    const TxMempoolSnapshotEntry* Find(const uint256& hash) const;
+
+    /** The in-mempool ancestors of hash, or its descendants unless fAncestors, not including itself */
+    std::vector<const TxMempoolSnapshotEntry*> CalculateRelatives(const uint256& hash, bool fAncestors) const;
+};
+
 /**
  * CTxMemPool stores valid-according-to-the-current-best-chain transactions
  * that may be included in the next block.
@@ -388,8 +455,8 @@ public:
  *
  * In order for the feerate sort to remain correct, we must update transactions
  * in the mempool when new descendants arrive.  To facilitate this, we track
- * the set of in-mempool direct parents and direct children in mapLinks.  Within
- * each CTxMemPoolEntry, we track the size and fees of all descendants.
+ * the in-mempool direct parents and direct children of each CTxMemPoolEntry
+ * within the entry itself, along with the size and fees of all descendants.
  *
  * Usually when a new transaction is added to the mempool, it has no in-mempool
  * children (because any such children would be an orphan).  So in
@@ -421,7 +488,7 @@ public:
  * state, to account for in-mempool, out-of-block descendants for all the
  * in-block transactions by calling UpdateTransactionsFromBlock().  Note that
  * until this is called, the mempool state is not consistent, and in particular
- * mapLinks may not be correct (and therefore functions like
+ * the parent and child links may not be correct (and therefore functions like
  * CalculateMemPoolAncestors() and CalculateDescendants() that rely
  * on them to walk the mempool are not generally safe to use).
  *
@@ -437,18 +504,25 @@ class CTxMemPool
 {
 private:
     uint32_t nCheckFrequency; //!< Value n means that n times in 2^32 we check.
-    unsigned int nTransactionsUpdated; //!< Used by getblocktemplate to trigger CreateNewBlock() invocation
+    std::atomic<unsigned int> nTransactionsUpdated; //!< Used by getblocktemplate to trigger CreateNewBlock() invocation, and to tell when the snapshot is out of date
     CBlockPolicyEstimator* minerPolicyEstimator;
 
     uint64_t totalTxSize;      //!< sum of all mempool tx's virtual sizes. Differs from serialized tx size since witness data is discounted. Defined in BIP 141.
     uint64_t cachedInnerUsage; //!< sum of dynamic memory usage of all the map elements (NOT the maps themselves)
 
+    //! Nodes of mapTx and mapNextTx. Declared before them, as it must outlive them.
+    NodeArena arena;
+    size_t nEmptyArenaUsage; //!< arena usage of the containers when empty
+
     mutable int64_t lastRollingFeeUpdate;
     mutable bool blockSinceLastRollingFeeBump;
     mutable double rollingMinimumFeeRate; //!< minimum fee to get into the pool, decreases exponentially
 
     void trackPackageRemoved(const CFeeRate& rate);
 
+    mutable std::mutex cs_snapshot;
+    mutable std::shared_ptr<const CTxMemPoolSnapshot> snapshot;
+
 public:
 
     static const int ROLLING_FEE_HALFLIFE = 60 * 60 * 12; // public only for testing
@@ -476,7 +550,8 @@ public:
                 boost::multi_index::identity<CTxMemPoolEntry>,
                 CompareTxMemPoolEntryByAncestorFee
             >
-        >
+        >,
+        node_arena_allocator<CTxMemPoolEntry>
     > indexed_transaction_set;
 
     mutable CCriticalSection cs;
@@ -492,26 +567,31 @@ public:
     };
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
 
-    const setEntries & GetMemPoolParents(txiter entry) const;
-    const setEntries & GetMemPoolChildren(txiter entry) const;
+    const CTxMemPoolEntry::Relatives & GetMemPoolParents(txiter entry) const;
+    const CTxMemPoolEntry::Relatives & GetMemPoolChildren(txiter entry) const;
+    txiter GetIter(const CTxMemPoolEntry* entry) const { return mapTx.iterator_to(*entry); }
 private:
     typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
 
-    struct TxLinks {
-        setEntries parents;
-        setEntries children;
+    /** A change to the ancestor or descendant state of an entry, summed up
+     *  over a batch of additions or removals so each entry is modified once. */
+    struct StateDelta {
+        int64_t nSize = 0;
+        CAmount nModFee = 0;
+        int64_t nCount = 0;
+        int64_t nSigOpCost = 0;
     };
-
-    typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
-    txlinksMap mapLinks;
+    typedef std::map<txiter, StateDelta, CompareIteratorByHash> deltaMap;
 
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
 
     std::vector<indexed_transaction_set::const_iterator> GetSortedDepthAndScore() const;
+    void CopyEntry(txiter it, TxMempoolSnapshotEntry& entry) const;
 
 public:
-    indirectmap<COutPoint, const CTransaction*> mapNextTx;
+    typedef indirectmap<COutPoint, const CTransaction*, node_arena_allocator<std::pair<const COutPoint* const, const CTransaction*> > > nexttx_map;
+    nexttx_map mapNextTx;
     std::map<uint256, CAmount> mapDeltas;
 
     /** Create a new CTxMemPool.
@@ -589,7 +669,7 @@ public:
      *  limitDescendantSize = max size of descendants any ancestor can have
      *  errString = populated with error reason if any limits are hit
      *  fSearchForParents = whether to search a tx's vin for in-mempool parents, or
-     *    look up parents from mapLinks. Must be true for entries not in the mempool
+     *    look up parents from the entry's links. Must be true for entries not in the mempool
      */
     bool CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents = true) const;
 
@@ -598,6 +678,24 @@ public:
      *  already in it.  */
     void CalculateDescendants(txiter it, setEntries &setDescendants);
 
+    /** What replacing a set of in-mempool transactions would evict */
+    struct ReplacementSummary {
+        //! The replaced transactions and all their in-mempool descendants
+        setEntries setEvicted;
+        //! Sum of the modified fees and sizes of setEvicted
+        CAmount nFees = 0;
+        size_t nSize = 0;
+        //! Sum of the cached descendant counts of the replaced transactions,
+        //! which overestimates setEvicted when they share descendants
+        uint64_t nPotentialEvicted = 0;
+    };
+
+    /** Fill summary with what replacing setConflicting would evict, walking
+     *  their descendants once and summing fees and sizes along the way.
+     *  Returns false before walking anything if the cached descendant counts
+     *  add up to more than nMaxEvicted. */
+    bool CalculateReplacementSummary(const setEntries& setConflicting, uint64_t nMaxEvicted, ReplacementSummary& summary) const;
+
     /** The minimum fee to get into the mempool, which may itself not be enough
       *  for larger-sized transactions.
       *  The incrementalRelayFee policy variable is used to bound the time it
@@ -640,10 +738,19 @@ public:
     TxMempoolInfo info(const uint256& hash) const;
     std::vector<TxMempoolInfo> infoAll() const;
 
+    /** An immutable copy of the mempool as it is now. Taking one holds cs
+     *  while the entries are copied; it is then shared by all callers until
+     *  the mempool changes. Must not be called with cs held. */
+    std::shared_ptr<const CTxMemPoolSnapshot> GetSnapshot() const;
+    /** Copy a single entry, for readers that need only one */
+    bool CopyEntry(const uint256& hash, TxMempoolSnapshotEntry& entry) const;
+
     size_t DynamicMemoryUsage() const;
 
     boost::signals2::signal<void (CTransactionRef)> NotifyEntryAdded;
     boost::signals2::signal<void (CTransactionRef, MemPoolRemovalReason)> NotifyEntryRemoved;
+    /** Fired, under cs, when the fee delta of a transaction in the pool changes */
+    boost::signals2::signal<void (const uint256&)> NotifyEntryPrioritised;
 
 private:
     /** UpdateForDescendants is used by UpdateTransactionsFromBlock to update
@@ -658,17 +765,29 @@ private:
      *  cachedDescendants will be updated with the descendants of the transaction
      *  being updated, so that future invocations don't need to walk the
      *  same transaction again, if encountered in another transaction chain.
+     *  The changes to the ancestor state of the descendants are added to
+     *  mapAncestorDeltas, to be applied once all transactions are updated.
      */
     void UpdateForDescendants(txiter updateIt,
             cacheMap &cachedDescendants,
-            const std::set<uint256> &setExclude);
+            const std::set<uint256> &setExclude,
+            deltaMap &mapAncestorDeltas);
+    /** Collect the in-mempool ancestors (or descendants) of each of entries
+     *  into cachedRelatives, leaving out entries themselves. Entries are
+     *  handled parents first (or children first), and the walk from one stops
+     *  at any other whose relatives are collected already, so that the links
+     *  they share are walked once for the whole set. */
+    void CalculateRelativesOutside(const setEntries &entries, bool fAncestors, cacheMap &cachedRelatives) const;
+    /** Apply summed up changes to the ancestor and descendant state of entries. */
+    void ApplyStateDeltas(const deltaMap &mapAncestorDeltas, const deltaMap &mapDescendantDeltas);
     /** Update ancestors of hash to add/remove it as a descendant transaction. */
     void UpdateAncestorsOf(bool add, txiter hash, setEntries &setAncestors);
     /** Set ancestor state for an entry */
     void UpdateEntryForAncestors(txiter it, const setEntries &setAncestors);
     /** For each transaction being removed, update ancestors and any direct children.
       * If updateDescendants is true, then also update in-mempool descendants'
-      * ancestor state. */
+      * ancestor state. All of them are handled in one batch, and only the
+      * transactions that stay in the mempool are updated. */
     void UpdateForRemoveFromMempool(const setEntries &entriesToRemove, bool updateDescendants);
     /** Sever link between specified transaction and direct children. */
     void UpdateChildrenForRemoval(txiter entry);
@@ -0,0 +1,208 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txorphanage.h>
+
+#include <consensus/validation.h>
+#include <core_memusage.h>
+#include <net_processing.h>
+#include <policy/policy.h>
+#include <util.h>
+#include <utiltime.h>
+
+#include <algorithm>
+
+bool TxOrphanage::AddTx(const CTransactionRef& tx, NodeId peer)
+{
+    const uint256& hash = tx->GetHash();
+    auto existing = m_orphans.find(hash);
+    if (existing != m_orphans.end()) {
+        Touch(existing->second);
+        return false;
+    }
+
+    // Ignore big transactions, to avoid a
+    // send-big-orphans memory exhaustion attack. If a peer has a legitimate
+    // large transaction with a missing parent then we assume
+    // it will rebroadcast it later, after the parent transaction(s)
+    // have been mined or received.
+    // 100 orphans, each of which is at most 99,999 bytes big is
+    // at most 10 megabytes of orphans and somewhat more byprev index (in the worst case):
+    unsigned int sz = GetTransactionWeight(*tx);
+    if (sz >= MAX_STANDARD_TX_WEIGHT)
+    {
+        LogPrint(BCLog::MEMPOOL, "ignoring large orphan tx (size: %u, hash: %s)\n", sz, hash.ToString());
+        return false;
+    }
+
+    OrphanTx& orphan = m_orphans.emplace(hash, OrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME, RecursiveDynamicUsage(tx), m_next_sequence++, {}, {}}).first->second;
+    PeerOrphans& peer_orphans = m_peers[peer];
+    orphan.itLRU = m_lru.insert(m_lru.end(), &orphan);
+    orphan.itPeerLRU = peer_orphans.lru.insert(peer_orphans.lru.end(), &orphan);
+    peer_orphans.nUsage += orphan.nUsage;
+    for (const CTxIn& txin : tx->vin) {
+        OrphanRefs& refs = m_outpoint_to_orphans[txin.prevout];
+        if (std::find(refs.begin(), refs.end(), &orphan) == refs.end()) {
+            refs.push_back(&orphan);
+        }
+    }
+
+    LogPrint(BCLog::MEMPOOL, "stored orphan tx %s (mapsz %u outsz %u)\n", hash.ToString(),
+             m_orphans.size(), m_outpoint_to_orphans.size());
+    return true;
+}
+
+int TxOrphanage::EraseTx(const uint256& txid)
+{
+    auto it = m_orphans.find(txid);
+    if (it == m_orphans.end())
+        return 0;
+    OrphanTx& orphan = it->second;
+    for (const CTxIn& txin : orphan.tx->vin) {
+        auto itPrev = m_outpoint_to_orphans.find(txin.prevout);
+        if (itPrev == m_outpoint_to_orphans.end())
+            continue;
+        OrphanRefs& refs = itPrev->second;
+        auto ref = std::find(refs.begin(), refs.end(), &orphan);
+        if (ref != refs.end()) {
+            refs.erase(ref);
+        }
+        if (refs.empty())
+            m_outpoint_to_orphans.erase(itPrev);
+    }
+    auto peer = m_peers.find(orphan.fromPeer);
+    assert(peer != m_peers.end());
+    peer->second.lru.erase(orphan.itPeerLRU);
+    peer->second.nUsage -= orphan.nUsage;
+    if (peer->second.lru.empty()) {
+        m_peers.erase(peer);
+    }
+    m_lru.erase(orphan.itLRU);
+    m_orphans.erase(it);
+    return 1;
+}
+
+int TxOrphanage::EraseForPeer(NodeId peer)
+{
+    auto it = m_peers.find(peer);
+    if (it == m_peers.end())
+        return 0;
+    std::vector<uint256> vErase;
+    for (const OrphanTx* orphan : it->second.lru) {
+        vErase.push_back(orphan->tx->GetHash());
+    }
+    int nErased = 0;
+    for (const uint256& hash : vErase) {
+        nErased += EraseTx(hash);
+    }
+    if (nErased > 0) LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx from peer=%d\n", nErased, peer);
+    return nErased;
+}
+
+int TxOrphanage::EraseForBlock(const CBlock& block)
+{
+    std::vector<uint256> vOrphanErase;
+    for (const CTransactionRef& ptx : block.vtx) {
+        // Which orphan pool entries must we evict?
+        for (const CTxIn& txin : ptx->vin) {
+            auto itByPrev = m_outpoint_to_orphans.find(txin.prevout);
+            if (itByPrev == m_outpoint_to_orphans.end()) continue;
+            for (const OrphanTx* orphan : itByPrev->second) {
+                vOrphanErase.push_back(orphan->tx->GetHash());
+            }
+        }
+    }
+
+    // Erase orphan transactions included or precluded by this block
+    int nErased = 0;
+    for (const uint256& hash : vOrphanErase) {
+        nErased += EraseTx(hash);
+    }
+    if (nErased > 0) LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx included or conflicted by block\n", nErased);
+    return nErased;
+}
+
+unsigned int TxOrphanage::LimitOrphans(unsigned int nMaxOrphans, size_t nMaxPeerUsage)
+{
+    unsigned int nEvicted = 0;
+    int64_t nNow = GetTime();
+    if (m_next_sweep <= nNow) {
+        // Sweep out expired orphan pool entries:
+        std::vector<uint256> vExpired;
+        int64_t nMinExpTime = nNow + ORPHAN_TX_EXPIRE_TIME - ORPHAN_TX_EXPIRE_INTERVAL;
+        for (const auto& entry : m_orphans) {
+            if (entry.second.nTimeExpire <= nNow) {
+                vExpired.push_back(entry.first);
+            } else {
+                nMinExpTime = std::min(entry.second.nTimeExpire, nMinExpTime);
+            }
+        }
+        for (const uint256& hash : vExpired) {
+            EraseTx(hash);
+        }
+        // Sweep again 5 minutes after the next entry that expires in order to batch the linear scan.
+        m_next_sweep = nMinExpTime + ORPHAN_TX_EXPIRE_INTERVAL;
+        if (!vExpired.empty()) LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx due to expiration\n", vExpired.size());
+    }
+    // A peer over its quota loses its own least recently used orphans, but
+    // always keeps the last one
+    std::vector<uint256> vEvict;
+    for (const auto& peer : m_peers) {
+        size_t nUsage = peer.second.nUsage;
+        for (auto it = peer.second.lru.begin(); nUsage > nMaxPeerUsage && std::next(it) != peer.second.lru.end(); ++it) {
+            vEvict.push_back((*it)->tx->GetHash());
+            nUsage -= (*it)->nUsage;
+        }
+    }
+    for (const uint256& hash : vEvict) {
+        nEvicted += EraseTx(hash);
+    }
+    while (m_orphans.size() > nMaxOrphans)
+    {
+        nEvicted += EraseTx(m_lru.front()->tx->GetHash());
+    }
+    return nEvicted;
+}
+
+std::vector<std::pair<CTransactionRef, NodeId>> TxOrphanage::GetChildren(const CTransaction& tx)
+{
+    std::vector<OrphanTx*> vChildren;
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        auto itByPrev = m_outpoint_to_orphans.find(COutPoint(tx.GetHash(), i));
+        if (itByPrev == m_outpoint_to_orphans.end()) continue;
+        for (OrphanTx* orphan : itByPrev->second) {
+            vChildren.push_back(orphan);
+        }
+    }
+    std::sort(vChildren.begin(), vChildren.end(), [](const OrphanTx* a, const OrphanTx* b) { return a->nSequence < b->nSequence; });
+    vChildren.erase(std::unique(vChildren.begin(), vChildren.end()), vChildren.end());
+
+    std::vector<std::pair<CTransactionRef, NodeId>> vResult;
+    for (OrphanTx* orphan : vChildren) {
+        Touch(*orphan);
+        vResult.emplace_back(orphan->tx, orphan->fromPeer);
+    }
+    return vResult;
+}
+
+size_t TxOrphanage::PeerUsage(NodeId peer) const
+{
+    auto it = m_peers.find(peer);
+    return it == m_peers.end() ? 0 : it->second.nUsage;
+}
+
+void TxOrphanage::Clear()
+{
+    m_lru.clear();
+    m_peers.clear();
+    m_outpoint_to_orphans.clear();
+    m_orphans.clear();
+}
+
+void TxOrphanage::Touch(OrphanTx& orphan)
+{
+    m_lru.splice(m_lru.end(), m_lru, orphan.itLRU);
+    std::list<OrphanTx*>& peer_lru = m_peers[orphan.fromPeer].lru;
+    peer_lru.splice(peer_lru.end(), peer_lru, orphan.itPeerLRU);
+}
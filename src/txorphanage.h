@@ -0,0 +1,96 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXORPHANAGE_H
+#define BITCOIN_TXORPHANAGE_H
+
+#include <coins.h>
+#include <net.h>
+#include <openhashmap.h>
+#include <prevector.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <txmempool.h>
+
+#include <list>
+#include <map>
+#include <vector>
+
+/** Memory a single peer's orphan transactions may take before its least
+ *  recently used ones are evicted */
+static const size_t MAX_ORPHAN_PEER_USAGE = 1000000;
+
+/**
+ * Transactions whose inputs are not all known yet, kept until their parents
+ * arrive. Orphans are looked up by txid and by the outpoints they spend in
+ * hash maps, and each peer's orphans are kept apart, so that a peer's
+ * orphans are found without a scan and are held to a memory quota. When the
+ * pool or a peer's share of it is full, the least recently used orphans go
+ * first: an orphan is used when it is added, announced again, or had one of
+ * its parents arrive.
+ *
+ * Not thread safe: the owner guards it with a lock.
+ */
+class TxOrphanage
+{
+public:
+    /** Add an orphan from peer. Returns false if it is known already or too
+     *  large to keep. */
+    bool AddTx(const CTransactionRef& tx, NodeId peer);
+
+    bool HaveTx(const uint256& txid) const { return m_orphans.count(txid) != 0; }
+
+    /** Erase an orphan. Returns the number erased. */
+    int EraseTx(const uint256& txid);
+
+    /** Erase all orphans that came from peer. */
+    int EraseForPeer(NodeId peer);
+
+    /** Erase all orphans included in or conflicted by block. */
+    int EraseForBlock(const CBlock& block);
+
+    /** Erase expired orphans, and evict the least recently used ones until
+     *  each peer is within nMaxPeerUsage bytes and the pool holds at most
+     *  nMaxOrphans. Returns the number evicted for lack of room. */
+    unsigned int LimitOrphans(unsigned int nMaxOrphans, size_t nMaxPeerUsage = MAX_ORPHAN_PEER_USAGE);
+
+    /** The orphans spending an output of tx, each once, in the order they
+     *  were added. They count as used. */
+    std::vector<std::pair<CTransactionRef, NodeId>> GetChildren(const CTransaction& tx);
+
+    size_t Size() const { return m_orphans.size(); }
+    /** Memory the orphans from peer take */
+    size_t PeerUsage(NodeId peer) const;
+    void Clear();
+
+private:
+    struct OrphanTx {
+        CTransactionRef tx;
+        NodeId fromPeer;
+        int64_t nTimeExpire;
+        size_t nUsage;
+        uint64_t nSequence;                              //!< Order of addition
+        std::list<OrphanTx*>::iterator itLRU;           //!< Position in m_lru
+        std::list<OrphanTx*>::iterator itPeerLRU;       //!< Position in its peer's list
+    };
+
+    struct PeerOrphans {
+        size_t nUsage = 0;
+        std::list<OrphanTx*> lru;                        //!< Least recently used first
+    };
+
+    /** Orphans spending an outpoint; usually just one */
+    typedef prevector<1, OrphanTx*> OrphanRefs;
+
+    openhashmap<uint256, OrphanTx, SaltedTxidHasher> m_orphans;
+    openhashmap<COutPoint, OrphanRefs, SaltedOutpointHasher> m_outpoint_to_orphans;
+    std::map<NodeId, PeerOrphans> m_peers;
+    std::list<OrphanTx*> m_lru;                          //!< Least recently used first
+    uint64_t m_next_sequence = 0;
+    int64_t m_next_sweep = 0;
+
+    void Touch(OrphanTx& orphan);
+};
+
+#endif // BITCOIN_TXORPHANAGE_H
@@ -0,0 +1,210 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txreconciliation.h>
+
+#include <hash.h>
+#include <pinsketch.h>
+#include <random.h>
+
+#include <algorithm>
+#include <assert.h>
+#include <limits>
+
+/** Tag the salts of both sides are hashed with into the short id key */
+static const std::string RECON_SALT_TAG = "Tx Relay Salting";
+
+uint64_t TxReconciliationTracker::PreRegisterPeer(NodeId peer)
+{
+    PeerState& state = m_peers[peer];
+    state.nLocalSalt = GetRand(std::numeric_limits<uint64_t>::max());
+    return state.nLocalSalt;
+}
+
+bool TxReconciliationTracker::RegisterPeer(NodeId peer, bool fInbound, uint32_t nVersion, uint64_t remote_salt)
+{
+    auto it = m_peers.find(peer);
+    if (it == m_peers.end() || it->second.fRegistered || nVersion < 1)
+        return false;
+    PeerState& state = it->second;
+
+    // Both sides arrive at the same key whichever salt is whose
+    uint256 key = (CHashWriter(SER_GETHASH, 0) << RECON_SALT_TAG
+                   << std::min(state.nLocalSalt, remote_salt) << std::max(state.nLocalSalt, remote_salt)).GetHash();
+    state.k0 = key.GetUint64(0);
+    state.k1 = key.GetUint64(1);
+    state.fRegistered = true;
+    state.fInitiator = !fInbound;
+    if (!fInbound && m_outbound_flooded < MAX_OUTBOUND_FLOOD_TO) {
+        state.fFlood = true;
+        m_outbound_flooded++;
+    }
+    return true;
+}
+
+void TxReconciliationTracker::ForgetPeer(NodeId peer)
+{
+    auto it = m_peers.find(peer);
+    if (it == m_peers.end())
+        return;
+    if (it->second.fFlood)
+        m_outbound_flooded--;
+    m_peers.erase(it);
+}
+
+bool TxReconciliationTracker::IsPeerRegistered(NodeId peer) const
+{
+    auto it = m_peers.find(peer);
+    return it != m_peers.end() && it->second.fRegistered;
+}
+
+bool TxReconciliationTracker::ShouldFloodTo(NodeId peer) const
+{
+    auto it = m_peers.find(peer);
+    return it == m_peers.end() || !it->second.fRegistered || it->second.fFlood;
+}
+
+bool TxReconciliationTracker::AddToSet(NodeId peer, const uint256& txid)
+{
+    auto it = m_peers.find(peer);
+    if (it == m_peers.end() || !it->second.fRegistered)
+        return false;
+    std::set<uint256>& setTx = it->second.setTx;
+    if (setTx.size() >= MAX_RECON_SET_SIZE && !setTx.count(txid))
+        return false;
+    setTx.insert(txid);
+    return true;
+}
+
+bool TxReconciliationTracker::InitiateReconciliation(NodeId peer, int64_t nNow, uint16_t& nSetSize, uint16_t& nQ)
+{
+    auto it = m_peers.find(peer);
+    if (it == m_peers.end() || !it->second.fRegistered)
+        return false;
+    PeerState& state = it->second;
+    if (!state.fInitiator || state.fRequested || state.nNextRequest > nNow)
+        return false;
+    state.fRequested = true;
+    state.nNextRequest = nNow + RECON_REQUEST_INTERVAL;
+    nSetSize = state.setTx.size();
+    nQ = RECON_Q;
+    return true;
+}
+
+bool TxReconciliationTracker::RespondToReconciliationRequest(NodeId peer, uint16_t nRemoteSetSize, uint16_t nRemoteQ,
+                                                             std::vector<unsigned char>& sketch)
+{
+    auto it = m_peers.find(peer);
+    if (it == m_peers.end() || !it->second.fRegistered)
+        return false;
+    PeerState& state = it->second;
+    if (state.fInitiator || state.fSnapshotted || nRemoteQ > RECON_Q_PRECISION)
+        return false;
+
+    PinSketch local(SketchCapacity(state.setTx.size(), nRemoteSetSize, nRemoteQ));
+    for (const uint256& txid : state.setTx) {
+        local.Add(ComputeShortID(state, txid));
+    }
+    sketch = local.Serialize();
+    state.setSnapshot.swap(state.setTx);
+    state.setTx.clear();
+    state.fSnapshotted = true;
+    return true;
+}
+
+bool TxReconciliationTracker::HandleSketch(NodeId peer, const std::vector<unsigned char>& sketch, bool& fSuccess,
+                                           std::vector<uint256>& vAnnounce, std::vector<uint32_t>& vAskFor)
+{
+    vAnnounce.clear();
+    vAskFor.clear();
+    auto it = m_peers.find(peer);
+    if (it == m_peers.end() || !it->second.fRegistered)
+        return false;
+    PeerState& state = it->second;
+    PinSketch remote(0);
+    if (!state.fInitiator || !state.fRequested || !PinSketch::Deserialize(sketch, remote) ||
+        remote.GetCapacity() > MAX_SKETCH_CAPACITY)
+        return false;
+    state.fRequested = false;
+
+    std::map<uint32_t, uint256> mapShortIDs;
+    PinSketch local(remote.GetCapacity());
+    for (const uint256& txid : state.setTx) {
+        uint32_t short_id = ComputeShortID(state, txid);
+        mapShortIDs.emplace(short_id, txid);
+        local.Add(short_id);
+    }
+    local.Merge(remote);
+
+    std::vector<uint32_t> vDifference;
+    fSuccess = remote.GetCapacity() > 0 && local.Decode(vDifference);
+    if (fSuccess) {
+        for (uint32_t short_id : vDifference) {
+            auto itTx = mapShortIDs.find(short_id);
+            if (itTx != mapShortIDs.end()) {
+                vAnnounce.push_back(itTx->second);
+            } else {
+                vAskFor.push_back(short_id);
+            }
+        }
+    } else {
+        vAnnounce.assign(state.setTx.begin(), state.setTx.end());
+    }
+    state.setTx.clear();
+    return true;
+}
+
+bool TxReconciliationTracker::HandleReconciliationDifference(NodeId peer, bool fSuccess, const std::vector<uint32_t>& vAskFor,
+                                                             std::vector<uint256>& vAnnounce)
+{
+    vAnnounce.clear();
+    auto it = m_peers.find(peer);
+    if (it == m_peers.end() || !it->second.fRegistered)
+        return false;
+    PeerState& state = it->second;
+    if (state.fInitiator || !state.fSnapshotted)
+        return false;
+
+    if (fSuccess) {
+        std::map<uint32_t, uint256> mapShortIDs;
+        for (const uint256& txid : state.setSnapshot) {
+            mapShortIDs.emplace(ComputeShortID(state, txid), txid);
+        }
+        for (uint32_t short_id : vAskFor) {
+            auto itTx = mapShortIDs.find(short_id);
+            if (itTx == mapShortIDs.end()) {
+                // The difference decoded wrongly, so the peer may lack more
+                fSuccess = false;
+                break;
+            }
+            vAnnounce.push_back(itTx->second);
+        }
+    }
+    if (!fSuccess) {
+        vAnnounce.assign(state.setSnapshot.begin(), state.setSnapshot.end());
+    }
+    state.setSnapshot.clear();
+    state.fSnapshotted = false;
+    return true;
+}
+
+uint32_t TxReconciliationTracker::GetShortID(NodeId peer, const uint256& txid) const
+{
+    auto it = m_peers.find(peer);
+    assert(it != m_peers.end() && it->second.fRegistered);
+    return ComputeShortID(it->second, txid);
+}
+
+uint32_t TxReconciliationTracker::ComputeShortID(const PeerState& state, const uint256& txid) const
+{
+    // Zero is not a valid sketch element
+    return 1 + (uint32_t)(SipHashUint256(state.k0, state.k1, txid) % 0xffffffff);
+}
+
+size_t TxReconciliationTracker::SketchCapacity(size_t nLocalSetSize, size_t nRemoteSetSize, uint16_t nQ)
+{
+    size_t nDifference = std::max(nLocalSetSize, nRemoteSetSize) - std::min(nLocalSetSize, nRemoteSetSize);
+    size_t nCapacity = nDifference + std::min(nLocalSetSize, nRemoteSetSize) * nQ / RECON_Q_PRECISION + 1;
+    return std::max(MIN_SKETCH_CAPACITY, std::min(MAX_SKETCH_CAPACITY, nCapacity));
+}
@@ -0,0 +1,128 @@
+// Copyright (c) 2019 The Quebecoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXRECONCILIATION_H
+#define BITCOIN_TXRECONCILIATION_H
+
+#include <net.h>
+#include <uint256.h>
+
+#include <map>
+#include <set>
+#include <vector>
+
+/** Version of the reconciliation protocol we speak, sent in sendtxrcncl */
+static const uint32_t TXRECONCILIATION_VERSION = 1;
+/** Outbound peers that we keep flooding transactions to as well */
+static const int MAX_OUTBOUND_FLOOD_TO = 4;
+/** Time between reconciliations we start with a peer, in microseconds */
+static const int64_t RECON_REQUEST_INTERVAL = 8 * 1000000;
+/** Transactions a reconciliation set holds at most; the rest is flooded */
+static const size_t MAX_RECON_SET_SIZE = 3000;
+/** Fixed point denominator of q, the expected share of a set that differs */
+static const uint16_t RECON_Q_PRECISION = 1 << 14;
+/** The q we ask for, a quarter */
+static const uint16_t RECON_Q = RECON_Q_PRECISION / 4;
+/** Bounds on the capacity of the sketches we send. Small sketches decode
+ *  larger differences into wrong results too readily, and large ones take
+ *  long to decode. */
+static const size_t MIN_SKETCH_CAPACITY = 4;
+static const size_t MAX_SKETCH_CAPACITY = 64;
+
+/**
+ * Transactions to announce to peers through set reconciliation, instead of
+ * announcing each of them to each peer with an inv.
+ *
+ * Each side of a connection keeps the transactions it would have announced
+ * in a set. The side that made the connection asks for a reconciliation
+ * every RECON_REQUEST_INTERVAL, giving the size of its set. The other side
+ * answers with a PinSketch of the short ids of its set, sized for the
+ * difference it expects, and sets its transactions aside. The asking side
+ * merges that with the sketch of its own set, which gives the short ids that
+ * only one of the sets holds: it announces its own ones, and sends back the
+ * others, which the answering side then announces. When the difference
+ * cannot be decoded, both sides announce their whole sets.
+ *
+ * Short ids are SipHash of the txid under a key both sides salt, so that
+ * they cannot be made to collide for all peers at once.
+ *
+ * Not thread safe: the owner guards it with a lock.
+ */
+class TxReconciliationTracker
+{
+public:
+    /** Start negotiating reconciliation with peer. Returns the salt to send
+     *  it in sendtxrcncl. */
+    uint64_t PreRegisterPeer(NodeId peer);
+
+    /** Finish the negotiation once the peer's sendtxrcncl arrived. The side
+     *  that made the connection asks for reconciliations. Returns false if
+     *  the peer was not pre-registered or is registered already. */
+    bool RegisterPeer(NodeId peer, bool fInbound, uint32_t nVersion, uint64_t remote_salt);
+
+    void ForgetPeer(NodeId peer);
+
+    bool IsPeerRegistered(NodeId peer) const;
+
+    /** Whether transactions are flooded to the peer despite reconciling */
+    bool ShouldFloodTo(NodeId peer) const;
+
+    /** Add a transaction to announce to peer at the next reconciliation.
+     *  Returns false if the peer's set is full, in which case the caller
+     *  should announce it with an inv instead. */
+    bool AddToSet(NodeId peer, const uint256& txid);
+
+    /** Whether it is time to ask peer for a reconciliation. If it is, the
+     *  request counts as sent, with nSetSize and nQ to put in it. */
+    bool InitiateReconciliation(NodeId peer, int64_t nNow, uint16_t& nSetSize, uint16_t& nQ);
+
+    /** Answer a reconciliation request: fill sketch with the sketch of our
+     *  set, and set that set aside until the peer tells us what it lacks.
+     *  Returns false if the request is not valid. */
+    bool RespondToReconciliationRequest(NodeId peer, uint16_t nRemoteSetSize, uint16_t nRemoteQ, std::vector<unsigned char>& sketch);
+
+    /** Reconcile our set with the peer's sketch. Fills vAnnounce with the
+     *  transactions the peer lacks, and vAskFor with the short ids of the
+     *  ones we lack; if the difference did not decode, fSuccess is false and
+     *  vAnnounce holds our whole set. Returns false if the sketch was not
+     *  asked for or is malformed. */
+    bool HandleSketch(NodeId peer, const std::vector<unsigned char>& sketch, bool& fSuccess,
+                      std::vector<uint256>& vAnnounce, std::vector<uint32_t>& vAskFor);
+
+    /** Finish a reconciliation we answered. Fills vAnnounce with the
+     *  transactions the peer asked for, or with all of the set we put aside
+     *  if the reconciliation failed or asked for short ids we do not have.
+     *  Returns false if no reconciliation was outstanding. */
+    bool HandleReconciliationDifference(NodeId peer, bool fSuccess, const std::vector<uint32_t>& vAskFor,
+                                        std::vector<uint256>& vAnnounce);
+
+    /** The short id of txid towards a registered peer */
+    uint32_t GetShortID(NodeId peer, const uint256& txid) const;
+
+private:
+    struct PeerState {
+        uint64_t nLocalSalt;
+        bool fRegistered = false;
+        bool fInitiator = false;
+        bool fFlood = false;
+        uint64_t k0 = 0;
+        uint64_t k1 = 0;
+        //! Transactions to announce at the next reconciliation
+        std::set<uint256> setTx;
+        //! Set aside for the peer to reconcile against (responder only)
+        std::set<uint256> setSnapshot;
+        bool fSnapshotted = false;
+        //! Whether we asked for a sketch and wait for it (initiator only)
+        bool fRequested = false;
+        int64_t nNextRequest = 0;
+    };
+
+    std::map<NodeId, PeerState> m_peers;
+    int m_outbound_flooded = 0;
+
+    uint32_t ComputeShortID(const PeerState& state, const uint256& txid) const;
+    static size_t SketchCapacity(size_t nLocalSetSize, size_t nRemoteSetSize, uint16_t nQ);
+};
+
+#endif // BITCOIN_TXRECONCILIATION_H
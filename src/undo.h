@@ -6,11 +6,16 @@
 #ifndef BITCOIN_UNDO_H
 #define BITCOIN_UNDO_H
 
+#include <coins.h>
 #include <compressor.h>
 #include <consensus/consensus.h>
 #include <primitives/transaction.h>
 #include <serialize.h>
 
+#include <assert.h>
+#include <map>
+#include <vector>
+
 /** Undo information for a CTxIn
  *
  *  Contains the prevout's CTxOut being spent, and its metadata as well
@@ -109,4 +114,164 @@ public:
     }
 };
 
+/** Script coding for the compact undo format
+ *
+ *  Besides the CScriptCompressor special cases, it defines templates for
+ *  witness v0 key hash and script hash outputs (encoded as 21 and 33 bytes),
+ *  and references to a script spent earlier in the same block, as blocks
+ *  often spend several outputs paying to one address (encoded as 1 byte +
+ *  the index of that script).
+ */
+class UndoScriptCompressor : public CScriptCompressor
+{
+private:
+    static const unsigned int nWitnessKeyHash = nSpecialScripts;
+    static const unsigned int nWitnessScriptHash = nSpecialScripts + 1;
+    static const unsigned int nReference = nSpecialScripts + 2;
+    static const unsigned int nFirstSize = nSpecialScripts + 3;
+
+    CScript &script;
+
+public:
+    explicit UndoScriptCompressor(CScript &scriptIn) : CScriptCompressor(scriptIn), script(scriptIn) { }
+
+    template<typename Stream>
+    void Write(Stream &s, std::map<CScript, uint32_t>& dictionary) const {
+        auto it = dictionary.find(script);
+        if (it != dictionary.end()) {
+            unsigned int nCode = nReference;
+            s << VARINT(nCode) << VARINT(it->second);
+            return;
+        }
+        dictionary.emplace(script, dictionary.size());
+
+        std::vector<unsigned char> compr;
+        if (Compress(compr)) {
+            s << CFlatData(compr);
+        } else if (script.size() == 22 && script[0] == OP_0 && script[1] == 20) {
+            unsigned int nCode = nWitnessKeyHash;
+            s << VARINT(nCode) << CFlatData(script.data() + 2, script.data() + 22);
+        } else if (script.size() == 34 && script[0] == OP_0 && script[1] == 32) {
+            unsigned int nCode = nWitnessScriptHash;
+            s << VARINT(nCode) << CFlatData(script.data() + 2, script.data() + 34);
+        } else {
+            unsigned int nSize = script.size() + nFirstSize;
+            s << VARINT(nSize) << CFlatData(script);
+        }
+    }
+
+    template<typename Stream>
+    void Read(Stream &s, std::vector<const CScript*>& dictionary) {
+        unsigned int nCode = 0;
+        s >> VARINT(nCode);
+        if (nCode == nReference) {
+            uint32_t nIndex = 0;
+            s >> VARINT(nIndex);
+            if (nIndex >= dictionary.size()) {
+                throw std::ios_base::failure("Undo script reference out of range");
+            }
+            script = *dictionary[nIndex];
+            return;
+        }
+
+        if (nCode < nSpecialScripts) {
+            std::vector<unsigned char> vch(GetSpecialSize(nCode), 0x00);
+            s >> REF(CFlatData(vch));
+            Decompress(nCode, vch);
+        } else if (nCode == nWitnessKeyHash) {
+            script.resize(22);
+            script[0] = OP_0;
+            script[1] = 20;
+            s >> REF(CFlatData(script.data() + 2, script.data() + 22));
+        } else if (nCode == nWitnessScriptHash) {
+            script.resize(34);
+            script[0] = OP_0;
+            script[1] = 32;
+            s >> REF(CFlatData(script.data() + 2, script.data() + 34));
+        } else {
+            unsigned int nSize = nCode - nFirstSize;
+            if (nSize > MAX_SCRIPT_SIZE) {
+                // Overly long script, replace with a short invalid one
+                script << OP_RETURN;
+                s.ignore(nSize);
+            } else {
+                script.resize(nSize);
+                s >> REF(CFlatData(script));
+            }
+        }
+        dictionary.push_back(&script);
+    }
+};
+
+/** Undo information for a CBlock, in the compact format
+ *
+ *  Blocks whose nStatus has BLOCK_UNDO_COMPACT set store their undo data
+ *  this way. Unlike the original format, it has no dummy version, it stores
+ *  heights relative to the height of the block, which keeps them to a byte
+ *  or two for recently created outputs, and it codes scripts with
+ *  UndoScriptCompressor.
+ */
+class CompactBlockUndo
+{
+    CBlockUndo& blockundo;
+    const int nHeight;
+
+public:
+    template<typename Stream>
+    void Serialize(Stream &s) const {
+        std::map<CScript, uint32_t> dictionary;
+        uint64_t count = blockundo.vtxundo.size();
+        ::Serialize(s, COMPACTSIZE(REF(count)));
+        for (const CTxUndo& txundo : blockundo.vtxundo) {
+            uint64_t nInputs = txundo.vprevout.size();
+            ::Serialize(s, COMPACTSIZE(REF(nInputs)));
+            for (const Coin& coin : txundo.vprevout) {
+                assert((int)coin.nHeight <= nHeight);
+                unsigned int nCode = (nHeight - coin.nHeight) * 2 + (coin.fCoinBase ? 1 : 0);
+                ::Serialize(s, VARINT(nCode));
+                uint64_t nVal = CTxOutCompressor::CompressAmount(coin.out.nValue);
+                ::Serialize(s, VARINT(nVal));
+                UndoScriptCompressor(REF(coin.out.scriptPubKey)).Write(s, dictionary);
+            }
+        }
+    }
+
+    template<typename Stream>
+    void Unserialize(Stream &s) {
+        // The scripts read so far, which stay in place as the vectors are not resized
+        std::vector<const CScript*> dictionary;
+        uint64_t count = 0;
+        uint64_t nTotalInputs = 0;
+        ::Unserialize(s, COMPACTSIZE(count));
+        if (count > MAX_INPUTS_PER_BLOCK) {
+            throw std::ios_base::failure("Too many transaction undo records");
+        }
+        blockundo.vtxundo.resize(count);
+        for (CTxUndo& txundo : blockundo.vtxundo) {
+            uint64_t nInputs = 0;
+            ::Unserialize(s, COMPACTSIZE(nInputs));
+            nTotalInputs += nInputs;
+            if (nTotalInputs > MAX_INPUTS_PER_BLOCK) {
+                throw std::ios_base::failure("Too many input undo records");
+            }
+            txundo.vprevout.resize(nInputs);
+            for (Coin& coin : txundo.vprevout) {
+                unsigned int nCode = 0;
+                ::Unserialize(s, VARINT(nCode));
+                if (nCode / 2 > (unsigned int)nHeight) {
+                    throw std::ios_base::failure("Undo record height out of range");
+                }
+                coin.nHeight = nHeight - nCode / 2;
+                coin.fCoinBase = nCode & 1;
+                uint64_t nVal = 0;
+                ::Unserialize(s, VARINT(nVal));
+                coin.out.nValue = CTxOutCompressor::DecompressAmount(nVal);
+                UndoScriptCompressor(coin.out.scriptPubKey).Read(s, dictionary);
+            }
+        }
+    }
+
+    CompactBlockUndo(CBlockUndo& blockundoIn, int nHeightIn) : blockundo(blockundoIn), nHeight(nHeightIn) {}
+};
+
 #endif // BITCOIN_UNDO_H
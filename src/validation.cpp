@@ -7,6 +7,7 @@
 
 #include <arith_uint256.h>
 #include <auxpow.h>
+#include <blockstore.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
@@ -15,8 +16,10 @@
 #include <consensus/merkle.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <crypto/common.h>
 #include <cuckoocache.h>
 #include <hash.h>
+#include <index/txindex.h>
 #include <init.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
@@ -41,6 +44,7 @@
 #include <validationinterface.h>
 #include <warnings.h>
 
+#include <deque>
 #include <future>
 #include <sstream>
 
@@ -192,6 +196,8 @@ private:
     CBlockIndex* AddToBlockIndex(const CBlockHeader& block);
     /** Create a new block index entry for a given block hash */
     CBlockIndex * InsertBlockIndex(const uint256& hash);
+    /** Load the block index from its snapshot, in an order where each block comes after its predecessor */
+    bool LoadBlockIndexSnapshot(CBlockTreeDB& blocktree, std::vector<CBlockIndex*>& vSorted);
     void CheckBlockIndex(const Consensus::Params& consensusParams);
 
     void InvalidBlockFound(CBlockIndex *pindex, const CValidationState &state);
@@ -215,15 +221,17 @@ uint256 hashBestBlock;
 int nScriptCheckThreads = 0;
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
-bool fTxIndex = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
+bool fCompactUndo = DEFAULT_COMPACT_UNDO;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
+uint64_t nPruneUndoTarget = 0;
+int64_t nPruneKeepTime = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
 bool fEnableReplacement = DEFAULT_ENABLE_REPLACEMENT;
 
@@ -298,7 +306,7 @@ enum FlushStateMode {
 // See definition for documentation
 static bool FlushStateToDisk(const CChainParams& chainParams, CValidationState &state, FlushStateMode mode, int nManualPruneHeight=0);
 static void FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPruneHeight);
-static void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight);
+static void FindFilesToPrune(std::set<int>& setFilesToPrune, std::set<int>& setUndoFilesToPrune, uint64_t nPruneAfterHeight);
 bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks = nullptr);
 static FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 
@@ -512,6 +520,40 @@ void UpdateMempoolForReorg(DisconnectedBlockTransactions &disconnectpool, bool f
     LimitMempoolSize(mempool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
 }
 
+static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+
+void ThreadScriptCheck() {
+    RenameThread("bitcoin-scriptch");
+    scriptcheckqueue.Thread();
+}
+
+/**
+ * Check the scripts of a transaction being accepted to the mempool. Those
+ * with at least MEMPOOL_PARALLEL_SCRIPT_CHECK_INPUTS inputs are spread over
+ * the script check threads instead of being run on the calling thread. As
+ * the queue only reports success or failure, a failing transaction is
+ * checked again serially to fill in state; the inputs that did pass are hits
+ * in the signature cache by then.
+ */
+static bool CheckInputScriptsForMempool(const CTransaction& tx, CValidationState& state, const CCoinsViewCache& view,
+                 unsigned int flags, PrecomputedTransactionData& txdata)
+{
+    AssertLockHeld(cs_main);
+
+    if (nScriptCheckThreads && tx.vin.size() >= MEMPOOL_PARALLEL_SCRIPT_CHECK_INPUTS) {
+        std::vector<CScriptCheck> vChecks;
+        if (!CheckInputs(tx, state, view, true, flags, true, false, txdata, &vChecks)) {
+            return false;
+        }
+        CCheckQueueControl<CScriptCheck> control(&scriptcheckqueue);
+        control.Add(vChecks);
+        if (control.Wait()) {
+            return true;
+        }
+    }
+    return CheckInputs(tx, state, view, true, flags, true, false, txdata);
+}
+
 // Used to avoid mempool polluting consensus critical paths if CCoinsViewMempool
 // were somehow broken and returning the wrong scriptPubKeys
 static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &view, CTxMemPool& pool,
@@ -548,9 +590,20 @@ static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, CValidationSt
     return CheckInputs(tx, state, view, true, flags, cacheSigStore, true, txdata);
 }
 
+/** How a transaction accepted as part of a package is held to the minimum fees */
+struct PackageContext {
+    //! Fee rate of the package's new transactions as a whole
+    CFeeRate feeRate;
+    //! Whether this is the last transaction of the package. Parents may meet
+    //! the minimum fees on the package's fee rate, the child has to meet them
+    //! on both its own and its ancestor fee rate.
+    bool fChild;
+};
+
 static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool& pool, CValidationState& state, const CTransactionRef& ptx,
                               bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
-                              bool bypass_limits, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache)
+                              bool bypass_limits, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache,
+                              const PackageContext* pPackage = nullptr)
 {
     const CTransaction& tx = *ptx;
     const uint256 hash = tx.GetHash();
@@ -724,16 +777,6 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
             return state.DoS(0, false, REJECT_NONSTANDARD, "bad-txns-too-many-sigops", false,
                 strprintf("%d", nSigOpsCost));
 
-        CAmount mempoolRejectFee = pool.GetMinFee(gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
-        if (!bypass_limits && mempoolRejectFee > 0 && nModifiedFees < mempoolRejectFee) {
-            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool min fee not met", false, strprintf("%d < %d", nFees, mempoolRejectFee));
-        }
-
-        // No transactions are allowed below minRelayTxFee except from disconnected blocks
-        if (!bypass_limits && nModifiedFees < ::minRelayTxFee.GetFee(nSize)) {
-            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "min relay fee not met");
-        }
-
         if (nAbsurdFee && nFees > nAbsurdFee)
             return state.Invalid(false,
                 REJECT_HIGHFEE, "absurdly-high-fee",
@@ -750,49 +793,86 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
             return state.DoS(0, false, REJECT_NONSTANDARD, "too-long-mempool-chain", false, errString);
         }
 
+        // The fees held to the minimums below. A package's parents may pay
+        // at its fee rate, so that its child can pay for them. The child is
+        // held to the lower of its own and its ancestor fee rate: it has to
+        // pay for itself, and cannot be carried by a parent either.
+        CAmount nMinimumFees = nModifiedFees;
+        if (pPackage && !pPackage->fChild) {
+            nMinimumFees = std::max(nMinimumFees, pPackage->feeRate.GetFee(nSize));
+        } else if (pPackage) {
+            CAmount nAncestorFees = nModifiedFees;
+            size_t nAncestorSize = nSize;
+            for (CTxMemPool::txiter ancestorIt : setAncestors) {
+                nAncestorFees += ancestorIt->GetModifiedFee();
+                nAncestorSize += ancestorIt->GetTxSize();
+            }
+            nMinimumFees = std::min(nMinimumFees, CFeeRate(nAncestorFees, nAncestorSize).GetFee(nSize));
+        }
+
+        CAmount mempoolRejectFee = pool.GetMinFee(gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
+        if (!bypass_limits && mempoolRejectFee > 0 && nMinimumFees < mempoolRejectFee) {
+            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool min fee not met", false, strprintf("%d < %d", nFees, mempoolRejectFee));
+        }
+
+        // No transactions are allowed below minRelayTxFee except from disconnected blocks
+        if (!bypass_limits && nMinimumFees < ::minRelayTxFee.GetFee(nSize)) {
+            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "min relay fee not met");
+        }
+
+        // Look up the conflicting entries once; everything below works on
+        // the iterators. We hold the lock, so none of them went away.
+        CTxMemPool::setEntries setIterConflicting;
+        for (const uint256 &hashConflicting : setConflicts)
+        {
+            CTxMemPool::txiter mi = pool.mapTx.find(hashConflicting);
+            if (mi != pool.mapTx.end())
+                setIterConflicting.insert(mi);
+        }
+
         // A transaction that spends outputs that would be replaced by it is invalid. Now
         // that we have the set of all ancestors we can detect this
         // pathological case by making sure setConflicts and setAncestors don't
         // intersect.
-        for (CTxMemPool::txiter ancestorIt : setAncestors)
+        for (CTxMemPool::txiter conflictIt : setIterConflicting)
         {
-            const uint256 &hashAncestor = ancestorIt->GetTx().GetHash();
-            if (setConflicts.count(hashAncestor))
+            if (setAncestors.count(conflictIt))
             {
                 return state.DoS(10, false,
                                  REJECT_INVALID, "bad-txns-spends-conflicting-tx", false,
                                  strprintf("%s spends conflicting transaction %s",
                                            hash.ToString(),
-                                           hashAncestor.ToString()));
+                                           conflictIt->GetTx().GetHash().ToString()));
             }
         }
 
         // Check if it's economically rational to mine this transaction rather
         // than the ones it replaces.
-        CAmount nConflictingFees = 0;
-        size_t nConflictingSize = 0;
-        uint64_t nConflictingCount = 0;
-        CTxMemPool::setEntries allConflicting;
-
-        // If we don't hold the lock allConflicting might be incomplete; the
-        // subsequent RemoveStaged() and addUnchecked() calls don't guarantee
-        // mempool consistency for us.
+        CTxMemPool::ReplacementSummary replacement;
+
+        // If we don't hold the lock replacement.setEvicted might be
+        // incomplete; the subsequent RemoveStaged() and addUnchecked() calls
+        // don't guarantee mempool consistency for us.
         const bool fReplacementTransaction = setConflicts.size();
         if (fReplacementTransaction)
         {
+            // Bail out on the cached descendant counts before walking any of
+            // the mempool. They potentially overestimate the number of actual
+            // descendants but we just want to be conservative to avoid doing
+            // too much work.
+            if (!pool.CalculateReplacementSummary(setIterConflicting, MAX_BIP125_REPLACEMENT_CANDIDATES, replacement)) {
+                return state.DoS(0, false,
+                        REJECT_NONSTANDARD, "too many potential replacements", false,
+                        strprintf("rejecting replacement %s; too many potential replacements (%d > %d)\n",
+                            hash.ToString(),
+                            replacement.nPotentialEvicted,
+                            MAX_BIP125_REPLACEMENT_CANDIDATES));
+            }
+
             CFeeRate newFeeRate(nModifiedFees, nSize);
             std::set<uint256> setConflictsParents;
-            const int maxDescendantsToVisit = 100;
-            CTxMemPool::setEntries setIterConflicting;
-            for (const uint256 &hashConflicting : setConflicts)
+            for (CTxMemPool::txiter mi : setIterConflicting)
             {
-                CTxMemPool::txiter mi = pool.mapTx.find(hashConflicting);
-                if (mi == pool.mapTx.end())
-                    continue;
-
-                // Save these to avoid repeated lookups
-                setIterConflicting.insert(mi);
-
                 // Don't allow the replacement to reduce the feerate of the
                 // mempool.
                 //
@@ -824,37 +904,15 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
                 {
                     setConflictsParents.insert(txin.prevout.hash);
                 }
-
-                nConflictingCount += mi->GetCountWithDescendants();
-            }
-            // This potentially overestimates the number of actual descendants
-            // but we just want to be conservative to avoid doing too much
-            // work.
-            if (nConflictingCount <= maxDescendantsToVisit) {
-                // If not too many to replace, then calculate the set of
-                // transactions that would have to be evicted
-                for (CTxMemPool::txiter it : setIterConflicting) {
-                    pool.CalculateDescendants(it, allConflicting);
-                }
-                for (CTxMemPool::txiter it : allConflicting) {
-                    nConflictingFees += it->GetModifiedFee();
-                    nConflictingSize += it->GetTxSize();
-                }
-            } else {
-                return state.DoS(0, false,
-                        REJECT_NONSTANDARD, "too many potential replacements", false,
-                        strprintf("rejecting replacement %s; too many potential replacements (%d > %d)\n",
-                            hash.ToString(),
-                            nConflictingCount,
-                            maxDescendantsToVisit));
             }
 
-            for (unsigned int j = 0; j < tx.vin.size(); j++)
+            // We don't want to accept replacements that require low
+            // feerate junk to be mined first. Ideally we'd keep track of
+            // the ancestor feerates and make the decision based on that,
+            // but for now requiring all new inputs to be confirmed works.
+            // Without in-mempool ancestors all inputs are confirmed already.
+            for (unsigned int j = 0; !setAncestors.empty() && j < tx.vin.size(); j++)
             {
-                // We don't want to accept replacements that require low
-                // feerate junk to be mined first. Ideally we'd keep track of
-                // the ancestor feerates and make the decision based on that,
-                // but for now requiring all new inputs to be confirmed works.
                 if (!setConflictsParents.count(tx.vin[j].prevout.hash))
                 {
                     // Rather than check the UTXO set - potentially expensive -
@@ -871,17 +929,17 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
             // The replacement must pay greater fees than the transactions it
             // replaces - if we did the bandwidth used by those conflicting
             // transactions would not be paid for.
-            if (nModifiedFees < nConflictingFees)
+            if (nModifiedFees < replacement.nFees)
             {
                 return state.DoS(0, false,
                                  REJECT_INSUFFICIENTFEE, "insufficient fee", false,
                                  strprintf("rejecting replacement %s, less fees than conflicting txs; %s < %s",
-                                          hash.ToString(), FormatMoney(nModifiedFees), FormatMoney(nConflictingFees)));
+                                          hash.ToString(), FormatMoney(nModifiedFees), FormatMoney(replacement.nFees)));
             }
 
             // Finally in addition to paying more fees than the conflicts the
             // new transaction must pay for its own bandwidth.
-            CAmount nDeltaFees = nModifiedFees - nConflictingFees;
+            CAmount nDeltaFees = nModifiedFees - replacement.nFees;
             if (nDeltaFees < ::incrementalRelayFee.GetFee(nSize))
             {
                 return state.DoS(0, false,
@@ -901,7 +959,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
         PrecomputedTransactionData txdata(tx);
-        if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, false, txdata)) {
+        if (!CheckInputScriptsForMempool(tx, state, view, scriptVerifyFlags, txdata)) {
             // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
             // need to turn both off, and compare against just turning off CLEANSTACK
             // to see if the failure is specifically due to witness validation.
@@ -949,30 +1007,32 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         }
 
         // Remove conflicting transactions from the mempool
-        for (const CTxMemPool::txiter it : allConflicting)
+        for (const CTxMemPool::txiter it : replacement.setEvicted)
         {
             LogPrint(BCLog::MEMPOOL, "replacing tx %s with %s for %s BTC additional fees, %d delta bytes\n",
                     it->GetTx().GetHash().ToString(),
                     hash.ToString(),
-                    FormatMoney(nModifiedFees - nConflictingFees),
-                    (int)nSize - (int)nConflictingSize);
+                    FormatMoney(nModifiedFees - replacement.nFees),
+                    (int)nSize - (int)replacement.nSize);
             if (plTxnReplaced)
                 plTxnReplaced->push_back(it->GetSharedTx());
         }
-        pool.RemoveStaged(allConflicting, false, MemPoolRemovalReason::REPLACED);
+        pool.RemoveStaged(replacement.setEvicted, false, MemPoolRemovalReason::REPLACED);
 
         // This transaction should only count for fee estimation if:
         // - it isn't a BIP 125 replacement transaction (may not be widely supported)
         // - it's not being readded during a reorg which bypasses typical mempool fee limits
         // - the node is not behind
         // - the transaction is not dependent on any other transactions in the mempool
-        bool validForFeeEstimation = !fReplacementTransaction && !bypass_limits && IsCurrentForFeeEstimation() && pool.HasNoInputsOf(tx);
+        // - it isn't part of a package, whose parents may not pay for themselves
+        bool validForFeeEstimation = !fReplacementTransaction && !bypass_limits && !pPackage && IsCurrentForFeeEstimation() && pool.HasNoInputsOf(tx);
 
         // Store transaction in memory
         pool.addUnchecked(hash, entry, setAncestors, validForFeeEstimation);
 
-        // trim mempool and check if tx was trimmed
-        if (!bypass_limits) {
+        // trim mempool and check if tx was trimmed; packages are trimmed once
+        // all of their transactions are in
+        if (!bypass_limits && !pPackage) {
             LimitMempoolSize(pool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
             if (!pool.exists(hash))
                 return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
@@ -1009,6 +1069,152 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
     return AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, pfMissingInputs, GetTime(), plTxnReplaced, bypass_limits, nAbsurdFee);
 }
 
+/** Check that a package is within the size limits, sorted, connected and free
+ *  of conflicts between its transactions */
+static bool CheckPackage(const std::vector<CTransactionRef>& package, CValidationState& state)
+{
+    if (package.empty() || package.size() > MAX_PACKAGE_COUNT)
+        return state.DoS(0, false, REJECT_NONSTANDARD, "package-too-many-transactions");
+
+    int64_t nWeight = 0;
+    std::map<uint256, size_t> mapIndex;
+    for (size_t i = 0; i < package.size(); i++) {
+        nWeight += GetTransactionWeight(*package[i]);
+        if (!mapIndex.emplace(package[i]->GetHash(), i).second)
+            return state.DoS(0, false, REJECT_NONSTANDARD, "package-contains-duplicates");
+    }
+    if (nWeight > MAX_PACKAGE_WEIGHT)
+        return state.DoS(0, false, REJECT_NONSTANDARD, "package-too-large");
+
+    std::set<COutPoint> setSpent;
+    std::vector<bool> vHasChild(package.size(), false);
+    for (size_t i = 0; i < package.size(); i++) {
+        for (const CTxIn& txin : package[i]->vin) {
+            if (!setSpent.insert(txin.prevout).second)
+                return state.DoS(0, false, REJECT_NONSTANDARD, "conflict-in-package");
+            auto it = mapIndex.find(txin.prevout.hash);
+            if (it == mapIndex.end())
+                continue;
+            if (it->second >= i)
+                return state.DoS(0, false, REJECT_NONSTANDARD, "package-not-sorted");
+            vHasChild[it->second] = true;
+        }
+    }
+    // Every transaction but the last must have a child in the package, which
+    // makes all of them ancestors of the last one
+    for (size_t i = 0; i + 1 < package.size(); i++) {
+        if (!vHasChild[i])
+            return state.DoS(0, false, REJECT_NONSTANDARD, "package-not-connected");
+    }
+    return true;
+}
+
+static bool AcceptPackageToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool& pool, CValidationState& state,
+                              const std::vector<CTransactionRef>& package, bool* pfMissingInputs, int64_t nAcceptTime,
+                              const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache)
+{
+    AssertLockHeld(cs_main);
+    LOCK(pool.cs);
+    if (pfMissingInputs) {
+        *pfMissingInputs = false;
+    }
+
+    if (!CheckPackage(package, state))
+        return false;
+
+    // Look up the inputs of the whole package in one view, which the
+    // package's own outputs are added to as we go, and sum up its fees
+    std::vector<CTransactionRef> vNew;
+    CAmount nPackageFees = 0;
+    int64_t nPackageSize = 0;
+    {
+        CCoinsView dummy;
+        CCoinsViewCache view(&dummy);
+        CCoinsViewMemPool viewMemPool(pcoinsTip.get(), pool);
+        view.SetBackend(viewMemPool);
+
+        for (const CTransactionRef& ptx : package) {
+            const CTransaction& tx = *ptx;
+            // Transactions already in the mempool have paid for themselves,
+            // and their outputs are found through viewMemPool
+            if (pool.exists(tx.GetHash()))
+                continue;
+
+            for (const CTxIn& txin : tx.vin) {
+                if (pool.mapNextTx.count(txin.prevout)) {
+                    return state.Invalid(false, REJECT_DUPLICATE, "txn-mempool-conflict");
+                }
+                if (!pcoinsTip->HaveCoinInCache(txin.prevout)) {
+                    coins_to_uncache.push_back(txin.prevout);
+                }
+                if (!view.HaveCoin(txin.prevout)) {
+                    if (pfMissingInputs) {
+                        *pfMissingInputs = true;
+                    }
+                    return false; // fMissingInputs and !state.IsInvalid() is used to detect this condition, don't set state.Invalid()
+                }
+            }
+
+            CAmount nFees = 0;
+            if (!Consensus::CheckTxInputs(tx, state, view, GetSpendHeight(view), nFees)) {
+                return error("%s: Consensus::CheckTxInputs: %s, %s", __func__, tx.GetHash().ToString(), FormatStateMessage(state));
+            }
+            pool.ApplyDelta(tx.GetHash(), nFees);
+            nPackageFees += nFees;
+            nPackageSize += GetVirtualTransactionSize(tx, GetTransactionSigOpCost(tx, view, STANDARD_SCRIPT_VERIFY_FLAGS));
+
+            AddCoins(view, tx, MEMPOOL_HEIGHT);
+            vNew.push_back(ptx);
+        }
+    }
+
+    if (vNew.empty())
+        return true;
+
+    // Each transaction goes through all of the checks of a single one, only
+    // that parents may meet the minimum fees on the package's fee rate. The
+    // mempool is only trimmed once all of them are in.
+    std::vector<CTransactionRef> vAdded;
+    for (const CTransactionRef& ptx : vNew) {
+        const PackageContext package_context{CFeeRate(nPackageFees, nPackageSize), ptx == vNew.back()};
+        if (!AcceptToMemoryPoolWorker(chainparams, pool, state, ptx, pfMissingInputs, nAcceptTime, nullptr /* plTxnReplaced */,
+                                      false /* bypass_limits */, nAbsurdFee, coins_to_uncache, &package_context)) {
+            // Take the package's transactions out again, as they may not pay for themselves
+            for (const CTransactionRef& ptxAdded : vAdded) {
+                pool.removeRecursive(*ptxAdded, MemPoolRemovalReason::UNKNOWN);
+            }
+            return false;
+        }
+        vAdded.push_back(ptx);
+    }
+
+    LimitMempoolSize(pool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+    for (const CTransactionRef& ptx : vNew) {
+        if (!pool.exists(ptx->GetHash()))
+            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
+    }
+
+    LogPrint(BCLog::MEMPOOL, "accepted package of %u new txs ending in %s (%s)\n", vNew.size(),
+             package.back()->GetHash().ToString(), CFeeRate(nPackageFees, nPackageSize).ToString());
+    return true;
+}
+
+bool AcceptPackageToMemoryPool(CTxMemPool& pool, CValidationState &state, const std::vector<CTransactionRef>& package,
+                               bool* pfMissingInputs, const CAmount nAbsurdFee)
+{
+    const CChainParams& chainparams = Params();
+    std::vector<COutPoint> coins_to_uncache;
+    bool res = AcceptPackageToMemoryPoolWorker(chainparams, pool, state, package, pfMissingInputs, GetTime(), nAbsurdFee, coins_to_uncache);
+    if (!res) {
+        for (const COutPoint& hashTx : coins_to_uncache)
+            pcoinsTip->Uncache(hashTx);
+    }
+    // After we've (potentially) uncached entries, ensure our coins cache is still within its size limits
+    CValidationState stateDummy;
+    FlushStateToDisk(chainparams, stateDummy, FLUSH_STATE_PERIODIC);
+    return res;
+}
+
 /**
  * Return transaction in txOut, and if it was found inside a block, its hash is placed in hashBlock.
  * If blockIndex is provided, the transaction is fetched from the corresponding block.
@@ -1026,28 +1232,8 @@ bool GetTransaction(const uint256& hash, CTransactionRef& txOut, const Consensus
             return true;
         }
 
-        if (fTxIndex) {
-            CDiskTxPos postx;
-            if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-                if (file.IsNull())
-                    return error("%s: OpenBlockFile failed", __func__);
-                CBlockHeader header;
-                try {
-                    file >> header;
-                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
-                } catch (const std::exception& e) {
-                    return error("%s: Deserialize or I/O error - %s", __func__, e.what());
-                }
-                hashBlock = header.GetHash();
-                if (txOut->GetHash() != hash)
-                    return error("%s: txid mismatch", __func__);
-                return true;
-            }
-
-            // transaction not found in index, nothing more can be done
-            return false;
+        if (g_txindex) {
+            return g_txindex->FindTx(hash, hashBlock, txOut);
         }
 
         if (fAllowSlow) { // use coin database to locate block that contains transaction, and scan it
@@ -1158,6 +1344,61 @@ static bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMes
     return true;
 }
 
+bool ReadRawBlockFromDisk(RawBlock& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start)
+{
+    bool finalized;
+    {
+        LOCK(cs_LastBlockFile);
+        finalized = pos.nFile < nLastBlockFile;
+    }
+    return g_blockstore.Read(pos, message_start, finalized, block);
+}
+
+//! Serialized size of a CPureBlockHeader, which the block hash is computed over
+static const size_t PURE_HEADER_SIZE = 80;
+
+bool ReadRawBlockFromDisk(RawBlock& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start)
+{
+    CDiskBlockPos block_pos;
+    {
+        LOCK(cs_main);
+        block_pos = pindex->GetBlockPos();
+    }
+
+    if (!ReadRawBlockFromDisk(block, block_pos, message_start))
+        return false;
+    // The block hash covers just the leading pure header, which is cheap to
+    // check without deserializing the block.
+    if (block.size() < PURE_HEADER_SIZE ||
+        Hash(block.begin(), block.begin() + PURE_HEADER_SIZE) != pindex->GetBlockHash())
+        return error("ReadRawBlockFromDisk(RawBlock&, CBlockIndex*): GetHash() doesn't match index for %s at %s",
+                pindex->ToString(), block_pos.ToString());
+    return true;
+}
+
+/** Deserialize a block through the block store. */
+static bool DeserializeFromDisk(CBlock& block, const CDiskBlockPos& pos)
+{
+    RawBlock raw_block;
+    if (!ReadRawBlockFromDisk(raw_block, pos, Params().MessageStart()))
+        return error("ReadBlockFromDisk: ReadRawBlockFromDisk failed for %s", pos.ToString());
+
+    SpanReader reader(SER_DISK, CLIENT_VERSION, raw_block.data(), raw_block.size());
+    reader >> block;
+    return true;
+}
+
+/** Deserialize just the header of a block, which is cheaper to read from the file directly. */
+static bool DeserializeFromDisk(CBlockHeader& block, const CDiskBlockPos& pos)
+{
+    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+
+    filein >> block;
+    return true;
+}
+
 ///* Generic implementation of block reading that can handle
 //   both a block and its header.  */
 template<typename T>
@@ -1165,14 +1406,10 @@ static bool ReadBlockOrHeader(T& block, const CDiskBlockPos& pos, const Consensu
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
-
     // Read block
     try {
-        filein >> block;
+        if (!DeserializeFromDisk(block, pos))
+            return false;
     }
     catch (const std::exception& e) {
         return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
@@ -1516,52 +1753,115 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
 
 namespace {
 
-bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
+/**
+ * Undo data of connected blocks, waiting to be written to disk by the next
+ * FlushBlockFile(). It always covers one contiguous range of a rev?????.dat
+ * file, as undo positions are handed out in order.
+ */
+struct UndoBuffer
 {
-    // Open history file to append
-    CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
+    int nFile = -1;
+    unsigned int nPos = 0; //!< position in the file of the first buffered byte
+    std::vector<unsigned char> vData;
+};
+
+// Protected by cs_main
+UndoBuffer undoBuffer;
+
+} // namespace
+
+bool WriteUndoBuffer(bool fCommit)
+{
+    AssertLockHeld(cs_main);
+    if (undoBuffer.vData.empty()) {
+        return true;
+    }
+
+    FILE* file = OpenUndoFile(CDiskBlockPos(undoBuffer.nFile, undoBuffer.nPos));
+    if (!file)
         return error("%s: OpenUndoFile failed", __func__);
+    const bool fWritten = fwrite(undoBuffer.vData.data(), 1, undoBuffer.vData.size(), file) == undoBuffer.vData.size();
+    if (fWritten && fCommit)
+        FileCommit(file);
+    fclose(file);
+    if (!fWritten)
+        return error("%s: write to rev%05u.dat failed", __func__, undoBuffer.nFile);
+
+    undoBuffer.vData.clear();
+    return true;
+}
+
+/** Copy the undo record at pos (the header excluded) out of the buffer, if it is there. */
+static bool ReadUndoBuffer(const CDiskBlockPos& pos, std::vector<unsigned char>& vRecord)
+{
+    AssertLockHeld(cs_main);
+    const unsigned int nHeaderSize = CMessageHeader::MESSAGE_START_SIZE + sizeof(unsigned int);
+    if (pos.nFile != undoBuffer.nFile || pos.nPos < undoBuffer.nPos + nHeaderSize || pos.nPos >= undoBuffer.nPos + undoBuffer.vData.size()) {
+        return false;
+    }
+
+    const size_t nOffset = pos.nPos - undoBuffer.nPos;
+    const size_t nRecordSize = ReadLE32(undoBuffer.vData.data() + nOffset - sizeof(unsigned int)) + sizeof(uint256);
+    if (nOffset + nRecordSize > undoBuffer.vData.size()) {
+        return false;
+    }
+    vRecord.assign(undoBuffer.vData.begin() + nOffset, undoBuffer.vData.begin() + nOffset + nRecordSize);
+    return true;
+}
+
+bool UndoWriteToDisk(const CBlockUndo& blockundo, int nHeight, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart, bool fCompact)
+{
+    AssertLockHeld(cs_main);
+
+    // Append to the buffer, unless the undo data goes elsewhere
+    if (pos.nFile != undoBuffer.nFile || pos.nPos != undoBuffer.nPos + undoBuffer.vData.size()) {
+        if (!WriteUndoBuffer(true))
+            return false;
+        undoBuffer.nFile = pos.nFile;
+        undoBuffer.nPos = pos.nPos;
+    }
 
     // Write index header
-    unsigned int nSize = GetSerializeSize(fileout, blockundo);
-    fileout << FLATDATA(messageStart) << nSize;
+    const CompactBlockUndo compact(REF(blockundo), nHeight);
+    CVectorWriter writer(SER_DISK, CLIENT_VERSION, undoBuffer.vData, undoBuffer.vData.size());
+    unsigned int nSize = fCompact ? GetSerializeSize(compact, SER_DISK, CLIENT_VERSION) : GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION);
+    writer << FLATDATA(messageStart) << nSize;
 
     // Write undo data
-    long fileOutPos = ftell(fileout.Get());
-    if (fileOutPos < 0)
-        return error("%s: ftell failed", __func__);
-    pos.nPos = (unsigned int)fileOutPos;
-    fileout << blockundo;
+    const size_t nDataStart = undoBuffer.vData.size();
+    pos.nPos = undoBuffer.nPos + nDataStart;
+    if (fCompact) {
+        writer << compact;
+    } else {
+        writer << blockundo;
+    }
 
     // calculate & write checksum
     CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
     hasher << hashBlock;
-    hasher << blockundo;
-    fileout << hasher.GetHash();
+    hasher.write((const char*)undoBuffer.vData.data() + nDataStart, nSize);
+    writer << hasher.GetHash();
 
+    if (undoBuffer.vData.size() >= MAX_UNDO_BUFFER_SIZE) {
+        return WriteUndoBuffer(false);
+    }
     return true;
 }
 
-static bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
+template <typename Stream>
+static bool UndoReadFromStream(Stream& s, CBlockUndo& blockundo, const CBlockIndex* pindex, bool fCompact)
 {
-    CDiskBlockPos pos = pindex->GetUndoPos();
-    if (pos.IsNull()) {
-        return error("%s: no undo data available", __func__);
-    }
-
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("%s: OpenUndoFile failed", __func__);
-
     // Read block
     uint256 hashChecksum;
-    CHashVerifier<CAutoFile> verifier(&filein); // We need a CHashVerifier as reserializing may lose data
+    CHashVerifier<Stream> verifier(&s); // We need a CHashVerifier as reserializing may lose data
     try {
         verifier << pindex->pprev->GetBlockHash();
-        verifier >> blockundo;
-        filein >> hashChecksum;
+        if (fCompact) {
+            verifier >> REF(CompactBlockUndo(blockundo, pindex->nHeight));
+        } else {
+            verifier >> blockundo;
+        }
+        s >> hashChecksum;
     }
     catch (const std::exception& e) {
         return error("%s: Deserialize or I/O error - %s", __func__, e.what());
@@ -1574,6 +1874,38 @@ static bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
     return true;
 }
 
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex *pindex)
+{
+    CDiskBlockPos pos;
+    bool fCompact;
+    std::vector<unsigned char> vBuffered;
+    bool fBuffered = false;
+    {
+        LOCK(cs_main);
+        pos = pindex->GetUndoPos();
+        fCompact = pindex->nStatus & BLOCK_UNDO_COMPACT;
+        fBuffered = !pos.IsNull() && ReadUndoBuffer(pos, vBuffered);
+    }
+    if (pos.IsNull()) {
+        return error("%s: no undo data available", __func__);
+    }
+
+    // Recently written undo data may not have reached the disk yet
+    if (fBuffered) {
+        SpanReader reader(SER_DISK, CLIENT_VERSION, vBuffered.data(), vBuffered.size());
+        return UndoReadFromStream(reader, blockundo, pindex, fCompact);
+    }
+
+    // Open history file to read
+    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull())
+        return error("%s: OpenUndoFile failed", __func__);
+
+    return UndoReadFromStream(filein, blockundo, pindex, fCompact);
+}
+
+namespace {
+
 /** Abort with a message */
 bool AbortNode(const std::string& strMessage, const std::string& userMessage="")
 {
@@ -1691,6 +2023,12 @@ void static FlushBlockFile(bool fFinalize = false)
 {
     LOCK(cs_LastBlockFile);
 
+    // Write out the buffered undo data first. It may belong to another file
+    // than the last one, in which case it is committed here.
+    if (!WriteUndoBuffer(undoBuffer.nFile != nLastBlockFile)) {
+        AbortNode("Failed to write undo data");
+    }
+
     CDiskBlockPos posOld(nLastBlockFile, 0);
 
     FILE *fileOld = OpenBlockFile(posOld);
@@ -1717,63 +2055,41 @@ static bool WriteUndoDataForBlock(const CBlockUndo& blockundo, CValidationState&
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull()) {
         CDiskBlockPos _pos;
-        if (!FindUndoPos(state, pindex->nFile, _pos, ::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION) + 40))
+        const unsigned int nSize = fCompactUndo ? ::GetSerializeSize(CompactBlockUndo(REF(blockundo), pindex->nHeight), SER_DISK, CLIENT_VERSION)
+                                                : ::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION);
+        if (!FindUndoPos(state, pindex->nFile, _pos, nSize + 40))
             return error("ConnectBlock(): FindUndoPos failed");
-        if (!UndoWriteToDisk(blockundo, _pos, pindex->pprev->GetBlockHash(), chainparams.MessageStart()))
+        if (!UndoWriteToDisk(blockundo, pindex->nHeight, _pos, pindex->pprev->GetBlockHash(), chainparams.MessageStart(), fCompactUndo))
             return AbortNode(state, "Failed to write undo data");
 
         // update nUndoPos in block index
         pindex->nUndoPos = _pos.nPos;
         pindex->nStatus |= BLOCK_HAVE_UNDO;
+        if (fCompactUndo) {
+            pindex->nStatus |= BLOCK_UNDO_COMPACT;
+        }
         setDirtyBlockIndex.insert(pindex);
     }
 
     return true;
 }
 
-static bool WriteTxIndexDataForBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex)
-{
-    if (!fTxIndex) return true;
+// Protected by cs_main
+VersionBitsCache versionbitscache;
 
-    CDiskTxPos pos(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
-    std::vector<std::pair<uint256, CDiskTxPos> > vPos;
-    vPos.reserve(block.vtx.size());
-    for (const CTransactionRef& tx : block.vtx)
-    {
-        vPos.push_back(std::make_pair(tx->GetHash(), pos));
-        pos.nTxOffset += ::GetSerializeSize(*tx, SER_DISK, CLIENT_VERSION);
-    }
+int32_t ComputeBlockVersion(const CBlockIndex* pindexPrev, const Consensus::Params& params)
+{
+    LOCK(cs_main);
+    int32_t nVersion = VERSIONBITS_TOP_BITS;
 
-    if (!pblocktree->WriteTxIndex(vPos)) {
-        return AbortNode(state, "Failed to write transaction index");
+    for (int i = 0; i < (int)Consensus::MAX_VERSION_BITS_DEPLOYMENTS; i++) {
+        ThresholdState state = VersionBitsState(pindexPrev, params, (Consensus::DeploymentPos)i, versionbitscache);
+        if (state == THRESHOLD_LOCKED_IN || state == THRESHOLD_STARTED) {
+            nVersion |= VersionBitsMask(params, (Consensus::DeploymentPos)i);
+        }
     }
 
-    return true;
-}
-
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
-
-void ThreadScriptCheck() {
-    RenameThread("bitcoin-scriptch");
-    scriptcheckqueue.Thread();
-}
-
-// Protected by cs_main
-VersionBitsCache versionbitscache;
-
-int32_t ComputeBlockVersion(const CBlockIndex* pindexPrev, const Consensus::Params& params)
-{
-    LOCK(cs_main);
-    int32_t nVersion = VERSIONBITS_TOP_BITS;
-
-    for (int i = 0; i < (int)Consensus::MAX_VERSION_BITS_DEPLOYMENTS; i++) {
-        ThresholdState state = VersionBitsState(pindexPrev, params, (Consensus::DeploymentPos)i, versionbitscache);
-        if (state == THRESHOLD_LOCKED_IN || state == THRESHOLD_STARTED) {
-            nVersion |= VersionBitsMask(params, (Consensus::DeploymentPos)i);
-        }
-    }
-
-    return nVersion;
+    return nVersion;
 }
 
 /**
@@ -2077,9 +2393,6 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
         setDirtyBlockIndex.insert(pindex);
     }
 
-    if (!WriteTxIndexDataForBlock(block, state, pindex))
-        return false;
-
     assert(pindex->phashBlock);
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
@@ -2093,6 +2406,71 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     return true;
 }
 
+/**
+ * Snapshot the block index, so that it can be loaded with a single read at
+ * the next startup. Must only be called right after the block index was
+ * written to the database, so that the two match.
+ */
+static bool WriteBlockIndexSnapshot()
+{
+    AssertLockHeld(cs_main);
+    int64_t nStart = GetTimeMicros();
+
+    std::vector<CBlockIndex*> vSorted;
+    vSorted.reserve(mapBlockIndex.size());
+    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex) {
+        vSorted.push_back(item.second);
+    }
+    std::sort(vSorted.begin(), vSorted.end(), [](const CBlockIndex* a, const CBlockIndex* b) {
+        return a->nHeight < b->nHeight;
+    });
+    std::unordered_map<const CBlockIndex*, int32_t> positions;
+    positions.reserve(vSorted.size());
+
+    std::vector<BlockIndexSnapshotEntry> entries(vSorted.size());
+    for (size_t i = 0; i < vSorted.size(); ++i) {
+        const CBlockIndex* pindex = vSorted[i];
+        BlockIndexSnapshotEntry& entry = entries[i];
+        entry.prev = -1;
+        entry.skip = -1;
+        if (pindex->pprev) {
+            auto it = positions.find(pindex->pprev);
+            if (it == positions.end()) {
+                return error("%s: block %s has no predecessor in the block index", __func__, pindex->GetBlockHash().ToString());
+            }
+            entry.prev = it->second;
+        }
+        if (pindex->pskip) {
+            auto it = positions.find(pindex->pskip);
+            if (it == positions.end()) {
+                return error("%s: block %s has no skip block in the block index", __func__, pindex->GetBlockHash().ToString());
+            }
+            entry.skip = it->second;
+        }
+        entry.hash        = pindex->GetBlockHash();
+        entry.height      = pindex->nHeight;
+        entry.file        = pindex->nFile;
+        entry.data_pos    = pindex->nDataPos;
+        entry.undo_pos    = pindex->nUndoPos;
+        entry.tx_count    = pindex->nTx;
+        entry.status      = pindex->nStatus;
+        entry.version     = pindex->nVersion;
+        entry.merkle_root = pindex->hashMerkleRoot;
+        entry.time        = pindex->nTime;
+        entry.bits        = pindex->nBits;
+        entry.nonce       = pindex->nNonce;
+        entry.chain_work  = ArithToUint256(pindex->nChainWork);
+        entry.time_max    = pindex->nTimeMax;
+        positions.emplace(pindex, i);
+    }
+
+    if (!pblocktree->WriteBlockIndexSnapshot(entries, pcoinsTip->GetBestBlock())) {
+        return false;
+    }
+    LogPrint(BCLog::BENCH, "Wrote block index snapshot of %u entries (%.2fms)\n", entries.size(), (GetTimeMicros() - nStart) * 0.001);
+    return true;
+}
+
 /**
  * Update the on-disk chain state.
  * The caches and indexes are flushed depending on the mode we're called with
@@ -2105,7 +2483,10 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
     static int64_t nLastWrite = 0;
     static int64_t nLastFlush = 0;
     static int64_t nLastSetChain = 0;
+    static int64_t nLastIndexSnapshot = 0;
+    static bool fIndexChangedSinceSnapshot = true;
     std::set<int> setFilesToPrune;
+    std::set<int> setUndoFilesToPrune;
     bool fFlushForPrune = false;
     bool fDoFullFlush = false;
     int64_t nNow = 0;
@@ -2116,10 +2497,10 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             if (nManualPruneHeight > 0) {
                 FindFilesToPruneManual(setFilesToPrune, nManualPruneHeight);
             } else {
-                FindFilesToPrune(setFilesToPrune, chainparams.PruneAfterHeight());
+                FindFilesToPrune(setFilesToPrune, setUndoFilesToPrune, chainparams.PruneAfterHeight());
                 fCheckForPruning = false;
             }
-            if (!setFilesToPrune.empty()) {
+            if (!setFilesToPrune.empty() || !setUndoFilesToPrune.empty()) {
                 fFlushForPrune = true;
                 if (!fHavePruned) {
                     pblocktree->WriteFlag("prunedblockfiles", true);
@@ -2138,8 +2519,12 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
         if (nLastSetChain == 0) {
             nLastSetChain = nNow;
         }
+        if (nLastIndexSnapshot == 0) {
+            nLastIndexSnapshot = nNow;
+        }
         int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
-        int64_t cacheSize = pcoinsTip->DynamicMemoryUsage();
+        // Entries a background flush has yet to write are still in memory.
+        int64_t cacheSize = pcoinsTip->DynamicMemoryUsage() + pcoinsdbview->PendingMemoryUsage();
         int64_t nTotalSpace = nCoinCacheUsage + std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
         // The cache is large and we're within 10% and 10 MiB of the limit, but we have time now (not in the middle of a block processing).
         bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize > std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024);
@@ -2172,13 +2557,19 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
                     vBlocks.push_back(*it);
                     setDirtyBlockIndex.erase(it++);
                 }
-                if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks)) {
+                if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile, vBlocks, pcoinsTip->GetBestBlock())) {
                     return AbortNode(state, "Failed to write to block index database");
                 }
+                fIndexChangedSinceSnapshot |= !vBlocks.empty();
+            }
+            // The block index matches the database now, which is when it can
+            // be snapshotted: at shutdown, and once in a while in case of a crash.
+            if (fIndexChangedSinceSnapshot && (mode == FLUSH_STATE_ALWAYS || nNow > nLastIndexSnapshot + (int64_t)BLOCK_INDEX_SNAPSHOT_INTERVAL * 1000000)) {
+                if (WriteBlockIndexSnapshot()) {
+                    fIndexChangedSinceSnapshot = false;
+                }
+                nLastIndexSnapshot = nNow;
             }
-            // Finally remove any pruned files
-            if (fFlushForPrune)
-                UnlinkPrunedFiles(setFilesToPrune);
             nLastWrite = nNow;
         }
         // Flush best chain related state. This can only be done if the blocks / block index write was also done.
@@ -2191,10 +2582,22 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
             // Flush the chainstate (which may refer to block index entries).
-            if (!pcoinsTip->Flush())
+            // Unless we are shutting down or about to delete block files that
+            // a replay after a crash would need, let the coin database write
+            // in the background; it keeps serving the flushed entries until
+            // they are on disk, and the head blocks marker keeps a partial
+            // write recoverable.
+            bool fBackground = mode != FLUSH_STATE_ALWAYS && !fFlushForPrune && gArgs.GetBoolArg("-dbbackgroundflush", DEFAULT_DB_BACKGROUND_FLUSH);
+            if (!pcoinsTip->Flush(fBackground))
                 return AbortNode(state, "Failed to write to coin database");
             nLastFlush = nNow;
         }
+        // Finally remove any pruned files, which neither the block index nor
+        // the chainstate on disk refer to anymore.
+        if (fFlushForPrune) {
+            RemovePrunedFilesInBackground(setFilesToPrune, false);
+            RemovePrunedFilesInBackground(setUndoFilesToPrune, true);
+        }
     }
     if (fDoFullFlush || ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000)) {
         // Update best block in wallet (so we can detect restored wallets).
@@ -2282,7 +2685,7 @@ void static UpdateTip(const CBlockIndex *pindexNew, const CChainParams& chainPar
       chainActive.Tip()->GetAlgo(), GetAlgoName(chainActive.Tip()->GetAlgo(), chainActive.Tip()->nVersion, chainParams.GetConsensus()),
       log(pindexNew->nChainWork.getdouble())/log(2.0), (unsigned long)pindexNew->nChainTx,
       DateTimeStrFormat("%Y-%m-%d %H:%M:%S", pindexNew->GetBlockTime()),
-      GuessVerificationProgress(chainParams.TxData(), pindexNew), pcoinsTip->DynamicMemoryUsage() * (1.0 / (1<<20)), pcoinsTip->GetCacheSize());
+      GuessVerificationProgress(chainParams.TxData(), pindexNew), (pcoinsTip->DynamicMemoryUsage() + pcoinsdbview->PendingMemoryUsage()) * (1.0 / (1<<20)), pcoinsTip->GetCacheSize());
     if (!warningMessages.empty())
         LogPrintf(" warning='%s'", boost::algorithm::join(warningMessages, ", "));
     LogPrintf("\n");
@@ -3624,7 +4027,7 @@ void PruneOneBlockFile(const int fileNumber)
         CBlockIndex* pindex = entry.second;
         if (pindex->nFile == fileNumber) {
             pindex->nStatus &= ~BLOCK_HAVE_DATA;
-            pindex->nStatus &= ~BLOCK_HAVE_UNDO;
+            pindex->nStatus &= ~(BLOCK_HAVE_UNDO | BLOCK_UNDO_COMPACT);
             pindex->nFile = 0;
             pindex->nDataPos = 0;
             pindex->nUndoPos = 0;
@@ -3650,16 +4053,185 @@ void PruneOneBlockFile(const int fileNumber)
 }
 
 
+/* Prune the undo file of a block file, keeping the blocks themselves (modify associated database entries) */
+void PruneOneUndoFile(const int fileNumber)
+{
+    LOCK(cs_LastBlockFile);
+
+    for (const auto& entry : mapBlockIndex) {
+        CBlockIndex* pindex = entry.second;
+        if (pindex->nFile == fileNumber && (pindex->nStatus & BLOCK_HAVE_UNDO)) {
+            pindex->nStatus &= ~(BLOCK_HAVE_UNDO | BLOCK_UNDO_COMPACT);
+            pindex->nUndoPos = 0;
+            setDirtyBlockIndex.insert(pindex);
+        }
+    }
+
+    vinfoBlockFile[fileNumber].nUndoSize = 0;
+    setDirtyFileInfo.insert(fileNumber);
+}
+
+/** Delete the undo file, and unless fUndoOnly the block file, of a pruned block file. Returns the bytes freed. */
+static uint64_t RemovePrunedFile(int nFile, bool fUndoOnly)
+{
+    CDiskBlockPos pos(nFile, 0);
+    uint64_t nBytes = 0;
+    std::vector<fs::path> vPaths{GetBlockPosFilename(pos, "rev")};
+    if (!fUndoOnly) {
+        g_blockstore.ForgetFile(nFile);
+        vPaths.push_back(GetBlockPosFilename(pos, "blk"));
+    }
+    for (const fs::path& path : vPaths) {
+        boost::system::error_code ec;
+        const uint64_t nSize = fs::file_size(path, ec);
+        if (fs::remove(path, ec) && !ec) {
+            nBytes += nSize;
+        }
+    }
+    LogPrintf("Prune: %s deleted %s (%05u)\n", __func__, fUndoOnly ? "rev" : "blk/rev", nFile);
+    return nBytes;
+}
+
 void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
 {
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
-        CDiskBlockPos pos(*it, 0);
-        fs::remove(GetBlockPosFilename(pos, "blk"));
-        fs::remove(GetBlockPosFilename(pos, "rev"));
-        LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
+        RemovePrunedFile(*it, false);
+    }
+}
+
+void RemoveLeftoverPrunedFiles(const std::vector<CBlockFileInfo>& vinfo, int nLastFile)
+{
+    AssertLockHeld(cs_main);
+
+    std::set<int> setBlkDataFiles;
+    std::set<int> setRevDataFiles;
+    for (const auto& entry : mapBlockIndex) {
+        const CBlockIndex* pindex = entry.second;
+        if (pindex->nStatus & BLOCK_HAVE_DATA) {
+            setBlkDataFiles.insert(pindex->nFile);
+        }
+        if (pindex->nStatus & BLOCK_HAVE_UNDO) {
+            setRevDataFiles.insert(pindex->nFile);
+        }
+    }
+
+    for (int nFile = 0; nFile < nLastFile; nFile++) {
+        CDiskBlockPos pos(nFile, 0);
+        if (vinfo[nFile].nSize == 0 && !setBlkDataFiles.count(nFile) && fs::exists(GetBlockPosFilename(pos, "blk"))) {
+            RemovePrunedFile(nFile, false);
+        } else if (vinfo[nFile].nUndoSize == 0 && !setRevDataFiles.count(nFile) && fs::exists(GetBlockPosFilename(pos, "rev"))) {
+            RemovePrunedFile(nFile, true);
+        }
     }
 }
 
+namespace {
+
+/**
+ * Deletes pruned files on a thread of its own, so that a flush that prunes
+ * many files does not hold cs_main while the file system unlinks them.
+ * Files are only handed over once nothing on disk refers to them anymore;
+ * ones that were not deleted before a crash are removed at startup.
+ */
+class PrunedFileRemover
+{
+private:
+    CWaitableCriticalSection cs;
+    CConditionVariable cond;
+    //! Files waiting to be deleted, and whether only their undo file goes
+    std::deque<std::pair<int, bool>> queue;
+    PruneProgress progress;
+    std::thread thread;
+    bool fStop = false;
+
+    void ThreadRemove()
+    {
+        WaitableLock lock(cs);
+        while (true) {
+            cond.wait(lock, [this] { return fStop || !queue.empty(); });
+            if (queue.empty()) {
+                return;
+            }
+            const std::pair<int, bool> file = queue.front();
+            lock.unlock();
+            const uint64_t nBytes = RemovePrunedFile(file.first, file.second);
+            lock.lock();
+            queue.pop_front();
+            progress.nPendingFiles--;
+            progress.nRemovedFiles++;
+            progress.nRemovedBytes += nBytes;
+            cond.notify_all();
+        }
+    }
+
+public:
+    void Add(const std::set<int>& setFiles, bool fUndoOnly)
+    {
+        if (setFiles.empty()) {
+            return;
+        }
+        WaitableLock lock(cs);
+        for (int nFile : setFiles) {
+            queue.emplace_back(nFile, fUndoOnly);
+        }
+        progress.nPendingFiles += setFiles.size();
+        if (!thread.joinable()) {
+            thread = std::thread(&TraceThread<std::function<void()> >, "prunefiles", std::function<void()>(std::bind(&PrunedFileRemover::ThreadRemove, this)));
+        }
+        cond.notify_one();
+    }
+
+    void Wait()
+    {
+        WaitableLock lock(cs);
+        cond.wait(lock, [this] { return queue.empty() || !thread.joinable(); });
+    }
+
+    void Stop()
+    {
+        {
+            WaitableLock lock(cs);
+            fStop = true;
+        }
+        cond.notify_one();
+        if (thread.joinable()) {
+            thread.join();
+        }
+        WaitableLock lock(cs);
+        fStop = false;
+    }
+
+    PruneProgress GetProgress()
+    {
+        WaitableLock lock(cs);
+        return progress;
+    }
+};
+
+PrunedFileRemover g_pruned_file_remover;
+
+} // namespace
+
+void RemovePrunedFilesInBackground(const std::set<int>& setFiles, bool fUndoOnly)
+{
+    g_pruned_file_remover.Add(setFiles, fUndoOnly);
+}
+
+void WaitForPrunedFileRemoval()
+{
+    g_pruned_file_remover.Wait();
+}
+
+void StopPrunedFileRemoval()
+{
+    g_pruned_file_remover.Stop();
+}
+
+PruneProgress GetPruneProgress()
+{
+    return g_pruned_file_remover.GetProgress();
+}
+
 /* Calculate the block/rev files to delete based on height specified by user with RPC command pruneblockchain */
 static void FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPruneHeight)
 {
@@ -3697,15 +4269,18 @@ void PruneBlockFilesManual(int nManualPruneHeight)
  * (which in this case means the blockchain must be re-downloaded.)
  *
  * Pruning functions are called from FlushStateToDisk when the global fCheckForPruning flag has been set.
- * Block and undo files are deleted in lock-step (when blk00003.dat is deleted, so is rev00003.dat.)
+ * Block and undo files are deleted in lock-step (when blk00003.dat is deleted, so is rev00003.dat.), except that with
+ * -pruneundo undo files are deleted ahead of their block files to keep undo data below a target of its own.
  * Pruning cannot take place until the longest chain is at least a certain length (100000 on mainnet, 1000 on testnet, 1000 on regtest).
- * Pruning will never delete a block within a defined distance (currently 288) from the active chain's tip.
+ * Pruning will never delete a block within a defined distance (currently 288) from the active chain's tip, nor, with
+ * -prunekeepdays, a block from the last days before the tip.
  * The block index is updated by unsetting HAVE_DATA and HAVE_UNDO for any blocks that were stored in the deleted files.
  * A db flag records the fact that at least some block files have been pruned.
  *
- * @param[out]   setFilesToPrune   The set of file indices that can be unlinked will be returned
+ * @param[out]   setFilesToPrune       The set of file indices whose block and undo files can be unlinked will be returned
+ * @param[out]   setUndoFilesToPrune   The set of file indices whose undo files alone can be unlinked will be returned
  */
-static void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight)
+static void FindFilesToPrune(std::set<int>& setFilesToPrune, std::set<int>& setUndoFilesToPrune, uint64_t nPruneAfterHeight)
 {
     LOCK2(cs_main, cs_LastBlockFile);
     if (chainActive.Tip() == nullptr || nPruneTarget == 0) {
@@ -3716,40 +4291,66 @@ static void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfte
     }
 
     unsigned int nLastBlockWeCanPrune = chainActive.Tip()->nHeight - MIN_BLOCKS_TO_KEEP;
-    uint64_t nCurrentUsage = CalculateCurrentUsage();
-    // We don't check to prune until after we've allocated new space for files
-    // So we should leave a buffer under our target to account for another allocation
-    // before the next pruning.
-    uint64_t nBuffer = BLOCKFILE_CHUNK_SIZE + UNDOFILE_CHUNK_SIZE;
-    uint64_t nBytesToPrune;
-    int count=0;
-
-    if (nCurrentUsage + nBuffer >= nPruneTarget) {
-        for (int fileNumber = 0; fileNumber < nLastBlockFile; fileNumber++) {
-            nBytesToPrune = vinfoBlockFile[fileNumber].nSize + vinfoBlockFile[fileNumber].nUndoSize;
-
-            if (vinfoBlockFile[fileNumber].nSize == 0)
-                continue;
+    const int64_t nKeepAfterTime = nPruneKeepTime > 0 ? chainActive.Tip()->GetBlockTime() - nPruneKeepTime : std::numeric_limits<int64_t>::max();
+    SelectFilesToPrune(vinfoBlockFile, nLastBlockFile, nLastBlockWeCanPrune, nKeepAfterTime, nPruneTarget, nPruneUndoTarget,
+                       setFilesToPrune, setUndoFilesToPrune);
+    for (int fileNumber : setUndoFilesToPrune) {
+        PruneOneUndoFile(fileNumber);
+    }
+    for (int fileNumber : setFilesToPrune) {
+        PruneOneBlockFile(fileNumber);
+    }
 
-            if (nCurrentUsage + nBuffer < nPruneTarget)  // are we below our target?
-                break;
+    uint64_t nCurrentUsage = CalculateCurrentUsage();
+    LogPrint(BCLog::PRUNE, "Prune: target=%dMiB actual=%dMiB diff=%dMiB max_prune_height=%d removed %d blk/rev pairs and %d rev files\n",
+           nPruneTarget/1024/1024, nCurrentUsage/1024/1024,
+           ((int64_t)nPruneTarget - (int64_t)nCurrentUsage)/1024/1024,
+           nLastBlockWeCanPrune, setFilesToPrune.size(), setUndoFilesToPrune.size());
+}
 
-            // don't prune files that could have a block within MIN_BLOCKS_TO_KEEP of the main chain's tip but keep scanning
-            if (vinfoBlockFile[fileNumber].nHeightLast > nLastBlockWeCanPrune)
+void SelectFilesToPrune(const std::vector<CBlockFileInfo>& vinfo, int nLastFile, unsigned int nLastBlockWeCanPrune, int64_t nKeepAfterTime,
+                        uint64_t nTarget, uint64_t nUndoTarget, std::set<int>& setFilesToPrune, std::set<int>& setUndoFilesToPrune)
+{
+    auto fCanPrune = [&](const CBlockFileInfo& info) {
+        // don't prune files that could have a block within MIN_BLOCKS_TO_KEEP of the main chain's tip, or within the days to keep
+        return info.nHeightLast <= nLastBlockWeCanPrune && (int64_t)info.nTimeLast < nKeepAfterTime;
+    };
+    uint64_t nCurrentUsage = 0;
+    uint64_t nUndoUsage = 0;
+    for (const CBlockFileInfo& info : vinfo) {
+        nCurrentUsage += info.nSize + info.nUndoSize;
+        nUndoUsage += info.nUndoSize;
+    }
+
+    // Undo data past its own target goes first, leaving the blocks in place
+    if (nUndoTarget > 0) {
+        for (int fileNumber = 0; fileNumber < nLastFile && nUndoUsage + UNDOFILE_CHUNK_SIZE >= nUndoTarget; fileNumber++) {
+            const uint64_t nBytesToPrune = vinfo[fileNumber].nUndoSize;
+            if (nBytesToPrune == 0 || !fCanPrune(vinfo[fileNumber]))
                 continue;
 
-            PruneOneBlockFile(fileNumber);
-            // Queue up the files for removal
-            setFilesToPrune.insert(fileNumber);
+            setUndoFilesToPrune.insert(fileNumber);
+            nUndoUsage -= nBytesToPrune;
             nCurrentUsage -= nBytesToPrune;
-            count++;
         }
     }
 
-    LogPrint(BCLog::PRUNE, "Prune: target=%dMiB actual=%dMiB diff=%dMiB max_prune_height=%d removed %d blk/rev pairs\n",
-           nPruneTarget/1024/1024, nCurrentUsage/1024/1024,
-           ((int64_t)nPruneTarget - (int64_t)nCurrentUsage)/1024/1024,
-           nLastBlockWeCanPrune, count);
+    // We don't check to prune until after we've allocated new space for files
+    // So we should leave a buffer under our target to account for another allocation
+    // before the next pruning.
+    const uint64_t nBuffer = BLOCKFILE_CHUNK_SIZE + UNDOFILE_CHUNK_SIZE;
+    for (int fileNumber = 0; fileNumber < nLastFile && nCurrentUsage + nBuffer >= nTarget; fileNumber++) {
+        if (vinfo[fileNumber].nSize == 0 || !fCanPrune(vinfo[fileNumber]))
+            continue;
+
+        // An undo file chosen above has already been counted
+        uint64_t nBytesToPrune = vinfo[fileNumber].nSize;
+        if (setUndoFilesToPrune.erase(fileNumber) == 0) {
+            nBytesToPrune += vinfo[fileNumber].nUndoSize;
+        }
+        setFilesToPrune.insert(fileNumber);
+        nCurrentUsage -= nBytesToPrune;
+    }
 }
 
 bool CheckDiskSpace(uint64_t nAdditionalBytes)
@@ -3818,27 +4419,130 @@ CBlockIndex * CChainState::InsertBlockIndex(const uint256& hash)
     return pindexNew;
 }
 
-bool CChainState::LoadBlockIndex(const Consensus::Params& consensus_params, CBlockTreeDB& blocktree)
+bool CChainState::LoadBlockIndexSnapshot(CBlockTreeDB& blocktree, std::vector<CBlockIndex*>& vSorted)
 {
-    if (!blocktree.LoadBlockIndexGuts(consensus_params, [this](const uint256& hash){ return this->InsertBlockIndex(hash); }))
+    std::vector<BlockIndexSnapshotEntry> entries;
+    std::vector<CDiskBlockIndex> changed;
+    // The chainstate must be open, to tell whether it moved on from the snapshot.
+    if (!mapBlockIndex.empty() || !pcoinsdbview || !blocktree.ReadBlockIndexSnapshot(entries, changed, pcoinsdbview->GetBestBlock())) {
         return false;
+    }
 
-    boost::this_thread::interruption_point();
+    mapBlockIndex.reserve(entries.size() + changed.size());
+    vSorted.reserve(entries.size() + changed.size());
+    for (const BlockIndexSnapshotEntry& entry : entries) {
+        CBlockIndex* pindex = InsertBlockIndex(entry.hash);
+        pindex->pprev          = entry.prev < 0 ? nullptr : vSorted[entry.prev];
+        pindex->pskip          = entry.skip < 0 ? nullptr : vSorted[entry.skip];
+        pindex->nHeight        = entry.height;
+        pindex->nFile          = entry.file;
+        pindex->nDataPos       = entry.data_pos;
+        pindex->nUndoPos       = entry.undo_pos;
+        pindex->nTx            = entry.tx_count;
+        pindex->nStatus        = entry.status;
+        pindex->nVersion       = entry.version;
+        pindex->hashMerkleRoot = entry.merkle_root;
+        pindex->nTime          = entry.time;
+        pindex->nBits          = entry.bits;
+        pindex->nNonce         = entry.nonce;
+        pindex->nChainWork     = UintToArith256(entry.chain_work);
+        pindex->nTimeMax       = entry.time_max;
+        vSorted.push_back(pindex);
+    }
+
+    // Apply what was written to the database after the snapshot was taken:
+    // new blocks, and the new state of blocks in the snapshot. Headers never
+    // change, so the chain work of the blocks in the snapshot still holds.
+    std::sort(changed.begin(), changed.end(), [](const CDiskBlockIndex& a, const CDiskBlockIndex& b) {
+        return a.nHeight < b.nHeight;
+    });
+    bool fConsistent = mapBlockIndex.size() == entries.size();
+    for (const CDiskBlockIndex& diskindex : changed) {
+        if (!fConsistent) break;
+        CBlockIndex* pindex;
+        BlockMap::iterator mi = mapBlockIndex.find(diskindex.GetBlockHash());
+        if (mi != mapBlockIndex.end()) {
+            pindex = mi->second;
+        } else {
+            CBlockIndex* pindexPrev = nullptr;
+            if (!diskindex.hashPrev.IsNull()) {
+                BlockMap::iterator miPrev = mapBlockIndex.find(diskindex.hashPrev);
+                if (miPrev == mapBlockIndex.end()) {
+                    fConsistent = false;
+                    break;
+                }
+                pindexPrev = miPrev->second;
+            }
+            pindex = InsertBlockIndex(diskindex.GetBlockHash());
+            pindex->pprev          = pindexPrev;
+            pindex->nHeight        = diskindex.nHeight;
+            pindex->nVersion       = diskindex.nVersion;
+            pindex->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindex->nTime          = diskindex.nTime;
+            pindex->nBits          = diskindex.nBits;
+            pindex->nNonce         = diskindex.nNonce;
+            pindex->nChainWork     = (pindexPrev ? pindexPrev->nChainWork : 0) + GetBlockProof(*pindex);
+            pindex->nTimeMax       = pindexPrev ? std::max(pindexPrev->nTimeMax, pindex->nTime) : pindex->nTime;
+            if (pindexPrev)
+                pindex->BuildSkip();
+            vSorted.push_back(pindex);
+        }
+        pindex->nFile    = diskindex.nFile;
+        pindex->nDataPos = diskindex.nDataPos;
+        pindex->nUndoPos = diskindex.nUndoPos;
+        pindex->nTx      = diskindex.nTx;
+        pindex->nStatus  = diskindex.nStatus;
+    }
+
+    if (!fConsistent) {
+        LogPrintf("%s: the block index snapshot is inconsistent\n", __func__);
+        for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex) {
+            delete item.second;
+        }
+        mapBlockIndex.clear();
+        vSorted.clear();
+        return false;
+    }
+    LogPrintf("%s: loaded %u entries, %u of them changed since the snapshot\n", __func__, vSorted.size(), changed.size());
+    return true;
+}
 
-    // Calculate nChainWork
-    std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
-    vSortedByHeight.reserve(mapBlockIndex.size());
-    for (const std::pair<uint256, CBlockIndex*>& item : mapBlockIndex)
-    {
-        CBlockIndex* pindex = item.second;
-        vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
+bool CChainState::LoadBlockIndex(const Consensus::Params& consensus_params, CBlockTreeDB& blocktree)
+{
+    // Blocks in an order where each comes after its predecessor
+    std::vector<CBlockIndex*> vSorted;
+    const bool fFromSnapshot = LoadBlockIndexSnapshot(blocktree, vSorted);
+    if (!fFromSnapshot) {
+        if (!blocktree.LoadBlockIndexGuts(consensus_params, [this](const uint256& hash){ return this->InsertBlockIndex(hash); }))
+            return false;
+
+        boost::this_thread::interruption_point();
+
+        std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
+        vSortedByHeight.reserve(mapBlockIndex.size());
+        for (const std::pair<uint256, CBlockIndex*>& item : mapBlockIndex)
+        {
+            CBlockIndex* pindex = item.second;
+            vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
+        }
+        sort(vSortedByHeight.begin(), vSortedByHeight.end());
+        vSorted.reserve(vSortedByHeight.size());
+        for (const std::pair<int, CBlockIndex*>& item : vSortedByHeight) {
+            vSorted.push_back(item.second);
+        }
     }
-    sort(vSortedByHeight.begin(), vSortedByHeight.end());
-    for (const std::pair<int, CBlockIndex*>& item : vSortedByHeight)
+
+    boost::this_thread::interruption_point();
+
+    for (CBlockIndex* pindex : vSorted)
     {
-        CBlockIndex* pindex = item.second;
-        pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
-        pindex->nTimeMax = (pindex->pprev ? std::max(pindex->pprev->nTimeMax, pindex->nTime) : pindex->nTime);
+        // The snapshot keeps the chain work, maximum time and skip pointers.
+        if (!fFromSnapshot) {
+            pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
+            pindex->nTimeMax = (pindex->pprev ? std::max(pindex->pprev->nTimeMax, pindex->nTime) : pindex->nTime);
+            if (pindex->pprev)
+                pindex->BuildSkip();
+        }
         // We can link the chain of blocks for which we've received transactions at some point.
         // Pruned nodes may have deleted the block.
         if (pindex->nTx > 0) {
@@ -3861,8 +4565,6 @@ bool CChainState::LoadBlockIndex(const Consensus::Params& consensus_params, CBlo
             setBlockIndexCandidates.insert(pindex);
         if (pindex->nStatus & BLOCK_FAILED_MASK && (!pindexBestInvalid || pindex->nChainWork > pindexBestInvalid->nChainWork))
             pindexBestInvalid = pindex;
-        if (pindex->pprev)
-            pindex->BuildSkip();
         if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == nullptr || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
             pindexBestHeader = pindex;
     }
@@ -3912,18 +4614,17 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
 
     // Check whether we have ever pruned block & undo files
     pblocktree->ReadFlag("prunedblockfiles", fHavePruned);
-    if (fHavePruned)
+    if (fHavePruned) {
         LogPrintf("LoadBlockIndexDB(): Block files have previously been pruned\n");
 
+        RemoveLeftoverPrunedFiles(vinfoBlockFile, nLastBlockFile);
+    }
+
     // Check whether we need to continue reindexing
     bool fReindexing = false;
     pblocktree->ReadReindexing(fReindexing);
     if(fReindexing) fReindex = true;
 
-    // Check whether we have a transaction index
-    pblocktree->ReadFlag("txindex", fTxIndex);
-    LogPrintf("%s: transaction index %s\n", __func__, fTxIndex ? "enabled" : "disabled");
-
     return true;
 }
 
@@ -4001,6 +4702,12 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
             LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
             break;
         }
+        if (fPruneMode && nCheckLevel >= 3 && pindex == pindexState && !(pindex->nStatus & BLOCK_HAVE_UNDO)) {
+            // With -pruneundo, blocks outlive their undo data, without which
+            // they cannot be disconnected.
+            LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no undo data)\n", pindex->nHeight);
+            break;
+        }
         CBlock block;
         // check level 0: read from disk
         if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
@@ -4019,7 +4726,7 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
             }
         }
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
-        if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
+        if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage() + pcoinsdbview->PendingMemoryUsage()) <= nCoinCacheUsage) {
             assert(coins.GetBestBlock() == pindex->GetBlockHash());
             DisconnectResult res = g_chainstate.DisconnectBlock(block, pindex, coins);
             if (res == DISCONNECT_FAILED) {
@@ -4199,7 +4906,7 @@ bool CChainState::RewindBlockIndex(const CChainParams& params)
             // Reduce validity
             pindexIter->nStatus = std::min<unsigned int>(pindexIter->nStatus & BLOCK_VALID_MASK, BLOCK_VALID_TREE) | (pindexIter->nStatus & ~BLOCK_VALID_MASK);
             // Remove have-data flags.
-            pindexIter->nStatus &= ~(BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO);
+            pindexIter->nStatus &= ~(BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO | BLOCK_UNDO_COMPACT);
             // Remove storage location.
             pindexIter->nFile = 0;
             pindexIter->nDataPos = 0;
@@ -4307,9 +5014,6 @@ bool LoadBlockIndex(const CChainParams& chainparams)
         // needs_init.
 
         LogPrintf("Initializing databases...\n");
-        // Use the provided setting for -txindex in the new database
-        fTxIndex = gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX);
-        pblocktree->WriteFlag("txindex", fTxIndex);
     }
     return true;
 }
@@ -4677,7 +5381,215 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
     return VersionBitsStateSinceHeight(chainActive.Tip(), params, pos, versionbitscache);
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+/** mempool.dat with the transactions alone, as written before version 2 */
+static const uint64_t MEMPOOL_DUMP_VERSION_NO_METADATA = 1;
+/** Older versions do not read version 2 files, and start with an empty mempool */
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
+
+/** Number of mempool.dat entries LoadMempool checks and adds under one hold of cs_main */
+static const size_t MEMPOOL_LOAD_BATCH_SIZE = 1000;
+
+/**
+ * A transaction in mempool.dat, with what the mempool knew about it.
+ * Entries are written ancestors first, so a batch of them can be added
+ * in file order.
+ */
+struct MempoolDumpEntry
+{
+    CTransactionRef tx;
+    int64_t nTime;
+    int64_t nFeeDelta;
+    CAmount nFee;
+    int64_t nSigOpCost;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(tx);
+        READWRITE(nTime);
+        READWRITE(nFeeDelta);
+        READWRITE(nFee);
+        READWRITE(nSigOpCost);
+    }
+};
+
+struct MempoolLoadStats
+{
+    int64_t count = 0;
+    int64_t expired = 0;
+    int64_t failed = 0;
+    int64_t already_there = 0;
+};
+
+static void LoadMempoolTx(const CChainParams& chainparams, const CTransactionRef& tx, int64_t nTime, MempoolLoadStats& stats)
+{
+    CValidationState state;
+    LOCK(cs_main);
+    AcceptToMemoryPoolWithTime(chainparams, mempool, state, tx, nullptr /* pfMissingInputs */, nTime,
+                               nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */);
+    if (state.IsValid()) {
+        ++stats.count;
+    } else {
+        // mempool may contain the transaction already, e.g. from
+        // wallet(s) having loaded it while we were processing
+        // mempool transactions; consider these as valid, instead of
+        // failed, but mark them as 'already there'
+        if (mempool.exists(tx->GetHash())) {
+            ++stats.already_there;
+        } else {
+            ++stats.failed;
+        }
+    }
+}
+
+/**
+ * Add a batch of mempool.dat entries. The inputs of all of them are looked
+ * up first and their scripts handed to the script check threads, and those
+ * that pass are then added to the mempool one after the other, once the fee
+ * floors and the script flags of the tip are checked as AcceptToMemoryPool
+ * checks them. An entry
+ * that does not take that path (a missing input, a conflict, a check that
+ * fails, metadata that no longer matches) goes through AcceptToMemoryPool
+ * afterwards, with the signature cache warm by then.
+ */
+static void LoadMempoolBatch(const CChainParams& chainparams, const std::vector<MempoolDumpEntry>& batch, MempoolLoadStats& stats)
+{
+    struct Candidate {
+        size_t nIndex;
+        bool fSpendsCoinbase;
+        PrecomputedTransactionData* txdata;
+    };
+    std::vector<Candidate> vCandidates;
+    std::vector<size_t> vSlow;
+
+    {
+        LOCK2(cs_main, mempool.cs);
+        const bool witnessEnabled = IsWitnessEnabled(chainActive.Tip(), chainparams.GetConsensus());
+        CCoinsViewMemPool viewMemPool(pcoinsTip.get(), mempool);
+        CCoinsViewCache view(&viewMemPool);
+        const int nSpendHeight = GetSpendHeight(view);
+
+        // The script checks point into these, so they must not move
+        std::deque<PrecomputedTransactionData> txdata;
+        CCheckQueueControl<CScriptCheck> control(nScriptCheckThreads ? &scriptcheckqueue : nullptr);
+        for (size_t i = 0; i < batch.size(); ++i) {
+            const CTransaction& tx = *batch[i].tx;
+            CValidationState state;
+            std::string reason;
+            if (!CheckTransaction(tx, state) || tx.IsCoinBase() ||
+                (tx.HasWitness() && !witnessEnabled) ||
+                (fRequireStandard && !IsStandardTx(tx, reason, witnessEnabled)) ||
+                ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS) < MIN_STANDARD_TX_NONWITNESS_SIZE ||
+                !CheckFinalTx(tx, STANDARD_LOCKTIME_VERIFY_FLAGS) || mempool.exists(tx.GetHash())) {
+                vSlow.push_back(i);
+                continue;
+            }
+
+            // Inputs spent in the mempool are left to the replacement rules
+            bool fHaveInputs = true;
+            bool fSpendsCoinbase = false;
+            for (const CTxIn& txin : tx.vin) {
+                if (mempool.mapNextTx.count(txin.prevout) || !view.HaveCoin(txin.prevout)) {
+                    fHaveInputs = false;
+                    break;
+                }
+                fSpendsCoinbase |= view.AccessCoin(txin.prevout).IsCoinBase();
+            }
+            if (!fHaveInputs) {
+                vSlow.push_back(i);
+                continue;
+            }
+
+            CAmount nFee = 0;
+            if (!Consensus::CheckTxInputs(tx, state, view, nSpendHeight, nFee) || nFee != batch[i].nFee ||
+                GetTransactionSigOpCost(tx, view, STANDARD_SCRIPT_VERIFY_FLAGS) != batch[i].nSigOpCost ||
+                batch[i].nSigOpCost > MAX_STANDARD_TX_SIGOPS_COST ||
+                (fRequireStandard && !AreInputsStandard(tx, view)) ||
+                (fRequireStandard && tx.HasWitness() && !IsWitnessStandard(tx, view))) {
+                vSlow.push_back(i);
+                continue;
+            }
+
+            // Without script check threads CheckInputs runs the scripts itself
+            txdata.emplace_back(tx);
+            std::vector<CScriptCheck> vChecks;
+            if (!CheckInputs(tx, state, view, true, STANDARD_SCRIPT_VERIFY_FLAGS, true, false, txdata.back(), nScriptCheckThreads ? &vChecks : nullptr)) {
+                vSlow.push_back(i);
+                continue;
+            }
+            control.Add(vChecks);
+
+            // Later entries in the batch may spend the outputs
+            UpdateCoins(tx, view, MEMPOOL_HEIGHT);
+            vCandidates.push_back(Candidate{i, fSpendsCoinbase, &txdata.back()});
+        }
+
+        if (!control.Wait()) {
+            // The queue does not tell which one failed
+            for (const Candidate& candidate : vCandidates) {
+                vSlow.push_back(candidate.nIndex);
+            }
+            vCandidates.clear();
+        }
+
+        size_t nLimitAncestors = gArgs.GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
+        size_t nLimitAncestorSize = gArgs.GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT)*1000;
+        size_t nLimitDescendants = gArgs.GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
+        size_t nLimitDescendantSize = gArgs.GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT)*1000;
+        const size_t nMaxMempool = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
+        const unsigned int currentBlockScriptVerifyFlags = GetBlockScriptFlags(chainActive.Tip(), chainparams.GetConsensus());
+        // Coins as AcceptToMemoryPool would see them, with the parents from
+        // earlier in the batch in the mempool and nothing spent by the batch
+        CCoinsViewCache viewAccept(&viewMemPool);
+        // Entries that spend one left out here are left out too
+        std::set<uint256> setLeftOut;
+        for (const Candidate& candidate : vCandidates) {
+            const MempoolDumpEntry& dumped = batch[candidate.nIndex];
+            const uint256& hash = dumped.tx->GetHash();
+            bool fParentLeftOut = false;
+            for (const CTxIn& txin : dumped.tx->vin) {
+                fParentLeftOut |= setLeftOut.count(txin.prevout.hash) > 0;
+            }
+
+            // Parents from earlier in the batch are in the mempool by now
+            LockPoints lp;
+            if (fParentLeftOut || !CheckSequenceLocks(*dumped.tx, STANDARD_LOCKTIME_VERIFY_FLAGS, &lp)) {
+                setLeftOut.insert(hash);
+                vSlow.push_back(candidate.nIndex);
+                continue;
+            }
+            CTxMemPoolEntry entry(dumped.tx, dumped.nFee, dumped.nTime, chainActive.Height(),
+                                  candidate.fSpendsCoinbase, dumped.nSigOpCost, lp);
+            CAmount nModifiedFees = dumped.nFee;
+            mempool.ApplyDelta(hash, nModifiedFees);
+            const CAmount mempoolRejectFee = mempool.GetMinFee(nMaxMempool).GetFee(entry.GetTxSize());
+            CTxMemPool::setEntries setAncestors;
+            std::string errString;
+            CValidationState state;
+            if (nModifiedFees < ::minRelayTxFee.GetFee(entry.GetTxSize()) ||
+                (mempoolRejectFee > 0 && nModifiedFees < mempoolRejectFee) ||
+                !CheckInputsFromMempoolAndCache(*dumped.tx, state, viewAccept, mempool, currentBlockScriptVerifyFlags, true, *candidate.txdata) ||
+                !mempool.CalculateMemPoolAncestors(entry, setAncestors, nLimitAncestors, nLimitAncestorSize, nLimitDescendants, nLimitDescendantSize, errString)) {
+                setLeftOut.insert(hash);
+                vSlow.push_back(candidate.nIndex);
+                continue;
+            }
+            mempool.addUnchecked(hash, entry, setAncestors, false);
+            GetMainSignals().TransactionAddedToMempool(dumped.tx);
+            ++stats.count;
+        }
+
+        if (!vCandidates.empty()) {
+            LimitMempoolSize(mempool, nMaxMempool, gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+        }
+    }
+
+    std::sort(vSlow.begin(), vSlow.end());
+    for (size_t i : vSlow) {
+        LoadMempoolTx(chainparams, batch[i].tx, batch[i].nTime, stats);
+    }
+}
 
 bool LoadMempool(void)
 {
@@ -4690,52 +5602,42 @@ bool LoadMempool(void)
         return false;
     }
 
-    int64_t count = 0;
-    int64_t expired = 0;
-    int64_t failed = 0;
-    int64_t already_there = 0;
+    MempoolLoadStats stats;
     int64_t nNow = GetTime();
 
     try {
         uint64_t version;
         file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
+        if (version != MEMPOOL_DUMP_VERSION && version != MEMPOOL_DUMP_VERSION_NO_METADATA) {
             return false;
         }
         uint64_t num;
         file >> num;
+        std::vector<MempoolDumpEntry> batch;
         while (num--) {
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-
-            CAmount amountdelta = nFeeDelta;
+            MempoolDumpEntry dumped;
+            if (version == MEMPOOL_DUMP_VERSION) {
+                file >> dumped;
+            } else {
+                file >> dumped.tx;
+                file >> dumped.nTime;
+                file >> dumped.nFeeDelta;
+            }
+
+            CAmount amountdelta = dumped.nFeeDelta;
             if (amountdelta) {
-                mempool.PrioritiseTransaction(tx->GetHash(), amountdelta);
+                mempool.PrioritiseTransaction(dumped.tx->GetHash(), amountdelta);
             }
-            CValidationState state;
-            if (nTime + nExpiryTimeout > nNow) {
-                LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(chainparams, mempool, state, tx, nullptr /* pfMissingInputs */, nTime,
-                                           nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */);
-                if (state.IsValid()) {
-                    ++count;
-                } else {
-                    // mempool may contain the transaction already, e.g. from
-                    // wallet(s) having loaded it while we were processing
-                    // mempool transactions; consider these as valid, instead of
-                    // failed, but mark them as 'already there'
-                    if (mempool.exists(tx->GetHash())) {
-                        ++already_there;
-                    } else {
-                        ++failed;
-                    }
-                }
+            if (dumped.nTime + nExpiryTimeout <= nNow) {
+                ++stats.expired;
+            } else if (version == MEMPOOL_DUMP_VERSION) {
+                batch.push_back(std::move(dumped));
             } else {
-                ++expired;
+                LoadMempoolTx(chainparams, dumped.tx, dumped.nTime, stats);
+            }
+            if (batch.size() == MEMPOOL_LOAD_BATCH_SIZE || (!num && !batch.empty())) {
+                LoadMempoolBatch(chainparams, batch, stats);
+                batch.clear();
             }
             if (ShutdownRequested())
                 return false;
@@ -4751,7 +5653,7 @@ bool LoadMempool(void)
         return false;
     }
 
-    LogPrintf("Imported mempool transactions from disk: %i succeeded, %i failed, %i expired, %i already there\n", count, failed, expired, already_there);
+    LogPrintf("Imported mempool transactions from disk: %i succeeded, %i failed, %i expired, %i already there\n", stats.count, stats.failed, stats.expired, stats.already_there);
     return true;
 }
 
@@ -4767,6 +5669,7 @@ bool DumpMempool(void)
         for (const auto &i : mempool.mapDeltas) {
             mapDeltas[i.first] = i.second;
         }
+        // Sorted by ancestor count, so parents come before their children
         vinfo = mempool.infoAll();
     }
 
@@ -4785,9 +5688,7 @@ bool DumpMempool(void)
 
         file << (uint64_t)vinfo.size();
         for (const auto& i : vinfo) {
-            file << *(i.tx);
-            file << (int64_t)i.nTime;
-            file << (int64_t)i.nFeeDelta;
+            file << MempoolDumpEntry{i.tx, i.nTime, i.nFeeDelta, i.nFee, i.nSigOpCost};
             mapDeltas.erase(i.tx->GetHash());
         }
 
@@ -4804,6 +5705,135 @@ bool DumpMempool(void)
     return true;
 }
 
+static const uint64_t SIGCACHE_DUMP_VERSION = 1;
+
+static void ReadCacheEntries(CHashVerifier<CAutoFile>& verifier, std::vector<uint256>& entries)
+{
+    uint64_t num;
+    verifier >> num;
+    while (num--) {
+        uint256 entry;
+        verifier >> entry;
+        entries.push_back(entry);
+    }
+}
+
+static void WriteCacheEntries(CDataStream& stream, const std::vector<uint256>& entries)
+{
+    stream << (uint64_t)entries.size();
+    for (const uint256& entry : entries) {
+        stream << entry;
+    }
+}
+
+bool LoadScriptCaches()
+{
+    int64_t start = GetTimeMicros();
+    FILE* filestr = fsbridge::fopen(GetDataDir() / "sigcache.dat", "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open signature cache file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    uint256 sigNonce, scriptNonce;
+    std::vector<uint256> sigEntries, scriptEntries;
+    int nClientVersion;
+    try {
+        CHashVerifier<CAutoFile> verifier(&file);
+        uint64_t version;
+        verifier >> version;
+        if (version != SIGCACHE_DUMP_VERSION) {
+            LogPrintf("Signature cache file has unknown version %u. Continuing anyway.\n", version);
+            return false;
+        }
+        verifier >> nClientVersion;
+        verifier >> sigNonce >> scriptNonce;
+        if (sigNonce.IsNull() || scriptNonce.IsNull()) {
+            LogPrintf("Signature cache file has an invalid salt. Continuing anyway.\n");
+            return false;
+        }
+        ReadCacheEntries(verifier, sigEntries);
+        ReadCacheEntries(verifier, scriptEntries);
+        uint256 hashTmp;
+        file >> hashTmp;
+        if (hashTmp != verifier.GetHash()) {
+            LogPrintf("Signature cache file checksum mismatch. Continuing anyway.\n");
+            return false;
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize signature cache data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+
+    // A script execution cache entry vouches for the whole interpreter, not
+    // just the ECDSA check, so only trust it from the build that wrote it.
+    if (nClientVersion != CLIENT_VERSION) {
+        scriptEntries.clear();
+    }
+    {
+        LOCK(cs_main);
+        // Entries already cached were computed under the current salt, and
+        // would no longer be found under another.
+        if ((scriptNonce != scriptExecutionCacheNonce && !scriptExecutionCache.live_elements().empty()) ||
+            !LoadSignatureCache(sigNonce, sigEntries)) {
+            LogPrintf("Signature cache file has a different salt than the caches in use. Continuing anyway.\n");
+            return false;
+        }
+        scriptExecutionCacheNonce = scriptNonce;
+        for (const uint256& entry : scriptEntries) {
+            scriptExecutionCache.insert(entry);
+        }
+    }
+
+    LogPrintf("Imported signature cache from disk: %u signature and %u script execution entries in %dms\n",
+              sigEntries.size(), scriptEntries.size(), (GetTimeMicros() - start) / 1000);
+    return true;
+}
+
+bool DumpScriptCaches()
+{
+    int64_t start = GetTimeMicros();
+
+    uint256 sigNonce, scriptNonce;
+    std::vector<uint256> sigEntries, scriptEntries;
+    DumpSignatureCache(sigNonce, sigEntries);
+    {
+        LOCK(cs_main);
+        scriptNonce = scriptExecutionCacheNonce;
+        scriptEntries = scriptExecutionCache.live_elements();
+    }
+
+    int64_t mid = GetTimeMicros();
+
+    try {
+        CDataStream stream(SER_DISK, CLIENT_VERSION);
+        stream << SIGCACHE_DUMP_VERSION;
+        stream << CLIENT_VERSION;
+        stream << sigNonce << scriptNonce;
+        WriteCacheEntries(stream, sigEntries);
+        WriteCacheEntries(stream, scriptEntries);
+        stream << Hash(stream.begin(), stream.end());
+
+        FILE* filestr = fsbridge::fopen(GetDataDir() / "sigcache.dat.new", "wb");
+        if (!filestr) {
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        file << stream;
+        FileCommit(file.Get());
+        file.fclose();
+        RenameOver(GetDataDir() / "sigcache.dat.new", GetDataDir() / "sigcache.dat");
+        int64_t last = GetTimeMicros();
+        LogPrintf("Dumped signature cache: %gs to copy, %gs to dump\n", (mid-start)*MICRO, (last-mid)*MICRO);
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump signature cache: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
 //! Guess how far we are in the verification process at the given block index
 double GuessVerificationProgress(const ChainTxData& data, const CBlockIndex *pindex) {
     if (pindex == nullptr)
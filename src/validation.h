@@ -31,7 +31,9 @@
 
 #include <atomic>
 
+class CBlockFileInfo;
 class CBlockIndex;
+class CBlockUndo;
 class CBlockTreeDB;
 class CChainParams;
 class CCoinsViewDB;
@@ -41,6 +43,7 @@ class CScriptCheck;
 class CBlockPolicyEstimator;
 class CTxMemPool;
 class CValidationState;
+class RawBlock;
 struct ChainTxData;
 
 struct PrecomputedTransactionData;
@@ -76,9 +79,14 @@ static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 /** The pre-allocation chunk size for rev?????.dat files (since 0.8) */
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
+/** The maximum amount of undo data buffered before it is written to rev?????.dat files */
+static const unsigned int MAX_UNDO_BUFFER_SIZE = 0x1000000; // 16 MiB
 
 /** Maximum number of script-checking threads allowed */
 static const int MAX_SCRIPTCHECK_THREADS = 16;
+/** Transactions with at least this many inputs have their scripts checked on
+ *  the script check threads when accepted to the mempool */
+static const unsigned int MEMPOOL_PARALLEL_SCRIPT_CHECK_INPUTS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
 /** Number of blocks that can be requested at any given time from a single peer. */
@@ -112,6 +120,8 @@ static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
 static const unsigned int DATABASE_FLUSH_INTERVAL = 24 * 60 * 60;
+/** Time to wait (in seconds) between snapshots of the block index. */
+static const unsigned int BLOCK_INDEX_SNAPSHOT_INTERVAL = 24 * 60 * 60;
 /** Maximum length of reject messages. */
 static const unsigned int MAX_REJECT_MESSAGE_LENGTH = 111;
 /** Average delay between local address broadcasts in seconds. */
@@ -141,9 +151,16 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
+static const bool DEFAULT_ADDRESSINDEX = false;
+static const bool DEFAULT_SPENTINDEX = false;
+static const char* const DEFAULT_BLOCKFILTERINDEX = "0";
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
+/** Default for -persistsigcache */
+static const bool DEFAULT_PERSIST_SIGCACHE = false;
+/** Default for -compactundo */
+static const bool DEFAULT_COMPACT_UNDO = false;
 /** Default for -mempoolreplacement */
 static const bool DEFAULT_ENABLE_REPLACEMENT = true;
 /** Default for using fee filter */
@@ -156,6 +173,7 @@ static const unsigned int MAX_BLOCKS_TO_ANNOUNCE = 8;
 static const int MAX_UNCONNECTING_HEADERS = 10;
 
 static const bool DEFAULT_PEERBLOOMFILTERS = true;
+static const bool DEFAULT_PEERBLOCKFILTERS = false;
 
 /** Default for -stopatheight */
 static const int DEFAULT_STOPATHEIGHT = 0;
@@ -180,11 +198,12 @@ extern uint256 hashBestBlock;
 extern std::atomic_bool fImporting;
 extern std::atomic_bool fReindex;
 extern int nScriptCheckThreads;
-extern bool fTxIndex;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
+/** Whether undo data is written in the compact format, which older versions cannot read */
+extern bool fCompactUndo;
 extern size_t nCoinCacheUsage;
 /** A fee rate smaller than this is considered zero fee (for relaying, mining and transaction creation) */
 extern CFeeRate minRelayTxFee;
@@ -213,6 +232,10 @@ extern bool fHavePruned;
 extern bool fPruneMode;
 /** Number of MiB of block files that we're trying to stay below. */
 extern uint64_t nPruneTarget;
+/** Number of bytes of undo files that we're trying to stay below, if non-zero. */
+extern uint64_t nPruneUndoTarget;
+/** Block files with blocks up to this many seconds older than the tip are not pruned automatically. */
+extern int64_t nPruneKeepTime;
 /** Block files containing a block-height within MIN_BLOCKS_TO_KEEP of chainActive.Tip() will not be pruned. */
 static const unsigned int MIN_BLOCKS_TO_KEEP = 288;
 /** Minimum blocks required to signal NODE_NETWORK_LIMITED */
@@ -308,11 +331,58 @@ void PruneOneBlockFile(const int fileNumber);
  */
 void PruneOneBlockFile(const int fileNumber);
 
+/**
+ *  Mark the undo data of one block file as pruned.
+ */
+void PruneOneUndoFile(const int fileNumber);
+
+/**
+ *  Choose the files automatic pruning deletes to bring the block and undo
+ *  files described by vinfo below nTarget bytes, and their undo data below
+ *  nUndoTarget unless it is 0. Only files before nLastFile, whose blocks are
+ *  all at or below nLastBlockWeCanPrune and older than nKeepAfterTime, are
+ *  chosen, oldest first. Undo files chosen to meet nUndoTarget end up in
+ *  setUndoFilesToPrune, block files, with their undo files, in setFilesToPrune.
+ */
+void SelectFilesToPrune(const std::vector<CBlockFileInfo>& vinfo, int nLastFile, unsigned int nLastBlockWeCanPrune, int64_t nKeepAfterTime,
+                        uint64_t nTarget, uint64_t nUndoTarget, std::set<int>& setFilesToPrune, std::set<int>& setUndoFilesToPrune);
+
+/**
+ *  Delete the files of pruned block files before nLastFile that are still on
+ *  disk, because the node stopped before the background thread got to them.
+ *  Pruning is recognized from the file info alone: PruneOneBlockFile clears
+ *  it, leaving nSize 0, and PruneOneUndoFile sets nUndoSize to 0. No other
+ *  file before the last one is ever empty, as blocks only go to a new file
+ *  once the one before it is full. Files that the block index still refers
+ *  to are kept all the same.
+ */
+void RemoveLeftoverPrunedFiles(const std::vector<CBlockFileInfo>& vinfo, int nLastFile) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 /**
  *  Actually unlink the specified files
  */
 void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune);
 
+/** Progress of the background removal of pruned files */
+struct PruneProgress
+{
+    uint64_t nPendingFiles = 0;  //!< Files waiting to be deleted
+    uint64_t nRemovedFiles = 0;  //!< Files deleted since startup
+    uint64_t nRemovedBytes = 0;  //!< Bytes freed since startup
+};
+
+/**
+ *  Unlink the specified files on the background pruning thread, only the
+ *  undo files if fUndoOnly is set
+ */
+void RemovePrunedFilesInBackground(const std::set<int>& setFiles, bool fUndoOnly);
+/** Wait for the background pruning thread to delete all files handed to it */
+void WaitForPrunedFileRemoval();
+/** Wait for the background pruning thread to delete all files handed to it, and stop it */
+void StopPrunedFileRemoval();
+/** Get the progress of the background pruning thread */
+PruneProgress GetPruneProgress();
+
 /** Flush all state, indexes and buffers to disk. */
 void FlushStateToDisk();
 /** Prune block files and flush state to disk. */
@@ -326,6 +396,16 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
                         bool* pfMissingInputs, std::list<CTransactionRef>* plTxnReplaced,
                         bool bypass_limits, const CAmount nAbsurdFee);
 
+/** (try to) add a package of transactions to memory pool together.
+ * The package is sorted with parents before children, and every transaction
+ * in it is an ancestor of the last one. Transactions already in the mempool
+ * are skipped; the others go through all the checks of a single transaction,
+ * except that parents only need to pay the minimum fees at the fee rate of
+ * the package, so a child can pay for a parent that is rejected on its own.
+ * Packages may not replace mempool transactions. **/
+bool AcceptPackageToMemoryPool(CTxMemPool& pool, CValidationState &state, const std::vector<CTransactionRef>& package,
+                               bool* pfMissingInputs, const CAmount nAbsurdFee);
+
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
 
@@ -414,6 +494,16 @@ void InitScriptExecutionCache();
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
 bool ReadBlockHeaderFromDisk(CBlockHeader& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CBlockIndex* pindex);
+/** Append the undo data of a block to the undo buffer, setting pos to where it
+ *  will be in its rev?????.dat file. The buffer is written out first if pos is
+ *  not where it ends, and once it holds MAX_UNDO_BUFFER_SIZE bytes. */
+bool UndoWriteToDisk(const CBlockUndo& blockundo, int nHeight, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart, bool fCompact) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+/** Write the undo buffer to disk, syncing the file if fCommit. */
+bool WriteUndoBuffer(bool fCommit) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+/** Read the serialized block at pos without deserializing it. */
+bool ReadRawBlockFromDisk(RawBlock& block, const CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& message_start);
+bool ReadRawBlockFromDisk(RawBlock& block, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& message_start);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -512,4 +602,11 @@ bool DumpMempool();
 /** Load the mempool from disk. */
 bool LoadMempool();
 
+/** Dump the signature and script execution caches to disk. */
+bool DumpScriptCaches();
+
+/** Load the signature and script execution caches from disk. Must be called
+ *  before any script is checked. */
+bool LoadScriptCaches();
+
 #endif // BITCOIN_VALIDATION_H
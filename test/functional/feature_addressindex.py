@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+# Copyright (c) 2019 The Quebecoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the address index and its RPCs.
+
+Balances, unspent outputs and transaction ids are looked up for addresses
+paid to and spent from, in the order they were confirmed, also within a
+block. The index follows a reorg, persists across a restart and catches up
+with blocks connected while it was disabled."""
+
+from test_framework.address import script_to_p2sh
+from test_framework.authproxy import JSONRPCException
+from test_framework.messages import COIN, COutPoint, CTransaction, CTxIn, CTxOut, ToHex
+from test_framework.script import CScript, OP_2, OP_3, OP_DROP, OP_EQUAL, OP_HASH160, OP_TRUE, hash160
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, assert_raises_rpc_error, wait_until
+
+MINER_SCRIPT = CScript([OP_TRUE])
+X_SCRIPT = CScript([OP_2, OP_DROP, OP_TRUE])
+Y_SCRIPT = CScript([OP_3, OP_DROP, OP_TRUE])
+FEE = 10000
+
+def p2sh(redeem_script):
+    return CScript([OP_HASH160, hash160(redeem_script), OP_EQUAL])
+
+def spend(prevouts, outputs):
+    """Spend (outpoint, redeem script) pairs to (redeem script, value) pairs"""
+    tx = CTransaction()
+    for outpoint, redeem_script in prevouts:
+        tx.vin.append(CTxIn(outpoint, CScript([redeem_script])))
+    for redeem_script, value in outputs:
+        tx.vout.append(CTxOut(value, p2sh(redeem_script)))
+    tx.rehash()
+    return tx
+
+def key_order(tx):
+    """The order the index used to keep transactions of a block in"""
+    return bytes.fromhex(tx.hash)[::-1]
+
+class AddressIndexTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+        self.extra_args = [["-addressindex"]]
+
+    def wait_for_index(self):
+        def synced():
+            try:
+                self.nodes[0].getaddressbalance([script_to_p2sh(MINER_SCRIPT)])
+                return True
+            except JSONRPCException as e:
+                assert "still being built" in e.error['message']
+                return False
+        wait_until(synced)
+
+    def txids(self, addresses, *heights):
+        return self.nodes[0].getaddresstxids(addresses, *heights)
+
+    def utxos(self, addresses):
+        return [(u['txid'], u['vout'], u['address']) for u in self.nodes[0].getaddressutxos(addresses)]
+
+    def check_balance(self, address, balance, received):
+        result = self.nodes[0].getaddressbalance([address])
+        assert_equal(result['balance'] * COIN, balance)
+        assert_equal(result['received'] * COIN, received)
+
+    def run_test(self):
+        node = self.nodes[0]
+        miner = script_to_p2sh(MINER_SCRIPT)
+        x = script_to_p2sh(X_SCRIPT)
+        y = script_to_p2sh(Y_SCRIPT)
+
+        coinbase = node.getblock(node.generatetoaddress(1, miner)[0])['tx'][0]
+        node.generatetoaddress(100, miner)
+        value = int(node.gettxout(coinbase, 0)['value'] * COIN)
+
+        self.log.info("Outputs paying to an address are indexed")
+        fund = spend([(COutPoint(int(coinbase, 16), 0), MINER_SCRIPT)],
+                     [(X_SCRIPT, 10 * COIN), (Y_SCRIPT, 5 * COIN), (MINER_SCRIPT, value - 15 * COIN - FEE)])
+        node.sendrawtransaction(ToHex(fund))
+        node.generatetoaddress(1, miner)
+        fund_height = node.getblockcount()
+        self.check_balance(x, 10 * COIN, 10 * COIN)
+        assert_equal(self.utxos([x]), [(fund.hash, 0, x)])
+        assert_equal(node.getaddressutxos([x])[0]['height'], fund_height)
+        assert_equal(self.txids([x]), [fund.hash])
+        assert_equal(self.txids([x, y]), [fund.hash])
+
+        self.log.info("Transactions of a block are listed in the order they were confirmed")
+        parent = spend([(COutPoint(fund.sha256, 0), X_SCRIPT)],
+                       [(X_SCRIPT, 4 * COIN), (X_SCRIPT, 6 * COIN - FEE)])
+        # Have the child sort first by txid, which the order must not follow
+        fee = FEE
+        while True:
+            child = spend([(COutPoint(parent.sha256, 0), X_SCRIPT)], [(Y_SCRIPT, 4 * COIN - fee)])
+            if key_order(child) < key_order(parent):
+                break
+            fee += 1
+        node.sendrawtransaction(ToHex(parent))
+        node.sendrawtransaction(ToHex(child))
+        block = node.generatetoaddress(1, miner)[0]
+        height = node.getblockcount()
+        assert_equal(node.getblock(block)['tx'][1:], [parent.hash, child.hash])
+
+        def check_after_block():
+            assert_equal(self.txids([x]), [fund.hash, parent.hash, child.hash])
+            assert_equal(self.txids([y]), [fund.hash, child.hash])
+            assert_equal(self.txids([y, x], height, height), [parent.hash, child.hash])
+            assert_equal(self.txids([x], fund_height, fund_height), [fund.hash])
+            assert_equal(self.utxos([y, x]), [(fund.hash, 1, y), (parent.hash, 1, x), (child.hash, 0, y)])
+            self.check_balance(x, 6 * COIN - FEE, 20 * COIN - FEE)
+            self.check_balance(y, 9 * COIN - fee, 9 * COIN - fee)
+        check_after_block()
+
+        self.log.info("Invalid height ranges are rejected")
+        assert_raises_rpc_error(-8, "Invalid height range", self.txids, [x], height, fund_height)
+        assert_raises_rpc_error(-8, "Invalid height range", self.txids, [x], -1)
+
+        self.log.info("A disconnected block is taken out of the index")
+        node.invalidateblock(block)
+        assert_equal(self.txids([x]), [fund.hash])
+        assert_equal(self.txids([y]), [fund.hash])
+        assert_equal(self.utxos([y, x]), [(fund.hash, 0, x), (fund.hash, 1, y)])
+        self.check_balance(x, 10 * COIN, 10 * COIN)
+        self.check_balance(y, 5 * COIN, 5 * COIN)
+        node.reconsiderblock(block)
+        check_after_block()
+
+        self.log.info("The index persists across a restart")
+        self.restart_node(0)
+        self.wait_for_index()
+        check_after_block()
+
+        self.log.info("The index catches up with blocks connected while it was disabled")
+        self.restart_node(0, extra_args=[])
+        assert_raises_rpc_error(-1, "Address index not enabled", self.txids, [x])
+        late = spend([(COutPoint(parent.sha256, 1), X_SCRIPT)], [(Y_SCRIPT, 6 * COIN - 2 * FEE)])
+        node.sendrawtransaction(ToHex(late))
+        node.generatetoaddress(1, miner)
+        self.restart_node(0)
+        self.wait_for_index()
+        assert_equal(self.txids([x]), [fund.hash, parent.hash, child.hash, late.hash])
+        assert_equal(self.utxos([x]), [])
+        self.check_balance(x, 0, 20 * COIN - FEE)
+        self.check_balance(y, 15 * COIN - fee - 2 * FEE, 15 * COIN - fee - 2 * FEE)
+
+if __name__ == '__main__':
+    AddressIndexTest().main()
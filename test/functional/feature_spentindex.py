@@ -0,0 +1,116 @@
+#!/usr/bin/env python3
+# Copyright (c) 2019 The Quebecoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the spent index through gettxspendingprevout.
+
+Spends are found in the mempool and, with -spentindex, in the active chain.
+Unspent outputs have no spender. The index follows a reorg and catches up
+with blocks connected while it was disabled."""
+
+from test_framework.address import script_to_p2sh
+from test_framework.authproxy import JSONRPCException
+from test_framework.messages import COIN, COutPoint, CTransaction, CTxIn, CTxOut, ToHex
+from test_framework.script import CScript, OP_EQUAL, OP_HASH160, OP_TRUE, hash160
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, assert_raises_rpc_error, wait_until
+
+REDEEM_SCRIPT = CScript([OP_TRUE])
+P2SH_SCRIPT = CScript([OP_HASH160, hash160(REDEEM_SCRIPT), OP_EQUAL])
+FEE = 10000
+
+def spend(outpoint, value, num_outputs=1):
+    tx = CTransaction()
+    tx.vin.append(CTxIn(outpoint, CScript([REDEEM_SCRIPT])))
+    for _ in range(num_outputs):
+        tx.vout.append(CTxOut((value - FEE) // num_outputs, P2SH_SCRIPT))
+    tx.rehash()
+    return tx
+
+class SpentIndexTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+        self.extra_args = [["-spentindex"]]
+
+    def lookup(self, tx, n):
+        return self.nodes[0].gettxspendingprevout([{"txid": tx.hash, "vout": n}])[0]
+
+    def check_unspent(self, tx, n):
+        assert_equal(self.lookup(tx, n), {"txid": tx.hash, "vout": n})
+
+    def check_spent_in_mempool(self, tx, n, spender):
+        assert_equal(self.lookup(tx, n), {"txid": tx.hash, "vout": n, "spendingtxid": spender.hash, "spendingvin": 0})
+
+    def check_spent_in_block(self, tx, n, spender, height):
+        result = self.lookup(tx, n)
+        assert_equal(result["spendingtxid"], spender.hash)
+        assert_equal(result["spendingvin"], 0)
+        assert_equal(result["blockheight"], height)
+        assert_equal(result["value"] * COIN, tx.vout[n].nValue)
+
+    def restart_with_index(self):
+        self.restart_node(0, extra_args=["-spentindex", "-persistmempool=0"])
+
+        def synced():
+            try:
+                self.nodes[0].gettxspendingprevout([{"txid": "00" * 32, "vout": 0}])
+                return True
+            except JSONRPCException as e:
+                assert "still being built" in e.error['message']
+                return False
+        wait_until(synced)
+
+    def run_test(self):
+        node = self.nodes[0]
+        address = script_to_p2sh(REDEEM_SCRIPT)
+        coinbase = node.getblock(node.generatetoaddress(1, address)[0])['tx'][0]
+        node.generatetoaddress(100, address)
+        value = int(node.gettxout(coinbase, 0)['value'] * COIN)
+        fund = spend(COutPoint(int(coinbase, 16), 0), value, 2)
+        node.sendrawtransaction(ToHex(fund))
+        node.generatetoaddress(1, address)
+
+        self.log.info("Unspent outputs have no spender")
+        self.check_unspent(fund, 0)
+        self.check_unspent(fund, 1)
+        assert_raises_rpc_error(-8, "vout must be positive", node.gettxspendingprevout, [{"txid": fund.hash, "vout": -1}])
+        assert_raises_rpc_error(-8, "outputs are missing", node.gettxspendingprevout, [])
+
+        self.log.info("Spends are found in the mempool, then in the chain")
+        spender = spend(COutPoint(fund.sha256, 0), fund.vout[0].nValue)
+        node.sendrawtransaction(ToHex(spender))
+        self.check_spent_in_mempool(fund, 0, spender)
+        block = node.generatetoaddress(1, address)[0]
+        height = node.getblockcount()
+        self.check_spent_in_block(fund, 0, spender, height)
+        self.check_unspent(fund, 1)
+
+        self.log.info("A disconnected spend is taken out of the index")
+        node.invalidateblock(block)
+        self.check_spent_in_mempool(fund, 0, spender)
+        # Without the mempool, only the index could tell of the spend
+        self.restart_with_index()
+        assert_equal(node.getrawmempool(), [])
+        self.check_unspent(fund, 0)
+
+        self.log.info("The spend in the new chain is found instead")
+        other_spender = spend(COutPoint(fund.sha256, 0), fund.vout[0].nValue - FEE)
+        node.sendrawtransaction(ToHex(other_spender))
+        node.generatetoaddress(1, address)
+        assert_equal(node.getblockcount(), height)
+        self.check_spent_in_block(fund, 0, other_spender, height)
+
+        self.log.info("The index catches up with blocks connected while it was disabled")
+        self.restart_node(0, extra_args=["-persistmempool=0"])
+        late_spender = spend(COutPoint(fund.sha256, 1), fund.vout[1].nValue)
+        node.sendrawtransaction(ToHex(late_spender))
+        node.generatetoaddress(2, address)
+        # Confirmed spends are not found without the index
+        self.check_unspent(fund, 1)
+        self.restart_with_index()
+        self.check_spent_in_block(fund, 1, late_spender, height + 1)
+        self.check_spent_in_block(fund, 0, other_spender, height)
+
+if __name__ == '__main__':
+    SpentIndexTest().main()
@@ -0,0 +1,191 @@
+#!/usr/bin/env python3
+# Copyright (c) 2019 The Quebecoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test serving BIP 157 compact block filters to peers and over REST.
+
+Filters, filter headers and checkpoints are served to peers with
+-peerblockfilters, also for a stale block, and bad requests get the peer
+disconnected. The REST interface serves the same filters and headers."""
+
+import http.client
+import urllib.parse
+
+from test_framework.address import script_to_p2sh
+from test_framework.authproxy import JSONRPCException
+from test_framework.messages import (
+    NODE_COMPACT_FILTERS,
+    hash256,
+    msg_getcfcheckpt,
+    msg_getcfheaders,
+    msg_getcfilters,
+    ser_string,
+    ser_uint256,
+    uint256_from_str,
+)
+from test_framework.mininode import P2PInterface
+from test_framework.script import CScript, OP_TRUE
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, connect_nodes, disconnect_nodes, sync_blocks, wait_until
+
+BASIC_FILTER = 0
+CFCHECKPT_INTERVAL = 1000
+
+class CFiltersClient(P2PInterface):
+    def __init__(self):
+        super().__init__()
+        # Received cfilter messages, in order
+        self.cfilters = []
+
+    def pop_cfilters(self):
+        cfilters = self.cfilters
+        self.cfilters = []
+        return cfilters
+
+    def on_cfilter(self, message):
+        self.cfilters.append(message)
+
+class CompactFiltersTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+        self.extra_args = [
+            ["-blockfilterindex", "-peerblockfilters", "-rest"],
+            ["-blockfilterindex"],
+        ]
+
+    def filter_of(self, node, block_hash):
+        return node.getblockfilter(block_hash, "basic")
+
+    def index_synced(self, node):
+        try:
+            self.filter_of(node, node.getbestblockhash())
+            return True
+        except JSONRPCException:
+            return False
+
+    def rest_get(self, path):
+        url = urllib.parse.urlparse(self.nodes[0].url)
+        conn = http.client.HTTPConnection(url.hostname, url.port)
+        conn.request('GET', path)
+        response = conn.getresponse()
+        return response.status, response.read()
+
+    def run_test(self):
+        address = script_to_p2sh(CScript([OP_TRUE]))
+
+        # Mine a stale block on node 0, which then reorgs to the longer
+        # chain mined by node 1
+        disconnect_nodes(self.nodes[0], 1)
+        stale_block_hash = self.nodes[0].generatetoaddress(1, address)[0]
+        self.nodes[1].generatetoaddress(CFCHECKPT_INTERVAL + 1, address)
+        connect_nodes(self.nodes[0], 1)
+        sync_blocks(self.nodes)
+        assert_equal(self.nodes[0].getblockheader(stale_block_hash)['confirmations'], -1)
+        wait_until(lambda: self.index_synced(self.nodes[0]))
+
+        self.log.info("Only the node with -peerblockfilters signals NODE_COMPACT_FILTERS")
+        assert int(self.nodes[0].getnetworkinfo()['localservices'], 16) & NODE_COMPACT_FILTERS
+        assert not int(self.nodes[1].getnetworkinfo()['localservices'], 16) & NODE_COMPACT_FILTERS
+
+        node0 = self.nodes[0].add_p2p_connection(CFiltersClient())
+        node0.wait_for_verack()
+
+        tip_hash = self.nodes[0].getbestblockhash()
+        tip_height = self.nodes[0].getblockcount()
+        stop_hash = int(tip_hash, 16)
+
+        self.log.info("getcfcheckpt returns the headers at each checkpoint")
+        node0.send_and_ping(msg_getcfcheckpt(filter_type=BASIC_FILTER, stop_hash=stop_hash))
+        response = node0.last_message['cfcheckpt']
+        assert_equal(response.filter_type, BASIC_FILTER)
+        assert_equal(response.stop_hash, stop_hash)
+        checkpoint_hash = self.nodes[0].getblockhash(CFCHECKPT_INTERVAL)
+        assert_equal(response.headers, [int(self.filter_of(self.nodes[0], checkpoint_hash)['header'], 16)])
+
+        self.log.info("getcfheaders returns filter hashes that chain up to the filter headers")
+        node0.send_and_ping(msg_getcfheaders(filter_type=BASIC_FILTER, start_height=1, stop_hash=stop_hash))
+        response = node0.last_message['cfheaders']
+        assert_equal(response.filter_type, BASIC_FILTER)
+        assert_equal(response.stop_hash, stop_hash)
+        assert_equal(len(response.hashes), tip_height)
+        genesis_filter = self.filter_of(self.nodes[0], self.nodes[0].getblockhash(0))
+        assert_equal(response.prev_header, int(genesis_filter['header'], 16))
+        header = ser_uint256(response.prev_header)
+        for filter_hash in response.hashes:
+            header = hash256(ser_uint256(filter_hash) + header)
+        assert_equal(uint256_from_str(header), int(self.filter_of(self.nodes[0], tip_hash)['header'], 16))
+
+        self.log.info("getcfilters returns the filters of the range")
+        start_height = tip_height - 9
+        node0.send_and_ping(msg_getcfilters(filter_type=BASIC_FILTER, start_height=start_height, stop_hash=stop_hash))
+        cfilters = node0.pop_cfilters()
+        assert_equal(len(cfilters), 10)
+        for height, cfilter in enumerate(cfilters, start_height):
+            block_hash = self.nodes[0].getblockhash(height)
+            assert_equal(cfilter.filter_type, BASIC_FILTER)
+            assert_equal(cfilter.block_hash, int(block_hash, 16))
+            assert_equal(cfilter.filter_data, bytes.fromhex(self.filter_of(self.nodes[0], block_hash)['filter']))
+
+        self.log.info("Filters of a stale block are served too")
+        stale_filter = self.filter_of(self.nodes[0], stale_block_hash)
+        node0.send_and_ping(msg_getcfilters(filter_type=BASIC_FILTER, start_height=1, stop_hash=int(stale_block_hash, 16)))
+        cfilters = node0.pop_cfilters()
+        assert_equal(len(cfilters), 1)
+        assert_equal(cfilters[0].block_hash, int(stale_block_hash, 16))
+        assert_equal(cfilters[0].filter_data, bytes.fromhex(stale_filter['filter']))
+        node0.send_and_ping(msg_getcfheaders(filter_type=BASIC_FILTER, start_height=1, stop_hash=int(stale_block_hash, 16)))
+        response = node0.last_message['cfheaders']
+        assert_equal(response.hashes, [uint256_from_str(hash256(bytes.fromhex(stale_filter['filter'])))])
+
+        self.log.info("Bad requests get the peer disconnected")
+        requests = [
+            # Unknown filter type
+            msg_getcfilters(filter_type=255, start_height=1, stop_hash=stop_hash),
+            # Start height above the stop block
+            msg_getcfheaders(filter_type=BASIC_FILTER, start_height=tip_height + 1, stop_hash=stop_hash),
+            # More filters than may be asked for at once
+            msg_getcfilters(filter_type=BASIC_FILTER, start_height=0, stop_hash=stop_hash),
+            # Unknown stop block
+            msg_getcfcheckpt(filter_type=BASIC_FILTER, stop_hash=123456789),
+        ]
+        for request in requests:
+            peer = self.nodes[0].add_p2p_connection(P2PInterface())
+            peer.wait_for_verack()
+            peer.send_message(request)
+            peer.wait_for_disconnect()
+            self.nodes[0].disconnect_p2ps()
+
+        self.log.info("A node without -peerblockfilters does not serve filters")
+        node1 = self.nodes[1].add_p2p_connection(P2PInterface())
+        node1.wait_for_verack()
+        node1.send_message(msg_getcfilters(filter_type=BASIC_FILTER, start_height=1, stop_hash=stop_hash))
+        node1.wait_for_disconnect()
+
+        self.log.info("REST serves the same filters and headers")
+        tip_filter = self.filter_of(self.nodes[0], tip_hash)
+        status, body = self.rest_get("/rest/blockfilter/basic/%s.json" % tip_hash)
+        assert_equal(status, 200)
+        assert_equal(body.decode().strip(), '{"filter":"%s"}' % tip_filter['filter'])
+        status, body = self.rest_get("/rest/blockfilter/basic/%s.hex" % tip_hash)
+        assert_equal(status, 200)
+        assert_equal(bytes.fromhex(body.decode().strip()),
+                     bytes([BASIC_FILTER]) + ser_uint256(int(tip_hash, 16)) + ser_string(bytes.fromhex(tip_filter['filter'])))
+
+        first_height = tip_height - 4
+        status, body = self.rest_get("/rest/blockfilterheaders/basic/5/%s.json" % self.nodes[0].getblockhash(first_height))
+        assert_equal(status, 200)
+        expected = [self.filter_of(self.nodes[0], self.nodes[0].getblockhash(h))['header'] for h in range(first_height, tip_height + 1)]
+        assert_equal(body.decode().strip(), '[%s]' % ','.join('"%s"' % h for h in expected))
+
+        for path in ["/rest/blockfilter/unknown/%s.json" % tip_hash,
+                     "/rest/blockfilter/basic/%s.json" % ("00" * 31),
+                     "/rest/blockfilterheaders/basic/0/%s.json" % tip_hash,
+                     "/rest/blockfilterheaders/basic/2001/%s.json" % tip_hash]:
+            status, _ = self.rest_get(path)
+            assert_equal(status, 400)
+        status, _ = self.rest_get("/rest/blockfilter/basic/%s.json" % ("00" * 32))
+        assert_equal(status, 404)
+
+if __name__ == '__main__':
+    CompactFiltersTest().main()
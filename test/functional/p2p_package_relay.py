@@ -0,0 +1,143 @@
+#!/usr/bin/env python3
+# Copyright (c) 2019 The Quebecoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test package relay through getpkgtxns and pkgtxns.
+
+A node with -packagerelay asks a peer for the package of a transaction whose
+parent it rejected for its fee, accepts the package when the child pays for
+the parent, ignores packages it did not ask for and only serves packages of
+transactions the peer knows of. A child has to pay for itself, however much
+its parents pay."""
+
+from test_framework.address import script_to_p2sh
+from test_framework.messages import (
+    COIN,
+    COutPoint,
+    CInv,
+    CTransaction,
+    CTxIn,
+    CTxOut,
+    NODE_NETWORK,
+    NODE_PACKAGE_RELAY,
+    NODE_WITNESS,
+    ToHex,
+    msg_getpkgtxns,
+    msg_inv,
+    msg_pkgtxns,
+    msg_tx,
+)
+from test_framework.mininode import NetworkThread, P2PInterface, mininode_lock
+from test_framework.script import CScript, OP_EQUAL, OP_HASH160, OP_TRUE, hash160
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, assert_raises_rpc_error, wait_until
+
+REDEEM_SCRIPT = CScript([OP_TRUE])
+P2SH_SCRIPT = CScript([OP_HASH160, hash160(REDEEM_SCRIPT), OP_EQUAL])
+HIGH_FEE = 100000
+NUM_OUTPUTS = 10
+
+class PackageRelayTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+        self.extra_args = [["-packagerelay"]]
+
+    def spend(self, outpoint, value, fee, num_outputs=1):
+        tx = CTransaction()
+        tx.vin.append(CTxIn(outpoint, CScript([REDEEM_SCRIPT])))
+        for _ in range(num_outputs):
+            tx.vout.append(CTxOut((value - fee) // num_outputs, P2SH_SCRIPT))
+        tx.rehash()
+        return tx
+
+    def spend_output(self, fee):
+        """Spend one of the confirmed outputs that anyone can spend"""
+        outpoint, value = self.utxos.pop()
+        return self.spend(outpoint, value, fee)
+
+    def spend_tx(self, parent, fee):
+        return self.spend(COutPoint(parent.sha256, 0), parent.vout[0].nValue, fee)
+
+    def in_mempool(self, tx):
+        return tx.hash in self.nodes[0].getrawmempool()
+
+    def run_test(self):
+        node = self.nodes[0]
+        address = script_to_p2sh(REDEEM_SCRIPT)
+        coinbase = node.getblock(node.generatetoaddress(1, address)[0])['tx'][0]
+        node.generatetoaddress(100, address)
+        value = int(node.gettxout(coinbase, 0)['value'] * COIN)
+        split = self.spend(COutPoint(int(coinbase, 16), 0), value, HIGH_FEE, NUM_OUTPUTS)
+        node.sendrawtransaction(ToHex(split))
+        node.generatetoaddress(1, address)
+        self.utxos = [(COutPoint(split.sha256, i), out.nValue) for i, out in enumerate(split.vout)]
+
+        peer = node.add_p2p_connection(P2PInterface(), services=NODE_NETWORK | NODE_WITNESS | NODE_PACKAGE_RELAY)
+        NetworkThread().start()
+        peer.wait_for_verack()
+
+        self.log.info("A transaction whose parent was rejected for its fee is asked for with its parent")
+        parent = self.spend_output(0)
+        child = self.spend_tx(parent, HIGH_FEE)
+        peer.send_and_ping(msg_tx(parent))
+        assert not self.in_mempool(parent)
+        peer.send_message(msg_tx(child))
+        wait_until(lambda: "getpkgtxns" in peer.last_message, lock=mininode_lock)
+        with mininode_lock:
+            assert_equal(peer.last_message["getpkgtxns"].txid, child.sha256)
+
+        self.log.info("Announcing it again does not lead to another request")
+        peer.send_and_ping(msg_inv([CInv(1, child.sha256)]))
+        peer.send_and_ping(msg_tx(child))
+        with mininode_lock:
+            assert_equal(peer.message_count["getpkgtxns"], 1)
+            assert "getdata" not in peer.last_message
+
+        self.log.info("The child pays for its parent")
+        peer.send_and_ping(msg_pkgtxns([parent, child]))
+        assert self.in_mempool(parent)
+        assert self.in_mempool(child)
+
+        self.log.info("getpkgtxns is answered with the transaction and its ancestors, parents first")
+        peer.send_message(msg_getpkgtxns(child.sha256))
+        wait_until(lambda: "pkgtxns" in peer.last_message, lock=mininode_lock)
+        with mininode_lock:
+            txs = peer.last_message["pkgtxns"].txs
+            for tx in txs:
+                tx.rehash()
+            assert_equal([tx.hash for tx in txs], [parent.hash, child.hash])
+
+        self.log.info("getpkgtxns for a transaction the peer does not know of is answered with notfound")
+        unknown = self.spend_tx(child, HIGH_FEE)
+        peer.send_message(msg_getpkgtxns(unknown.sha256))
+        wait_until(lambda: "notfound" in peer.last_message, lock=mininode_lock)
+        with mininode_lock:
+            assert_equal(peer.last_message["notfound"].inv[0].hash, unknown.sha256)
+            assert_equal(peer.message_count["pkgtxns"], 1)
+
+        self.log.info("Packages that were not asked for are ignored")
+        parent = self.spend_output(0)
+        child = self.spend_tx(parent, HIGH_FEE)
+        peer.send_and_ping(msg_pkgtxns([parent, child]))
+        assert not self.in_mempool(parent)
+        assert not self.in_mempool(child)
+        # The same package is fine when submitted
+        node.submitpackage([ToHex(parent), ToHex(child)])
+        assert self.in_mempool(child)
+
+        self.log.info("A parent cannot pay for a child that pays nothing")
+        rich_parent = self.spend_output(HIGH_FEE)
+        free_child = self.spend_tx(rich_parent, 0)
+        assert_raises_rpc_error(-26, "min relay fee not met", node.submitpackage, [ToHex(rich_parent), ToHex(free_child)])
+        assert not self.in_mempool(rich_parent)
+        assert not self.in_mempool(free_child)
+
+        self.log.info("Nor can a child that pays too little make up for its parent")
+        parent = self.spend_output(0)
+        cheap_child = self.spend_tx(parent, 50)
+        assert_raises_rpc_error(-26, "min relay fee not met", node.submitpackage, [ToHex(parent), ToHex(cheap_child)])
+        assert not self.in_mempool(parent)
+
+if __name__ == '__main__':
+    PackageRelayTest().main()
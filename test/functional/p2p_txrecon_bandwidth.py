@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+# Copyright (c) 2019 The Quebecoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Measure the bytes spent announcing each relayed transaction.
+
+Relays the same transactions through fully connected networks of nodes of
+growing size, once flooding them with inv messages and once announcing them
+through set reconciliation (-txreconciliation), and reports the bytes of
+inv and reconciliation messages sent per transaction in each case."""
+
+from test_framework.address import script_to_p2sh
+from test_framework.messages import COIN, COutPoint, CTransaction, CTxIn, CTxOut, ToHex
+from test_framework.script import CScript, OP_TRUE, hash160, OP_HASH160, OP_EQUAL
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, assert_greater_than, connect_nodes, sync_blocks, sync_mempools
+
+NUM_TXS = 100
+PEER_COUNTS = [1, 3, 5, 7]
+ANNOUNCE_MSGS = ['inv', 'sendtxrcncl', 'reqrecon', 'sketch', 'reconcildiff']
+RECON_MSGS = ['sendtxrcncl', 'reqrecon', 'sketch', 'reconcildiff']
+
+REDEEM_SCRIPT = CScript([OP_TRUE])
+P2SH_SCRIPT = CScript([OP_HASH160, hash160(REDEEM_SCRIPT), OP_EQUAL])
+
+class TxReconciliationBandwidthTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = max(PEER_COUNTS) + 1
+        self.setup_clean_chain = True
+        self.extra_args = [["-persistmempool=0"]] * self.num_nodes
+
+    def setup_network(self):
+        # The networks are set up for each measurement
+        self.setup_nodes()
+
+    def spend(self, outpoint, value, num_outputs):
+        tx = CTransaction()
+        tx.vin.append(CTxIn(outpoint, CScript([REDEEM_SCRIPT])))
+        for _ in range(num_outputs):
+            tx.vout.append(CTxOut(value // num_outputs, P2SH_SCRIPT))
+        tx.rehash()
+        return tx
+
+    def create_transactions(self):
+        """Mine a coin that anyone can spend, split it and return transactions
+        spending each part, which stay valid as long as the mempool is not
+        persisted."""
+        node = self.nodes[0]
+        address = script_to_p2sh(REDEEM_SCRIPT)
+        coinbase = node.getblock(node.generatetoaddress(1, address)[0])['tx'][0]
+        node.generatetoaddress(100, address)
+        value = int(node.gettxout(coinbase, 0)['value'] * COIN)
+
+        split = self.spend(COutPoint(int(coinbase, 16), 0), value - 100000, NUM_TXS)
+        node.sendrawtransaction(ToHex(split))
+        node.generatetoaddress(1, address)
+        return [self.spend(COutPoint(split.sha256, i), split.vout[i].nValue - 10000, 1) for i in range(NUM_TXS)]
+
+    def bytes_sent(self, nodes, msgs):
+        return sum(peer['bytessent_per_msg'].get(msg, 0) for node in nodes for peer in node.getpeerinfo() for msg in msgs)
+
+    def measure(self, txs, num_peers, reconcile):
+        num_nodes = num_peers + 1
+        for i in range(num_nodes):
+            self.start_node(i, ["-persistmempool=0", "-txreconciliation=%d" % reconcile])
+        nodes = self.nodes[:num_nodes]
+        # Every node connects to the nodes before it
+        for i in range(num_nodes):
+            for j in range(i):
+                connect_nodes(nodes[i], j)
+        sync_blocks(nodes)
+        for node in nodes:
+            assert_equal(len(node.getpeerinfo()), num_peers)
+
+        announce_before = self.bytes_sent(nodes, ANNOUNCE_MSGS)
+        for i, tx in enumerate(txs):
+            nodes[i % num_nodes].sendrawtransaction(ToHex(tx))
+        sync_mempools(nodes, timeout=120)
+        for node in nodes:
+            assert_equal(node.getmempoolinfo()['size'], len(txs))
+
+        bytes_per_tx = (self.bytes_sent(nodes, ANNOUNCE_MSGS) - announce_before) / (len(txs) * num_nodes)
+        recon_bytes = self.bytes_sent(nodes, RECON_MSGS)
+        for i in range(num_nodes):
+            self.stop_node(i)
+        return bytes_per_tx, recon_bytes
+
+    def run_test(self):
+        txs = self.create_transactions()
+        self.stop_nodes()
+
+        self.log.info("Announcement bytes sent per transaction and node:")
+        self.log.info("peers     flooding   reconciliation")
+        results = {}
+        for num_peers in PEER_COUNTS:
+            flood, flood_recon_bytes = self.measure(txs, num_peers, False)
+            recon, recon_bytes = self.measure(txs, num_peers, True)
+            results[num_peers] = (flood, recon)
+            self.log.info("%5d %12.1f %16.1f" % (num_peers, flood, recon))
+
+            # Nodes only reconcile when they are told to
+            assert_equal(flood_recon_bytes, 0)
+            assert_greater_than(recon_bytes, 0)
+
+        # Flooding grows with the number of peers; reconciliation takes over
+        # once there are more outbound peers than those flooded to
+        flood, recon = results[max(PEER_COUNTS)]
+        assert_greater_than(flood, recon)
+
+        for i in range(self.num_nodes):
+            self.start_node(i)
+
+if __name__ == '__main__':
+    TxReconciliationBandwidthTest().main()
@@ -80,6 +80,8 @@ BASE_SCRIPTS= [
     'rpc_rawtransaction.py',
     'wallet_address_types.py',
     'feature_reindex.py',
+    'feature_addressindex.py',
+    'feature_spentindex.py',
     # vv Tests less than 30s vv
     'wallet_keypool_topup.py',
     'interface_zmq.py',
@@ -110,6 +112,8 @@ BASE_SCRIPTS= [
     'mining_prioritisetransaction.py',
     'p2p_invalid_block.py',
     'p2p_invalid_tx.py',
+    'p2p_package_relay.py',
+    'p2p_blockfilters.py',
     'feature_versionbits_warning.py',
     'rpc_preciousblock.py',
     'wallet_importprunedfunds.py',
@@ -152,6 +156,7 @@ EXTENDED_SCRIPTS = [
     'feature_bip68_sequence.py',
     'mining_getblocktemplate_longpoll.py',
     'p2p_timeouts.py',
+    'p2p_txrecon_bandwidth.py',
     # vv Tests less than 60s vv
     'feature_bip9_softforks.py',
     'p2p_feefilter.py',